@@ -34,7 +34,12 @@ extern "C" {
 #define CE_CDB_OBJ_DESTROY_EVENT \
     CE_ID64_0("obj_destroy", 0x5669bedb7db786e4ULL)
 
+// Listener queue overflowed and events was dropped, rescan watched objects.
+#define CE_CDB_RESYNC_EVENT \
+    CE_ID64_0("resync", 0xd09d3b108015fcdfULL)
+
 typedef struct ce_alloc_t0 ce_alloc_t0;
+typedef struct ce_vio_t0 ce_vio_t0;
 
 typedef enum ce_cdb_type_e0 {
     CDB_TYPE_NONE = 0,
@@ -54,7 +59,21 @@ typedef enum ce_cdb_prop_flag_e0 {
     CDB_PROP_FLAG_UNPACK = 1 << 0,
 } ce_cdb_flag_e0;
 
+typedef enum ce_cdb_db_flag_e0 {
+    CDB_DB_FLAG_NONE = 0,
+
+    // Transient db, all object data live in one arena freed by destroy_db.
+    CDB_DB_FLAG_ARENA = 1 << 0,
+
+    // Maintain type -> objects index, see objs_by_type.
+    CDB_DB_FLAG_TYPE_INDEX = 1 << 1,
+
+    // Maintain object -> referrers index, see referrers.
+    CDB_DB_FLAG_REF_INDEX = 1 << 2,
+} ce_cdb_db_flag_e0;
+
 typedef struct ct_cdb_ev_queue_o0 ct_cdb_ev_queue_o0;
+typedef struct ce_cdb_delta_stream_o0 ce_cdb_delta_stream_o0;
 typedef struct ce_cdb_obj_o0 ce_cdb_obj_o0;
 
 typedef struct ce_cdb_t0 {
@@ -102,6 +121,22 @@ typedef struct ce_cdb_prop_ev_t0 {
     };
 } ce_cdb_prop_ev_t0;
 
+typedef struct ce_cdb_listener_stats_t0 {
+    uint64_t pushed;
+    uint64_t dropped;
+    uint64_t overflows;
+    uint64_t queued;
+} ce_cdb_listener_stats_t0;
+
+// Listener get only events of objects with type from types and
+// changes of props from props. Empty list => everything.
+typedef struct ce_cdb_listener_filter_t0 {
+    const uint64_t *types;
+    uint32_t types_n;
+    const uint64_t *props;
+    uint32_t props_n;
+} ce_cdb_listener_filter_t0;
+
 typedef bool (*ct_cdb_obj_loader_t0)(uint64_t uid);
 
 typedef struct ce_cdb_prop_def_t0 {
@@ -117,12 +152,26 @@ typedef struct ce_cdb_type_def_t0 {
     uint32_t num;
 } ce_cdb_type_def_t0;
 
+typedef struct ce_cdb_view_prop_t0 {
+    uint64_t prop;
+    uint32_t offset;
+} ce_cdb_view_prop_t0;
+
+typedef struct ce_cdb_layout_t0 {
+    uint64_t idx;
+} ce_cdb_layout_t0;
+
+typedef struct ce_cdb_snapshot_t0 {
+    uint64_t idx;
+} ce_cdb_snapshot_t0;
+
 struct ce_cdb_a0 {
     void (*set_loader)(ct_cdb_obj_loader_t0 loader);
 
     ce_cdb_t0 (*db)();
 
-    ce_cdb_t0 (*create_db)(uint64_t max_objects);
+    ce_cdb_t0 (*create_db)(uint64_t max_objects,
+                           uint64_t flags);
 
     void (*destroy_db)(ce_cdb_t0 db);
 
@@ -153,6 +202,14 @@ struct ce_cdb_a0 {
     void (*destroy_object)(ce_cdb_t0 db,
                            uint64_t obj);
 
+    // Destroyed object waits for gc, its uid can not be created again yet.
+    bool (*destroy_pending)(ce_cdb_t0 db,
+                            uint64_t obj);
+
+    // Free pending destroyed object now so its uid can be created again.
+    void (*flush_destroy)(ce_cdb_t0 db,
+                          uint64_t obj);
+
     uint64_t (*obj_type)(ce_cdb_t0 db,
                          uint64_t obj);
 
@@ -178,6 +235,70 @@ struct ce_cdb_a0 {
 
     void (*gc)();
 
+    // Limit time of one gc to budget_us, rest of destroyed objects are freed
+    // in next frames. 0 => no limit.
+    void (*set_gc_budget)(uint64_t budget_us);
+
+    // SNAPSHOT
+    // Save point of db in O(1). Object is copied on first change after
+    // snapshot and copy is shared by snapshots until release_snapshot.
+    ce_cdb_snapshot_t0 (*create_snapshot)(ce_cdb_t0 db);
+
+    // Changed objects get state from snapshot, created are destroyed and
+    // destroyed are created again. Prop listeners get resync event.
+    void (*restore_snapshot)(ce_cdb_t0 db,
+                             ce_cdb_snapshot_t0 snapshot);
+
+    void (*release_snapshot)(ce_cdb_t0 db,
+                             ce_cdb_snapshot_t0 snapshot);
+
+    // Objects changed, created or destroyed after snapshot.
+    uint32_t (*snapshot_objs)(ce_cdb_t0 db,
+                              ce_cdb_snapshot_t0 snapshot,
+                              const uint64_t **objs);
+
+    // Object as it was in snapshot, NULL if it did not exist.
+    const ce_cdb_obj_o0 *(*read_snapshot)(ce_cdb_t0 db,
+                                          ce_cdb_snapshot_t0 snapshot,
+                                          uint64_t obj);
+
+    // DELTA
+    // Append own prop changes from -> to as delta record. from == NULL =>
+    // create with all props, to == NULL => destroy.
+    void (*diff)(const ce_cdb_obj_o0 *from,
+                 const ce_cdb_obj_o0 *to,
+                 char **output,
+                 ce_alloc_t0 *allocator);
+
+    // Apply all delta records in input.
+    void (*apply_delta)(ce_cdb_t0 db,
+                        const char *input,
+                        uint64_t size);
+
+    // Every flush write frame (u64 size | delta records) of objects changed
+    // since last flush to vio, reader apply it with apply_delta.
+    ce_cdb_delta_stream_o0 *(*create_delta_stream)(ce_cdb_t0 db,
+                                                   ce_vio_t0 *vio,
+                                                   ce_alloc_t0 *allocator);
+
+    void (*delta_stream_flush)(ce_cdb_delta_stream_o0 *stream);
+
+    void (*destroy_delta_stream)(ce_cdb_delta_stream_o0 *stream);
+
+    // INDEX
+    // Return number of objects with type and copy at most max of them to objs.
+    uint32_t (*objs_by_type)(ce_cdb_t0 db,
+                             uint64_t type,
+                             uint64_t *objs,
+                             uint32_t max);
+
+    // Return number of objects that point to obj by own ref, subobject or
+    // objset and copy at most max of them to objs.
+    uint32_t (*referrers)(ce_cdb_t0 db,
+                          uint64_t obj,
+                          uint64_t *objs,
+                          uint32_t max);
+
     //
 
     void (*dump_str)(ce_cdb_t0 db,
@@ -194,11 +315,25 @@ struct ce_cdb_a0 {
                  char **output,
                  ce_alloc_t0 *allocator);
 
+    // Varint encoded dump with key/string table, load() read both formats.
+    // inline_subobj => subobjects and sets are stored with object.
+    void (*dump_compact)(ce_cdb_t0 db,
+                         uint64_t obj,
+                         char **output,
+                         bool inline_subobj,
+                         ce_alloc_t0 *allocator);
+
     void (*load)(ce_cdb_t0 db,
                  const char *input,
                  uint64_t obj,
                  ce_alloc_t0 *allocator);
 
+    // Load without copy, strings and blobs point into input. Input is not
+    // written, it can be read only mapping that live as long as db.
+    void (*load_mapped)(ce_cdb_t0 db,
+                        const char *input,
+                        uint64_t obj);
+
     uint64_t (*find_root)(ce_cdb_t0 _db,
                           uint64_t obj);
 
@@ -225,6 +360,7 @@ struct ce_cdb_a0 {
                        uint64_t object);
 
     // SET
+    // Writer pin reader epoch until commit, commit it on same thread.
     ce_cdb_obj_o0 *(*write_begin)(ce_cdb_t0 db,
                                   uint64_t object);
 
@@ -284,11 +420,17 @@ struct ce_cdb_a0 {
 
     ct_cdb_ev_queue_o0 *(*new_changed_obj_listener)(ce_cdb_t0 db);
 
+    ct_cdb_ev_queue_o0 *(*new_changed_obj_listener_filter)(ce_cdb_t0 db,
+                                                           const ce_cdb_listener_filter_t0 *filter);
+
     bool (*pop_changed_obj)(ct_cdb_ev_queue_o0 *q,
                             ce_cdb_ev_t0 *ev);
 
     ct_cdb_ev_queue_o0 *(*new_objs_listener)(ce_cdb_t0 db);
 
+    ct_cdb_ev_queue_o0 *(*new_objs_listener_filter)(ce_cdb_t0 db,
+                                                    const ce_cdb_listener_filter_t0 *filter);
+
     bool (*pop_objs_events)(ct_cdb_ev_queue_o0 *q,
                            ce_cdb_prop_ev_t0 *ev);
 
@@ -297,11 +439,20 @@ struct ce_cdb_a0 {
     bool (*pop_obj_events)(ct_cdb_ev_queue_o0 *q,
                            ce_cdb_prop_ev_t0 *ev);
 
+    void (*listener_stats)(ct_cdb_ev_queue_o0 *q,
+                           ce_cdb_listener_stats_t0 *stats);
+
 
     // READ
     const ce_cdb_obj_o0 *(*read)(ce_cdb_t0 db,
                                  uint64_t object);
 
+    // Readers returned by read() are valid until next gc.
+    // Pin thread to keep them valid across gc/frames until unpin.
+    void (*read_pin)();
+
+    void (*read_unpin)();
+
     uint64_t (*read_to)(ce_cdb_t0 db,
                         uint64_t object,
                         void *to,
@@ -356,6 +507,56 @@ struct ce_cdb_a0 {
                         uint64_t property,
                         uint64_t *objs);
 
+    // READ by prop index
+    // Resolve index once with prop_index, typed object read is offset load.
+    uint32_t (*prop_index)(uint64_t type,
+                           uint64_t property);
+
+    float (*read_float_idx)(const ce_cdb_obj_o0 *reader,
+                            uint32_t prop_idx,
+                            float defaultt);
+
+    bool (*read_bool_idx)(const ce_cdb_obj_o0 *reader,
+                          uint32_t prop_idx,
+                          bool defaultt);
+
+    const char *(*read_str_idx)(const ce_cdb_obj_o0 *reader,
+                                uint32_t prop_idx,
+                                const char *defaultt);
+
+    uint64_t (*read_uint64_idx)(const ce_cdb_obj_o0 *reader,
+                                uint32_t prop_idx,
+                                uint64_t defaultt);
+
+    void *(*read_ptr_idx)(const ce_cdb_obj_o0 *reader,
+                          uint32_t prop_idx,
+                          void *defaultt);
+
+    uint64_t (*read_ref_idx)(const ce_cdb_obj_o0 *reader,
+                             uint32_t prop_idx,
+                             uint64_t defaultt);
+
+    uint64_t (*read_subobject_idx)(const ce_cdb_obj_o0 *reader,
+                                   uint32_t prop_idx,
+                                   uint64_t defaultt);
+
+    uint64_t (*read_objset_num_idx)(const ce_cdb_obj_o0 *reader,
+                                    uint32_t prop_idx);
+
+    void (*read_objset_idx)(const ce_cdb_obj_o0 *reader,
+                            uint32_t prop_idx,
+                            uint64_t *objs);
+
+    // VIEW
+    // Layout map props of type to struct offsets, value has prop def type.
+    // Missing props are not written so prefill struct with defaults.
+    ce_cdb_layout_t0 (*create_layout)(uint64_t type,
+                                      const ce_cdb_view_prop_t0 *props,
+                                      uint32_t n);
+
+    void (*read_view)(const ce_cdb_obj_o0 *reader,
+                      ce_cdb_layout_t0 layout,
+                      void *to);
 };
 
 CE_MODULE(ce_cdb_a0);
@@ -151,7 +151,12 @@ static inline void ce_hash_add(ce_hash_t *hash,
         memset(hash->keys, 255, sizeof(uint64_t) * hash->n);
     }
 
-    uint32_t idx = 0;
+    // Existing key => only update value
+    uint32_t idx = ce_hash_find_slot(hash, k);
+    if (hash->keys[idx] == k) {
+        hash->values[idx] = value;
+        return;
+    }
 
     begin:
     idx = _ce_hash_find_slot(hash, k);
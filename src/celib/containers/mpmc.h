@@ -77,10 +77,10 @@ static inline void ce_mpmc_free(ce_mpmc_queue_t0 *q) {
 }
 
 static inline uint32_t ce_mpmc_size(ce_mpmc_queue_t0 *q) {
-    uint32_t e = atomic_load(&q->enqueue_pos) & q->capacity_mask;
-    uint32_t d = atomic_load(&q->dequeue_pos) & q->capacity_mask;
+    uint32_t e = (uint32_t) atomic_load(&q->enqueue_pos);
+    uint32_t d = (uint32_t) atomic_load(&q->dequeue_pos);
 
-    return e > d ? e - d : d - e;
+    return e - d;
 }
 
 static inline bool ce_mpmc_enqueue(ce_mpmc_queue_t0 *q,
@@ -0,0 +1,136 @@
+//
+//                      **Segmented pool**
+//
+// Growable array with stable item addresses. Items live in blocks that are
+// allocated on first touch and found by two-level directory, so memory
+// track used items instead of capacity. Blocks are zeroed.
+
+#ifndef CE_SEGPOOL_H
+#define CE_SEGPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "celib/celib_types.h"
+#include <string.h>
+#include <stdatomic.h>
+
+#define CE_SEGPOOL_DIR_BITS 10
+#define CE_SEGPOOL_DIR_N (1u << CE_SEGPOOL_DIR_BITS)
+
+// # Struct
+typedef struct ce_segpool_t0 {
+    ce_alloc_t0 *allocator;
+    uint32_t item_size;
+    uint32_t block_shift;
+
+    // -> CE_SEGPOOL_DIR_N dirs -> CE_SEGPOOL_DIR_N blocks
+    atomic_uintptr_t top;
+} ce_segpool_t0;
+
+// Nothing is allocated until first ce_segpool_get.
+static inline void ce_segpool_init(ce_segpool_t0 *pool,
+                                   uint32_t item_size,
+                                   uint32_t block_items,
+                                   ce_alloc_t0 *allocator) {
+    uint32_t shift = 0;
+    while ((1u << shift) < block_items) {
+        ++shift;
+    }
+
+    *pool = (ce_segpool_t0) {
+            .allocator = allocator,
+            .item_size = item_size ? item_size : 1,
+            .block_shift = shift,
+    };
+}
+
+static inline void *_ce_segpool_slot(atomic_uintptr_t *slot,
+                                     size_t size,
+                                     ce_alloc_t0 *allocator) {
+    uintptr_t p = atomic_load_explicit(slot, memory_order_acquire);
+
+    if (p) {
+        return (void *) p;
+    }
+
+    void *new_p = CE_ALLOC(allocator, uint8_t, size);
+    memset(new_p, 0, size);
+
+    if (atomic_compare_exchange_strong(slot, &p, (uintptr_t) new_p)) {
+        return new_p;
+    }
+
+    CE_FREE(allocator, new_p);
+    return (void *) p;
+}
+
+// Return item idx, allocate its block if needed. Thread safe.
+static inline void *ce_segpool_get(ce_segpool_t0 *pool,
+                                   uint64_t idx) {
+    const uint64_t block = idx >> pool->block_shift;
+    const uint64_t dir = block >> CE_SEGPOOL_DIR_BITS;
+
+    CE_ASSERT("segpool", dir < CE_SEGPOOL_DIR_N);
+
+    const size_t dir_size = sizeof(atomic_uintptr_t) * CE_SEGPOOL_DIR_N;
+
+    atomic_uintptr_t *dirs = _ce_segpool_slot(&pool->top, dir_size, pool->allocator);
+    atomic_uintptr_t *blocks = _ce_segpool_slot(&dirs[dir], dir_size, pool->allocator);
+
+    uint8_t *data = _ce_segpool_slot(&blocks[block & (CE_SEGPOOL_DIR_N - 1)],
+                                     (size_t) pool->item_size << pool->block_shift,
+                                     pool->allocator);
+
+    return data + (idx & ((1ull << pool->block_shift) - 1)) * pool->item_size;
+}
+
+// Return item idx from block that was already allocated by ce_segpool_get.
+static inline void *ce_segpool_at(const ce_segpool_t0 *pool,
+                                  uint64_t idx) {
+    const uint64_t block = idx >> pool->block_shift;
+
+    atomic_uintptr_t *dirs = (atomic_uintptr_t *) atomic_load_explicit(&pool->top,
+                                                                       memory_order_acquire);
+    atomic_uintptr_t *blocks = (atomic_uintptr_t *) atomic_load_explicit(
+            &dirs[block >> CE_SEGPOOL_DIR_BITS], memory_order_acquire);
+    uint8_t *data = (uint8_t *) atomic_load_explicit(
+            &blocks[block & (CE_SEGPOOL_DIR_N - 1)], memory_order_acquire);
+
+    return data + (idx & ((1ull << pool->block_shift) - 1)) * pool->item_size;
+}
+
+static inline void ce_segpool_free(ce_segpool_t0 *pool) {
+    atomic_uintptr_t *dirs = (atomic_uintptr_t *) atomic_load(&pool->top);
+
+    if (!dirs) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < CE_SEGPOOL_DIR_N; ++i) {
+        atomic_uintptr_t *blocks = (atomic_uintptr_t *) atomic_load(&dirs[i]);
+
+        if (!blocks) {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < CE_SEGPOOL_DIR_N; ++j) {
+            void *data = (void *) atomic_load(&blocks[j]);
+            if (data) {
+                CE_FREE(pool->allocator, data);
+            }
+        }
+
+        CE_FREE(pool->allocator, blocks);
+    }
+
+    CE_FREE(pool->allocator, dirs);
+    atomic_store(&pool->top, 0);
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif //CE_SEGPOOL_H
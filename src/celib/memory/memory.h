@@ -19,6 +19,13 @@ struct ce_memory_a0 {
 
     char *(*str_dup)(const char *s,
                      ce_alloc_t0 *allocator);
+
+    // Bump allocator, free is noop and all memory is released by destroy_arena.
+    // chunk_size == 0 => default.
+    ce_alloc_t0 *(*create_arena)(ce_alloc_t0 *backing,
+                                 uint64_t chunk_size);
+
+    void (*destroy_arena)(ce_alloc_t0 *arena);
 };
 
 CE_MODULE(ce_memory_a0);
@@ -0,0 +1,164 @@
+#ifndef CETECH_ARENA_ALLOC_INL
+#define CETECH_ARENA_ALLOC_INL
+
+// Bump allocator. Free is noop (only last allocation is given back),
+// all chunks are released at once by destroy_arena.
+
+#define ARENA_DEFAULT_CHUNK_SIZE (1024 * 1024)
+
+typedef struct arena_chunk_t {
+    struct arena_chunk_t *next;
+    uint64_t size;
+    uint64_t used;
+} arena_chunk_t;
+
+typedef struct arena_allocator_t {
+    ce_alloc_t0 alloc;
+    ce_alloc_t0 *backing;
+    uint64_t chunk_size;
+    arena_chunk_t *chunk;
+    atomic_flag lock;
+} arena_allocator_t;
+
+static inline uint8_t *_arena_chunk_data(arena_chunk_t *chunk) {
+    return (uint8_t *) (chunk + 1);
+}
+
+static arena_chunk_t *_arena_new_chunk(arena_allocator_t *a,
+                                       uint64_t size) {
+    arena_chunk_t *chunk = CE_ALLOC(a->backing, arena_chunk_t,
+                                    sizeof(arena_chunk_t) + size);
+
+    *chunk = (arena_chunk_t) {.size = size};
+    return chunk;
+}
+
+// Every allocation is prefixed by its size, realloc need it to copy.
+static void *_arena_bump(arena_chunk_t *chunk,
+                         size_t size,
+                         size_t align) {
+    uintptr_t data = (uintptr_t) _arena_chunk_data(chunk);
+    uintptr_t p = CE_ALIGN_MASK(data + chunk->used + sizeof(uint64_t), align - 1);
+
+    if (p + size > data + chunk->size) {
+        return NULL;
+    }
+
+    chunk->used = p + size - data;
+    ((uint64_t *) p)[-1] = size;
+    return (void *) p;
+}
+
+static void *_arena_alloc(arena_allocator_t *a,
+                          size_t size,
+                          size_t align) {
+    void *p = a->chunk ? _arena_bump(a->chunk, size, align) : NULL;
+    if (p) {
+        return p;
+    }
+
+    const uint64_t need = size + align + sizeof(uint64_t);
+
+    // Big allocation get own chunk and keep current one for small.
+    if (a->chunk && (need > (a->chunk_size / 4))) {
+        arena_chunk_t *chunk = _arena_new_chunk(a, need);
+        chunk->next = a->chunk->next;
+        a->chunk->next = chunk;
+        return _arena_bump(chunk, size, align);
+    }
+
+    arena_chunk_t *chunk = _arena_new_chunk(a, need > a->chunk_size ? need : a->chunk_size);
+    chunk->next = a->chunk;
+    a->chunk = chunk;
+
+    return _arena_bump(chunk, size, align);
+}
+
+static void *_arena_reallocate(const ce_alloc_o0 *_a,
+                               void *ptr,
+                               size_t size,
+                               size_t old_size,
+                               size_t align,
+                               const char *filename,
+                               uint32_t line) {
+    CE_UNUSED(old_size);
+    CE_UNUSED(filename);
+    CE_UNUSED(line);
+
+    arena_allocator_t *a = (arena_allocator_t *) _a;
+
+    if (align < sizeof(uint64_t)) {
+        align = sizeof(uint64_t);
+    }
+
+    while (atomic_flag_test_and_set_explicit(&a->lock, memory_order_acquire)) {
+    }
+
+    void *new_ptr = NULL;
+
+    if (!ptr) {
+        new_ptr = size ? _arena_alloc(a, size, align) : NULL;
+    } else {
+        arena_chunk_t *chunk = a->chunk;
+        uint8_t *data = _arena_chunk_data(chunk);
+        const uint64_t ptr_size = ((uint64_t *) ptr)[-1];
+        const bool is_last = ((uint8_t *) ptr + ptr_size) == (data + chunk->used);
+
+        if (!size) {
+            if (is_last) {
+                chunk->used = (uint8_t *) ptr - sizeof(uint64_t) - data;
+            }
+        } else if (size <= ptr_size) {
+            new_ptr = ptr;
+        } else if (is_last && (((uint8_t *) ptr + size) <= (data + chunk->size))) {
+            chunk->used = (uint8_t *) ptr + size - data;
+            ((uint64_t *) ptr)[-1] = size;
+            new_ptr = ptr;
+        } else {
+            new_ptr = _arena_alloc(a, size, align);
+            memcpy(new_ptr, ptr, ptr_size);
+        }
+    }
+
+    atomic_flag_clear_explicit(&a->lock, memory_order_release);
+
+    return new_ptr;
+}
+
+static struct ce_alloc_vt0 arena_vt = {
+        .reallocate = _arena_reallocate,
+};
+
+static ce_alloc_t0 *create_arena(ce_alloc_t0 *backing,
+                                 uint64_t chunk_size) {
+    arena_allocator_t *a = CE_ALLOC(backing, arena_allocator_t, sizeof(arena_allocator_t));
+
+    *a = (arena_allocator_t) {
+            .backing = backing,
+            .chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE,
+    };
+
+    atomic_flag_clear(&a->lock);
+
+    a->alloc = (ce_alloc_t0) {
+            .inst = (ce_alloc_o0 *) a,
+            .vt = &arena_vt,
+    };
+
+    return &a->alloc;
+}
+
+static void destroy_arena(ce_alloc_t0 *arena) {
+    arena_allocator_t *a = (arena_allocator_t *) arena->inst;
+
+    arena_chunk_t *chunk = a->chunk;
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        CE_FREE(a->backing, chunk);
+        chunk = next;
+    }
+
+    CE_FREE(a->backing, a);
+}
+
+#endif //CETECH_ARENA_ALLOC_INL
@@ -22,6 +22,7 @@
 
 #include "virt_alloc.inl"
 #include "system_alloc.inl"
+#include "arena_alloc.inl"
 
 //static struct _G {
 //} _G = {};
@@ -45,6 +46,8 @@ static struct ce_memory_a0 _api = {
         .system = &_system_allocator,
         .virt_system = &_virt_system_allocator,
         .str_dup = str_dup,
+        .create_arena = create_arena,
+        .destroy_arena = destroy_arena,
 };
 
 struct ce_memory_a0 *ce_memory_a0 = &_api;
@@ -4,6 +4,16 @@
 #include <celib/log.h>
 #include <celib/macros.h>
 #include <celib/memory/memory.h>
+#include <celib/platform.h>
+
+#if CE_PLATFORM_LINUX || CE_PLATFORM_OSX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#elif CE_PLATFORM_WINDOWS
+#include <windows.h>
+#endif
 
 #include "include/SDL2/SDL.h"
 #include "celib/memory/allocator.h"
@@ -98,9 +108,87 @@ void vio_close(struct ce_vio_t0* vio) {
     CE_FREE(alloc, vio);
 }
 
+#if CE_PLATFORM_LINUX || CE_PLATFORM_OSX
+
+const void *vio_map(const char *path,
+                    uint64_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || !st.st_size) {
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        ce_log_a0->error(LOG_WHERE_OS, "Could not map file %s", path);
+        return NULL;
+    }
+
+    *size = st.st_size;
+    return data;
+}
+
+void vio_unmap(const void *data,
+               uint64_t size) {
+    munmap((void *) data, size);
+}
+
+#elif CE_PLATFORM_WINDOWS
+
+const void *vio_map(const char *path,
+                    uint64_t *size) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || !file_size.QuadPart) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+
+    if (!mapping) {
+        ce_log_a0->error(LOG_WHERE_OS, "Could not map file %s", path);
+        return NULL;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!data) {
+        ce_log_a0->error(LOG_WHERE_OS, "Could not map file %s", path);
+        return NULL;
+    }
+
+    *size = file_size.QuadPart;
+    return data;
+}
+
+void vio_unmap(const void *data,
+               uint64_t size) {
+    CE_UNUSED(size);
+    UnmapViewOfFile(data);
+}
+
+#endif
+
 struct ce_os_vio_a0 vio_api = {
         .from_file = vio_from_file,
         .close = vio_close,
+        .map = vio_map,
+        .unmap = vio_unmap,
 };
 
 struct ce_os_vio_a0 *ce_os_vio_a0 = &vio_api;
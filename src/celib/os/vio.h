@@ -56,6 +56,13 @@ struct ce_os_vio_a0 {
                                    enum ce_vio_open_mode mode);
 
     void (*close)(struct ce_vio_t0 * vio);
+
+    // Map whole file read only. Return NULL if file does not exist.
+    const void *(*map)(const char *path,
+                       uint64_t *size);
+
+    void (*unmap)(const void *data,
+                  uint64_t size);
 };
 
 
@@ -21,22 +21,32 @@
 #include <celib/containers/bitset.h>
 #include <celib/containers/spsc.h>
 #include <celib/containers/mpmc.h>
+#include <celib/containers/segpool.h>
 
 #include <celib/os/thread.h>
+#include <celib/os/vio.h>
 #include <celib/containers/buffer.h>
 #include <celib/id.h>
 
 #include <sys/time.h>
 
 #include <celib/os/time.h>
+#include <celib/task.h>
 
 #define _G coredb_global
 #define LOG_WHERE "cdb"
 
 #define MAX_OBJECTS 1000000000ULL
-#define MAX_OBJECTS_PER_TYPE 1000000ULL
 #define MAX_EVENTS_LISTENER 1024
+#define OBJECT_POOL_BLOCK_ITEMS 256
+#define TYPE_POOL_BLOCK_SIZE (64 * 1024)
+#define VALUE_POOL_BLOCK_ITEMS 1024
 #define MAX_QUEUE_SIZE 1024 * 64
+#define MAX_READERS 256
+#define LIMBO_QUEUE_SIZE (1024 * 64)
+#define MAX_LAYOUTS 1024
+#define GC_BATCH_SIZE 256
+#define CDB_ARENA_CHUNK_SIZE (4 * 1024 * 1024)
 
 #define UID_HASHMAP
 //#define _FORCE_DYNAMINC_OBJECT
@@ -64,25 +74,19 @@ static void *virt_alloc(uint64_t size) {
     return CE_REALLOC(ce_memory_a0->virt_system, void, NULL,size, 0);
 }
 
-static int virt_free(void *addr,
-                     uint64_t size) {
-    return CE_REALLOC(ce_memory_a0->virt_system, void, addr, 0, size) != NULL;
-}
-
 enum {
     _OBJ_FLAG_TYPED_OBJ = 1 << 0,
+    _OBJ_FLAG_WRITER = 1 << 1,
 };
 
 typedef struct type_storage_t {
     uint64_t type;
     uint64_t type_size;
-    uint8_t *pool;
+    ce_segpool_t0 pool;
     uint64_t flags;
     ce_mpmc_queue_t0 free_idx;
-    ce_mpmc_queue_t0 to_free_idx;
 
     ce_hash_t prop_idx;
-    ce_cdb_type_def_t0 *prop_def;
     uint64_t *prop_name;
     uint8_t *prop_type;
     uint32_t *prop_offset;
@@ -90,9 +94,25 @@ typedef struct type_storage_t {
     atomic_uint_fast32_t pool_n;
 } type_storage_t;
 
+typedef struct listener_t {
+    ce_mpmc_queue_t0 queue;
+
+    // queue was full, events are dropped until consumer get resync event
+    atomic_bool overflow;
+
+    atomic_uint_fast64_t pushed;
+    atomic_uint_fast64_t dropped;
+    atomic_uint_fast64_t overflows;
+
+    // filter, empty => all
+    ce_hash_t types;
+    ce_hash_t props;
+} listener_t;
+
 typedef struct listener_pack_t {
-    ce_mpmc_queue_t0 *queues;
+    listener_t *listeners;
     atomic_uint_fast16_t n;
+    ce_spinlock_t0 lock;
 } listener_pack_t;
 
 typedef struct object_t {
@@ -101,8 +121,9 @@ typedef struct object_t {
     uint64_t type;
     uint64_t flags;
 
-    // prefab
+    // prefab, dynamic instance read not overridden props from prefab
     uint64_t instance_of;
+    struct object_t **prefab;
     uint64_t *instances;
 
     // hierarchy
@@ -113,6 +134,26 @@ typedef struct object_t {
     uint64_t orig_obj;
     ce_cdb_prop_ev_t0 *changed;
 
+    // delta writer: props hold only changed values, rest is read from base
+    struct object_t *base;
+
+    // object: bumped by every commit, in place one keep pointer same
+    // writer: version of base at write_begin
+    atomic_uint_fast64_t version;
+
+    // writer and instance: own keys + keys of base or prefab
+    uint64_t *keys_view;
+
+    // object: bumped by commit that add or remove prop
+    // instance: keys_version sum of prefab chain keys_view was built for,
+    // keys_view is rebuilt on read when it change
+    uint64_t keys_version;
+    atomic_uint_fast64_t keys_view_stamp;
+    ce_spinlock_t0 keys_view_lock;
+
+    // last epoch in which object was handed out by read(), or commit lock
+    atomic_uint_fast64_t read_epoch;
+
     // object
     ce_hash_t prop_map;
     uint64_t properties_count;
@@ -123,11 +164,13 @@ typedef struct object_t {
 
     // Typed
     uint32_t typed_obj_idx;
-    uint32_t typed_writer_idx;
     type_storage_t *storage;
 
     //events
     listener_pack_t obj_listeners;
+
+    // snapshot copy, number of snapshots that hold it
+    uint32_t snapshot_refs;
 } object_t;
 
 
@@ -137,10 +180,31 @@ typedef struct set_t {
 } set_t;
 
 
+// Type index entry use db->type_pos for O(1) remove, ref index entry count
+// references from referrer (more props can point to same object).
+typedef struct obj_index_t {
+    uint64_t *objs;
+    ce_hash_t ref_n;
+} obj_index_t;
+
+// Object is copied on first change after snapshot, copy is shared by all
+// snapshots which did not know the object yet.
+typedef struct snapshot_t {
+    bool used;
+
+    // uid -> copy, 0 => object was created after snapshot
+    ce_hash_t objs;
+    uint64_t *uids;
+} snapshot_t;
+
 typedef struct db_t {
     uint32_t used;
     uint32_t idx;
     uint64_t max_objects;
+    uint64_t flags;
+
+    // object data, arena for CDB_DB_FLAG_ARENA
+    ce_alloc_t0 *allocator;
 
     // changed
     ce_spinlock_t0 change_lock;
@@ -150,20 +214,30 @@ typedef struct db_t {
     ce_spinlock_t0 destroy_lock;
     uint64_t *destroyed_obj;
 
-    // to free uid
-    uint64_t *to_free_objects_uid;
+    // to free uid, gc process [cursor, n) within frame budget
+    ce_segpool_t0 to_free_objects_uid;
     atomic_ullong to_free_objects_uid_n;
+    uint64_t to_free_objects_cursor;
+    ce_hash_t to_free_set;
+
+    // gc batch and flush_destroy free objects one at time
+    ce_spinlock_t0 free_lock;
 
     // objects
-    object_t *object_pool;
+    ce_segpool_t0 object_pool;
     ce_mpmc_queue_t0 free_objects;
-    ce_mpmc_queue_t0 to_free_objects;
+
+    // retired object versions, one queue per epoch % 3
+    ce_mpmc_queue_t0 limbo[3];
+
+    // sets and blobs replaced by writer, same epochs as limbo
+    ce_mpmc_queue_t0 value_limbo[3];
 
     atomic_ullong object_pool_n;
 
     // objects id
-    object_t **object_id_pool;
-    object_t ***free_objects_id;
+    ce_segpool_t0 object_id_pool;
+    ce_segpool_t0 free_objects_id;
     atomic_ullong object_id_pool_n;
     atomic_ullong free_objects_id_n;
 
@@ -173,16 +247,18 @@ typedef struct db_t {
 #else
 #endif
 
-    // blobs
-    ce_cdb_blob_t0 *blobs;
+    // blobs and sets, compile tasks create them at once => pools
+    ce_segpool_t0 blob_pool;
+    atomic_uint_fast32_t blob_n;
 
-    //
-    set_t *sets;
+    ce_segpool_t0 set_pool;
+    atomic_uint_fast32_t set_n;
 
     // Typed object
+    ce_spinlock_t0 type_lock;
     ce_hash_t type_map;
     atomic_uint_fast32_t type_n;
-    type_storage_t *type_storage;
+    ce_segpool_t0 type_storage;
 
     // Dynamic object
     // TODO:
@@ -190,13 +266,58 @@ typedef struct db_t {
     // chnaged_queues
     listener_pack_t chnaged_objs;
     listener_pack_t obj_listeners;
+
+    // snapshots, idx + 1 is handle
+    snapshot_t *snapshots;
+    atomic_uint_fast32_t snapshot_n;
+    ce_spinlock_t0 snapshot_lock;
+
+    // secondary indexes, type -> objs and target -> referrers
+    ce_spinlock_t0 index_lock;
+    ce_hash_t type_index;
+    ce_hash_t type_pos;
+    ce_hash_t ref_index;
+    obj_index_t *obj_index;
 } db_t;
 
 typedef struct type_defs_t {
     ce_hash_t def_map;
     ce_cdb_type_def_t0 *defs;
+
+    // id64 of prop names, per def
+    uint64_t **keys;
 } type_defs_t;
 
+// View layout
+typedef struct layout_prop_t {
+    uint64_t key;
+    uint32_t prop_idx;
+    uint32_t offset;
+    uint8_t type;
+} layout_prop_t;
+
+// Contiguous run of typed storage copied by one memcpy.
+typedef struct layout_copy_t {
+    uint32_t src;
+    uint32_t dst;
+    uint32_t size;
+} layout_copy_t;
+
+typedef struct layout_t {
+    uint64_t type;
+    layout_prop_t *props;
+    layout_copy_t *copies;
+
+    // props that can not be copied from storage (blob)
+    layout_prop_t *slow_props;
+} layout_t;
+
+// Reader state is (epoch << 1) | pinned, 0 == not reading.
+typedef struct reader_t {
+    atomic_uint_fast64_t state;
+    cache_line_pad_t _pad;
+} reader_t;
+
 static struct _G {
     db_t *dbs;
     uint32_t *to_free_db;
@@ -206,8 +327,23 @@ static struct _G {
 
     ct_cdb_obj_loader_t0 loader;
     type_defs_t type_defs;
+
+    // view layouts, idx 0 is invalid
+    layout_t layouts[MAX_LAYOUTS];
+    atomic_uint_fast32_t layouts_n;
+
+    // epoch reclamation
+    atomic_uint_fast64_t epoch;
+    atomic_uint_fast32_t readers_n;
+    reader_t readers[MAX_READERS];
+
+    // 0 => free all destroyed objects in one gc
+    uint64_t gc_budget_us;
 } _G;
 
+static CE_THREAD_LOCAL uint32_t _reader_idx;
+static CE_THREAD_LOCAL uint32_t _reader_pin_n;
+
 static object_t **_get_uid_objid(db_t *db,
                                  uint64_t uid) {
     CE_ASSERT(LOG_WHERE, uid != 0);
@@ -323,80 +459,208 @@ static struct object_t *_get_object_from_uid(db_t *db,
 
 
 // events
+// Listeners are reserved with first listener, most of objects have none.
 void _init_listener_pack(listener_pack_t *pack) {
-    pack->queues = virt_alloc(sizeof(ce_mpmc_queue_t0) * MAX_EVENTS_LISTENER);
+    pack->listeners = NULL;
+}
+
+// Listener is visible for publishers only after it is fully initialized.
+listener_t *_new_listener(listener_pack_t *pack,
+                          uint32_t queue_size,
+                          size_t item_size,
+                          const ce_cdb_listener_filter_t0 *filter) {
+    ce_os_thread_a0->spin_lock(&pack->lock);
+
+    uint32_t idx = atomic_load(&pack->n);
+    CE_ASSERT(LOG_WHERE, idx < MAX_EVENTS_LISTENER);
+
+    if (!pack->listeners) {
+        pack->listeners = virt_alloc(sizeof(listener_t) * MAX_EVENTS_LISTENER);
+    }
+
+    listener_t *l = &pack->listeners[idx];
+    ce_mpmc_init(&l->queue, queue_size, item_size, _G.allocator);
+
+    if (filter) {
+        for (uint32_t i = 0; i < filter->types_n; ++i) {
+            ce_hash_add(&l->types, filter->types[i], 1, _G.allocator);
+        }
+
+        for (uint32_t i = 0; i < filter->props_n; ++i) {
+            ce_hash_add(&l->props, filter->props[i], 1, _G.allocator);
+        }
+    }
+
+    atomic_store(&pack->n, idx + 1);
+
+    ce_os_thread_a0->spin_unlock(&pack->lock);
+    return l;
+}
+
+static void _listener_push(listener_t *l,
+                           const uint8_t *events,
+                           uint32_t n) {
+    if (atomic_load(&l->overflow)) {
+        atomic_fetch_add(&l->dropped, n);
+        return;
+    }
+
+    const size_t item_size = l->queue.itemsize;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (ce_mpmc_enqueue(&l->queue, (void *) (events + (i * item_size)))) {
+            continue;
+        }
+
+        atomic_fetch_add(&l->pushed, i);
+        atomic_fetch_add(&l->dropped, n - i);
+
+        if (!atomic_exchange(&l->overflow, true)) {
+            atomic_fetch_add(&l->overflows, 1);
+            ce_log_a0->warning(LOG_WHERE, "Listener queue is full, events dropped until resync.");
+        }
+        return;
+    }
+
+    atomic_fetch_add(&l->pushed, n);
 }
 
-ce_mpmc_queue_t0 *_new_listener(listener_pack_t *pack,
-                                uint32_t queue_size,
-                                size_t item_size) {
-    uint32_t idx = atomic_fetch_add(&pack->n, 1);
-    ce_mpmc_queue_t0 *q = &pack->queues[idx];
-    ce_mpmc_init(q, queue_size, item_size, _G.allocator);
-    return q;
+// One publish per commit, every interested listener get whole batch.
+static void _publish_events(listener_pack_t *pack,
+                            uint64_t obj_type,
+                            const ce_cdb_prop_ev_t0 *events,
+                            uint32_t n) {
+    if (!n) {
+        return;
+    }
+
+    const uint32_t listeners_n = atomic_load(&pack->n);
+    for (uint32_t i = 0; i < listeners_n; ++i) {
+        listener_t *l = &pack->listeners[i];
+
+        if (l->types.n && !ce_hash_contain(&l->types, obj_type)) {
+            continue;
+        }
+
+        if (!l->props.n) {
+            _listener_push(l, (const uint8_t *) events, n);
+            continue;
+        }
+
+        for (uint32_t j = 0; j < n; ++j) {
+            if (ce_hash_contain(&l->props, events[j].prop)) {
+                _listener_push(l, (const uint8_t *) &events[j], 1);
+            }
+        }
+    }
 }
 
 static void _push_event(listener_pack_t *pack,
-                        void *event) {
-    uint32_t n = pack->n;
-    for (int i = 0; i < n; ++i) {
-        ce_mpmc_queue_t0 *q = &pack->queues[i];
-        ce_mpmc_enqueue(q, event);
+                        ce_cdb_ev_t0 *event) {
+    const uint32_t listeners_n = atomic_load(&pack->n);
+    for (uint32_t i = 0; i < listeners_n; ++i) {
+        listener_t *l = &pack->listeners[i];
+
+        if (l->types.n && !ce_hash_contain(&l->types, event->obj_type)) {
+            continue;
+        }
+
+        _listener_push(l, (const uint8_t *) event, 1);
+    }
+}
+
+// Queue is drained and some events was dropped => tell consumer to resync.
+static bool _listener_pop(listener_t *l,
+                          void *ev) {
+    if (ce_mpmc_dequeue(&l->queue, ev)) {
+        return true;
+    }
+
+    if (atomic_load(&l->overflow) && atomic_exchange(&l->overflow, false)) {
+        memset(ev, 0, l->queue.itemsize);
+        *((uint64_t *) ev) = CE_CDB_RESYNC_EVENT;
+        return true;
+    }
+
+    return false;
+}
+
+// Listeners missed changes => consumer rescan on resync event.
+static void _resync_listeners(listener_pack_t *pack) {
+    const uint32_t listeners_n = atomic_load(&pack->n);
+    for (uint32_t i = 0; i < listeners_n; ++i) {
+        atomic_store(&pack->listeners[i].overflow, true);
     }
 }
 
-ce_mpmc_queue_t0 *_new_changed_obj_events_listener(db_t *db) {
-    return _new_listener(&db->chnaged_objs, MAX_QUEUE_SIZE, sizeof(ce_cdb_ev_t0));
+listener_t *_new_changed_obj_events_listener(db_t *db,
+                                             const ce_cdb_listener_filter_t0 *filter) {
+    return _new_listener(&db->chnaged_objs, MAX_QUEUE_SIZE, sizeof(ce_cdb_ev_t0), filter);
 }
 
 
-ce_mpmc_queue_t0 *_new_obj_events_listener(db_t *db) {
-    return _new_listener(&db->obj_listeners, MAX_QUEUE_SIZE, sizeof(ce_cdb_prop_ev_t0));
+listener_t *_new_obj_events_listener(db_t *db,
+                                     const ce_cdb_listener_filter_t0 *filter) {
+    return _new_listener(&db->obj_listeners, MAX_QUEUE_SIZE, sizeof(ce_cdb_prop_ev_t0),
+                         filter);
 }
 
-ce_mpmc_queue_t0 *_new_obj_events_listener2(db_t *db,
-                                            uint64_t _obj) {
+listener_t *_new_obj_events_listener2(db_t *db,
+                                      uint64_t _obj) {
     object_t *obj = _get_object_from_uid(db, _obj);
-    return _new_listener(&obj->obj_listeners, 64, sizeof(ce_cdb_prop_ev_t0));
+    return _new_listener(&obj->obj_listeners, 64, sizeof(ce_cdb_prop_ev_t0), NULL);
 }
 
 
 // objid
 object_t **_new_obj_id(db_t *db) {
-    uint32_t idx = 0;
+    uint64_t idx = 0;
     if (db->free_objects_id_n) {
         idx = atomic_fetch_sub(&db->free_objects_id_n, 1) - 1;
-        return db->free_objects_id[idx];
+        return *(object_t ***) ce_segpool_at(&db->free_objects_id, idx);
 
     } else {
         idx = atomic_fetch_add(&db->object_id_pool_n, 1);
     }
 
-    return &db->object_id_pool[idx];
+    CE_ASSERT(LOG_WHERE, idx < db->max_objects);
+
+    return ce_segpool_get(&db->object_id_pool, idx);
 }
 
 void _free_obj_id(db_t *db,
                   object_t **obj) {
     uint64_t idx = atomic_fetch_add(&db->free_objects_id_n, 1);
-    db->free_objects_id[idx] = obj;
+    *(object_t ***) ce_segpool_get(&db->free_objects_id, idx) = obj;
 }
 
 // blob
+typedef struct blob_t {
+    ce_cdb_blob_t0 blob;
+
+    // data point into load_mapped input, not owned
+    bool mapped;
+} blob_t;
+
 uint32_t _new_blob(db_t *db) {
-    uint32_t idx = ce_array_size(db->blobs);
-    ce_array_push(db->blobs, (ce_cdb_blob_t0) {}, _G.allocator);
+    uint32_t idx = atomic_fetch_add(&db->blob_n, 1);
+    *(blob_t *) ce_segpool_get(&db->blob_pool, idx) = (blob_t) {};
     return idx;
 }
 
 ce_cdb_blob_t0 *_get_blob(db_t *db,
                           uint32_t idx) {
-    return &db->blobs[idx];
+    return &((blob_t *) ce_segpool_at(&db->blob_pool, idx))->blob;
+}
+
+static bool *_blob_mapped(db_t *db,
+                          uint32_t idx) {
+    return &((blob_t *) ce_segpool_at(&db->blob_pool, idx))->mapped;
 }
 
 // sets
 uint32_t _new_set(db_t *db) {
-    uint32_t idx = ce_array_size(db->sets);
-    ce_array_push(db->sets, (set_t) {}, _G.allocator);
+    uint32_t idx = atomic_fetch_add(&db->set_n, 1);
+    *(set_t *) ce_segpool_get(&db->set_pool, idx) = (set_t) {};
     return idx;
 }
 
@@ -406,41 +670,46 @@ set_t *_get_set(db_t *db,
         return NULL;
     }
 
-    return &db->sets[idx];
+    return ce_segpool_at(&db->set_pool, idx);
 }
 
-void _add_to_set(db_t *db,
+bool _add_to_set(db_t *db,
                  uint32_t idx,
                  uint64_t obj) {
     set_t *set = _get_set(db, idx);
 
     if (!set) {
-        return;
+        return false;
     }
 
     if (ce_hash_contain(&set->set, obj)) {
-        return;
+        return false;
     }
 
     uint64_t obj_idx = ce_array_size(set->objs);
-    ce_array_push(set->objs, obj, _G.allocator);
-    ce_hash_add(&set->set, obj, obj_idx, _G.allocator);
+    ce_array_push(set->objs, obj, db->allocator);
+    ce_hash_add(&set->set, obj, obj_idx, db->allocator);
+    return true;
 }
 
-void _remove_from_set(db_t *db,
+bool _remove_from_set(db_t *db,
                       uint32_t idx,
                       uint64_t obj) {
     set_t *set = _get_set(db, idx);
 
+    if (!set) {
+        return false;
+    }
+
     uint64_t obj_idx = ce_hash_lookup(&set->set, obj, UINT64_MAX);
 
     if (obj_idx == UINT64_MAX) {
-        return;
+        return false;
     }
 
     uint64_t obj_n = ce_array_size(set->objs);
     if (!obj_n) {
-        return;
+        return false;
     }
 
     uint64_t last_idx = obj_n - 1;
@@ -450,8 +719,9 @@ void _remove_from_set(db_t *db,
 
     ce_array_pop_back(set->objs);
 
-    ce_hash_add(&set->set, last_obj, idx, _G.allocator);
+    ce_hash_add(&set->set, last_obj, obj_idx, db->allocator);
     ce_hash_remove(&set->set, obj);
+    return true;
 }
 
 
@@ -473,6 +743,17 @@ size_t _type_obj_size(ce_cdb_type_def_t0 *defs) {
     return size;
 }
 
+static uint32_t _type_prop_offset(const ce_cdb_type_def_t0 *defs,
+                                  uint32_t prop_idx) {
+    uint32_t bytes = 0;
+    for (uint32_t i = 0; i < prop_idx; ++i) {
+        type_info_t ti = _TYPE_INFO[defs->defs[i].type];
+        bytes += ti.size + CE_ALIGN_PADDING(bytes, ti.align);
+    }
+
+    type_info_t ti = _TYPE_INFO[defs->defs[prop_idx].type];
+    return bytes + CE_ALIGN_PADDING(bytes, ti.align);
+}
 
 type_storage_t *_get_or_create_storage(db_t *db,
                                        uint64_t type) {
@@ -480,22 +761,29 @@ type_storage_t *_get_or_create_storage(db_t *db,
     return NULL;
 #endif
 
-    uint64_t idx = ce_hash_lookup(&db->type_map, type, UINT64_MAX);
-
     if (!type) {
         return NULL;
     }
 
+    // Lookup and create at once, objects of new type can be created by
+    // more tasks.
+    ce_os_thread_a0->spin_lock(&db->type_lock);
+
+    uint64_t idx = ce_hash_lookup(&db->type_map, type, UINT64_MAX);
+
     if (idx == UINT64_MAX) {
         uint32_t typedef_idx = ce_hash_lookup(&_G.type_defs.def_map, type, UINT32_MAX);
 
         if (typedef_idx == UINT32_MAX) {
+            ce_os_thread_a0->spin_unlock(&db->type_lock);
             return NULL;
         }
 
         idx = atomic_fetch_add(&db->type_n, 1);
-        ce_hash_add(&db->type_map, type, idx, _G.allocator);
-        type_storage_t *storage = &db->type_storage[idx];
+        CE_ASSERT(LOG_WHERE, idx < MAX_TYPES);
+
+        ce_hash_add(&db->type_map, type, idx, db->allocator);
+        type_storage_t *storage = ce_segpool_get(&db->type_storage, idx);
 
         ce_cdb_type_def_t0 *defs = &_G.type_defs.defs[typedef_idx];
 
@@ -504,14 +792,14 @@ type_storage_t *_get_or_create_storage(db_t *db,
 
         *storage = (type_storage_t) {
                 .type =  type,
-                .pool = virt_alloc(type_size * MAX_OBJECTS_PER_TYPE),
                 .type_size = type_size,
                 .pool_n = 1, // NULL element;
-                .prop_def = defs,
         };
 
-        ce_mpmc_init(&storage->free_idx, 4096, sizeof(uint64_t), _G.allocator);
-        ce_mpmc_init(&storage->to_free_idx, 4096, sizeof(uint64_t), _G.allocator);
+        ce_segpool_init(&storage->pool, type_size,
+                        TYPE_POOL_BLOCK_SIZE / (type_size ? type_size : 1), _G.allocator);
+
+        ce_mpmc_init(&storage->free_idx, 4096, sizeof(uint64_t), db->allocator);
 
         uint32_t bytes = 0;
         for (int i = 0; i < defs->num; ++i) {
@@ -522,28 +810,32 @@ type_storage_t *_get_or_create_storage(db_t *db,
             size_t padding = CE_ALIGN_PADDING(bytes, ti.align);
             size_t offset = bytes + padding;
 
-            uint64_t k = ce_id_a0->id64(def.name);
-            ce_array_push(storage->prop_type, def.type, _G.allocator);
-            ce_array_push(storage->prop_name, k, _G.allocator);
-            ce_array_push(storage->prop_offset, offset, _G.allocator);
-            ce_hash_add(&storage->prop_idx, k, i, _G.allocator);
+            uint64_t k = _G.type_defs.keys[typedef_idx][i];
+            ce_array_push(storage->prop_type, def.type, db->allocator);
+            ce_array_push(storage->prop_name, k, db->allocator);
+            ce_array_push(storage->prop_offset, offset, db->allocator);
+            ce_hash_add(&storage->prop_idx, k, i, db->allocator);
 
             bytes += (ti.size + padding);
         }
     }
 
-    return &db->type_storage[idx];
+    ce_os_thread_a0->spin_unlock(&db->type_lock);
+
+    return ce_segpool_at(&db->type_storage, idx);
 }
 
 type_storage_t *_get_storage(db_t *db,
                              uint64_t type) {
+    ce_os_thread_a0->spin_lock(&db->type_lock);
     uint64_t idx = ce_hash_lookup(&db->type_map, type, UINT64_MAX);
+    ce_os_thread_a0->spin_unlock(&db->type_lock);
 
     if (idx == UINT64_MAX) {
         return NULL;
     }
 
-    return &db->type_storage[idx];
+    return ce_segpool_at(&db->type_storage, idx);
 }
 
 uint64_t _new_typed_object(type_storage_t *storage,
@@ -552,25 +844,21 @@ uint64_t _new_typed_object(type_storage_t *storage,
         return 0;
     }
 
+    // Slot is cleared on reuse not on free, gc of many objects stay cheap.
     uint64_t free_idx = 0;
     if (ce_mpmc_dequeue(&storage->free_idx, &free_idx)) {
+        memset(ce_segpool_at(&storage->pool, free_idx), 0, storage->type_size);
         return free_idx;
     }
 
     uint64_t value_idx = atomic_fetch_add(&storage->pool_n, 1);
+    ce_segpool_get(&storage->pool, value_idx);
     return value_idx;
 }
 
-void _free_typed_object(db_t *db,
-                        uint64_t type,
+void _free_typed_object(type_storage_t *storage,
                         uint64_t idx) {
-    type_storage_t *storage = _get_storage(db, type);
-
-    if (!storage) {
-        return;
-    }
-
-    ce_mpmc_enqueue(&storage->to_free_idx, &idx);
+    ce_mpmc_enqueue(&storage->free_idx, &idx);
 }
 
 uint64_t _clone_typed_object(type_storage_t *storage,
@@ -578,13 +866,20 @@ uint64_t _clone_typed_object(type_storage_t *storage,
                              uint64_t from_idx) {
     uint64_t clone_idx = _new_typed_object(storage, type);
 
-    memcpy(&storage->pool[storage->type_size * clone_idx],
-           &storage->pool[storage->type_size * from_idx],
+    memcpy(ce_segpool_at(&storage->pool, clone_idx),
+           ce_segpool_at(&storage->pool, from_idx),
            storage->type_size);
 
     return clone_idx;
 }
 
+static inline ce_cdb_value_u0 *_get_prop_value_ptr_idx(type_storage_t *storage,
+                                                       uint64_t obj_idx,
+                                                       uint32_t prop_idx) {
+    uint8_t *data = ce_segpool_at(&storage->pool, obj_idx);
+    return (ce_cdb_value_u0 *) (data + storage->prop_offset[prop_idx]);
+}
+
 ce_cdb_value_u0 *_get_prop_value_ptr(type_storage_t *storage,
                                      uint64_t obj_idx,
                                      uint64_t prop) {
@@ -594,11 +889,7 @@ ce_cdb_value_u0 *_get_prop_value_ptr(type_storage_t *storage,
         return NULL;
     }
 
-    uint64_t prop_offset = storage->prop_offset[prop_idx];
-
-    uint64_t idx = obj_idx * storage->type_size;
-    ce_cdb_value_u0 *val = (ce_cdb_value_u0 *) (&storage->pool[idx] + prop_offset);
-    return val;
+    return _get_prop_value_ptr_idx(storage, obj_idx, prop_idx);
 }
 
 ///
@@ -624,7 +915,52 @@ void reg_obj_type(uint64_t type,
     def->num = n;
 
     ce_array_clean(def->defs);
-    ce_array_push_n(def->defs, prop_def, sizeof(ce_cdb_prop_def_t0) * n, _G.allocator);
+    ce_array_push_n(def->defs, prop_def, n, _G.allocator);
+
+    if (idx >= ce_array_size(_G.type_defs.keys)) {
+        ce_array_push(_G.type_defs.keys, NULL, _G.allocator);
+    }
+
+    uint64_t **keys = &_G.type_defs.keys[idx];
+    ce_array_clean(*keys);
+    for (uint32_t i = 0; i < n; ++i) {
+        ce_array_push(*keys, ce_id_a0->id64(prop_def[i].name), _G.allocator);
+    }
+}
+
+static uint32_t prop_index(uint64_t type,
+                           uint64_t prop) {
+    uint32_t idx = ce_hash_lookup(&_G.type_defs.def_map, type, UINT32_MAX);
+
+    if (idx == UINT32_MAX) {
+        return UINT32_MAX;
+    }
+
+    const uint64_t *keys = _G.type_defs.keys[idx];
+    const uint32_t keys_n = ce_array_size(keys);
+    for (uint32_t i = 0; i < keys_n; ++i) {
+        if (keys[i] == prop) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static uint64_t _prop_index_key(uint64_t type,
+                                uint32_t prop_idx) {
+    uint32_t idx = ce_hash_lookup(&_G.type_defs.def_map, type, UINT32_MAX);
+
+    if (idx == UINT32_MAX) {
+        return 0;
+    }
+
+    const uint64_t *keys = _G.type_defs.keys[idx];
+    if (prop_idx >= ce_array_size(keys)) {
+        return 0;
+    }
+
+    return keys[prop_idx];
 }
 
 const ce_cdb_type_def_t0 *_get_prop_def(uint64_t type) {
@@ -648,9 +984,13 @@ static struct db_t *_get_db(ce_cdb_t0 db) {
     return &_G.dbs[db.idx];
 }
 
+static ce_alloc_t0 *_obj_allocator(const object_t *obj) {
+    return _G.dbs[obj->db.idx].allocator;
+}
+
 static void _add_instance(object_t *obj,
                           uint64_t instance) {
-    ce_array_push(obj->instances, instance, _G.allocator);
+    ce_array_push(obj->instances, instance, _obj_allocator(obj));
 }
 
 static void _add_changed_obj(db_t *db_inst,
@@ -659,8 +999,8 @@ static void _add_changed_obj(db_t *db_inst,
 
     if (!ce_hash_contain(&db_inst->changed_obj_set, k)) {
         ce_os_thread_a0->spin_lock(&db_inst->change_lock);
-        ce_array_push(db_inst->changed_obj, obj->orig_obj, _G.allocator);
-        ce_hash_add(&db_inst->changed_obj_set, k, 0, _G.allocator);
+        ce_array_push(db_inst->changed_obj, obj->orig_obj, db_inst->allocator);
+        ce_hash_add(&db_inst->changed_obj_set, k, 0, db_inst->allocator);
         ce_os_thread_a0->spin_unlock(&db_inst->change_lock);
 
         ce_cdb_ev_t0 ev = {
@@ -675,7 +1015,7 @@ static void _add_changed_obj(db_t *db_inst,
 
 static void _add_change(object_t *obj,
                         ce_cdb_prop_ev_t0 ev) {
-    ce_array_push(obj->changed, ev, _G.allocator);
+    ce_array_push(obj->changed, ev, _obj_allocator(obj));
 }
 
 static uint64_t _object_new_property(object_t *obj,
@@ -702,7 +1042,7 @@ struct object_t *_new_object(db_t *db,
     if (!ce_mpmc_dequeue(&db->free_objects, &obj)) {
         uint64_t idx = atomic_fetch_add(&db->object_pool_n, 1);
 
-        obj = &db->object_pool[idx];
+        obj = ce_segpool_get(&db->object_pool, idx);
         *obj = (object_t) {};
 
         _init_listener_pack(&obj->obj_listeners);
@@ -721,31 +1061,41 @@ static struct object_t *_object_clone(db_t *db,
     object_t *new_obj = _new_object(db, alloc);
 
     new_obj->instance_of = obj->instance_of;
+    new_obj->prefab = obj->prefab;
     new_obj->parent = obj->parent;
     new_obj->key = obj->key;
     new_obj->id = obj->id;
+    new_obj->orig_obj = obj->orig_obj;
     new_obj->flags = obj->flags;
     new_obj->type = obj->type;
     new_obj->obj_listeners = obj->obj_listeners;
+    new_obj->keys_version = obj->keys_version;
+
+    uint32_t inst_n = ce_array_size(obj->instances);
+    if (inst_n) {
+        ce_array_push_n(new_obj->instances, obj->instances, inst_n, alloc);
+    }
 
     if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
         new_obj->storage = obj->storage;
-
+        new_obj->typed_obj_idx = _clone_typed_object(obj->storage,
+                                                     obj->type,
+                                                     obj->typed_obj_idx);
     } else {
-        _object_new_property(new_obj, 0, CDB_TYPE_NONE, _G.allocator);
+        _object_new_property(new_obj, 0, CDB_TYPE_NONE, alloc);
 
         new_obj->properties_count = properties_count;
         ce_array_push_n(new_obj->changed, obj->changed,
                         ce_array_size(obj->changed), alloc);
 
         ce_array_push_n(new_obj->keys, obj->keys + 1,
-                        ce_array_size(obj->keys) - 1, alloc);
+                        properties_count - 1, alloc);
 
         ce_array_push_n(new_obj->property_type, obj->property_type + 1,
-                        ce_array_size(obj->property_type) - 1, alloc);
+                        properties_count - 1, alloc);
 
         ce_array_push_n(new_obj->values, obj->values + 1,
-                        ce_array_size(obj->values) - 1, alloc);
+                        properties_count - 1, alloc);
 
         ce_hash_clone(&obj->prop_map, &new_obj->prop_map, alloc);
     }
@@ -758,2542 +1108,5350 @@ static uint64_t _find_prop_index(const struct object_t *obj,
     return ce_hash_lookup(&obj->prop_map, key, 0);
 }
 
-static void _destroy_object(db_t *db_inst,
-                            object_t *obj) {
-    ce_mpmc_enqueue(&db_inst->to_free_objects, &obj);
-}
-
-static struct ce_cdb_t0 create_db(uint64_t max_objects) {
-    uint64_t n = ce_array_size(_G.dbs);
+static void _object_remove_property(object_t *obj,
+                                    uint64_t key) {
+    uint64_t idx = _find_prop_index(obj, key);
 
-    uint32_t idx = UINT32_MAX;
-    for (uint32_t i = 0; i < n; ++i) {
-        if (!_G.dbs[i].used) {
-            idx = i;
-            break;
+    if (obj->flags & _OBJ_FLAG_WRITER) {
+        // Writer can not touch base, so remember removal as NONE value.
+        if (!idx) {
+            idx = _object_new_property(obj, key, CDB_TYPE_NONE, _obj_allocator(obj));
         }
-    }
 
-    if (UINT32_MAX == idx) {
-        idx = ce_array_size(_G.dbs);
-        ce_array_push(_G.dbs, (db_t) {}, _G.allocator);
+        obj->property_type[idx] = CDB_TYPE_NONE;
+        obj->values[idx] = (ce_cdb_value_u0) {};
+        return;
     }
 
-    _G.dbs[idx] = (db_t) {
-            .used = true,
-            .idx = idx,
-            .max_objects = max_objects,
+    if (!idx) {
+        return;
+    }
 
-            .to_free_objects_uid = (uint64_t *) virt_alloc(max_objects * sizeof(uint64_t)),
+    uint64_t last_idx = --obj->properties_count;
+    ce_hash_add(&obj->prop_map, obj->keys[last_idx], idx, _obj_allocator(obj));
 
-            //
-            .object_pool = (object_t *) virt_alloc(max_objects * sizeof(object_t)),
+    obj->keys[idx] = obj->keys[last_idx];
+    obj->property_type[idx] = obj->property_type[last_idx];
+    obj->values[idx] = obj->values[last_idx];
 
-            //
-            .object_id_pool = (object_t **) virt_alloc(max_objects * sizeof(object_t **)),
-            .free_objects_id = (object_t ***) virt_alloc(max_objects * sizeof(object_t ***)),
-            .type_storage = (type_storage_t *) virt_alloc(MAX_TYPES * sizeof(type_storage_t)),
+    ce_array_pop_back(obj->keys);
+    ce_array_pop_back(obj->property_type);
+    ce_array_pop_back(obj->values);
 
-#ifndef UID_HASHMAP
-#endif
-    };
+    ce_hash_remove(&obj->prop_map, key);
+}
 
-#ifndef UID_HASHMAP
-#endif
+// Epoch reclamation
+// Object version (or writer) unlinked in epoch E is pushed to limbo[E % 3].
+// Epoch can advance only if every reader announced current epoch, so when
+// epoch become E + 2 nobody can see versions from limbo[E % 3].
+static reader_t *_get_reader() {
+    if (!_reader_idx) {
+        _reader_idx = atomic_fetch_add(&_G.readers_n, 1) + 1;
+        CE_ASSERT(LOG_WHERE, _reader_idx < MAX_READERS);
+    }
 
-    struct db_t *db = &_G.dbs[idx];
+    return &_G.readers[_reader_idx];
+}
 
+static uint64_t _oldest_reader_epoch() {
+    uint64_t oldest = UINT64_MAX;
 
-    _init_listener_pack(&db->obj_listeners);
-    _init_listener_pack(&db->chnaged_objs);
+    const uint32_t n = atomic_load(&_G.readers_n);
+    for (uint32_t i = 1; i <= n; ++i) {
+        uint64_t state = atomic_load(&_G.readers[i].state);
+        if (state && ((state >> 1) < oldest)) {
+            oldest = state >> 1;
+        }
+    }
 
-    ce_mpmc_init(&db->free_objects, 4096, sizeof(object_t *), _G.allocator);
-    ce_mpmc_init(&db->to_free_objects, 4096, sizeof(object_t *), _G.allocator);
+    return oldest;
+}
 
-    // create set with idx == 0
-    _new_set(&_G.dbs[idx]);
+static void _reclaim_object(db_t *db,
+                            object_t *obj) {
+    if ((obj->flags & _OBJ_FLAG_TYPED_OBJ) && !(obj->flags & _OBJ_FLAG_WRITER)) {
+        _free_typed_object(obj->storage, obj->typed_obj_idx);
+    }
 
-    // create blob with idx == 0
-    _new_blob(&_G.dbs[idx]);
+    ce_array_clean(obj->instances);
 
-    return (ce_cdb_t0) {.idx = idx};
-};
+    ce_array_clean(obj->property_type);
+    ce_array_clean(obj->keys);
+    ce_array_clean(obj->values);
 
+    ce_hash_clean(&obj->prop_map);
 
-static void _init_from_defs(ce_cdb_t0 db,
-                            object_t *obj,
-                            const ce_cdb_type_def_t0 *def);
+    ce_array_clean(obj->changed);
+    ce_array_clean(obj->keys_view);
+
+    *obj = (object_t) {
+            .instances = obj->instances,
+            .property_type = obj->property_type,
+            .keys = obj->keys,
+            .values = obj->values,
+            .prop_map = obj->prop_map,
+            .changed = obj->changed,
+            .keys_view = obj->keys_view,
+            .obj_listeners = obj->obj_listeners,
+    };
 
-static void create_object_uid(ce_cdb_t0 db,
-                              uint64_t uid,
-                              uint64_t type) {
-    db_t *db_inst = &_G.dbs[db.idx];
-    object_t *obj = _new_object(db_inst, _G.allocator);
+    ce_mpmc_enqueue(&db->free_objects, &obj);
+}
 
-    object_t **objid = _new_obj_id(db_inst);
-    *objid = obj;
-    _set_uid_objid(db_inst, uid, objid);
+// Commit lock, readers wait for it so they never see half applied writer.
+#define _OBJ_LOCKED UINT64_MAX
 
-    obj->id = objid;
-    obj->db = db;
-    obj->type = type;
-    obj->orig_obj = uid;
+static uint64_t _lock_object(object_t *obj) {
+    uint64_t read_epoch = atomic_load(&obj->read_epoch);
+    for (;;) {
+        if (read_epoch == _OBJ_LOCKED) {
+            read_epoch = atomic_load(&obj->read_epoch);
+            continue;
+        }
 
-    type_storage_t *storage = _get_or_create_storage(db_inst, obj->type);
+        if (atomic_compare_exchange_weak(&obj->read_epoch, &read_epoch, _OBJ_LOCKED)) {
+            return read_epoch;
+        }
+    }
+}
 
-    if (storage) {
-        obj->flags |= _OBJ_FLAG_TYPED_OBJ;
-        obj->storage = storage;
-        obj->typed_obj_idx = _new_typed_object(storage, type);
+static void _unlock_object(object_t *obj,
+                           uint64_t read_epoch) {
+    atomic_store(&obj->read_epoch, read_epoch);
+}
 
-        const ce_cdb_type_def_t0 *def = _get_prop_def(type);
-        if (def) {
-            _init_from_defs(db, obj, def);
+// Mark version as read so writers clone it instead of write in place.
+// Mark only grow, reader with older epoch must not hide newer one.
+static void _mark_read(object_t *obj,
+                       uint64_t epoch) {
+    uint64_t read_epoch = atomic_load_explicit(&obj->read_epoch, memory_order_relaxed);
+    while ((read_epoch < epoch) || (read_epoch == _OBJ_LOCKED)) {
+        if (read_epoch == _OBJ_LOCKED) {
+            read_epoch = atomic_load(&obj->read_epoch);
+            continue;
         }
-    } else {
-        _object_new_property(obj, 0, CDB_TYPE_NONE, _G.allocator);
-        const ce_cdb_type_def_t0 *def = _get_prop_def(type);
-        if (def) {
-            _init_from_defs(db, obj, def);
+
+        if (atomic_compare_exchange_weak(&obj->read_epoch, &read_epoch, epoch)) {
+            break;
         }
     }
-
-    ce_array_clean(obj->changed);
 }
 
+// Current prefab version of dynamic instance, typed object has all props.
+static object_t *_prefab_obj(object_t *obj) {
+    if (!obj->prefab || (obj->flags & _OBJ_FLAG_TYPED_OBJ)) {
+        return NULL;
+    }
 
-static uint64_t create_object(ce_cdb_t0 db,
-                              uint64_t type) {
-    uint64_t uid = _gen_uid();
-    create_object_uid(db, uid, type);
-    return uid;
+    object_t *prefab = *obj->prefab;
+    _mark_read(prefab, atomic_load(&_G.epoch));
+    return prefab;
 }
 
-static ce_cdb_obj_o0 *write_begin(ce_cdb_t0 db,
-                                  uint64_t _obj);
-
-static void write_commit(ce_cdb_obj_o0 *_writer);
+// Set or blob idx, or old keys_view array of instance for CDB_TYPE_NONE.
+typedef struct retired_value_t {
+    uint32_t type;
+    uint32_t idx;
+    uint64_t *keys;
+} retired_value_t;
 
-void set_subobject(ce_cdb_obj_o0 *_writer,
-                   uint64_t property,
-                   uint64_t subobject);
+static void _snapshot_free_value(db_t *db,
+                                 enum ce_cdb_type_e0 type,
+                                 ce_cdb_value_u0 *v);
 
-static ce_cdb_value_u0 *_get_value_ptr_generic(object_t *obj,
-                                               uint64_t property) {
+static void _drain_limbo(db_t *db_inst,
+                         uint32_t limbo_idx) {
+    object_t *obj = NULL;
+    while (ce_mpmc_dequeue(&db_inst->limbo[limbo_idx], &obj)) {
+        _reclaim_object(db_inst, obj);
+    }
 
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-        uint64_t o = obj->typed_writer_idx ? obj->typed_writer_idx : obj->typed_obj_idx;
-        ce_cdb_value_u0 *v = _get_prop_value_ptr(obj->storage, o, property);
-        return v;
-    } else {
-        uint64_t idx = _find_prop_index(obj, property);
-        if (idx) {
-            return &obj->values[idx];
+    retired_value_t value = {};
+    while (ce_mpmc_dequeue(&db_inst->value_limbo[limbo_idx], &value)) {
+        if (value.type == CDB_TYPE_NONE) {
+            ce_array_free(value.keys, db_inst->allocator);
+            continue;
         }
-    }
 
-    return NULL;
+        ce_cdb_value_u0 v = {};
+        if (value.type == CDB_TYPE_BLOB) {
+            v.blob = value.idx;
+        } else {
+            v.set = value.idx;
+        }
+
+        _snapshot_free_value(db_inst, value.type, &v);
+    }
 }
 
-static bool prop_exist(const ce_cdb_obj_o0 *reader,
-                       uint64_t key) {
+// Return limbo idx of epoch - 1 that is safe to reclaim or UINT32_MAX.
+static uint32_t _advance_epoch() {
+    uint64_t epoch = atomic_load(&_G.epoch);
 
-    if (!reader) {
-        return false;
+    if (_oldest_reader_epoch() < epoch) {
+        return UINT32_MAX;
     }
 
-    object_t *obj = _get_object_from_o(reader);
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, key);
-    return v != NULL;
+    if (!atomic_compare_exchange_strong(&_G.epoch, &epoch, epoch + 1)) {
+        return UINT32_MAX;
+    }
+
+    return (epoch + 2) % 3;
 }
 
-void prop_copy(const ce_cdb_obj_o0 *from,
-               ce_cdb_obj_o0 *to,
-               uint64_t prop);
+static bool _try_advance_epoch() {
+    const uint32_t limbo_idx = _advance_epoch();
 
-static void set_instance_of(ce_cdb_t0 _db,
-                            uint64_t from,
-                            uint64_t to) {
-    db_t *db = _get_db(_db);
+    if (UINT32_MAX == limbo_idx) {
+        return false;
+    }
 
-    object_t *inst = _get_object_from_uid(db, to);
-    inst->instance_of = from;
+    const uint32_t db_n = ce_array_size(_G.dbs);
+    for (uint32_t i = 0; i < db_n; ++i) {
+        db_t *db_inst = &_G.dbs[i];
+
+        if (!db_inst->used) {
+            continue;
+        }
+
+        _drain_limbo(db_inst, limbo_idx);
+    }
 
+    return true;
 }
 
-static uint64_t create_from(ce_cdb_t0 db,
-                            uint64_t from);
+static void _destroy_object(db_t *db_inst,
+                            object_t *obj) {
+    // Object must be unlinked before we read epoch.
+    atomic_thread_fence(memory_order_seq_cst);
 
-uint64_t read_objset_count(const ce_cdb_obj_o0 *reader,
-                           uint64_t property);
+    for (;;) {
+        uint64_t epoch = atomic_load(&_G.epoch);
+        if (ce_mpmc_enqueue(&db_inst->limbo[epoch % 3], &obj)) {
+            return;
+        }
 
-void add_obj(ce_cdb_obj_o0 *_writer,
-             uint64_t property,
-             uint64_t obj);
+        if (!_try_advance_epoch()) {
+            // Someone pin old epoch for too long, leak it rather than free it.
+            ce_log_a0->warning(LOG_WHERE, "Limbo is full, object version leaked.");
+            return;
+        }
+    }
+}
 
-uint64_t _create_from_uid(ce_cdb_t0 db,
-                          uint64_t from,
-                          uint64_t uid,
-                          bool load) {
-    db_t *db_inst = &_G.dbs[db.idx];
+// Free set, blob or keys when no reader can see version that use it.
+static void _retire(db_t *db_inst,
+                    retired_value_t value) {
+    // Value must be unlinked before we read epoch.
+    atomic_thread_fence(memory_order_seq_cst);
 
-    object_t *from_obj = _get_object_from_uid(db_inst, from);
+    for (;;) {
+        uint64_t epoch = atomic_load(&_G.epoch);
+        if (ce_mpmc_enqueue(&db_inst->value_limbo[epoch % 3], &value)) {
+            return;
+        }
 
-    object_t *inst = _new_object(db_inst, _G.allocator);
+        if (!_try_advance_epoch()) {
+            ce_log_a0->warning(LOG_WHERE, "Limbo is full, value leaked.");
+            return;
+        }
+    }
+}
 
-    object_t **objid = _new_obj_id(db_inst);
-    *objid = inst;
-    _set_uid_objid(db_inst, uid, objid);
+static void _retire_value(db_t *db_inst,
+                          enum ce_cdb_type_e0 type,
+                          uint32_t idx) {
+    _retire(db_inst, (retired_value_t) {.type = type, .idx = idx});
+}
 
-    inst->db = db;
-    inst->id = objid;
-    inst->instance_of = from;
-    inst->type = from_obj->type;
-    inst->orig_obj = uid;
+static void read_pin() {
+    reader_t *reader = _get_reader();
 
-    _add_instance(from_obj, uid);
+    if (_reader_pin_n++) {
+        return;
+    }
 
-    const ce_cdb_obj_o0 *reader = ce_cdb_a0->read(db, from);
+    // Keep epoch of implicit read if any, pointers from it stay valid.
+    uint64_t state = atomic_load(&reader->state);
+    for (;;) {
+        uint64_t new_state = state ? (state | 1) : ((atomic_load(&_G.epoch) << 1) | 1);
+        if (atomic_compare_exchange_weak(&reader->state, &state, new_state)) {
+            break;
+        }
+    }
+}
 
-    type_storage_t *storage = _get_or_create_storage(db_inst, inst->type);
-    if (storage) {
-        inst->flags |= _OBJ_FLAG_TYPED_OBJ;
-        inst->storage = storage;
+static void read_unpin() {
+    reader_t *reader = _get_reader();
 
-        if (from_obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-//            inst->typed_obj_idx = _clone_typed_object(storage, inst->type, from_obj->typed_obj_idx);
-            inst->typed_obj_idx = _new_typed_object(storage, inst->type);
+    CE_ASSERT(LOG_WHERE, _reader_pin_n);
 
-            object_t *wr = inst;
-            for (int i = 0; i < inst->storage->prop_def->num; ++i) {
-                uint64_t key = inst->storage->prop_name[i];
-                uint64_t type = inst->storage->prop_type[i];
+    if (--_reader_pin_n) {
+        return;
+    }
 
-                if (type == CDB_TYPE_SUBOBJECT) {
-                    union ce_cdb_value_u0 *value_ptr = _get_prop_value_ptr(storage,
-                                                                           from_obj->typed_obj_idx,
-                                                                           key);
+    atomic_store(&reader->state, 0);
 
-                    uint64_t old_subobj = value_ptr->subobj;
-                    if (old_subobj) {
-                        uint64_t new_subobj = create_from(db, old_subobj);
-                        set_subobject((ce_cdb_obj_o0 *) wr, key, new_subobj);
-                    }
+    _try_advance_epoch();
+}
 
-                } else if (load && type == CDB_TYPE_SET_SUBOBJECT) {
-                    continue;
-                } else {
-                    prop_copy(reader, (ce_cdb_obj_o0 *) inst, key);
-                }
-            }
-        }
-    } else {
-        _object_new_property(inst, 0, CDB_TYPE_NONE, _G.allocator);
+static void _instance_build_keys(object_t *obj);
+
+// Sets and blobs are shared by versions and changed in place => copy them.
+static void _snapshot_copy_value(db_t *db,
+                                 enum ce_cdb_type_e0 type,
+                                 ce_cdb_value_u0 *v) {
+    if ((type == CDB_TYPE_SET_SUBOBJECT) && v->set) {
+        uint32_t set_idx = _new_set(db);
+        set_t *set = _get_set(db, v->set);
 
+        const uint32_t n = ce_array_size(set->objs);
+        for (uint32_t i = 0; i < n; ++i) {
+            _add_to_set(db, set_idx, set->objs[i]);
+        }
 
-        object_t *wr = inst;
-        for (int i = 1; i < from_obj->properties_count; ++i) {
-            uint64_t key = from_obj->keys[i];
-            if (from_obj->property_type[i] == CDB_TYPE_SUBOBJECT) {
-                union ce_cdb_value_u0 *value_ptr = &from_obj->values[i];
+        v->set = set_idx;
+    } else if ((type == CDB_TYPE_BLOB) && v->blob) {
+        uint32_t blob_idx = _new_blob(db);
+        ce_cdb_blob_t0 *blob = _get_blob(db, v->blob);
 
-                uint64_t old_subobj = value_ptr->subobj;
-                uint64_t new_subobj = create_from(db, old_subobj);
-                set_subobject((ce_cdb_obj_o0 *) wr, from_obj->keys[i], new_subobj);
-            } else if (load && (from_obj->property_type[i] == CDB_TYPE_SET_SUBOBJECT)) {
-                continue;
-            } else {
-                if (!prop_exist((ce_cdb_obj_o0 *) inst, key)) {
-                    prop_copy(reader, (ce_cdb_obj_o0 *) inst, key);
-                }
-            }
+        void *data = NULL;
+        if (blob->size) {
+            data = CE_ALLOC(db->allocator, uint8_t, blob->size);
+            memcpy(data, blob->data, blob->size);
         }
+
+        *_get_blob(db, blob_idx) = (ce_cdb_blob_t0) {
+                .data = data,
+                .size = blob->size,
+        };
+
+        v->blob = blob_idx;
     }
+}
 
+static void _snapshot_free_value(db_t *db,
+                                 enum ce_cdb_type_e0 type,
+                                 ce_cdb_value_u0 *v) {
+    if ((type == CDB_TYPE_SET_SUBOBJECT) && v->set) {
+        set_t *set = _get_set(db, v->set);
+        ce_hash_free(&set->set, db->allocator);
+        ce_array_free(set->objs, db->allocator);
+    } else if ((type == CDB_TYPE_BLOB) && v->blob) {
+        ce_cdb_blob_t0 *blob = _get_blob(db, v->blob);
+        bool *mapped = _blob_mapped(db, v->blob);
 
-    ce_array_clean(inst->changed);
+        if (!*mapped) {
+            CE_FREE(db->allocator, blob->data);
+        }
 
-    return (uint64_t) uid;
+        *mapped = false;
+        *blob = (ce_cdb_blob_t0) {};
+    }
 }
 
-uint64_t create_from_uid(ce_cdb_t0 db,
-                         uint64_t from,
-                         uint64_t uid) {
-    return _create_from_uid(db, from, uid, false);
+static void _snapshot_foreach_value(db_t *db,
+                                    object_t *obj,
+                                    void (*fce)(db_t *,
+                                                enum ce_cdb_type_e0,
+                                                ce_cdb_value_u0 *)) {
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        type_storage_t *storage = obj->storage;
+        const uint32_t n = ce_array_size(storage->prop_type);
+        for (uint32_t i = 0; i < n; ++i) {
+            fce(db, storage->prop_type[i],
+                _get_prop_value_ptr_idx(storage, obj->typed_obj_idx, i));
+        }
+    } else {
+        for (uint64_t i = 1; i < obj->properties_count; ++i) {
+            fce(db, obj->property_type[i], &obj->values[i]);
+        }
+    }
 }
 
-static uint64_t create_from(ce_cdb_t0 db,
-                            uint64_t from) {
-    uint64_t uid = _gen_uid();
-    return create_from_uid(db, from, uid);
-}
+static object_t *_snapshot_copy(db_t *db,
+                                object_t *obj) {
+    object_t *copy = _object_clone(db, obj, db->allocator);
+    ce_array_clean(copy->changed);
 
-uint64_t read_objset_count(const ce_cdb_obj_o0 *reader,
-                           uint64_t property) {
-    object_t *obj = _get_object_from_o(reader);
+    _snapshot_foreach_value(db, copy, _snapshot_copy_value);
 
-    if (!obj) {
-        return 0;
+    return copy;
+}
+
+// Object uid is going to change, snapshots which do not know it yet keep
+// copy of obj. NULL obj => object is created now.
+static void _snapshot_keep(db_t *db,
+                           uint64_t uid,
+                           object_t *obj) {
+    if (!atomic_load(&db->snapshot_n)) {
+        return;
     }
 
-    db_t *db_inst = _get_db(obj->db);
+    ce_os_thread_a0->spin_lock(&db->snapshot_lock);
 
+    object_t *copy = NULL;
+    const uint32_t snapshots_n = ce_array_size(db->snapshots);
+    for (uint32_t i = 0; i < snapshots_n; ++i) {
+        snapshot_t *snapshot = &db->snapshots[i];
 
-    uint32_t setidx = 0;
+        if (!snapshot->used || ce_hash_contain(&snapshot->objs, uid)) {
+            continue;
+        }
 
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-        uint64_t o = obj->typed_writer_idx ? obj->typed_writer_idx : obj->typed_obj_idx;
-        ce_cdb_value_u0 *v = _get_prop_value_ptr(obj->storage, o, property);
+        if (obj && !copy) {
+            uint64_t read_epoch = _lock_object(obj);
+            copy = _snapshot_copy(db, obj);
+            _unlock_object(obj, read_epoch);
 
-        if (!v) {
-            return 0;
+            _instance_build_keys(copy);
         }
 
-        setidx = v->set;
-    } else {
-        uint64_t idx = _find_prop_index(obj, property);
-
-        if (!idx) {
-            return 0;
+        if (copy) {
+            ++copy->snapshot_refs;
         }
 
-        setidx = obj->values[idx].set;
+        ce_hash_add(&snapshot->objs, uid, (uint64_t) copy, _G.allocator);
+        ce_array_push(snapshot->uids, uid, _G.allocator);
     }
 
-    set_t *set = _get_set(db_inst, setidx);
+    ce_os_thread_a0->spin_unlock(&db->snapshot_lock);
+}
 
-    if (!set) {
-        return 0;
+// Own props
+// Instance inherited props are not own => they are not part of delta or index.
+static uint64_t _own_prop_n(object_t *obj) {
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        return ce_array_size(obj->storage->prop_type);
     }
 
-    return ce_array_size(set->objs);
+    return obj->properties_count - 1;
 }
 
-static void destroy_db(ce_cdb_t0 db) {
-    ce_array_push(_G.to_free_db, db.idx, _G.allocator);
+static ce_cdb_value_u0 *_own_prop(object_t *obj,
+                                  uint64_t i,
+                                  uint64_t *key,
+                                  enum ce_cdb_type_e0 *type) {
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        type_storage_t *storage = obj->storage;
+        *key = storage->prop_name[i];
+        *type = storage->prop_type[i];
+        return _get_prop_value_ptr_idx(storage, obj->typed_obj_idx, i);
+    }
+
+    *key = obj->keys[i + 1];
+    *type = obj->property_type[i + 1];
+    return &obj->values[i + 1];
 }
 
-static uint64_t type(ce_cdb_t0 _db,
-                     uint64_t _obj) ;
+static ce_cdb_value_u0 *_own_prop_find(object_t *obj,
+                                       uint64_t key,
+                                       enum ce_cdb_type_e0 *type) {
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        type_storage_t *storage = obj->storage;
+        uint64_t idx = ce_hash_lookup(&storage->prop_idx, key, UINT64_MAX);
 
-static void _add_obj_to_destroy_list(db_t *db_inst,
-                                     uint64_t _obj) {
-    const uint64_t n = db_inst->to_free_objects_uid_n;
-    for (int i = 0; i < n; ++i) {
-        if (db_inst->to_free_objects_uid[i] != _obj) {
-            continue;
+        if (idx == UINT64_MAX) {
+            return NULL;
         }
-//    CE_ASSERT(LOG_WHERE, !contain);
-        return;
+
+        *type = storage->prop_type[idx];
+        return _get_prop_value_ptr_idx(storage, obj->typed_obj_idx, idx);
     }
 
-    object_t *obj = _get_object_from_uid(db_inst, _obj);
+    uint64_t idx = _find_prop_index(obj, key);
+    if (!idx || (obj->property_type[idx] == CDB_TYPE_NONE)) {
+        return NULL;
+    }
 
-    if (obj) {
-        ce_cdb_ev_t0 ev = {
-                .ev_type =  CE_CDB_OBJ_DESTROY_EVENT,
-                .obj = _obj,
-                .obj_type  = obj->type,
-        };
+    *type = obj->property_type[idx];
+    return &obj->values[idx];
+}
 
-        _push_event(&db_inst->chnaged_objs, &ev);
+// Index
+static obj_index_t *_index_entry(db_t *db,
+                                 ce_hash_t *index,
+                                 uint64_t key) {
+    uint64_t idx = ce_hash_lookup(index, key, UINT64_MAX);
 
+    if (idx == UINT64_MAX) {
+        idx = ce_array_size(db->obj_index);
+        ce_array_push(db->obj_index, (obj_index_t) {}, _G.allocator);
+        ce_hash_add(index, key, idx, _G.allocator);
     }
 
-    uint64_t idx = atomic_fetch_add(&db_inst->to_free_objects_uid_n, 1);
-    db_inst->to_free_objects_uid[idx] = _obj;
+    return &db->obj_index[idx];
 }
 
-static enum ce_cdb_type_e0 prop_type(const ce_cdb_obj_o0 *reader,
-                                     uint64_t key);
+static void _index_type(db_t *db,
+                        uint64_t type,
+                        uint64_t obj,
+                        bool add) {
+    if (!type || !(db->flags & CDB_DB_FLAG_TYPE_INDEX)) {
+        return;
+    }
 
-void _remove_obj(ce_cdb_obj_o0 *_writer,
-                 uint64_t property,
-                 uint64_t obj);
+    ce_os_thread_a0->spin_lock(&db->index_lock);
 
-static void destroy_object(ce_cdb_t0 db,
-                           uint64_t _obj) {
-    db_t *db_inst = _get_db(db);
+    obj_index_t *entry = _index_entry(db, &db->type_index, type);
+    uint64_t pos = ce_hash_lookup(&db->type_pos, obj, UINT64_MAX);
 
-    ce_log_a0->debug(LOG_WHERE, "Destroy obj %llx", _obj);
+    if (add && (pos == UINT64_MAX)) {
+        ce_hash_add(&db->type_pos, obj, ce_array_size(entry->objs), _G.allocator);
+        ce_array_push(entry->objs, obj, _G.allocator);
+    } else if (!add && (pos != UINT64_MAX)) {
+        uint64_t last = ce_array_back(entry->objs);
+        entry->objs[pos] = last;
+        ce_array_pop_back(entry->objs);
 
-    object_t *obj = _get_object_from_uid(db_inst, _obj);
+        ce_hash_add(&db->type_pos, last, pos, _G.allocator);
+        ce_hash_remove(&db->type_pos, obj);
+    }
 
-    if (!obj) {
-        ce_log_a0->warning(LOG_WHERE, "Obj %llx is not alive.", _obj);
+    ce_os_thread_a0->spin_unlock(&db->index_lock);
+}
+
+static void _index_ref(db_t *db,
+                       uint64_t target,
+                       uint64_t referrer,
+                       bool add) {
+    if (!target || !(db->flags & CDB_DB_FLAG_REF_INDEX)) {
         return;
     }
 
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-        _free_typed_object(db_inst, obj->type, obj->typed_obj_idx);
-
-        for (int i = 0; i < obj->storage->prop_def->num; ++i) {
-            uint64_t key = obj->storage->prop_name[i];
-            ce_cdb_type_e0 type = obj->storage->prop_type[i];
-            switch (type) {
-                case CDB_TYPE_SUBOBJECT: {
-                    union ce_cdb_value_u0 *value_ptr = _get_value_ptr_generic(obj, key);
+    ce_os_thread_a0->spin_lock(&db->index_lock);
 
-                    uint64_t old_subobj = value_ptr->subobj;
-                    if (old_subobj) {
-                        destroy_object(db, old_subobj);
-                    }
-                }
+    obj_index_t *entry = _index_entry(db, &db->ref_index, target);
+    uint64_t n = ce_hash_lookup(&entry->ref_n, referrer, 0);
 
-                    break;
+    if (add) {
+        if (!n) {
+            ce_array_push(entry->objs, referrer, _G.allocator);
+        }
 
-                case CDB_TYPE_SET_SUBOBJECT: {
-                    uint64_t n = read_objset_count((ce_cdb_obj_o0 *) obj, key);
-                    uint64_t k[n];
-                    ce_cdb_a0->read_objset((ce_cdb_obj_o0 *) obj, key, k);
-                    for (int j = 0; j < n; ++j) {
-                        uint64_t subobj = k[j];
-                        destroy_object(db, subobj);
-                    }
-                }
-                    break;
-                default:
-                    break;
+        ce_hash_add(&entry->ref_n, referrer, n + 1, _G.allocator);
+    } else if (n > 1) {
+        ce_hash_add(&entry->ref_n, referrer, n - 1, _G.allocator);
+    } else if (n) {
+        ce_hash_remove(&entry->ref_n, referrer);
+
+        const uint32_t objs_n = ce_array_size(entry->objs);
+        for (uint32_t i = 0; i < objs_n; ++i) {
+            if (entry->objs[i] == referrer) {
+                entry->objs[i] = entry->objs[objs_n - 1];
+                ce_array_pop_back(entry->objs);
+                break;
             }
         }
+    }
 
-    } else {
-        for (int i = 1; i < obj->properties_count; ++i) {
-            switch (obj->property_type[i]) {
-                case CDB_TYPE_SUBOBJECT: {
-                    union ce_cdb_value_u0 *value_ptr = &obj->values[i];
+    ce_os_thread_a0->spin_unlock(&db->index_lock);
+}
 
-                    uint64_t old_subobj = value_ptr->subobj;
-                    destroy_object(db, old_subobj);
-                }
+static void _index_value(db_t *db,
+                         uint64_t referrer,
+                         enum ce_cdb_type_e0 type,
+                         const ce_cdb_value_u0 *v,
+                         bool add) {
+    switch (type) {
+        case CDB_TYPE_REF:
+            _index_ref(db, v->ref, referrer, add);
+            break;
 
-                    break;
+        case CDB_TYPE_SUBOBJECT:
+            _index_ref(db, v->subobj, referrer, add);
+            break;
 
-                case CDB_TYPE_SET_SUBOBJECT: {
-                    uint64_t prop = obj->keys[i];
-                    uint64_t n = read_objset_count((ce_cdb_obj_o0 *) obj, prop);
-                    uint64_t k[n];
-                    ce_cdb_a0->read_objset((ce_cdb_obj_o0 *) obj, prop, k);
-                    for (int j = 0; j < n; ++j) {
-                        uint64_t subobj = k[j];
-                        destroy_object(db, subobj);
-                    }
-                }
-                    break;
-                default:
-                    break;
+        case CDB_TYPE_SET_SUBOBJECT: {
+            set_t *set = _get_set(db, v->set);
+            const uint32_t n = set ? ce_array_size(set->objs) : 0;
+            for (uint32_t i = 0; i < n; ++i) {
+                _index_ref(db, set->objs[i], referrer, add);
             }
         }
-    }
+            break;
 
-    // Remove from parent
-    if (obj->parent) {
-        object_t *parent_obj = _get_object_from_uid(db_inst, obj->parent);
-        if (prop_type((ce_cdb_obj_o0 *) parent_obj, obj->key) == CDB_TYPE_SET_SUBOBJECT) {
-            _remove_obj((ce_cdb_obj_o0 *) parent_obj, obj->key, _obj);
-        }
+        default:
+            break;
     }
+}
 
-    // destroy instances
-    uint64_t inst_n = ce_array_size(obj->instances);
-    for (int l = 0; l < inst_n; ++l) {
-        uint64_t inst = obj->instances[l];
-        destroy_object(db, inst);
+// Set members are indexed by add_obj/remove_obj as they change set in place.
+static void _index_obj_refs(db_t *db,
+                            object_t *obj,
+                            bool add,
+                            bool sets) {
+    if (!(db->flags & CDB_DB_FLAG_REF_INDEX)) {
+        return;
     }
 
-    _add_obj_to_destroy_list(db_inst, _obj);
-}
+    const uint64_t prop_n = _own_prop_n(obj);
+    for (uint64_t i = 0; i < prop_n; ++i) {
+        uint64_t key;
+        enum ce_cdb_type_e0 type;
+        ce_cdb_value_u0 *v = _own_prop(obj, i, &key, &type);
 
-static void _gc_db() {
-    const uint32_t fdb_n = ce_array_size(_G.to_free_db);
-    for (int i = 0; i < fdb_n; ++i) {
-        uint32_t idx = _G.to_free_db[i];
-        struct db_t *db_inst = &_G.dbs[idx];
+        if (!sets && (type == CDB_TYPE_SET_SUBOBJECT)) {
+            continue;
+        }
 
-        virt_free(db_inst->to_free_objects_uid, db_inst->max_objects * sizeof(object_t **));
-        virt_free(db_inst->object_pool, db_inst->max_objects * sizeof(object_t));
+        _index_value(db, obj->orig_obj, type, v, add);
+    }
+}
 
-        ce_mpmc_free(&db_inst->free_objects);
-        ce_mpmc_free(&db_inst->to_free_objects);
+static void _index_obj(db_t *db,
+                       object_t *obj,
+                       bool add) {
+    _index_type(db, obj->type, obj->orig_obj, add);
+    _index_obj_refs(db, obj, add, true);
+}
 
-        db_inst->used = false;
+// Ref and subobject are changed on commit, removed set lose its members.
+static void _index_commit(db_t *db,
+                          object_t *obj,
+                          object_t *writer) {
+    if (!(db->flags & CDB_DB_FLAG_REF_INDEX)) {
+        return;
     }
-    ce_array_clean(_G.to_free_db);
-}
 
-static void _typed_gc() {
-    const uint32_t db_n = ce_array_size(_G.dbs);
-    for (int i = 0; i < db_n; ++i) {
-        struct db_t *db_inst = &_G.dbs[i];
+    for (uint64_t i = 1; i < writer->properties_count; ++i) {
+        enum ce_cdb_type_e0 type = writer->property_type[i];
+        const ce_cdb_value_u0 *v = &writer->values[i];
 
-        if (!db_inst->used) {
+        enum ce_cdb_type_e0 old_type = CDB_TYPE_NONE;
+        const ce_cdb_value_u0 *old_v = _own_prop_find(obj, writer->keys[i], &old_type);
+
+        if (old_v && (old_type == type) && !memcmp(old_v, v, sizeof(ce_cdb_value_u0))) {
             continue;
         }
 
-        uint32_t n = db_inst->type_n;
-
-        for (int j = 0; j < n; ++j) {
-            type_storage_t *storage = &db_inst->type_storage[j];
+        if (old_v && ((old_type != CDB_TYPE_SET_SUBOBJECT) || (type == CDB_TYPE_NONE))) {
+            _index_value(db, obj->orig_obj, old_type, old_v, false);
+        }
 
-            uint64_t to_free_idx = 0;
-            while (ce_mpmc_dequeue(&storage->to_free_idx, &to_free_idx)) {
-                memset(&storage->pool[to_free_idx * storage->type_size], 0, storage->type_size);
-                ce_mpmc_enqueue(&storage->free_idx, &to_free_idx);
-            }
+        if (type != CDB_TYPE_SET_SUBOBJECT) {
+            _index_value(db, obj->orig_obj, type, v, true);
         }
     }
 }
 
-static void gc() {
-    _gc_db();
+static uint32_t _index_read(db_t *db,
+                            ce_hash_t *index,
+                            uint64_t key,
+                            uint64_t *objs,
+                            uint32_t max) {
+    ce_os_thread_a0->spin_lock(&db->index_lock);
 
-    const uint32_t db_n = ce_array_size(_G.dbs);
-    for (int i = 0; i < db_n; ++i) {
-        struct db_t *db_inst = &_G.dbs[i];
+    uint64_t idx = ce_hash_lookup(index, key, UINT64_MAX);
+    uint32_t n = 0;
 
-        if (!db_inst->used) {
-            continue;
-        }
+    if (idx != UINT64_MAX) {
+        obj_index_t *entry = &db->obj_index[idx];
+        n = ce_array_size(entry->objs);
 
-        ce_array_clean(db_inst->changed_obj);
-        ce_hash_clean(&db_inst->changed_obj_set);
+        if (objs && n) {
+            memcpy(objs, entry->objs, sizeof(uint64_t) * (n < max ? n : max));
+        }
+    }
 
-        const uint32_t to_free_objects_uid_n = db_inst->to_free_objects_uid_n;
+    ce_os_thread_a0->spin_unlock(&db->index_lock);
 
-        for (int j = 0; j < to_free_objects_uid_n; ++j) {
-            uint64_t objid = db_inst->to_free_objects_uid[j];
+    return n;
+}
 
-            struct object_t *obj = _get_object_from_uid(db_inst, objid);
+static uint32_t objs_by_type(ce_cdb_t0 db,
+                             uint64_t type,
+                             uint64_t *objs,
+                             uint32_t max) {
+    db_t *db_inst = _get_db(db);
+    return _index_read(db_inst, &db_inst->type_index, type, objs, max);
+}
 
-            // remove from instance from parent instance
-            if (obj->instance_of) {
-                struct object_t *prefab_obj = _get_object_from_uid(db_inst, obj->instance_of);
+static uint32_t referrers(ce_cdb_t0 db,
+                          uint64_t obj,
+                          uint64_t *objs,
+                          uint32_t max) {
+    db_t *db_inst = _get_db(db);
+    return _index_read(db_inst, &db_inst->ref_index, obj, objs, max);
+}
 
-                const uint32_t instances_n = ce_array_size(prefab_obj->instances);
+// Segpool hold at most CE_SEGPOOL_DIR_N^2 blocks, make block big enough for
+// max_objects.
+static uint32_t _object_pool_block_items(uint64_t max_objects) {
+    const uint64_t blocks_n = (uint64_t) CE_SEGPOOL_DIR_N * CE_SEGPOOL_DIR_N;
+    const uint64_t items = (max_objects + blocks_n - 1) / blocks_n;
 
-                const uint32_t last_idx = instances_n - 1;
-                for (int k = 0; k < instances_n; ++k) {
-                    if (prefab_obj->instances[k] != obj->orig_obj) {
-                        continue;
-                    }
+    return (items > OBJECT_POOL_BLOCK_ITEMS) ? (uint32_t) items
+                                             : OBJECT_POOL_BLOCK_ITEMS;
+}
 
-                    prefab_obj->instances[k] = prefab_obj->instances[last_idx];
-                    ce_array_pop_back(prefab_obj->instances);
-                    break;
-                }
-            }
+static struct ce_cdb_t0 create_db(uint64_t max_objects,
+                                  uint64_t flags) {
+    uint64_t n = ce_array_size(_G.dbs);
 
-            _destroy_object(db_inst, obj);
+    uint32_t idx = UINT32_MAX;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (!_G.dbs[i].used) {
+            idx = i;
+            break;
         }
+    }
 
-        for (int j = 0; j < to_free_objects_uid_n; ++j) {
-            uint64_t uid = db_inst->to_free_objects_uid[j];
-
-            object_t **objid = _get_objectid_from_uid(db_inst, uid);
-            if (objid) {
-                _free_obj_id(db_inst, objid);
-            }
-
-            _remove_uid_obj(db_inst, uid);
-        }
+    if (UINT32_MAX == idx) {
+        idx = ce_array_size(_G.dbs);
+        ce_array_push(_G.dbs, (db_t) {}, _G.allocator);
+    }
 
-        db_inst->to_free_objects_uid_n = 0;
+    _G.dbs[idx] = (db_t) {
+            .used = true,
+            .idx = idx,
+            .max_objects = max_objects,
+            .flags = flags,
+            .allocator = (flags & CDB_DB_FLAG_ARENA)
+                         ? ce_memory_a0->create_arena(_G.allocator, CDB_ARENA_CHUNK_SIZE)
+                         : _G.allocator,
 
+#ifndef UID_HASHMAP
+#endif
+    };
 
-        struct object_t *to_free_obj = 0;
-        while (ce_mpmc_dequeue(&db_inst->to_free_objects, &to_free_obj)) {
-            ce_array_clean(to_free_obj->instances);
+#ifndef UID_HASHMAP
+#endif
 
-            ce_array_clean(to_free_obj->property_type);
-            ce_array_clean(to_free_obj->keys);
-            ce_array_clean(to_free_obj->values);
+    struct db_t *db = &_G.dbs[idx];
 
-            ce_hash_clean(&to_free_obj->prop_map);
+    // Pools grow by blocks, max_objects is only limit.
+    ce_segpool_init(&db->to_free_objects_uid, sizeof(uint64_t), 4096, _G.allocator);
+    ce_segpool_init(&db->object_pool, sizeof(object_t),
+                    _object_pool_block_items(max_objects), _G.allocator);
+    ce_segpool_init(&db->object_id_pool, sizeof(object_t *), 4096, _G.allocator);
+    ce_segpool_init(&db->free_objects_id, sizeof(object_t **), 4096, _G.allocator);
+    ce_segpool_init(&db->type_storage, sizeof(type_storage_t), 64, _G.allocator);
+    ce_segpool_init(&db->blob_pool, sizeof(blob_t), VALUE_POOL_BLOCK_ITEMS, _G.allocator);
+    ce_segpool_init(&db->set_pool, sizeof(set_t), VALUE_POOL_BLOCK_ITEMS, _G.allocator);
 
-            ce_array_clean(to_free_obj->changed);
 
-            *to_free_obj = (object_t) {
-                    .instances = to_free_obj->instances,
-                    .property_type = to_free_obj->property_type,
-                    .keys = to_free_obj->keys,
-                    .values = to_free_obj->values,
-                    .prop_map = to_free_obj->prop_map,
-                    .changed = to_free_obj->changed,
-                    .obj_listeners = to_free_obj->obj_listeners,
-            };
+    _init_listener_pack(&db->obj_listeners);
+    _init_listener_pack(&db->chnaged_objs);
 
-            ce_mpmc_enqueue(&db_inst->free_objects, &to_free_obj);
-        }
+    ce_mpmc_init(&db->free_objects, 4096, sizeof(object_t *), _G.allocator);
 
+    for (int i = 0; i < CE_ARRAY_LEN(db->limbo); ++i) {
+        ce_mpmc_init(&db->limbo[i], LIMBO_QUEUE_SIZE, sizeof(object_t *), _G.allocator);
+        ce_mpmc_init(&db->value_limbo[i], LIMBO_QUEUE_SIZE, sizeof(retired_value_t), _G.allocator);
     }
 
-    _typed_gc();
-}
+    // create set with idx == 0
+    _new_set(&_G.dbs[idx]);
 
-typedef struct cdb_binobj_header {
-    uint64_t version;
-    uint64_t type;
-    uint64_t parent;
-    uint64_t instance_of;
-    uint64_t properties_count;
-    uint64_t string_buffer_size;
-    uint64_t blob_buffer_size;
-    uint64_t set_buffer_size;
-} cdb_binobj_header;
+    // create blob with idx == 0
+    _new_blob(&_G.dbs[idx]);
 
-// TODO: typed obj case is invalid
-static void dump(ce_cdb_t0 db,
-                 uint64_t _obj,
-                 char **output,
-                 struct ce_alloc_t0 *allocator) {
-    db_t *dbi = _get_db(db);
+    return (ce_cdb_t0) {.idx = idx};
+};
 
-    object_t *obj = _get_object_from_uid(dbi, _obj);
 
-    char *str_buffer = NULL;
-    char *blob_buffer = NULL;
-    char *set_buffer = NULL;
+static void _init_from_defs(ce_cdb_t0 db,
+                            object_t *obj,
+                            const ce_cdb_type_def_t0 *def);
 
-    uint64_t *keys = NULL;
-    uint8_t *type = NULL;
-    ce_cdb_value_u0 *values = NULL;
-    ce_cdb_value_u0 *values_copy = NULL;
+static void create_object_uid(ce_cdb_t0 db,
+                              uint64_t uid,
+                              uint64_t type) {
+    db_t *db_inst = &_G.dbs[db.idx];
+    _snapshot_keep(db_inst, uid, NULL);
 
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+    object_t *obj = _new_object(db_inst, db_inst->allocator);
 
-    } else {
-        keys = obj->keys;
-        type = obj->property_type;
+    object_t **objid = _new_obj_id(db_inst);
+    *objid = obj;
+    _set_uid_objid(db_inst, uid, objid);
 
-        values = obj->values;
-        values_copy = CE_ALLOC(allocator,
-                               ce_cdb_value_u0,
-                               sizeof(ce_cdb_value_u0) * ce_array_size(values));
-        memcpy(values_copy, values, sizeof(ce_cdb_value_u0) * ce_array_size(values));
+    obj->id = objid;
+    obj->db = db;
+    obj->type = type;
+    obj->orig_obj = uid;
 
-        for (int i = 1; i < obj->properties_count; ++i) {
-            switch (obj->property_type[i]) {
-                case CDB_TYPE_STR: {
-                    uint64_t stroffset = ce_array_size(str_buffer);
-                    char *str = values_copy[i].str;
-                    ce_array_push_n(str_buffer, str, strlen(str) + 1, allocator);
+    type_storage_t *storage = _get_or_create_storage(db_inst, obj->type);
 
-                    values_copy[i].uint64 = stroffset;
-                }
-                    break;
+    if (storage) {
+        obj->flags |= _OBJ_FLAG_TYPED_OBJ;
+        obj->storage = storage;
+        obj->typed_obj_idx = _new_typed_object(storage, type);
 
-                case CDB_TYPE_BLOB: {
-                    uint64_t bloboffset = ce_array_size(blob_buffer);
+        const ce_cdb_type_def_t0 *def = _get_prop_def(type);
+        if (def) {
+            _init_from_defs(db, obj, def);
+        }
+    } else {
+        _object_new_property(obj, 0, CDB_TYPE_NONE, db_inst->allocator);
+        const ce_cdb_type_def_t0 *def = _get_prop_def(type);
+        if (def) {
+            _init_from_defs(db, obj, def);
+        }
+    }
 
+    ce_array_clean(obj->changed);
 
-                    struct ce_cdb_blob_t0 *blob = _get_blob(dbi, values_copy[i].blob);
+    _index_type(db_inst, type, uid, true);
+    _index_obj_refs(db_inst, obj, true, false);
+}
 
-                    ce_array_push_n(blob_buffer, &blob->size, sizeof(uint64_t), allocator);
-                    ce_array_push_n(blob_buffer, blob->data, blob->size, allocator);
 
-                    values_copy[i].uint64 = bloboffset;
-                }
-                    break;
+static uint64_t create_object(ce_cdb_t0 db,
+                              uint64_t type) {
+    uint64_t uid = _gen_uid();
+    create_object_uid(db, uid, type);
+    return uid;
+}
 
-                case CDB_TYPE_SET_SUBOBJECT: {
-                    uint64_t setoffset = ce_array_size(set_buffer);
+static ce_cdb_obj_o0 *write_begin(ce_cdb_t0 db,
+                                  uint64_t _obj);
 
-                    struct set_t *set = _get_set(dbi, values_copy[i].set);
+static void write_commit(ce_cdb_obj_o0 *_writer);
 
-                    uint64_t n = ce_array_size(set->objs);
+void set_subobject(ce_cdb_obj_o0 *_writer,
+                   uint64_t property,
+                   uint64_t subobject);
 
-                    ce_array_push_n(set_buffer, &n, sizeof(uint64_t), allocator);
-                    ce_array_push_n(set_buffer, set->objs, sizeof(uint64_t) * n, allocator);
+static ce_cdb_value_u0 *_get_value_ptr_generic(object_t *obj,
+                                               uint64_t property) {
 
-                    values_copy[i].uint64 = setoffset;
-                }
-                    break;
-                default:
-                    break;
+    if (obj->flags & _OBJ_FLAG_WRITER) {
+        uint64_t idx = _find_prop_index(obj, property);
+        if (idx) {
+            if (obj->property_type[idx] == CDB_TYPE_NONE) {
+                return NULL; // removed in this writer
             }
+
+            return &obj->values[idx];
         }
+
+        obj = obj->base;
     }
 
-    cdb_binobj_header header = {
-            .type = obj->type,
-            .parent = obj->parent,
-            .instance_of = obj->instance_of,
-            .properties_count = obj->properties_count - 1,
-            .string_buffer_size = ce_array_size(str_buffer),
-            .blob_buffer_size = ce_array_size(blob_buffer),
-            .set_buffer_size = ce_array_size(set_buffer),
-    };
+    while (obj) {
+        if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+            return _get_prop_value_ptr(obj->storage, obj->typed_obj_idx, property);
+        }
 
-    ce_array_push_n(*output, (char *) &header,
-                    sizeof(cdb_binobj_header),
-                    allocator);
+        uint64_t idx = _find_prop_index(obj, property);
+        if (idx) {
+            return &obj->values[idx];
+        }
 
-    if (true && (obj->flags & _OBJ_FLAG_TYPED_OBJ)) {
-        ce_array_push_n(*output, (char *) (obj->storage->prop_name),
-                        sizeof(uint64_t) * (ce_array_size(obj->storage->prop_name)),
-                        allocator);
+        obj = _prefab_obj(obj);
+    }
 
-        ce_array_push_n(*output, (char *) (obj->storage->prop_type),
-                        sizeof(uint8_t) * (ce_array_size(obj->storage->prop_type)),
-                        allocator);
+    return NULL;
+}
 
-        ce_cdb_type_def_t0 *defs = obj->storage->prop_def;
+// Prop index is index of prop in type def. Typed object => direct offset load.
+static ce_cdb_value_u0 *_get_value_ptr_idx(object_t *obj,
+                                           uint32_t prop_idx) {
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        type_storage_t *storage = obj->storage;
 
-        for (int i = 0; i < defs->num; ++i) {
-            ce_cdb_prop_def_t0 *def = &defs->defs[i];
-            uint64_t k = ce_id_a0->id64(def->name);
-
-            switch (def->type) {
-                case CDB_TYPE_SET_SUBOBJECT:
-                case CDB_TYPE_BLOB:
-                case CDB_TYPE_STR:
-                    ce_array_push_n(*output, &values_copy[i + 1],
-                                    sizeof(ce_cdb_value_u0), allocator);
-                    break;
+        if (prop_idx >= ce_array_size(storage->prop_offset)) {
+            return NULL;
+        }
 
-                default: {
-                    ce_cdb_value_u0 *v = _get_prop_value_ptr(obj->storage, obj->typed_obj_idx, k);
-                    ce_array_push_n(*output, v, sizeof(ce_cdb_value_u0), allocator);
+        if (obj->flags & _OBJ_FLAG_WRITER) {
+            uint64_t idx = _find_prop_index(obj, storage->prop_name[prop_idx]);
+            if (idx) {
+                if (obj->property_type[idx] == CDB_TYPE_NONE) {
+                    return NULL;
                 }
-                    break;
+
+                return &obj->values[idx];
             }
-        }
-    } else {
-        ce_array_push_n(*output, (char *) (keys + 1),
-                        sizeof(uint64_t) * (ce_array_size(keys) - 1),
-                        allocator);
 
-        ce_array_push_n(*output, (char *) (type + 1),
-                        sizeof(uint8_t) * (ce_array_size(type) - 1),
-                        allocator);
+            obj = obj->base;
+        }
 
-        ce_array_push_n(*output, (char *) (values_copy + 1),
-                        sizeof(ce_cdb_value_u0) * (ce_array_size(values) - 1),
-                        allocator);
+        return _get_prop_value_ptr_idx(storage, obj->typed_obj_idx, prop_idx);
     }
 
-    ce_array_push_n(*output, (char *) str_buffer,
-                    header.string_buffer_size,
-                    allocator);
+    uint64_t key = _prop_index_key(obj->type, prop_idx);
 
-    ce_array_push_n(*output, (char *) blob_buffer,
-                    header.blob_buffer_size,
-                    allocator);
+    if (!key) {
+        return NULL;
+    }
 
-    ce_array_push_n(*output, (char *) set_buffer,
-                    header.set_buffer_size,
-                    allocator);
+    return _get_value_ptr_generic(obj, key);
+}
 
+static bool prop_exist(const ce_cdb_obj_o0 *reader,
+                       uint64_t key) {
 
-    ce_array_free(str_buffer, allocator);
-    ce_array_free(blob_buffer, allocator);
-    ce_array_free(set_buffer, allocator);
+    if (!reader) {
+        return false;
+    }
 
-    CE_FREE(allocator, values_copy);
+    object_t *obj = _get_object_from_o(reader);
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, key);
+    return v != NULL;
 }
 
+void prop_copy(const ce_cdb_obj_o0 *from,
+               ce_cdb_obj_o0 *to,
+               uint64_t prop);
 
-static ce_cdb_obj_o0 *write_begin(ce_cdb_t0 db,
-                                  uint64_t _obj) {
-    db_t *db_inst = _get_db(db);
-    object_t *obj = _get_object_from_uid(db_inst, _obj);
-
-    if (!obj) {
-        return NULL;
-    }
+static uint64_t prop_count(const ce_cdb_obj_o0 *reader);
 
-    object_t *new_obj = _object_clone(db_inst, obj, _G.allocator);
+static const uint64_t *prop_keys(const ce_cdb_obj_o0 *reader);
 
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-        new_obj->typed_obj_idx = obj->typed_obj_idx;
-        uint64_t clone_objidx = _clone_typed_object(new_obj->storage,
-                                                    obj->type,
-                                                    obj->typed_obj_idx);
-        new_obj->typed_writer_idx = clone_objidx;
-    }
+static enum ce_cdb_type_e0 prop_type(const ce_cdb_obj_o0 *reader,
+                                     uint64_t key);
 
-    uint32_t n = ce_array_size(obj->instances);
-    if (n) {
-        ce_array_push_n(new_obj->instances, obj->instances, n, _G.allocator);
-    }
+static uint64_t read_subobject(const ce_cdb_obj_o0 *reader,
+                               uint64_t property,
+                               uint64_t defaultt);
 
-    new_obj->orig_obj = _obj;
+static void _instance_build_keys(object_t *obj);
 
-    return (ce_cdb_obj_o0 *) new_obj;
-}
-
-static enum ce_cdb_type_e0 prop_type(const ce_cdb_obj_o0 *reader,
-                                     uint64_t key) {
-    object_t *obj = _get_object_from_o(reader);
-
-
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-        for (int i = 0; i < obj->storage->prop_def->num; ++i) {
-            uint64_t name = obj->storage->prop_name[i];
-            if (name != key) {
-                continue;
-            }
+static void set_instance_of(ce_cdb_t0 _db,
+                            uint64_t from,
+                            uint64_t to) {
+    db_t *db = _get_db(_db);
 
-            return obj->storage->prop_type[i];
-        }
-    } else {
-        uint64_t idx = _find_prop_index(obj, key);
-        if (idx) {
-            return (enum ce_cdb_type_e0) obj->property_type[idx];
-        }
-    }
+    object_t *inst = _get_object_from_uid(db, to);
+    _snapshot_keep(db, to, inst);
+    inst->instance_of = from;
 
-    return CDB_TYPE_NONE;
+    object_t *prefab = _get_object_from_uid(db, from);
+    inst->prefab = prefab ? prefab->id : NULL;
+    _instance_build_keys(inst);
 }
 
-static void _dispatch_instances(ce_cdb_t0 db,
-                                struct object_t *orig_obj);
-
-static void write_commit(ce_cdb_obj_o0 *_writer) {
-    object_t *writer = _get_object_from_o(_writer);
-
-    if (!writer) {
-        return;
-    }
-
-    db_t *db = _get_db(writer->db);
-
-    object_t *orig_obj = _get_object_from_uid(db, writer->orig_obj);
-
-    _dispatch_instances(writer->db, writer);
+static uint64_t create_from(ce_cdb_t0 db,
+                            uint64_t from);
 
-    if (writer->typed_obj_idx) {
-        _free_typed_object(db, writer->type, writer->typed_obj_idx);
-        writer->typed_obj_idx = writer->typed_writer_idx;
-    }
+uint64_t read_objset_count(const ce_cdb_obj_o0 *reader,
+                           uint64_t property);
 
-    *writer->id = writer;
+void add_obj(ce_cdb_obj_o0 *_writer,
+             uint64_t property,
+             uint64_t obj);
 
-    _add_changed_obj(db, writer);
+// Instance is dynamic object that hold only overridden props, rest is read
+// from prefab. Subobjects and sets are instanced because instance own them.
+uint64_t _create_from_uid(ce_cdb_t0 db,
+                          uint64_t from,
+                          uint64_t uid,
+                          bool load) {
+    db_t *db_inst = &_G.dbs[db.idx];
 
-    uint32_t ch_n = ce_array_size(writer->changed);
-    for (int i = 0; i < ch_n; ++i) {
-        _push_event(&db->obj_listeners, &writer->changed[i]);
-        _push_event(&writer->obj_listeners, &writer->changed[i]);
-    }
+    object_t *from_obj = _get_object_from_uid(db_inst, from);
 
-    ce_array_clean(writer->changed);
-    _destroy_object(db, orig_obj);
-}
+    _snapshot_keep(db_inst, uid, NULL);
+    _snapshot_keep(db_inst, from, from_obj);
 
-static bool write_try_commit(ce_cdb_obj_o0 *_writer) {
-    object_t *writer = _get_object_from_o(_writer);
-    db_t *db = _get_db(writer->db);
+    object_t *inst = _new_object(db_inst, db_inst->allocator);
 
-    object_t *orig_obj = _get_object_from_uid(db, writer->orig_obj);
+    object_t **objid = _new_obj_id(db_inst);
+    *objid = inst;
+    _set_uid_objid(db_inst, uid, objid);
 
-    object_t **obj_addr = orig_obj->id;
+    inst->db = db;
+    inst->id = objid;
+    inst->instance_of = from;
+    inst->prefab = from_obj->id;
+    inst->type = from_obj->type;
+    inst->orig_obj = uid;
 
-    if (writer->typed_obj_idx) {
-        _free_typed_object(db, writer->type, writer->typed_obj_idx);
-        writer->typed_obj_idx = writer->typed_writer_idx;
-    }
+    _add_instance(from_obj, uid);
 
-    bool ok = atomic_compare_exchange_weak((atomic_ullong *) obj_addr,
-                                           ((uint64_t *) &orig_obj),
-                                           ((uint64_t) writer));
+    _object_new_property(inst, 0, CDB_TYPE_NONE, db_inst->allocator);
 
-    if (ok) {
-        _add_changed_obj(db, writer);
+    const ce_cdb_obj_o0 *reader = ce_cdb_a0->read(db, from);
+    const uint64_t prop_n = prop_count(reader);
+    const uint64_t *keys = prop_keys(reader);
 
-        uint32_t ch_n = ce_array_size(writer->changed);
+    ce_cdb_obj_o0 *wr = (ce_cdb_obj_o0 *) inst;
+    for (uint64_t i = 0; i < prop_n; ++i) {
+        uint64_t key = keys[i];
+        enum ce_cdb_type_e0 type = prop_type(reader, key);
 
-        for (int i = 0; i < ch_n; ++i) {
-            _push_event(&db->obj_listeners, &writer->changed[i]);
+        if (type == CDB_TYPE_SUBOBJECT) {
+            uint64_t subobj = read_subobject(reader, key, 0);
+            if (subobj) {
+                set_subobject(wr, key, create_from(db, subobj));
+            }
+        } else if (!load && (type == CDB_TYPE_SET_SUBOBJECT)) {
+            prop_copy(reader, wr, key);
         }
     }
 
-    _destroy_object(db, orig_obj);
-    return ok;
-}
+    ce_array_clean(inst->changed);
 
-static ce_cdb_value_u0 *_get_or_create_value_ptr_generic(object_t *obj,
-                                                         uint64_t property,
-                                                         ce_cdb_type_e0 prop_type) {
+    _instance_build_keys(inst);
 
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-        uint64_t o = obj->typed_writer_idx ? obj->typed_writer_idx : obj->typed_obj_idx;
-        ce_cdb_value_u0 *v = _get_prop_value_ptr(obj->storage, o, property);
-        return v;
-    } else {
-        uint64_t idx = _find_prop_index(obj, property);
-        if (!idx) {
-            idx = _object_new_property(obj, property, prop_type, _G.allocator);
-        }
-        return &obj->values[idx];
-    }
+    _index_type(db_inst, inst->type, uid, true);
+    _index_obj_refs(db_inst, inst, true, false);
 
-    return NULL;
+    return (uint64_t) uid;
 }
 
-static void _set_float(ce_cdb_obj_o0 *_writer,
-                       uint64_t property,
-                       float value,
-                       bool log_event) {
-    object_t *writer = _get_object_from_o(_writer);
+uint64_t create_from_uid(ce_cdb_t0 db,
+                         uint64_t from,
+                         uint64_t uid) {
+    return _create_from_uid(db, from, uid, false);
+}
 
-    if (!writer) {
-        return;
-    }
+static uint64_t create_from(ce_cdb_t0 db,
+                            uint64_t from) {
+    uint64_t uid = _gen_uid();
+    return create_from_uid(db, from, uid);
+}
 
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_FLOAT);
+uint64_t read_objset_count(const ce_cdb_obj_o0 *reader,
+                           uint64_t property) {
+    object_t *obj = _get_object_from_o(reader);
 
-    if (log_event) {
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop = property,
-                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
-                .prop_type = CDB_TYPE_FLOAT,
-                .old_value = *value_ptr,
-                .new_value.f = value,
-        });
+    if (!obj) {
+        return 0;
     }
 
-    value_ptr->f = value;
+    db_t *db_inst = _get_db(obj->db);
 
-}
 
-static void _set_bool(ce_cdb_obj_o0 *_writer,
-                      uint64_t property,
-                      bool value,
-                      bool log_event) {
-    object_t *writer = _get_object_from_o(_writer);
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
 
-    if (!writer) {
-        return;
+    if (!v) {
+        return 0;
     }
 
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_BOOL);
+    set_t *set = _get_set(db_inst, v->set);
 
-    if (log_event) {
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop=property,
-                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
-                .prop_type = CDB_TYPE_BOOL,
-                .old_value = *value_ptr,
-                .new_value.b = value,
-        });
+    if (!set) {
+        return 0;
     }
 
-    value_ptr->b = value;
+    return ce_array_size(set->objs);
 }
 
-static void _set_string(ce_cdb_obj_o0 *_writer,
-                        uint64_t property,
-                        const char *value,
-                        bool log_event) {
-    ce_alloc_t0 *a = _G.allocator;
-
-    object_t *writer = _get_object_from_o(_writer);
+static void destroy_db(ce_cdb_t0 db) {
+    ce_array_push(_G.to_free_db, db.idx, _G.allocator);
+}
 
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_STR);
+static uint64_t type(ce_cdb_t0 _db,
+                     uint64_t _obj) ;
 
-    char *value_clone = NULL;
-    if (value) {
-        value_clone = ce_memory_a0->str_dup(value, a);
+static void _add_obj_to_destroy_list(db_t *db_inst,
+                                     uint64_t _obj) {
+    ce_os_thread_a0->spin_lock(&db_inst->destroy_lock);
+    bool contain = ce_hash_contain(&db_inst->to_free_set, _obj);
+    if (!contain) {
+        ce_hash_add(&db_inst->to_free_set, _obj, 1, _G.allocator);
     }
+    ce_os_thread_a0->spin_unlock(&db_inst->destroy_lock);
 
-    if (log_event) {
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop=property,
-                .ev_type =CE_CDB_PROP_CHANGE_EVENT,
-                .prop_type = CDB_TYPE_STR,
-                .old_value = *value_ptr,
-                .new_value.str = value_clone,
-        });
+    if (contain) {
+        return;
     }
 
-    value_ptr->str = value_clone;
-}
-
+    object_t *obj = _get_object_from_uid(db_inst, _obj);
 
-static void _set_uint64(ce_cdb_obj_o0 *_writer,
-                        uint64_t property,
-                        uint64_t value,
-                        bool log_event) {
-    object_t *writer = _get_object_from_o(_writer);
+    if (obj) {
+        ce_cdb_ev_t0 ev = {
+                .ev_type =  CE_CDB_OBJ_DESTROY_EVENT,
+                .obj = _obj,
+                .obj_type  = obj->type,
+        };
 
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
-                                                                  CDB_TYPE_UINT64);
+        _push_event(&db_inst->chnaged_objs, &ev);
 
-    if (log_event) {
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop=property,
-                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
-                .prop_type = CDB_TYPE_UINT64,
-                .old_value = *value_ptr,
-                .new_value.uint64 = value,
-        });
     }
 
-    value_ptr->uint64 = value;
+    uint64_t idx = atomic_fetch_add(&db_inst->to_free_objects_uid_n, 1);
+    *(uint64_t *) ce_segpool_get(&db_inst->to_free_objects_uid, idx) = _obj;
 }
 
-static void _set_ptr(ce_cdb_obj_o0 *_writer,
-                     uint64_t property,
-                     const void *value,
-                     bool log_event) {
-    object_t *writer = _get_object_from_o(_writer);
-
-    if (!writer) {
-        return;
-    }
-
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_PTR);
-
-    if (log_event) {
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop=property,
-                .ev_type =CE_CDB_PROP_CHANGE_EVENT,
-                .prop_type = CDB_TYPE_PTR,
-                .old_value = *value_ptr,
-                .new_value.ptr = (void *) value,
-        });
-    }
+static enum ce_cdb_type_e0 prop_type(const ce_cdb_obj_o0 *reader,
+                                     uint64_t key);
 
-    value_ptr->ptr = (void *) value;
-}
+void _remove_obj(ce_cdb_obj_o0 *_writer,
+                 uint64_t property,
+                 uint64_t obj);
 
-static void _set_ref(ce_cdb_obj_o0 *_writer,
-                     uint64_t property,
-                     uint64_t ref,
-                     bool log_event) {
+static void destroy_object(ce_cdb_t0 db,
+                           uint64_t _obj) {
+    db_t *db_inst = _get_db(db);
 
+    ce_log_a0->debug(LOG_WHERE, "Destroy obj %llx", _obj);
 
-    object_t *writer = _get_object_from_o(_writer);
+    object_t *obj = _get_object_from_uid(db_inst, _obj);
 
-    if (!writer) {
+    if (!obj) {
+        ce_log_a0->warning(LOG_WHERE, "Obj %llx is not alive.", _obj);
         return;
     }
 
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_REF);
+    _snapshot_keep(db_inst, _obj, obj);
 
-    if (log_event) {
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop=property,
-                .ev_type =CE_CDB_PROP_CHANGE_EVENT,
-                .prop_type = CDB_TYPE_REF,
-                .old_value = *value_ptr,
-                .new_value.ref = ref,
-        });
-    }
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        for (int i = 0; i < ce_array_size(obj->storage->prop_name); ++i) {
+            uint64_t key = obj->storage->prop_name[i];
+            ce_cdb_type_e0 type = obj->storage->prop_type[i];
+            switch (type) {
+                case CDB_TYPE_SUBOBJECT: {
+                    union ce_cdb_value_u0 *value_ptr = _get_value_ptr_generic(obj, key);
 
-    value_ptr->ref = ref;
-}
+                    uint64_t old_subobj = value_ptr->subobj;
+                    if (old_subobj) {
+                        destroy_object(db, old_subobj);
+                    }
+                }
 
-void _set_subobject(ce_cdb_obj_o0 *_writer,
-                    uint64_t property,
-                    uint64_t subobject,
-                    bool log_event) {
-    object_t *writer = _get_object_from_o(_writer);
+                    break;
 
-    if (!writer) {
-        return;
-    }
+                case CDB_TYPE_SET_SUBOBJECT: {
+                    uint64_t n = read_objset_count((ce_cdb_obj_o0 *) obj, key);
+                    uint64_t k[n];
+                    ce_cdb_a0->read_objset((ce_cdb_obj_o0 *) obj, key, k);
+                    for (int j = 0; j < n; ++j) {
+                        uint64_t subobj = k[j];
+                        destroy_object(db, subobj);
+                    }
+                }
+                    break;
+                default:
+                    break;
+            }
+        }
 
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
-                                                                  CDB_TYPE_SUBOBJECT);
+    } else {
+        for (int i = 1; i < obj->properties_count; ++i) {
+            switch (obj->property_type[i]) {
+                case CDB_TYPE_SUBOBJECT: {
+                    union ce_cdb_value_u0 *value_ptr = &obj->values[i];
+
+                    uint64_t old_subobj = value_ptr->subobj;
+                    destroy_object(db, old_subobj);
+                }
 
+                    break;
 
-    if (value_ptr->subobj) {
-        destroy_object(writer->db, value_ptr->subobj);
+                case CDB_TYPE_SET_SUBOBJECT: {
+                    uint64_t prop = obj->keys[i];
+                    uint64_t n = read_objset_count((ce_cdb_obj_o0 *) obj, prop);
+                    uint64_t k[n];
+                    ce_cdb_a0->read_objset((ce_cdb_obj_o0 *) obj, prop, k);
+                    for (int j = 0; j < n; ++j) {
+                        uint64_t subobj = k[j];
+                        destroy_object(db, subobj);
+                    }
+                }
+                    break;
+                default:
+                    break;
+            }
+        }
     }
 
-    value_ptr->subobj = subobject;
+    // Remove from parent
+    if (obj->parent) {
+        object_t *parent_obj = _get_object_from_uid(db_inst, obj->parent);
+        if (prop_type((ce_cdb_obj_o0 *) parent_obj, obj->key) == CDB_TYPE_SET_SUBOBJECT) {
+            _snapshot_keep(db_inst, obj->parent, parent_obj);
+            _remove_obj((ce_cdb_obj_o0 *) parent_obj, obj->key, _obj);
+        }
+    }
 
-    if (log_event) {
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop = property,
-                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
-                .prop_type = CDB_TYPE_SUBOBJECT,
-                .old_value = *value_ptr,
-                .new_value.subobj = subobject,
-        });
+    // destroy instances
+    uint64_t inst_n = ce_array_size(obj->instances);
+    for (int l = 0; l < inst_n; ++l) {
+        uint64_t inst = obj->instances[l];
+        destroy_object(db, inst);
     }
 
-    if (subobject) {
-        struct db_t *db = _get_db(writer->db);
+    _index_obj(db_inst, obj, false);
 
-        struct object_t *subobj = _get_object_from_uid(db, subobject);
-        subobj->parent = writer->orig_obj;
-        subobj->key = property;
-    }
+    _add_obj_to_destroy_list(db_inst, _obj);
 }
 
+static bool destroy_pending(ce_cdb_t0 db,
+                            uint64_t obj) {
+    db_t *db_inst = _get_db(db);
 
-static void set_float(ce_cdb_obj_o0 *_writer,
-                      uint64_t property,
-                      float value) {
-    _set_float(_writer, property, value, true);
-}
+    ce_os_thread_a0->spin_lock(&db_inst->destroy_lock);
+    bool pending = ce_hash_contain(&db_inst->to_free_set, obj);
+    ce_os_thread_a0->spin_unlock(&db_inst->destroy_lock);
 
-static void set_bool(ce_cdb_obj_o0 *_writer,
-                     uint64_t property,
-                     bool value) {
-    _set_bool(_writer, property, value, true);
+    return pending;
 }
 
-static void set_string(ce_cdb_obj_o0 *_writer,
-                       uint64_t property,
-                       const char *value) {
-    _set_string(_writer, property, value, true);
-}
+static void _gc_db() {
+    const uint32_t fdb_n = ce_array_size(_G.to_free_db);
+    for (int i = 0; i < fdb_n; ++i) {
+        uint32_t idx = _G.to_free_db[i];
+        struct db_t *db_inst = &_G.dbs[idx];
 
-static void set_uint64(ce_cdb_obj_o0 *_writer,
-                       uint64_t property,
-                       uint64_t value) {
-    _set_uint64(_writer, property, value, true);
-}
+        ce_segpool_free(&db_inst->to_free_objects_uid);
+        ce_hash_free(&db_inst->to_free_set, _G.allocator);
+        ce_segpool_free(&db_inst->object_pool);
 
+        ce_mpmc_free(&db_inst->free_objects);
 
-static void set_ptr(ce_cdb_obj_o0 *_writer,
-                    uint64_t property,
-                    const void *value) {
-    _set_ptr(_writer, property, value, true);
-}
+        for (int j = 0; j < CE_ARRAY_LEN(db_inst->limbo); ++j) {
+            ce_mpmc_free(&db_inst->limbo[j]);
+            ce_mpmc_free(&db_inst->value_limbo[j]);
+        }
 
-static void set_ref(ce_cdb_obj_o0 *_writer,
-                    uint64_t property,
-                    uint64_t ref) {
-    _set_ref(_writer, property, ref, true);
-}
+        const uint32_t type_n = atomic_load(&db_inst->type_n);
+        for (uint32_t j = 0; j < type_n; ++j) {
+            type_storage_t *storage = ce_segpool_at(&db_inst->type_storage, j);
+            ce_segpool_free(&storage->pool);
+            ce_mpmc_free(&storage->free_idx);
+        }
 
-uint64_t parent(ce_cdb_t0 _db,
-                uint64_t object) {
-    db_t *db = _get_db(_db);
+        ce_segpool_free(&db_inst->type_storage);
+        ce_hash_free(&db_inst->type_map, db_inst->allocator);
+        ce_segpool_free(&db_inst->blob_pool);
+        ce_segpool_free(&db_inst->set_pool);
+        ce_segpool_free(&db_inst->object_id_pool);
+        ce_segpool_free(&db_inst->free_objects_id);
+
+        const uint32_t index_n = ce_array_size(db_inst->obj_index);
+        for (uint32_t j = 0; j < index_n; ++j) {
+            ce_array_free(db_inst->obj_index[j].objs, _G.allocator);
+            ce_hash_free(&db_inst->obj_index[j].ref_n, _G.allocator);
+        }
 
-    object_t *obj = _get_object_from_uid(db, object);
-    if(!obj) {
-        return 0;
+        ce_array_free(db_inst->obj_index, _G.allocator);
+        ce_hash_free(&db_inst->type_index, _G.allocator);
+        ce_hash_free(&db_inst->type_pos, _G.allocator);
+        ce_hash_free(&db_inst->ref_index, _G.allocator);
+
+        // Props, strings, blobs and sets of arena db go at once.
+        if (db_inst->flags & CDB_DB_FLAG_ARENA) {
+            ce_memory_a0->destroy_arena(db_inst->allocator);
+        }
+
+        db_inst->used = false;
     }
-    return obj->parent;
+    ce_array_clean(_G.to_free_db);
 }
 
-void set_subobjectw(ce_cdb_obj_o0 *_writer,
-                    uint64_t property,
-                    ce_cdb_obj_o0 *_subwriter) {
-    object_t *writer = _get_object_from_o(_writer);
-    object_t *subwriter = _get_object_from_o(_subwriter);
+typedef struct gc_task_t {
+    db_t *db;
+    uint64_t deadline;
+    uint32_t limbo_idx;
+} gc_task_t;
 
-    subwriter->key = property;
+// Free destroyed objects, caller hold free_lock.
+static void _free_objects(db_t *db_inst,
+                          const uint64_t *uids,
+                          uint64_t uids_n) {
+    // instance uid -> prefab uid, prefabs are compacted once per batch
+    ce_hash_t removed = {};
+    ce_hash_t prefab_set = {};
+    uint64_t *prefabs = NULL;
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property, CDB_TYPE_SUBOBJECT, _G.allocator);
-    }
+    for (uint64_t j = 0; j < uids_n; ++j) {
+        uint64_t uid = uids[j];
 
+        object_t **objid = _get_objectid_from_uid(db_inst, uid);
+        if (!objid || !(*objid)->instance_of) {
+            continue;
+        }
 
-    union ce_cdb_value_u0 *value_ptr = &writer->values[idx];
+        object_t *obj = *objid;
+        ce_hash_add(&removed, obj->orig_obj, obj->instance_of, _G.allocator);
 
-    _add_change(writer, (ce_cdb_prop_ev_t0) {
-            .obj = writer->orig_obj,
-            .prop = property,
-            .ev_type = CE_CDB_PROP_CHANGE_EVENT,
-            .prop_type = CDB_TYPE_SUBOBJECT,
-            .old_value = *value_ptr,
-            .new_value.subobj = subwriter->orig_obj,
-    });
+        if (!ce_hash_contain(&prefab_set, obj->instance_of)) {
+            ce_hash_add(&prefab_set, obj->instance_of, 1, _G.allocator);
+            ce_array_push(prefabs, obj->instance_of, _G.allocator);
+        }
+    }
 
+    const uint32_t prefabs_n = ce_array_size(prefabs);
+    for (uint32_t j = 0; j < prefabs_n; ++j) {
+        // Do not use _get_object_from_uid, prefab freed before must not be loaded again.
+        object_t **prefab_id = _get_objectid_from_uid(db_inst, prefabs[j]);
+        if (!prefab_id) {
+            continue;
+        }
 
-    value_ptr->subobj = subwriter->orig_obj;
-    subwriter->parent = writer->orig_obj;
-}
+        object_t *prefab_obj = *prefab_id;
+        _snapshot_keep(db_inst, prefabs[j], prefab_obj);
 
+        const uint32_t instances_n = ce_array_size(prefab_obj->instances);
 
-void set_subobject(ce_cdb_obj_o0 *_writer,
-                   uint64_t property,
-                   uint64_t subobject) {
-    _set_subobject(_writer, property, subobject, true);
-}
+        uint32_t k = 0;
+        for (uint32_t l = 0; l < instances_n; ++l) {
+            uint64_t inst = prefab_obj->instances[l];
+            if (!ce_hash_contain(&removed, inst)) {
+                prefab_obj->instances[k++] = inst;
+            }
+        }
 
-void _move_set(ce_cdb_obj_o0 *_writer,
-               uint64_t property,
-               uint64_t set,
-               bool log_event) {
-    object_t *writer = _get_object_from_o(_writer);
+        if (k != instances_n) {
+            ce_array_resize(prefab_obj->instances, k, _obj_allocator(prefab_obj));
+        }
+    }
 
-    if (!writer) {
-        return;
+    for (uint64_t j = 0; j < uids_n; ++j) {
+        uint64_t uid = uids[j];
+
+        object_t **objid = _get_objectid_from_uid(db_inst, uid);
+        if (objid) {
+            object_t *obj = *objid;
+
+            _remove_uid_obj(db_inst, uid);
+            _free_obj_id(db_inst, objid);
+            _destroy_object(db_inst, obj);
+        }
     }
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property, CDB_TYPE_SUBOBJECT, _G.allocator);
+    ce_os_thread_a0->spin_lock(&db_inst->destroy_lock);
+    for (uint64_t j = 0; j < uids_n; ++j) {
+        ce_hash_remove(&db_inst->to_free_set, uids[j]);
     }
+    ce_os_thread_a0->spin_unlock(&db_inst->destroy_lock);
 
-    union ce_cdb_value_u0 *value_ptr = &writer->values[idx];
+    ce_hash_free(&removed, _G.allocator);
+    ce_hash_free(&prefab_set, _G.allocator);
+    ce_array_free(prefabs, _G.allocator);
+}
 
-    if (log_event) {
+static void _gc_free_objects(db_t *db_inst,
+                             uint64_t from,
+                             uint64_t to) {
+    uint64_t uids[GC_BATCH_SIZE];
+    uint64_t uids_n = 0;
+
+    ce_os_thread_a0->spin_lock(&db_inst->free_lock);
+
+    // Uid that is not pending anymore was freed by flush_destroy, flushed
+    // uid can be created and destroyed again so list can have it twice.
+    ce_hash_t batch_set = {};
+    ce_os_thread_a0->spin_lock(&db_inst->destroy_lock);
+    for (uint64_t j = from; j < to; ++j) {
+        uint64_t uid = *(uint64_t *) ce_segpool_get(&db_inst->to_free_objects_uid, j);
+        if (!ce_hash_contain(&db_inst->to_free_set, uid)
+            || ce_hash_contain(&batch_set, uid)) {
+            continue;
+        }
 
+        ce_hash_add(&batch_set, uid, 1, _G.allocator);
+        uids[uids_n++] = uid;
     }
+    ce_os_thread_a0->spin_unlock(&db_inst->destroy_lock);
+    ce_hash_free(&batch_set, _G.allocator);
 
-    value_ptr->set = set;
+    _free_objects(db_inst, uids, uids_n);
+
+    ce_os_thread_a0->spin_unlock(&db_inst->free_lock);
 }
 
-void set_blob(ce_cdb_obj_o0 *_writer,
-              uint64_t property,
-              void *blob_data,
-              uint64_t blob_size) {
-    ce_alloc_t0 *a = _G.allocator;
+static void flush_destroy(ce_cdb_t0 db,
+                          uint64_t obj) {
+    db_t *db_inst = _get_db(db);
 
-    object_t *writer = _get_object_from_o(_writer);
+    ce_os_thread_a0->spin_lock(&db_inst->free_lock);
 
-    if (!writer) {
-        return;
+    if (destroy_pending(db, obj)) {
+        _free_objects(db_inst, &obj, 1);
     }
 
-    db_t *db = _get_db(writer->db);
+    ce_os_thread_a0->spin_unlock(&db_inst->free_lock);
+}
 
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_BLOB);
+static void _gc_free_task(void *data) {
+    gc_task_t *task = data;
+    db_t *db_inst = task->db;
 
-    if (value_ptr->blob) {
-        struct ce_cdb_blob_t0 *blob = _get_blob(db, value_ptr->blob);
-        CE_FREE(a, blob->data);
-    } else {
-        uint32_t new_blob_idx = _new_blob(db);
-        value_ptr->blob = new_blob_idx;
-    }
+    uint64_t n = atomic_load(&db_inst->to_free_objects_uid_n);
+    uint64_t cursor = db_inst->to_free_objects_cursor;
 
-    void *new_blob = CE_ALLOC(a, uint8_t, blob_size);
-    memcpy(new_blob, blob_data, blob_size);
+    // At least one batch per frame so gc always make progress.
+    while (cursor < n) {
+        uint64_t to = cursor + GC_BATCH_SIZE;
+        if (to > n) {
+            to = n;
+        }
 
-    uint32_t blob_idx = value_ptr->blob;
-    ce_cdb_blob_t0 *blob = _get_blob(db, blob_idx);
+        _gc_free_objects(db_inst, cursor, to);
+        cursor = to;
 
-    *blob = (ce_cdb_blob_t0) {
-            .size = blob_size,
-            .data = new_blob,
-    };
+        if (task->deadline && (ce_os_time_a0->perf_counter() >= task->deadline)) {
+            break;
+        }
+    }
 
-    _add_change(writer, (ce_cdb_prop_ev_t0) {
-            .obj = writer->orig_obj,
-            .prop=property,
-            .ev_type =CE_CDB_PROP_CHANGE_EVENT,
-            .prop_type = CDB_TYPE_BLOB,
-            .old_value = *value_ptr,
-            .new_value.blob = blob_idx,
-    });
-}
+    db_inst->to_free_objects_cursor = cursor;
 
+    // Someone can destroy object while we gc, keep list for next frame.
+    if ((cursor == n) &&
+        atomic_compare_exchange_strong(&db_inst->to_free_objects_uid_n, &n, 0)) {
+        db_inst->to_free_objects_cursor = 0;
+    }
+}
 
-void add_obj(ce_cdb_obj_o0 *_writer,
-             uint64_t property,
-             uint64_t obj) {
-    object_t *writer = _get_object_from_o(_writer);
+static void _gc_reclaim_task(void *data) {
+    gc_task_t *task = data;
+    _drain_limbo(task->db, task->limbo_idx);
+}
 
-    if (!writer) {
+static void _gc_run_tasks(ce_task_item_t0 *tasks) {
+    const uint32_t tasks_n = ce_array_size(tasks);
+    if (!tasks_n) {
         return;
     }
 
-    db_t *db = _get_db(writer->db);
+    ce_task_counter_t0 *counter = NULL;
+    ce_task_a0->add(tasks, tasks_n, &counter);
+    ce_task_a0->wait_for_counter(counter, 0);
+}
 
-    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
-                                                                  CDB_TYPE_SET_SUBOBJECT);
+static void set_gc_budget(uint64_t budget_us) {
+    _G.gc_budget_us = budget_us;
+}
 
-    if (!value_ptr->set) {
-        value_ptr->set = _new_set(db);
+static void gc() {
+    _gc_db();
+
+    uint64_t deadline = 0;
+    if (_G.gc_budget_us) {
+        uint64_t budget = (_G.gc_budget_us * ce_os_time_a0->perf_freq()) / 1000000;
+        deadline = ce_os_time_a0->perf_counter() + budget;
     }
 
-    _add_to_set(db, value_ptr->set, obj);
+    const uint32_t db_n = ce_array_size(_G.dbs);
 
-    if (obj) {
-        struct object_t *subobj = _get_object_from_uid(db, obj);
-        subobj->parent = writer->orig_obj;
-        subobj->key = property;
-    }
+    gc_task_t *task_data = NULL;
+    ce_task_item_t0 *tasks = NULL;
+    ce_array_set_capacity(task_data, db_n, _G.allocator);
 
-    _add_change(writer, (ce_cdb_prop_ev_t0) {
-            .obj = writer->orig_obj,
-            .prop=property,
-            .ev_type =CE_CDB_OBJSET_ADD_EVENT,
-            .prop_type = CDB_TYPE_SET_SUBOBJECT,
-            .new_value.subobj = obj,
-    });
-}
+    for (uint32_t i = 0; i < db_n; ++i) {
+        struct db_t *db_inst = &_G.dbs[i];
 
-void _remove_obj(ce_cdb_obj_o0 *_writer,
-                 uint64_t property,
-                 uint64_t obj) {
-    object_t *writer = _get_object_from_o(_writer);
+        if (!db_inst->used) {
+            continue;
+        }
 
-    if (!writer) {
-        return;
-    }
+        ce_array_clean(db_inst->changed_obj);
+        ce_hash_clean(&db_inst->changed_obj_set);
 
-    db_t *db = _get_db(writer->db);
+        if (!atomic_load(&db_inst->to_free_objects_uid_n)) {
+            continue;
+        }
 
-    ce_cdb_value_u0 *value_ptr = _get_value_ptr_generic(writer, property);
+        uint32_t idx = ce_array_size(task_data);
+        ce_array_push(task_data, ((gc_task_t) {
+                .db = db_inst,
+                .deadline = deadline,
+        }), _G.allocator);
 
-    if (!value_ptr) {
-        return;
+        ce_array_push(tasks, ((ce_task_item_t0) {
+                .name = "cdb_gc_free",
+                .work = _gc_free_task,
+                .data = &task_data[idx],
+        }), _G.allocator);
     }
 
-    uint32_t set_idx = value_ptr->set;
+    _gc_run_tasks(tasks);
 
-    _remove_from_set(db, set_idx, obj);
+    // Frame end: readers that do not pin are valid only until gc.
+    const uint32_t readers_n = atomic_load(&_G.readers_n);
+    for (uint32_t i = 1; i <= readers_n; ++i) {
+        uint64_t state = atomic_load(&_G.readers[i].state);
+        if (!(state & 1)) {
+            atomic_compare_exchange_strong(&_G.readers[i].state, &state, 0);
+        }
+    }
 
-    _add_change(writer, (ce_cdb_prop_ev_t0) {
-            .obj = writer->orig_obj,
-            .prop=property,
-            .ev_type =CE_CDB_OBJSET_REMOVE_EVENT,
-            .prop_type = CDB_TYPE_SET_SUBOBJECT,
-            .old_value.subobj= obj,
-    });
-}
+    // Two advances reclaim everything retired so far if nobody is pinned.
+    for (int a = 0; a < 2; ++a) {
+        const uint32_t limbo_idx = _advance_epoch();
+        if (UINT32_MAX == limbo_idx) {
+            break;
+        }
 
-void remove_obj(ce_cdb_obj_o0 *_writer,
-                uint64_t property,
-                uint64_t obj) {
-    _remove_obj(_writer, property, obj);
+        ce_array_clean(task_data);
+        ce_array_clean(tasks);
 
-    object_t *writer = _get_object_from_o(_writer);
+        for (uint32_t i = 0; i < db_n; ++i) {
+            struct db_t *db_inst = &_G.dbs[i];
 
-    if (!writer) {
-        return;
+            if (!db_inst->used || !ce_mpmc_size(&db_inst->limbo[limbo_idx])) {
+                continue;
+            }
+
+            uint32_t idx = ce_array_size(task_data);
+            ce_array_push(task_data, ((gc_task_t) {
+                    .db = db_inst,
+                    .limbo_idx = limbo_idx,
+            }), _G.allocator);
+
+            ce_array_push(tasks, ((ce_task_item_t0) {
+                    .name = "cdb_gc_reclaim",
+                    .work = _gc_reclaim_task,
+                    .data = &task_data[idx],
+            }), _G.allocator);
+        }
+
+        _gc_run_tasks(tasks);
     }
 
-    destroy_object(writer->db, obj);
+    ce_array_free(task_data, _G.allocator);
+    ce_array_free(tasks, _G.allocator);
 }
 
-static bool prop_exist(const ce_cdb_obj_o0 *reader,
-                       uint64_t key);
+// Binary object layout, every section is 8 byte aligned so values are read
+// from input without copy:
+//
+// header | keys[n + 1] | values[n + 1] | types[n + 1] | strings | blobs | sets
+//
+// Index 0 is sentinel same as in object_t.
+#define CDB_BINOBJ_VERSION 1
+#define _BINOBJ_ALIGN(_value) CE_ALIGN_MASK(_value, 0x7)
 
-void remove_property(ce_cdb_obj_o0 *_writer,
-                     uint64_t property) {
+typedef struct cdb_binobj_header {
+    uint64_t version;
+    uint64_t type;
+    uint64_t parent;
+    uint64_t instance_of;
+    uint64_t properties_count;
+    uint64_t string_buffer_size;
+    uint64_t blob_buffer_size;
+    uint64_t set_buffer_size;
+} cdb_binobj_header;
 
-    object_t *writer = _get_object_from_o(_writer);
+static void _binobj_pad(char **buffer,
+                        struct ce_alloc_t0 *allocator) {
+    static const char zero[8] = {};
+    uint64_t size = ce_array_size(*buffer);
+    uint64_t pad = _BINOBJ_ALIGN(size) - size;
 
-    uint64_t idx = _find_prop_index(writer, property);
+    if (pad) {
+        ce_array_push_n(*buffer, zero, pad, allocator);
+    }
+}
 
-    if (idx) {
-        if (writer->property_type[idx] == CDB_TYPE_SUBOBJECT) {
-            destroy_object(writer->db, writer->values[idx].subobj);
-        }
+static void dump(ce_cdb_t0 db,
+                 uint64_t _obj,
+                 char **output,
+                 struct ce_alloc_t0 *allocator) {
+    db_t *dbi = _get_db(db);
 
-        uint64_t last_idx = --writer->properties_count;
-        ce_hash_add(&writer->prop_map, writer->keys[last_idx], idx, _G.allocator);
+    object_t *obj = _get_object_from_uid(dbi, _obj);
 
-        writer->keys[idx] = writer->keys[last_idx];
-        writer->property_type[idx] = writer->property_type[last_idx];
-        writer->values[idx] = writer->values[last_idx];
+    char *str_buffer = NULL;
+    char *blob_buffer = NULL;
+    char *set_buffer = NULL;
 
-        ce_array_pop_back(writer->keys);
-        ce_array_pop_back(writer->property_type);
-        ce_array_pop_back(writer->values);
+    uint64_t *keys = NULL;
+    uint8_t *type = NULL;
+    ce_cdb_value_u0 *values = NULL;
 
+    ce_array_push(keys, 0, allocator);
+    ce_array_push(type, CDB_TYPE_NONE, allocator);
+    ce_array_push(values, (ce_cdb_value_u0) {}, allocator);
 
-        ce_hash_remove(&writer->prop_map, property);
+    // Typed and dynamic object share same binary layout.
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        type_storage_t *storage = obj->storage;
 
-        object_t *writer = _get_object_from_o(_writer);
+        uint32_t n = ce_array_size(storage->prop_name);
+        for (uint32_t i = 0; i < n; ++i) {
+            uint8_t t = storage->prop_type[i];
 
-        uint64_t idx = _find_prop_index(writer, property);
-        union ce_cdb_value_u0 *value_ptr = &writer->values[idx];
+            ce_cdb_value_u0 v = {};
+            memcpy(&v, _get_prop_value_ptr_idx(storage, obj->typed_obj_idx, i),
+                   _TYPE_INFO[t].size);
 
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop=property,
-                .ev_type =CE_CDB_PROP_REMOVE_EVENT,
-                .prop_type = writer->property_type[idx],
-                .old_value = *value_ptr,
-        });
+            ce_array_push(keys, storage->prop_name[i], allocator);
+            ce_array_push(type, t, allocator);
+            ce_array_push(values, v, allocator);
+        }
+    } else {
+        uint64_t n = obj->properties_count - 1;
+        if (n) {
+            ce_array_push_n(keys, obj->keys + 1, n, allocator);
+            ce_array_push_n(type, obj->property_type + 1, n, allocator);
+            ce_array_push_n(values, obj->values + 1, n, allocator);
+        }
     }
-}
 
-const ce_cdb_obj_o0 *read(ce_cdb_t0 _db,
-                          uint64_t object) {
-    if (!object) {
-        return NULL;
-    }
+    const uint64_t slot_n = ce_array_size(keys);
+    for (int i = 1; i < slot_n; ++i) {
+        switch (type[i]) {
+            case CDB_TYPE_STR: {
+                uint64_t stroffset = ce_array_size(str_buffer);
+                const char *str = values[i].str ? values[i].str : "";
+                ce_array_push_n(str_buffer, str, strlen(str) + 1, allocator);
 
-    db_t *db = _get_db(_db);
-    object_t *obj = _get_object_from_uid(db, object);
-    return (ce_cdb_obj_o0 *) obj;
-}
+                values[i].uint64 = stroffset;
+            }
+                break;
 
-static uint64_t type(ce_cdb_t0 _db,
-                     uint64_t _obj) {
-    db_t *db = _get_db(_db);
-    object_t *obj = _get_object_from_uid(db, _obj);
+            case CDB_TYPE_BLOB: {
+                uint64_t bloboffset = ce_array_size(blob_buffer);
 
-    if (!obj) {
-        return 0;
-    }
+                struct ce_cdb_blob_t0 *blob = _get_blob(dbi, values[i].blob);
 
-    return obj->type;
-}
+                ce_array_push_n(blob_buffer, (char *) &blob->size, sizeof(uint64_t), allocator);
+                if (blob->size) {
+                    ce_array_push_n(blob_buffer, (char *) blob->data, blob->size, allocator);
+                }
+                _binobj_pad(&blob_buffer, allocator);
 
+                values[i].uint64 = bloboffset;
+            }
+                break;
 
-uint64_t read_to(ce_cdb_t0 db,
-                 uint64_t object,
-                 void *to,
-                 size_t max_size);
+            case CDB_TYPE_SET_SUBOBJECT: {
+                uint64_t setoffset = ce_array_size(set_buffer);
 
-uint64_t _read_to(ce_cdb_t0 db,
-                  void *to,
-                  uint64_t type,
-                  ce_cdb_value_u0 *v,
-                  ce_cdb_prop_def_t0 *def,
-                  uint64_t cur_byte,
-                  size_t max_size) {
-    db_t *db_inst = _get_db(db);
+                struct set_t *set = _get_set(dbi, values[i].set);
 
-    type_info_t ti = _TYPE_INFO[def->type];
+                uint64_t n = set ? ce_array_size(set->objs) : 0;
 
-    size_t padding = CE_ALIGN_PADDING(to + cur_byte, ti.align);
+                ce_array_push_n(set_buffer, (char *) &n, sizeof(uint64_t), allocator);
+                if (n) {
+                    ce_array_push_n(set_buffer, (char *) set->objs, sizeof(uint64_t) * n,
+                                    allocator);
+                }
 
-    if (def->flags & CDB_PROP_FLAG_UNPACK) {
-        return read_to(db, v->subobj, to + cur_byte, max_size);
-    } else if (type == CDB_TYPE_BLOB) {
-        ce_cdb_blob_t0 *blob = _get_blob(db_inst, v->blob);
-        memcpy(to + (cur_byte + padding), &blob->data, sizeof(void *));
-        return ti.size + padding;
-    } else {
-        memcpy(to + (cur_byte + padding), v, ti.size);
-        return ti.size + padding;
+                values[i].uint64 = setoffset;
+            }
+                break;
+            default:
+                break;
+        }
     }
-}
-
-uint64_t read_to(ce_cdb_t0 db,
-                 uint64_t object,
-                 void *to,
-                 size_t max_size) {
-    db_t *db_inst = _get_db(db);
-    object_t *obj = _get_object_from_uid(db_inst, object);
 
-    if (!obj) {
-        return 0;
-    }
+    _binobj_pad(&str_buffer, allocator);
 
-    uint64_t obj_type = obj->type;
-    uint64_t cur_byte = 0;
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+    cdb_binobj_header header = {
+            .version = CDB_BINOBJ_VERSION,
+            .type = obj->type,
+            .parent = obj->parent,
+            .instance_of = obj->instance_of,
+            .properties_count = slot_n - 1,
+            .string_buffer_size = ce_array_size(str_buffer),
+            .blob_buffer_size = ce_array_size(blob_buffer),
+            .set_buffer_size = ce_array_size(set_buffer),
+    };
 
-        uint32_t n = obj->storage->prop_def->num;
-        for (int i = 0; i < n; ++i) {
-            ce_cdb_prop_def_t0 *def = &obj->storage->prop_def->defs[i];
-            uint64_t name = obj->storage->prop_name[i];
-            ce_cdb_type_e0 type = obj->storage->prop_type[i];
+    ce_array_push_n(*output, (char *) &header,
+                    sizeof(cdb_binobj_header),
+                    allocator);
 
-            ce_cdb_value_u0 *v = _get_prop_value_ptr(obj->storage, obj->typed_obj_idx, name);
+    ce_array_push_n(*output, (char *) keys,
+                    sizeof(uint64_t) * slot_n,
+                    allocator);
 
-            cur_byte += _read_to(db, to, type, v, def, cur_byte, max_size);
-        }
+    ce_array_push_n(*output, (char *) values,
+                    sizeof(ce_cdb_value_u0) * slot_n,
+                    allocator);
 
-    } else {
-        const ce_cdb_type_def_t0 *defs = _get_prop_def(obj_type);
+    ce_array_push_n(*output, (char *) type,
+                    sizeof(uint8_t) * slot_n,
+                    allocator);
 
-        if (defs) {
-            for (int i = 0; i < defs->num; ++i) {
-                ce_cdb_prop_def_t0 *def = &defs->defs[i];
+    _binobj_pad(output, allocator);
 
-                uint64_t prop = ce_id_a0->id64(def->name);
-                uint64_t idx = _find_prop_index(obj, prop);
+    if (header.string_buffer_size) {
+        ce_array_push_n(*output, str_buffer,
+                        header.string_buffer_size,
+                        allocator);
+    }
 
-                if (!idx) {
-                    continue;
-                }
-                ce_cdb_value_u0 *v = &obj->values[idx];
-                uint64_t type = obj->property_type[idx];
+    if (header.blob_buffer_size) {
+        ce_array_push_n(*output, blob_buffer,
+                        header.blob_buffer_size,
+                        allocator);
+    }
 
-                cur_byte += _read_to(db, to, type, v, def, cur_byte, max_size);
-            }
-        }
+    if (header.set_buffer_size) {
+        ce_array_push_n(*output, set_buffer,
+                        header.set_buffer_size,
+                        allocator);
     }
 
-    CE_ASSERT(LOG_WHERE, cur_byte <= max_size);
-    return cur_byte;
+    ce_array_free(str_buffer, allocator);
+    ce_array_free(blob_buffer, allocator);
+    ce_array_free(set_buffer, allocator);
+
+    ce_array_free(keys, allocator);
+    ce_array_free(type, allocator);
+    ce_array_free(values, allocator);
 }
 
-uint64_t read_prop_to(ce_cdb_t0 db,
-                      uint64_t object,
-                      uint64_t prop,
-                      void *to,
-                      size_t max_size) {
-    db_t *db_inst = _get_db(db);
-    object_t *obj = _get_object_from_uid(db_inst, object);
+// Compact binary object, stream of varints:
+//
+// version(u8) | flags | key_n | keys[key_n](u64) | str_n | strings | parent(u64) | obj
+//
+// obj := type_idx | instance_of(u64) | prop_n | (key_idx | type(u8) | value)*
+//
+// Keys (prop names and types) and strings are stored once per blob.
+// With CDB_COMPACT_INLINE subobjects follow their uid.
+#define CDB_BINOBJ_COMPACT_VERSION 2
 
-    if (!obj) {
-        return 0;
-    }
+enum {
+    CDB_COMPACT_INLINE = 1 << 0,
+};
 
-    uint64_t cur_byte = 0;
+typedef struct compact_writer_t {
+    ce_alloc_t0 *allocator;
+    db_t *db;
+    bool inline_subobj;
 
-    uint64_t obj_type = type(db, object);
-    const ce_cdb_type_def_t0 *defs = _get_prop_def(obj_type);
-    if (defs) {
-        uint8_t *data = to;
-        for (int i = 0; i < defs->num; ++i) {
-            ce_cdb_prop_def_t0 *def = &defs->defs[i];
-            uint64_t p = ce_id_a0->id64(def->name);
+    ce_hash_t key_map;
+    uint64_t *keys;
 
-            if (p != prop) {
-                continue;
-            }
+    ce_hash_t str_map;
+    const char **strs;
 
-            uint64_t idx = _find_prop_index(obj, p);
+    char *data;
+} compact_writer_t;
 
-            if (!idx) {
-                continue;
-            }
+static void _write_varint(char **out,
+                          uint64_t v,
+                          ce_alloc_t0 *allocator) {
+    uint8_t buf[10];
+    uint32_t n = 0;
 
-            ce_cdb_value_u0 *v = &obj->values[idx];
-            uint64_t size = 0;
-            if (def->type == CDB_TYPE_SUBOBJECT) {
-                size = read_to(db, v->subobj, data + cur_byte, 0);
-            } else {
-                type_info_t ti = _TYPE_INFO[def->type];
-                size = ti.size;
-                memcpy(data + cur_byte, v, size);
-            }
+    do {
+        buf[n] = (uint8_t) (v & 0x7f);
+        v >>= 7;
+        if (v) {
+            buf[n] |= 0x80;
+        }
+        ++n;
+    } while (v);
+
+    ce_array_push_n(*out, (char *) buf, n, allocator);
+}
+
+static uint64_t _read_varint(const uint8_t **p) {
+    uint64_t v = 0;
+    uint32_t shift = 0;
+
+    for (;;) {
+        uint8_t b = *(*p)++;
+        v |= (uint64_t) (b & 0x7f) << shift;
 
-            return size;
+        if (!(b & 0x80)) {
+            return v;
         }
+
+        shift += 7;
     }
+}
 
-    return 0;
+static void _write_u64(char **out,
+                       uint64_t v,
+                       ce_alloc_t0 *allocator) {
+    ce_array_push_n(*out, (char *) &v, sizeof(uint64_t), allocator);
 }
 
-static float read_float(const ce_cdb_obj_o0 *reader,
-                        uint64_t property,
-                        float defaultt) {
-    if (!reader) {
-        return defaultt;
-    }
+static uint64_t _read_u64(const uint8_t **p) {
+    uint64_t v;
+    memcpy(&v, *p, sizeof(uint64_t));
+    *p += sizeof(uint64_t);
+    return v;
+}
 
-    object_t *obj = _get_object_from_o(reader);
+static uint64_t _compact_key(compact_writer_t *w,
+                             uint64_t key) {
+    uint64_t idx = ce_hash_lookup(&w->key_map, key, UINT64_MAX);
 
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return defaultt;
+    if (idx == UINT64_MAX) {
+        idx = ce_array_size(w->keys);
+        ce_array_push(w->keys, key, w->allocator);
+        ce_hash_add(&w->key_map, key, idx, w->allocator);
     }
 
-    return v->f;
+    return idx;
 }
 
-static bool read_bool(const ce_cdb_obj_o0 *reader,
-                      uint64_t property,
-                      bool defaultt) {
-    if (!reader) {
-        return defaultt;
+static uint64_t _compact_str(compact_writer_t *w,
+                             const char *str) {
+    str = str ? str : "";
+
+    uint64_t h = ce_hash_murmur2_64(str, strlen(str), 0);
+    uint64_t idx = ce_hash_lookup(&w->str_map, h, UINT64_MAX);
+
+    if ((idx == UINT64_MAX) || strcmp(w->strs[idx], str)) {
+        idx = ce_array_size(w->strs);
+        ce_array_push(w->strs, str, w->allocator);
+        ce_hash_add(&w->str_map, h, idx, w->allocator);
     }
 
-    object_t *obj = _get_object_from_o(reader);
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return defaultt;
-    }
-
-    return v->b;
+    return idx;
 }
 
-static const char *read_string(const ce_cdb_obj_o0 *reader,
-                               uint64_t property,
-                               const char *defaultt) {
-    if (!reader) {
-        return defaultt;
-    }
+static void _compact_dump_obj(compact_writer_t *w,
+                              uint64_t uid);
 
-    object_t *obj = _get_object_from_o(reader);
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return defaultt;
-    }
+static void _compact_dump_value(compact_writer_t *w,
+                                enum ce_cdb_type_e0 t,
+                                ce_cdb_value_u0 v) {
+    char **out = &w->data;
+    ce_alloc_t0 *a = w->allocator;
 
-    return v->str;
-}
+    switch (t) {
+        case CDB_TYPE_UINT64:
+            _write_varint(out, v.uint64, a);
+            break;
 
+        case CDB_TYPE_PTR:
+            _write_varint(out, (uint64_t) v.ptr, a);
+            break;
 
-static uint64_t read_uint64(const ce_cdb_obj_o0 *reader,
-                            uint64_t property,
-                            uint64_t defaultt) {
-    if (!reader) {
-        return defaultt;
-    }
+        case CDB_TYPE_REF:
+            _write_u64(out, v.ref, a);
+            break;
 
-    object_t *obj = _get_object_from_o(reader);
+        case CDB_TYPE_FLOAT:
+            ce_array_push_n(*out, (char *) &v.f, sizeof(float), a);
+            break;
 
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return defaultt;
-    }
+        case CDB_TYPE_BOOL:
+            ce_array_push(*out, (char) v.b, a);
+            break;
 
-    return v->uint64;
-}
+        case CDB_TYPE_STR:
+            _write_varint(out, _compact_str(w, v.str), a);
+            break;
 
-static void *read_ptr(const ce_cdb_obj_o0 *reader,
-                      uint64_t property,
-                      void *defaultt) {
-    if (!reader) {
-        return defaultt;
-    }
+        case CDB_TYPE_SUBOBJECT:
+            _write_u64(out, v.subobj, a);
+            if (w->inline_subobj && v.subobj) {
+                _compact_dump_obj(w, v.subobj);
+            }
+            break;
 
-    object_t *obj = _get_object_from_o(reader);
+        case CDB_TYPE_BLOB: {
+            ce_cdb_blob_t0 *blob = _get_blob(w->db, v.blob);
+            _write_varint(out, blob->size, a);
+            if (blob->size) {
+                ce_array_push_n(*out, (char *) blob->data, blob->size, a);
+            }
+        }
+            break;
 
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return defaultt;
-    }
+        case CDB_TYPE_SET_SUBOBJECT: {
+            set_t *set = _get_set(w->db, v.set);
+            uint64_t n = set ? ce_array_size(set->objs) : 0;
+
+            _write_varint(out, n, a);
+            for (uint64_t i = 0; i < n; ++i) {
+                _write_u64(out, set->objs[i], a);
+                if (w->inline_subobj) {
+                    _compact_dump_obj(w, set->objs[i]);
+                }
+            }
+        }
+            break;
 
-    return v->ptr;
+        default:
+            break;
+    }
 }
 
-static uint64_t read_ref(const ce_cdb_obj_o0 *reader,
-                         uint64_t property,
-                         uint64_t defaultt) {
-    if (!reader) {
-        return defaultt;
-    }
+static void _compact_dump_obj(compact_writer_t *w,
+                              uint64_t uid) {
+    object_t *obj = _get_object_from_uid(w->db, uid);
+    ce_alloc_t0 *a = w->allocator;
 
-    object_t *obj = _get_object_from_o(reader);
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return defaultt;
-    }
+    _write_varint(&w->data, _compact_key(w, obj->type), a);
+    _write_u64(&w->data, obj->instance_of, a);
 
-    return v->ref;
-}
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        type_storage_t *storage = obj->storage;
 
-static uint64_t read_subobject(const ce_cdb_obj_o0 *reader,
-                               uint64_t property,
-                               uint64_t defaultt) {
-    if (!reader) {
-        return defaultt;
-    }
+        uint32_t n = ce_array_size(storage->prop_name);
+        _write_varint(&w->data, n, a);
 
-    object_t *obj = _get_object_from_o(reader);
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return defaultt;
-    }
+        for (uint32_t i = 0; i < n; ++i) {
+            uint8_t t = storage->prop_type[i];
 
-    return v->subobj;
+            ce_cdb_value_u0 v = {};
+            memcpy(&v, _get_prop_value_ptr_idx(storage, obj->typed_obj_idx, i),
+                   _TYPE_INFO[t].size);
+
+            _write_varint(&w->data, _compact_key(w, storage->prop_name[i]), a);
+            ce_array_push(w->data, (char) t, a);
+            _compact_dump_value(w, t, v);
+        }
+    } else {
+        _write_varint(&w->data, obj->properties_count - 1, a);
+
+        for (uint64_t i = 1; i < obj->properties_count; ++i) {
+            uint8_t t = obj->property_type[i];
+
+            _write_varint(&w->data, _compact_key(w, obj->keys[i]), a);
+            ce_array_push(w->data, (char) t, a);
+            _compact_dump_value(w, t, obj->values[i]);
+        }
+    }
 }
 
-void read_objset(const ce_cdb_obj_o0 *reader,
-                 uint64_t property,
-                 uint64_t *objs) {
-    object_t *obj = _get_object_from_o(reader);
+static void dump_compact(ce_cdb_t0 db,
+                         uint64_t _obj,
+                         char **output,
+                         bool inline_subobj,
+                         struct ce_alloc_t0 *allocator) {
+    db_t *dbi = _get_db(db);
+
+    object_t *obj = _get_object_from_uid(dbi, _obj);
 
     if (!obj) {
         return;
     }
 
-    db_t *db_inst = _get_db(obj->db);
+    compact_writer_t w = {
+            .allocator = allocator,
+            .db = dbi,
+            .inline_subobj = inline_subobj,
+    };
 
+    _compact_dump_obj(&w, _obj);
 
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return;
-    }
+    ce_array_push(*output, (char) CDB_BINOBJ_COMPACT_VERSION, allocator);
+    _write_varint(output, inline_subobj ? CDB_COMPACT_INLINE : 0, allocator);
 
-    uint32_t setidx = v->set;
-    set_t *set = _get_set(db_inst, setidx);
+    const uint64_t key_n = ce_array_size(w.keys);
+    _write_varint(output, key_n, allocator);
+    if (key_n) {
+        ce_array_push_n(*output, (char *) w.keys, sizeof(uint64_t) * key_n, allocator);
+    }
 
-    if (!set) {
-        return;
+    const uint64_t str_n = ce_array_size(w.strs);
+    _write_varint(output, str_n, allocator);
+    for (uint64_t i = 0; i < str_n; ++i) {
+        uint64_t len = strlen(w.strs[i]);
+        _write_varint(output, len, allocator);
+        ce_array_push_n(*output, w.strs[i], len + 1, allocator);
     }
 
-    uint32_t size = ce_array_size(set->objs);
+    _write_u64(output, obj->parent, allocator);
 
-    memcpy(objs, set->objs, size * sizeof(uint64_t));
+    ce_array_push_n(*output, w.data, ce_array_size(w.data), allocator);
+
+    ce_hash_free(&w.key_map, allocator);
+    ce_hash_free(&w.str_map, allocator);
+    ce_array_free(w.keys, allocator);
+    ce_array_free(w.strs, allocator);
+    ce_array_free(w.data, allocator);
 }
 
-void *read_blob(const ce_cdb_obj_o0 *reader,
-                uint64_t property,
-                uint64_t *size,
-                void *defaultt) {
-    if (!reader) {
-        return defaultt;
-    }
+static ce_cdb_obj_o0 *write_begin(ce_cdb_t0 db,
+                                  uint64_t _obj) {
+    db_t *db_inst = _get_db(db);
 
-    object_t *obj = _get_object_from_o(reader);
+    // Writer read base until commit, keep it alive over gc.
+    read_pin();
 
-    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
-    if (!v) {
-        return defaultt;
+    object_t *obj = _get_object_from_uid(db_inst, _obj);
+
+    if (!obj) {
+        read_unpin();
+        return NULL;
     }
 
-    db_t *db = _get_db(obj->db);
-    ce_cdb_blob_t0 *blob = _get_blob(db, v->blob);
+    _snapshot_keep(db_inst, _obj, obj);
 
-    if (size) {
-        *size = blob->size;
-    }
+    // Writer is only a delta over obj, values are copied on first write
+    // and the object is cloned at commit only if someone may read it.
+    object_t *writer = _new_object(db_inst, db_inst->allocator);
 
-    return blob->data;
+    writer->id = obj->id;
+    writer->db = db;
+    writer->type = obj->type;
+    writer->flags = obj->flags | _OBJ_FLAG_WRITER;
+    writer->instance_of = obj->instance_of;
+    writer->parent = obj->parent;
+    writer->key = obj->key;
+    writer->storage = obj->storage;
+    writer->orig_obj = _obj;
+    writer->base = obj;
+    atomic_store(&writer->version, atomic_load(&obj->version));
+
+    _object_new_property(writer, 0, CDB_TYPE_NONE, db_inst->allocator);
+
+    return (ce_cdb_obj_o0 *) writer;
 }
 
-static const uint64_t *prop_keys(const ce_cdb_obj_o0 *reader) {
+static enum ce_cdb_type_e0 prop_type(const ce_cdb_obj_o0 *reader,
+                                     uint64_t key) {
     object_t *obj = _get_object_from_o(reader);
 
-    if (!obj) {
-        return 0;
+    if (obj->flags & _OBJ_FLAG_WRITER) {
+        uint64_t idx = _find_prop_index(obj, key);
+        if (idx) {
+            return (enum ce_cdb_type_e0) obj->property_type[idx];
+        }
+
+        obj = obj->base;
     }
 
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-        return obj->storage->prop_name;
-    } else {
-        return obj->keys + 1;
+    while (obj) {
+        if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+            uint64_t idx = ce_hash_lookup(&obj->storage->prop_idx, key, UINT64_MAX);
+            if (idx != UINT64_MAX) {
+                return (enum ce_cdb_type_e0) obj->storage->prop_type[idx];
+            }
+
+            break;
+        }
+
+        uint64_t idx = _find_prop_index(obj, key);
+        if (idx) {
+            return (enum ce_cdb_type_e0) obj->property_type[idx];
+        }
+
+        obj = _prefab_obj(obj);
     }
+
+    return CDB_TYPE_NONE;
 }
 
-static uint64_t prop_count(const ce_cdb_obj_o0 *reader) {
-    object_t *obj = _get_object_from_o(reader);
+static void _dispatch_instances(db_t *db_inst,
+                                object_t *obj,
+                                const ce_cdb_prop_ev_t0 *events,
+                                uint32_t events_n);
 
-    if (!obj) {
-        return 0;
-    }
+// New or removed prop change key set of object and its instances.
+static bool _writer_change_keys(object_t *writer) {
+    const uint32_t changed_n = ce_array_size(writer->changed);
+    for (uint32_t i = 0; i < changed_n; ++i) {
+        const ce_cdb_prop_ev_t0 *ev = &writer->changed[i];
 
-    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
-        return ce_array_size(obj->storage->prop_name);
-    } else {
-        return obj->properties_count - 1;
+        if (ev->ev_type == CE_CDB_PROP_REMOVE_EVENT) {
+            return true;
+        }
+
+        if ((ev->ev_type == CE_CDB_PROP_CHANGE_EVENT)
+            && !_get_value_ptr_generic(writer->base, ev->prop)) {
+            return true;
+        }
     }
+
+    return false;
 }
 
+// true if writer only overwrite values that already exist in obj.
+static bool _writer_is_overwrite(object_t *writer,
+                                 object_t *obj) {
+    for (uint64_t i = 1; i < writer->properties_count; ++i) {
+        if (writer->property_type[i] == CDB_TYPE_NONE) {
+            return false;
+        }
 
-bool prop_equal(const ce_cdb_obj_o0 *r1,
-                const ce_cdb_obj_o0 *r2,
-                uint64_t prorp) {
-    enum ce_cdb_type_e0 t = prop_type(r1, prorp);
+        // Instance value read from prefab is not in obj arrays.
+        bool exist = (obj->flags & _OBJ_FLAG_TYPED_OBJ)
+                     ? _get_value_ptr_generic(obj, writer->keys[i]) != NULL
+                     : _find_prop_index(obj, writer->keys[i]) != 0;
 
-    if (!prop_exist(r1, prorp) || !prop_exist(r2, prorp)) {
-        return false;
+        if (!exist) {
+            return false;
+        }
     }
 
-    switch (t) {
-        case CDB_TYPE_NONE:
-            break;
-        case CDB_TYPE_UINT64:
-            return read_uint64(r1, prorp, 0) == read_uint64(r2, prorp, 0);
-            break;
-        case CDB_TYPE_PTR:
-            return read_ptr(r1, prorp, 0) == read_ptr(r2, prorp, 0);
-            break;
-        case CDB_TYPE_REF:
-            return read_ref(r1, prorp, 0) == read_ref(r2, prorp, 0);
-            break;
-        case CDB_TYPE_FLOAT:
-            return read_float(r1, prorp, 0) == read_float(r2, prorp, 0);
-            break;
-        case CDB_TYPE_BOOL:
-            return read_bool(r1, prorp, 0) == read_bool(r2, prorp, 0);
-            break;
+    return true;
+}
 
-        case CDB_TYPE_STR: {
-            const char *s1 = read_string(r1, prorp, 0);
-            const char *s2 = read_string(r2, prorp, 0);
+static void _apply_writer(object_t *obj,
+                          object_t *writer) {
+    obj->parent = writer->parent;
+    obj->key = writer->key;
 
-            if (s1 == s2) {
-                return true;
+    for (uint64_t i = 1; i < writer->properties_count; ++i) {
+        uint64_t key = writer->keys[i];
+        enum ce_cdb_type_e0 type = writer->property_type[i];
+
+        if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+            type_storage_t *storage = obj->storage;
+            uint64_t prop_idx = ce_hash_lookup(&storage->prop_idx, key, UINT64_MAX);
+
+            if ((type == CDB_TYPE_NONE) || (prop_idx == UINT64_MAX)) {
+                continue;
             }
 
-            if (s1 == NULL || s2 == NULL) {
-                return false;
+            ce_cdb_value_u0 *v = _get_prop_value_ptr(storage, obj->typed_obj_idx, key);
+            memcpy(v, &writer->values[i], _TYPE_INFO[storage->prop_type[prop_idx]].size);
+        } else {
+            if (type == CDB_TYPE_NONE) {
+                _object_remove_property(obj, key);
+                continue;
             }
 
-            return !strcmp(s1, s2);
+            uint64_t idx = _find_prop_index(obj, key);
+            if (!idx) {
+                idx = _object_new_property(obj, key, type, _obj_allocator(obj));
+            }
+
+            obj->values[idx] = writer->values[i];
         }
-            break;
-        case CDB_TYPE_SUBOBJECT:
-            return read_subobject(r1, prorp, 0) == read_subobject(r2, prorp, 0);
-            break;
-        case CDB_TYPE_BLOB:
-            break;
+    }
+}
 
-        default:
-            break;
+// Own value of obj, instance value read from prefab is not own.
+static ce_cdb_value_u0 *_own_value_ptr(object_t *obj,
+                                       uint64_t key,
+                                       enum ce_cdb_type_e0 *type) {
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        type_storage_t *storage = obj->storage;
+        uint64_t prop_idx = ce_hash_lookup(&storage->prop_idx, key, UINT64_MAX);
+
+        if (prop_idx == UINT64_MAX) {
+            return NULL;
+        }
+
+        *type = (enum ce_cdb_type_e0) storage->prop_type[prop_idx];
+        return _get_prop_value_ptr(storage, obj->typed_obj_idx, key);
     }
 
-    return false;
+    uint64_t idx = _find_prop_index(obj, key);
+    if (!idx) {
+        return NULL;
+    }
+
+    *type = (enum ce_cdb_type_e0) obj->property_type[idx];
+    return &obj->values[idx];
 }
 
-void prop_copy(const ce_cdb_obj_o0 *from,
-               ce_cdb_obj_o0 *to,
-               uint64_t prop) {
-    enum ce_cdb_type_e0 t = prop_type(from, prop);
-    union ce_cdb_value_u0 v;
-    switch (t) {
-        case CDB_TYPE_NONE:
-            break;
+static bool _is_shared_type(enum ce_cdb_type_e0 type) {
+    return (type == CDB_TYPE_BLOB) || (type == CDB_TYPE_SET_SUBOBJECT);
+}
 
-        case CDB_TYPE_UINT64:
-            v.uint64 = read_uint64(from, prop, 0);
-            set_uint64(to, prop, v.uint64);
-            break;
-        case CDB_TYPE_PTR:
-            v.ptr = read_ptr(from, prop, 0);
-            set_ptr(to, prop, v.ptr);
-            break;
+static uint32_t _value_idx(enum ce_cdb_type_e0 type,
+                           const ce_cdb_value_u0 *v) {
+    return (type == CDB_TYPE_BLOB) ? v->blob : v->set;
+}
 
-        case CDB_TYPE_REF:
-            v.ref = read_ref(from, prop, 0);
-            set_ref(to, prop, v.ref);
-            break;
+// Set or blob of writer is still the one of obj.
+static bool _value_is_from(object_t *obj,
+                           uint64_t key,
+                           enum ce_cdb_type_e0 type,
+                           const ce_cdb_value_u0 *v) {
+    uint32_t idx = _value_idx(type, v);
+    if (!idx) {
+        return false;
+    }
 
-        case CDB_TYPE_FLOAT:
-            v.f = read_float(from, prop, 0);
-            set_float(to, prop, v.f);
-            break;
+    enum ce_cdb_type_e0 obj_type = CDB_TYPE_NONE;
+    ce_cdb_value_u0 *obj_v = _own_value_ptr(obj, key, &obj_type);
 
-        case CDB_TYPE_BOOL:
-            v.b = read_bool(from, prop, 0);
-            set_bool(to, prop, v.b);
-            break;
+    return obj_v && (obj_type == type) && (_value_idx(type, obj_v) == idx);
+}
 
-        case CDB_TYPE_STR:
-            v.str = (char *) read_string(from, prop, 0);
-            set_string(to, prop, v.str);
-            break;
+// Writer must not change set or blob it share with base, readers of base
+// can read it until commit.
+static bool _writer_shares_value(object_t *writer,
+                                 uint64_t key,
+                                 enum ce_cdb_type_e0 type,
+                                 const ce_cdb_value_u0 *v) {
+    if (!(writer->flags & _OBJ_FLAG_WRITER)) {
+        return false;
+    }
 
-        case CDB_TYPE_SUBOBJECT:
-            v.subobj = read_subobject(from, prop, 0);
-            set_subobject(to, prop, v.subobj);
-            break;
+    return _value_is_from(writer->base, key, type, v);
+}
 
-        case CDB_TYPE_SET_SUBOBJECT: {
-            uint64_t n = read_objset_count(from, prop);
-            uint64_t k[n];
-            read_objset(from, prop, k);
-            for (int j = 0; j < n; ++j) {
-                uint64_t new_subobj = create_from(ce_cdb_a0->db(), k[j]);
-                add_obj(to, prop, new_subobj);
-            }
+// Copy shared set before writer change it.
+static void _writer_own_set(db_t *db,
+                            object_t *writer,
+                            uint64_t key,
+                            ce_cdb_value_u0 *v) {
+    if (!v->set) {
+        v->set = _new_set(db);
+    } else if (_writer_shares_value(writer, key, CDB_TYPE_SET_SUBOBJECT, v)) {
+        _snapshot_copy_value(db, CDB_TYPE_SET_SUBOBJECT, v);
+    }
+}
+
+// Sets and blobs of obj replaced by writer go after readers of obj.
+static void _retire_replaced_values(db_t *db,
+                                    object_t *writer,
+                                    object_t *obj) {
+    for (uint64_t i = 1; i < writer->properties_count; ++i) {
+        uint64_t key = writer->keys[i];
+
+        enum ce_cdb_type_e0 type = CDB_TYPE_NONE;
+        ce_cdb_value_u0 *obj_v = _own_value_ptr(obj, key, &type);
+
+        if (!obj_v || !_is_shared_type(type) || !_value_idx(type, obj_v)) {
+            continue;
         }
-            break;
 
-        default:
-            break;
+        // Typed object keep its props, remove is skipped by apply.
+        if ((writer->property_type[i] == CDB_TYPE_NONE)
+            && (obj->flags & _OBJ_FLAG_TYPED_OBJ)) {
+            continue;
+        }
+
+        if ((writer->property_type[i] == type)
+            && (_value_idx(type, &writer->values[i]) == _value_idx(type, obj_v))) {
+            continue;
+        }
+
+        _retire_value(db, type, _value_idx(type, obj_v));
     }
 }
 
-void _prop_move(const ce_cdb_obj_o0 *from,
-                ce_cdb_obj_o0 *to,
-                uint64_t prop) {
-    enum ce_cdb_type_e0 t = prop_type(from, prop);
-    union ce_cdb_value_u0 v;
-    switch (t) {
-        case CDB_TYPE_NONE:
-            break;
+// Not committed writer own sets and blobs nobody saw.
+static void _free_writer_values(db_t *db,
+                                object_t *writer) {
+    for (uint64_t i = 1; i < writer->properties_count; ++i) {
+        enum ce_cdb_type_e0 type = writer->property_type[i];
+        ce_cdb_value_u0 *v = &writer->values[i];
 
-        case CDB_TYPE_UINT64:
-            v.uint64 = read_uint64(from, prop, 0);
-            _set_uint64(to, prop, v.uint64, false);
-            break;
-        case CDB_TYPE_PTR:
-            v.ptr = read_ptr(from, prop, 0);
-            _set_ptr(to, prop, v.ptr, false);
-            break;
+        if (!_is_shared_type(type) || !_value_idx(type, v)
+            || _writer_shares_value(writer, writer->keys[i], type, v)) {
+            continue;
+        }
 
-        case CDB_TYPE_REF:
-            v.ref = read_ref(from, prop, 0);
-            _set_ref(to, prop, v.ref, false);
-            break;
+        _snapshot_free_value(db, type, v);
+    }
+}
 
-        case CDB_TYPE_FLOAT:
-            v.f = read_float(from, prop, 0);
-            _set_float(to, prop, v.f, false);
-            break;
+// Apply writer and return new object version.
+static object_t *_commit_writer(db_t *db,
+                                object_t *writer) {
+    object_t *obj = NULL;
+    uint64_t read_epoch = 0;
 
-        case CDB_TYPE_BOOL:
-            v.b = read_bool(from, prop, 0);
-            _set_bool(to, prop, v.b, false);
-            break;
+    for (;;) {
+        obj = *writer->id;
+        read_epoch = _lock_object(obj);
 
-        case CDB_TYPE_STR:
-            v.str = (char *) read_string(from, prop, 0);
-            _set_string(to, prop, v.str, false);
+        if (*writer->id == obj) {
             break;
+        }
 
-        case CDB_TYPE_SUBOBJECT:
-            v.subobj = read_subobject(from, prop, 0);
-            _set_subobject(to, prop, v.subobj, false);
-            break;
+        _unlock_object(obj, read_epoch);
+    }
 
-        case CDB_TYPE_BLOB:
-            break;
+    _index_commit(db, obj, writer);
+    _retire_replaced_values(db, writer, obj);
 
-        case CDB_TYPE_SET_SUBOBJECT:
-            v.set = read_subobject(from, prop, 0);
-            _move_set(to, prop, v.set, false);
+    // No active reader could read obj and writer only overwrite values so
+    // arrays are not reallocated => apply in place without clone.
+    bool shared = read_epoch && (read_epoch >= _oldest_reader_epoch());
+    if (!shared && _writer_is_overwrite(writer, obj)) {
+        _apply_writer(obj, writer);
+        atomic_fetch_add(&obj->version, 1);
+        _unlock_object(obj, read_epoch);
+        return obj;
     }
+
+    object_t *new_obj = _object_clone(db, obj, db->allocator);
+    _apply_writer(new_obj, writer);
+    new_obj->keys_version += _writer_change_keys(writer);
+    _instance_build_keys(new_obj);
+    atomic_store(&new_obj->version, atomic_load(&obj->version) + 1);
+
+    *writer->id = new_obj;
+
+    _unlock_object(obj, read_epoch);
+    _destroy_object(db, obj);
+    return new_obj;
 }
 
-static struct ce_cdb_t0 global_db() {
-    return _G.global_db;
+static void write_commit(ce_cdb_obj_o0 *_writer) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    db_t *db = _get_db(writer->db);
+
+    object_t *obj = _commit_writer(db, writer);
+
+    _add_changed_obj(db, writer);
+
+    uint32_t ch_n = ce_array_size(writer->changed);
+    _publish_events(&db->obj_listeners, obj->type, writer->changed, ch_n);
+    _publish_events(&obj->obj_listeners, obj->type, writer->changed, ch_n);
+
+    _dispatch_instances(db, obj, writer->changed, ch_n);
+
+    _destroy_object(db, writer);
+
+    read_unpin();
 }
 
-void set_type(ce_cdb_t0 _db,
-              uint64_t _obj,
-              uint64_t type) {
-    if (!_obj) {
+static bool write_try_commit(ce_cdb_obj_o0 *_writer) {
+    object_t *writer = _get_object_from_o(_writer);
+    db_t *db = _get_db(writer->db);
+
+    object_t *orig_obj = writer->base;
+
+    uint64_t read_epoch = _lock_object(orig_obj);
+
+    // Commit in place keep pointer, only version tell it changed.
+    bool ok = (*writer->id == orig_obj)
+              && (atomic_load(&orig_obj->version) == atomic_load(&writer->version));
+
+    object_t *new_obj = NULL;
+    if (ok) {
+        _retire_replaced_values(db, writer, orig_obj);
+
+        new_obj = _object_clone(db, orig_obj, db->allocator);
+        _apply_writer(new_obj, writer);
+        new_obj->keys_version += _writer_change_keys(writer);
+        _instance_build_keys(new_obj);
+        atomic_store(&new_obj->version, atomic_load(&orig_obj->version) + 1);
+
+        *writer->id = new_obj;
+    }
+
+    _unlock_object(orig_obj, read_epoch);
+
+    if (ok) {
+        _add_changed_obj(db, writer);
+
+        uint32_t ch_n = ce_array_size(writer->changed);
+        _publish_events(&db->obj_listeners, new_obj->type, writer->changed, ch_n);
+        _publish_events(&new_obj->obj_listeners, new_obj->type, writer->changed, ch_n);
+
+        _destroy_object(db, orig_obj);
+    } else {
+        _free_writer_values(db, writer);
+    }
+
+    _destroy_object(db, writer);
+
+    read_unpin();
+
+    return ok;
+}
+
+static ce_cdb_value_u0 *_get_or_create_value_ptr_generic(object_t *obj,
+                                                         uint64_t property,
+                                                         ce_cdb_type_e0 prop_type) {
+
+    if (obj->flags & _OBJ_FLAG_WRITER) {
+        uint64_t idx = _find_prop_index(obj, property);
+
+        if (!idx) {
+            // Copy on write, keep base type same as dynamic object do.
+            ce_cdb_value_u0 value = {};
+            ce_cdb_value_u0 *v = _get_value_ptr_generic(obj->base, property);
+
+            if (v) {
+                prop_type = ce_cdb_a0->prop_type((ce_cdb_obj_o0 *) obj->base, property);
+
+                // Instance own its sets, subobjects and blobs, never share prefab ones.
+                bool inherited = !(obj->base->flags & _OBJ_FLAG_TYPED_OBJ)
+                                 && !_find_prop_index(obj->base, property);
+                bool owned_type = (prop_type == CDB_TYPE_SET_SUBOBJECT)
+                                  || (prop_type == CDB_TYPE_SUBOBJECT)
+                                  || (prop_type == CDB_TYPE_BLOB);
+
+                if (!(inherited && owned_type)) {
+                    memcpy(&value, v, _TYPE_INFO[prop_type].size);
+                }
+            }
+
+            idx = _object_new_property(obj, property, prop_type, _obj_allocator(obj));
+            obj->values[idx] = value;
+        } else if (obj->property_type[idx] == CDB_TYPE_NONE) {
+            obj->property_type[idx] = prop_type;
+        }
+
+        return &obj->values[idx];
+    }
+
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        ce_cdb_value_u0 *v = _get_prop_value_ptr(obj->storage, obj->typed_obj_idx, property);
+        return v;
+    } else {
+        uint64_t idx = _find_prop_index(obj, property);
+        if (!idx) {
+            idx = _object_new_property(obj, property, prop_type, _obj_allocator(obj));
+        }
+        return &obj->values[idx];
+    }
+
+    return NULL;
+}
+
+static void _set_float(ce_cdb_obj_o0 *_writer,
+                       uint64_t property,
+                       float value,
+                       bool log_event) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
         return;
     }
 
-    db_t *db = _get_db(_db);
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_FLOAT);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    if (log_event) {
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop = property,
+                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
+                .prop_type = CDB_TYPE_FLOAT,
+                .old_value = *value_ptr,
+                .new_value.f = value,
+        });
+    }
+
+    value_ptr->f = value;
 
-    object_t *obj = _get_object_from_uid(db, _obj);
-    obj->type = type;
 }
 
+static void _set_bool(ce_cdb_obj_o0 *_writer,
+                      uint64_t property,
+                      bool value,
+                      bool log_event) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
 
-uint64_t key(ce_cdb_t0 _db,
-             uint64_t _obj) {
-    db_t *db = _get_db(_db);
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_BOOL);
 
-    object_t *obj = _get_object_from_uid(db, _obj);
-    return obj->key;
+    if (!value_ptr) {
+        return;
+    }
+
+    if (log_event) {
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop=property,
+                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
+                .prop_type = CDB_TYPE_BOOL,
+                .old_value = *value_ptr,
+                .new_value.b = value,
+        });
+    }
+
+    value_ptr->b = value;
 }
 
-void move(ce_cdb_t0 _db,
-          uint64_t _from_obj,
-          uint64_t _to) {
-    db_t *db = _get_db(_db);
+static void _set_string(ce_cdb_obj_o0 *_writer,
+                        uint64_t property,
+                        const char *value,
+                        bool log_event) {
+    object_t *writer = _get_object_from_o(_writer);
+    ce_alloc_t0 *a = _obj_allocator(writer);
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_STR);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    char *value_clone = NULL;
+    if (value) {
+        value_clone = ce_memory_a0->str_dup(value, a);
+    }
+
+    if (log_event) {
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop=property,
+                .ev_type =CE_CDB_PROP_CHANGE_EVENT,
+                .prop_type = CDB_TYPE_STR,
+                .old_value = *value_ptr,
+                .new_value.str = value_clone,
+        });
+    }
+
+    value_ptr->str = value_clone;
+}
+
+
+static void _set_uint64(ce_cdb_obj_o0 *_writer,
+                        uint64_t property,
+                        uint64_t value,
+                        bool log_event) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
+                                                                  CDB_TYPE_UINT64);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    if (log_event) {
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop=property,
+                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
+                .prop_type = CDB_TYPE_UINT64,
+                .old_value = *value_ptr,
+                .new_value.uint64 = value,
+        });
+    }
+
+    value_ptr->uint64 = value;
+}
+
+static void _set_ptr(ce_cdb_obj_o0 *_writer,
+                     uint64_t property,
+                     const void *value,
+                     bool log_event) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_PTR);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    if (log_event) {
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop=property,
+                .ev_type =CE_CDB_PROP_CHANGE_EVENT,
+                .prop_type = CDB_TYPE_PTR,
+                .old_value = *value_ptr,
+                .new_value.ptr = (void *) value,
+        });
+    }
+
+    value_ptr->ptr = (void *) value;
+}
+
+static void _set_ref(ce_cdb_obj_o0 *_writer,
+                     uint64_t property,
+                     uint64_t ref,
+                     bool log_event) {
+
+
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_REF);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    if (log_event) {
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop=property,
+                .ev_type =CE_CDB_PROP_CHANGE_EVENT,
+                .prop_type = CDB_TYPE_REF,
+                .old_value = *value_ptr,
+                .new_value.ref = ref,
+        });
+    }
+
+    value_ptr->ref = ref;
+}
+
+void _set_subobject(ce_cdb_obj_o0 *_writer,
+                    uint64_t property,
+                    uint64_t subobject,
+                    bool log_event) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
+                                                                  CDB_TYPE_SUBOBJECT);
+
+    if (!value_ptr) {
+        return;
+    }
+
+
+    if (value_ptr->subobj) {
+        destroy_object(writer->db, value_ptr->subobj);
+    }
+
+    value_ptr->subobj = subobject;
+
+    if (log_event) {
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop = property,
+                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
+                .prop_type = CDB_TYPE_SUBOBJECT,
+                .old_value = *value_ptr,
+                .new_value.subobj = subobject,
+        });
+    }
+
+    if (subobject) {
+        struct db_t *db = _get_db(writer->db);
+
+        struct object_t *subobj = _get_object_from_uid(db, subobject);
+        _snapshot_keep(db, subobject, subobj);
+        subobj->parent = writer->orig_obj;
+        subobj->key = property;
+    }
+}
+
+
+static void set_float(ce_cdb_obj_o0 *_writer,
+                      uint64_t property,
+                      float value) {
+    _set_float(_writer, property, value, true);
+}
+
+static void set_bool(ce_cdb_obj_o0 *_writer,
+                     uint64_t property,
+                     bool value) {
+    _set_bool(_writer, property, value, true);
+}
+
+static void set_string(ce_cdb_obj_o0 *_writer,
+                       uint64_t property,
+                       const char *value) {
+    _set_string(_writer, property, value, true);
+}
+
+static void set_uint64(ce_cdb_obj_o0 *_writer,
+                       uint64_t property,
+                       uint64_t value) {
+    _set_uint64(_writer, property, value, true);
+}
+
+
+static void set_ptr(ce_cdb_obj_o0 *_writer,
+                    uint64_t property,
+                    const void *value) {
+    _set_ptr(_writer, property, value, true);
+}
+
+static void set_ref(ce_cdb_obj_o0 *_writer,
+                    uint64_t property,
+                    uint64_t ref) {
+    _set_ref(_writer, property, ref, true);
+}
+
+uint64_t parent(ce_cdb_t0 _db,
+                uint64_t object) {
+    db_t *db = _get_db(_db);
+
+    object_t *obj = _get_object_from_uid(db, object);
+    if(!obj) {
+        return 0;
+    }
+    return obj->parent;
+}
+
+void set_subobjectw(ce_cdb_obj_o0 *_writer,
+                    uint64_t property,
+                    ce_cdb_obj_o0 *_subwriter) {
+    object_t *writer = _get_object_from_o(_writer);
+    object_t *subwriter = _get_object_from_o(_subwriter);
+
+    subwriter->key = property;
+
+    union ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
+                                                                        CDB_TYPE_SUBOBJECT);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    _add_change(writer, (ce_cdb_prop_ev_t0) {
+            .obj = writer->orig_obj,
+            .prop = property,
+            .ev_type = CE_CDB_PROP_CHANGE_EVENT,
+            .prop_type = CDB_TYPE_SUBOBJECT,
+            .old_value = *value_ptr,
+            .new_value.subobj = subwriter->orig_obj,
+    });
+
+
+    value_ptr->subobj = subwriter->orig_obj;
+    subwriter->parent = writer->orig_obj;
+}
+
+
+void set_subobject(ce_cdb_obj_o0 *_writer,
+                   uint64_t property,
+                   uint64_t subobject) {
+    _set_subobject(_writer, property, subobject, true);
+}
+
+void _move_set(ce_cdb_obj_o0 *_writer,
+               uint64_t property,
+               uint64_t set,
+               bool log_event) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    union ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
+                                                                        CDB_TYPE_SET_SUBOBJECT);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    if (log_event) {
+
+    }
+
+    value_ptr->set = set;
+
+    _index_value(_get_db(writer->db), writer->orig_obj, CDB_TYPE_SET_SUBOBJECT, value_ptr, true);
+}
+
+void set_blob(ce_cdb_obj_o0 *_writer,
+              uint64_t property,
+              void *blob_data,
+              uint64_t blob_size) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    db_t *db = _get_db(writer->db);
+    ce_alloc_t0 *a = db->allocator;
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property, CDB_TYPE_BLOB);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    // Blob of base is retired at commit, writer own blob is reused.
+    if (value_ptr->blob
+        && !_writer_shares_value(writer, property, CDB_TYPE_BLOB, value_ptr)) {
+        struct ce_cdb_blob_t0 *blob = _get_blob(db, value_ptr->blob);
+
+        bool *mapped = _blob_mapped(db, value_ptr->blob);
+
+        if (*mapped) {
+            *mapped = false;
+        } else {
+            CE_FREE(a, blob->data);
+        }
+    } else {
+        uint32_t new_blob_idx = _new_blob(db);
+        value_ptr->blob = new_blob_idx;
+    }
+
+    void *new_blob = CE_ALLOC(a, uint8_t, blob_size);
+    memcpy(new_blob, blob_data, blob_size);
+
+    uint32_t blob_idx = value_ptr->blob;
+    ce_cdb_blob_t0 *blob = _get_blob(db, blob_idx);
+
+    *blob = (ce_cdb_blob_t0) {
+            .size = blob_size,
+            .data = new_blob,
+    };
+
+    _add_change(writer, (ce_cdb_prop_ev_t0) {
+            .obj = writer->orig_obj,
+            .prop=property,
+            .ev_type =CE_CDB_PROP_CHANGE_EVENT,
+            .prop_type = CDB_TYPE_BLOB,
+            .old_value = *value_ptr,
+            .new_value.blob = blob_idx,
+    });
+}
+
+
+void add_obj(ce_cdb_obj_o0 *_writer,
+             uint64_t property,
+             uint64_t obj) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    db_t *db = _get_db(writer->db);
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
+                                                                  CDB_TYPE_SET_SUBOBJECT);
+
+    if (!value_ptr) {
+        return;
+    }
+
+    _writer_own_set(db, writer, property, value_ptr);
+
+    if (_add_to_set(db, value_ptr->set, obj)) {
+        _index_ref(db, obj, writer->orig_obj, true);
+    }
+
+    if (obj) {
+        struct object_t *subobj = _get_object_from_uid(db, obj);
+        _snapshot_keep(db, obj, subobj);
+        subobj->parent = writer->orig_obj;
+        subobj->key = property;
+    }
+
+    _add_change(writer, (ce_cdb_prop_ev_t0) {
+            .obj = writer->orig_obj,
+            .prop=property,
+            .ev_type =CE_CDB_OBJSET_ADD_EVENT,
+            .prop_type = CDB_TYPE_SET_SUBOBJECT,
+            .new_value.subobj = obj,
+    });
+}
+
+void _remove_obj(ce_cdb_obj_o0 *_writer,
+                 uint64_t property,
+                 uint64_t obj) {
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    db_t *db = _get_db(writer->db);
+
+    if (!_get_value_ptr_generic(writer, property)) {
+        return;
+    }
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(writer, property,
+                                                                  CDB_TYPE_SET_SUBOBJECT);
+
+    if (!value_ptr || !value_ptr->set) {
+        return;
+    }
+
+    _writer_own_set(db, writer, property, value_ptr);
+
+    uint32_t set_idx = value_ptr->set;
+
+    if (_remove_from_set(db, set_idx, obj)) {
+        _index_ref(db, obj, writer->orig_obj, false);
+    }
+
+    _add_change(writer, (ce_cdb_prop_ev_t0) {
+            .obj = writer->orig_obj,
+            .prop=property,
+            .ev_type =CE_CDB_OBJSET_REMOVE_EVENT,
+            .prop_type = CDB_TYPE_SET_SUBOBJECT,
+            .old_value.subobj= obj,
+    });
+}
+
+void remove_obj(ce_cdb_obj_o0 *_writer,
+                uint64_t property,
+                uint64_t obj) {
+    _remove_obj(_writer, property, obj);
+
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (!writer) {
+        return;
+    }
+
+    destroy_object(writer->db, obj);
+}
+
+static bool prop_exist(const ce_cdb_obj_o0 *reader,
+                       uint64_t key);
+
+void remove_property(ce_cdb_obj_o0 *_writer,
+                     uint64_t property) {
+
+    object_t *writer = _get_object_from_o(_writer);
+
+    if (writer->flags & _OBJ_FLAG_TYPED_OBJ) {
+        return;
+    }
+
+    union ce_cdb_value_u0 *value_ptr = _get_value_ptr_generic(writer, property);
+
+    if (value_ptr) {
+        enum ce_cdb_type_e0 type = prop_type(_writer, property);
+        union ce_cdb_value_u0 old_value = *value_ptr;
+
+        if (type == CDB_TYPE_SUBOBJECT) {
+            destroy_object(writer->db, old_value.subobj);
+        }
+
+        _object_remove_property(writer, property);
+
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop=property,
+                .ev_type =CE_CDB_PROP_REMOVE_EVENT,
+                .prop_type = type,
+                .old_value = old_value,
+        });
+    }
+}
+
+const ce_cdb_obj_o0 *read(ce_cdb_t0 _db,
+                          uint64_t object) {
+    if (!object) {
+        return NULL;
+    }
+
+    db_t *db = _get_db(_db);
+
+    // Not pinned reader is valid until next gc.
+    reader_t *reader = _get_reader();
+    uint64_t epoch = atomic_load(&_G.epoch);
+    if (!atomic_load_explicit(&reader->state, memory_order_relaxed)) {
+        atomic_store(&reader->state, epoch << 1);
+    }
+
+    object_t *obj = _get_object_from_uid(db, object);
+
+    if (obj) {
+        _mark_read(obj, epoch);
+    }
+
+    return (ce_cdb_obj_o0 *) obj;
+}
+
+static uint64_t type(ce_cdb_t0 _db,
+                     uint64_t _obj) {
+    db_t *db = _get_db(_db);
+    object_t *obj = _get_object_from_uid(db, _obj);
+
+    if (!obj) {
+        return 0;
+    }
+
+    return obj->type;
+}
+
+
+uint64_t read_to(ce_cdb_t0 db,
+                 uint64_t object,
+                 void *to,
+                 size_t max_size);
+
+uint64_t _read_to(ce_cdb_t0 db,
+                  void *to,
+                  uint64_t type,
+                  ce_cdb_value_u0 *v,
+                  const ce_cdb_prop_def_t0 *def,
+                  uint64_t cur_byte,
+                  size_t max_size) {
+    db_t *db_inst = _get_db(db);
+
+    type_info_t ti = _TYPE_INFO[def->type];
+
+    size_t padding = CE_ALIGN_PADDING(to + cur_byte, ti.align);
+
+    if (def->flags & CDB_PROP_FLAG_UNPACK) {
+        return read_to(db, v->subobj, to + cur_byte, max_size);
+    } else if (type == CDB_TYPE_BLOB) {
+        ce_cdb_blob_t0 *blob = _get_blob(db_inst, v->blob);
+        memcpy(to + (cur_byte + padding), &blob->data, sizeof(void *));
+        return ti.size + padding;
+    } else {
+        memcpy(to + (cur_byte + padding), v, ti.size);
+        return ti.size + padding;
+    }
+}
+
+uint64_t read_to(ce_cdb_t0 db,
+                 uint64_t object,
+                 void *to,
+                 size_t max_size) {
+    db_t *db_inst = _get_db(db);
+    object_t *obj = _get_object_from_uid(db_inst, object);
+
+    if (!obj) {
+        return 0;
+    }
+
+    uint64_t obj_type = obj->type;
+    uint64_t cur_byte = 0;
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        const ce_cdb_type_def_t0 *defs = _get_prop_def(obj_type);
+        type_storage_t *storage = obj->storage;
+
+        uint32_t n = ce_array_size(storage->prop_name);
+        for (int i = 0; i < n; ++i) {
+            const ce_cdb_prop_def_t0 *def = &defs->defs[i];
+            ce_cdb_type_e0 type = storage->prop_type[i];
+
+            ce_cdb_value_u0 *v = _get_prop_value_ptr_idx(storage, obj->typed_obj_idx, i);
+
+            cur_byte += _read_to(db, to, type, v, def, cur_byte, max_size);
+        }
+
+    } else {
+        const ce_cdb_type_def_t0 *defs = _get_prop_def(obj_type);
+
+        if (defs) {
+            for (int i = 0; i < defs->num; ++i) {
+                ce_cdb_prop_def_t0 *def = &defs->defs[i];
+
+                uint64_t prop = _prop_index_key(obj_type, i);
+                ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, prop);
+
+                if (!v) {
+                    continue;
+                }
+
+                uint64_t type = prop_type((const ce_cdb_obj_o0 *) obj, prop);
+
+                cur_byte += _read_to(db, to, type, v, def, cur_byte, max_size);
+            }
+        }
+    }
+
+    CE_ASSERT(LOG_WHERE, cur_byte <= max_size);
+    return cur_byte;
+}
+
+uint64_t read_prop_to(ce_cdb_t0 db,
+                      uint64_t object,
+                      uint64_t prop,
+                      void *to,
+                      size_t max_size) {
+    db_t *db_inst = _get_db(db);
+    object_t *obj = _get_object_from_uid(db_inst, object);
+
+    if (!obj) {
+        return 0;
+    }
+
+    const ce_cdb_type_def_t0 *defs = _get_prop_def(obj->type);
+    uint32_t prop_idx = prop_index(obj->type, prop);
+
+    if (!defs || (prop_idx == UINT32_MAX)) {
+        return 0;
+    }
+
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, prop);
+
+    if (!v) {
+        return 0;
+    }
+
+    const ce_cdb_prop_def_t0 *def = &defs->defs[prop_idx];
+    if (def->type == CDB_TYPE_SUBOBJECT) {
+        return read_to(db, v->subobj, to, max_size);
+    }
+
+    type_info_t ti = _TYPE_INFO[def->type];
+    memcpy(to, v, ti.size);
+    return ti.size;
+}
+
+static float read_float(const ce_cdb_obj_o0 *reader,
+                        uint64_t property,
+                        float defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->f;
+}
+
+static bool read_bool(const ce_cdb_obj_o0 *reader,
+                      uint64_t property,
+                      bool defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->b;
+}
+
+static const char *read_string(const ce_cdb_obj_o0 *reader,
+                               uint64_t property,
+                               const char *defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->str;
+}
+
+
+static uint64_t read_uint64(const ce_cdb_obj_o0 *reader,
+                            uint64_t property,
+                            uint64_t defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->uint64;
+}
+
+static void *read_ptr(const ce_cdb_obj_o0 *reader,
+                      uint64_t property,
+                      void *defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->ptr;
+}
+
+static uint64_t read_ref(const ce_cdb_obj_o0 *reader,
+                         uint64_t property,
+                         uint64_t defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->ref;
+}
+
+static uint64_t read_subobject(const ce_cdb_obj_o0 *reader,
+                               uint64_t property,
+                               uint64_t defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->subobj;
+}
+
+void read_objset(const ce_cdb_obj_o0 *reader,
+                 uint64_t property,
+                 uint64_t *objs) {
+    object_t *obj = _get_object_from_o(reader);
+
+    if (!obj) {
+        return;
+    }
+
+    db_t *db_inst = _get_db(obj->db);
+
+
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return;
+    }
+
+    uint32_t setidx = v->set;
+    set_t *set = _get_set(db_inst, setidx);
+
+    if (!set) {
+        return;
+    }
+
+    uint32_t size = ce_array_size(set->objs);
+
+    memcpy(objs, set->objs, size * sizeof(uint64_t));
+}
+
+void *read_blob(const ce_cdb_obj_o0 *reader,
+                uint64_t property,
+                uint64_t *size,
+                void *defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+
+    ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, property);
+    if (!v) {
+        return defaultt;
+    }
+
+    db_t *db = _get_db(obj->db);
+    ce_cdb_blob_t0 *blob = _get_blob(db, v->blob);
+
+    if (size) {
+        *size = blob->size;
+    }
+
+    return blob->data;
+}
+
+static float read_float_idx(const ce_cdb_obj_o0 *reader,
+                            uint32_t prop_idx,
+                            float defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(_get_object_from_o(reader), prop_idx);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->f;
+}
+
+static bool read_bool_idx(const ce_cdb_obj_o0 *reader,
+                          uint32_t prop_idx,
+                          bool defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(_get_object_from_o(reader), prop_idx);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->b;
+}
+
+static const char *read_string_idx(const ce_cdb_obj_o0 *reader,
+                                   uint32_t prop_idx,
+                                   const char *defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(_get_object_from_o(reader), prop_idx);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->str;
+}
+
+static uint64_t read_uint64_idx(const ce_cdb_obj_o0 *reader,
+                                uint32_t prop_idx,
+                                uint64_t defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(_get_object_from_o(reader), prop_idx);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->uint64;
+}
+
+static void *read_ptr_idx(const ce_cdb_obj_o0 *reader,
+                          uint32_t prop_idx,
+                          void *defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(_get_object_from_o(reader), prop_idx);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->ptr;
+}
+
+static uint64_t read_ref_idx(const ce_cdb_obj_o0 *reader,
+                             uint32_t prop_idx,
+                             uint64_t defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(_get_object_from_o(reader), prop_idx);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->ref;
+}
+
+static uint64_t read_subobject_idx(const ce_cdb_obj_o0 *reader,
+                                   uint32_t prop_idx,
+                                   uint64_t defaultt) {
+    if (!reader) {
+        return defaultt;
+    }
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(_get_object_from_o(reader), prop_idx);
+    if (!v) {
+        return defaultt;
+    }
+
+    return v->subobj;
+}
+
+static uint64_t read_objset_num_idx(const ce_cdb_obj_o0 *reader,
+                                    uint32_t prop_idx) {
+    if (!reader) {
+        return 0;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(obj, prop_idx);
+    if (!v) {
+        return 0;
+    }
+
+    set_t *set = _get_set(_get_db(obj->db), v->set);
+
+    if (!set) {
+        return 0;
+    }
+
+    return ce_array_size(set->objs);
+}
+
+static void read_objset_idx(const ce_cdb_obj_o0 *reader,
+                            uint32_t prop_idx,
+                            uint64_t *objs) {
+    if (!reader) {
+        return;
+    }
+
+    object_t *obj = _get_object_from_o(reader);
+
+    ce_cdb_value_u0 *v = _get_value_ptr_idx(obj, prop_idx);
+    if (!v) {
+        return;
+    }
+
+    set_t *set = _get_set(_get_db(obj->db), v->set);
+
+    if (!set) {
+        return;
+    }
+
+    memcpy(objs, set->objs, ce_array_size(set->objs) * sizeof(uint64_t));
+}
+
+static ce_cdb_layout_t0 create_layout(uint64_t type,
+                                      const ce_cdb_view_prop_t0 *props,
+                                      uint32_t n) {
+    const ce_cdb_type_def_t0 *defs = _get_prop_def(type);
+
+    if (!defs) {
+        ce_log_a0->error(LOG_WHERE, "Layout for unregistered type 0x%llx", type);
+        return (ce_cdb_layout_t0) {};
+    }
+
+    uint32_t idx = atomic_fetch_add(&_G.layouts_n, 1);
+    if (idx >= MAX_LAYOUTS) {
+        ce_log_a0->error(LOG_WHERE, "Too many layouts");
+        return (ce_cdb_layout_t0) {};
+    }
+
+    layout_t *layout = &_G.layouts[idx];
+    *layout = (layout_t) {.type = type};
+
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t prop_idx = prop_index(type, props[i].prop);
+
+        if (prop_idx == UINT32_MAX) {
+            ce_log_a0->warning(LOG_WHERE, "Layout prop 0x%llx not in type 0x%llx",
+                               props[i].prop, type);
+            continue;
+        }
+
+        uint8_t prop_type = defs->defs[prop_idx].type;
+
+        if (prop_type == CDB_TYPE_SET_SUBOBJECT) {
+            continue;
+        }
+
+        layout_prop_t lp = {
+                .key = props[i].prop,
+                .prop_idx = prop_idx,
+                .offset = props[i].offset,
+                .type = prop_type,
+        };
+
+        ce_array_push(layout->props, lp, _G.allocator);
+
+        if (prop_type == CDB_TYPE_BLOB) {
+            ce_array_push(layout->slow_props, lp, _G.allocator);
+            continue;
+        }
+
+        layout_copy_t copy = {
+                .src = _type_prop_offset(defs, prop_idx),
+                .dst = props[i].offset,
+                .size = _TYPE_INFO[prop_type].size,
+        };
+
+        // Merge with previous run if both sides are contiguous.
+        uint32_t copies_n = ce_array_size(layout->copies);
+        if (copies_n) {
+            layout_copy_t *last = &layout->copies[copies_n - 1];
+            if ((last->src + last->size == copy.src) &&
+                (last->dst + last->size == copy.dst)) {
+                last->size += copy.size;
+                continue;
+            }
+        }
+
+        ce_array_push(layout->copies, copy, _G.allocator);
+    }
+
+    return (ce_cdb_layout_t0) {.idx = idx};
+}
+
+static void _read_view_value(db_t *db,
+                             ce_cdb_value_u0 *v,
+                             const layout_prop_t *prop,
+                             uint8_t *to) {
+    if (prop->type == CDB_TYPE_BLOB) {
+        ce_cdb_blob_t0 *blob = _get_blob(db, v->blob);
+        memcpy(to + prop->offset, &blob->data, sizeof(void *));
+        return;
+    }
+
+    memcpy(to + prop->offset, v, _TYPE_INFO[prop->type].size);
+}
+
+static void read_view(const ce_cdb_obj_o0 *reader,
+                      ce_cdb_layout_t0 _layout,
+                      void *_to) {
+    object_t *obj = _get_object_from_o(reader);
+
+    if (!obj || !_layout.idx) {
+        return;
+    }
+
+    const layout_t *layout = &_G.layouts[_layout.idx];
+    db_t *db = _get_db(obj->db);
+    uint8_t *to = _to;
+
+    // Typed object => copy runs straight from storage.
+    if ((obj->flags & _OBJ_FLAG_TYPED_OBJ)
+        && !(obj->flags & _OBJ_FLAG_WRITER)
+        && (obj->type == layout->type)) {
+        type_storage_t *storage = obj->storage;
+        const uint8_t *data = ce_segpool_at(&storage->pool, obj->typed_obj_idx);
+
+        const uint32_t copies_n = ce_array_size(layout->copies);
+        for (uint32_t i = 0; i < copies_n; ++i) {
+            const layout_copy_t *copy = &layout->copies[i];
+            memcpy(to + copy->dst, data + copy->src, copy->size);
+        }
+
+        const uint32_t slow_n = ce_array_size(layout->slow_props);
+        for (uint32_t i = 0; i < slow_n; ++i) {
+            const layout_prop_t *prop = &layout->slow_props[i];
+            ce_cdb_value_u0 *v = _get_prop_value_ptr_idx(storage, obj->typed_obj_idx,
+                                                         prop->prop_idx);
+            _read_view_value(db, v, prop, to);
+        }
+
+        return;
+    }
+
+    const uint32_t props_n = ce_array_size(layout->props);
+    for (uint32_t i = 0; i < props_n; ++i) {
+        const layout_prop_t *prop = &layout->props[i];
+
+        ce_cdb_value_u0 *v = _get_value_ptr_generic(obj, prop->key);
+        if (!v) {
+            continue;
+        }
+
+        _read_view_value(db, v, prop, to);
+    }
+}
+
+static uint64_t prop_count(const ce_cdb_obj_o0 *reader);
+
+static void _writer_build_keys(object_t *writer) {
+    const ce_cdb_obj_o0 *base = (const ce_cdb_obj_o0 *) writer->base;
+    const uint64_t base_n = prop_count(base);
+    const uint64_t *base_keys = ce_cdb_a0->prop_keys(base);
+
+    ce_array_clean(writer->keys_view);
+
+    for (uint64_t i = 0; i < base_n; ++i) {
+        uint64_t idx = _find_prop_index(writer, base_keys[i]);
+        if (idx && (writer->property_type[idx] == CDB_TYPE_NONE)) {
+            continue;
+        }
+
+        ce_array_push(writer->keys_view, base_keys[i], _obj_allocator(writer));
+    }
+
+    for (uint64_t i = 1; i < writer->properties_count; ++i) {
+        if (writer->property_type[i] == CDB_TYPE_NONE) {
+            continue;
+        }
+
+        if (prop_exist(base, writer->keys[i])) {
+            continue;
+        }
+
+        ce_array_push(writer->keys_view, writer->keys[i], _obj_allocator(writer));
+    }
+}
+
+// Prefab keys change without instance commit, instance compare this with
+// stamp of its keys_view.
+static uint64_t _prefab_keys_stamp(object_t *obj) {
+    uint64_t stamp = 0;
+
+    for (object_t *prefab = _prefab_obj(obj); prefab; prefab = _prefab_obj(prefab)) {
+        stamp += prefab->keys_version;
+    }
+
+    return stamp;
+}
+
+static void _instance_fill_keys(object_t *obj,
+                                object_t *prefab,
+                                uint64_t **keys) {
+    const ce_cdb_obj_o0 *prefab_r = (const ce_cdb_obj_o0 *) prefab;
+    const uint64_t prefab_n = prop_count(prefab_r);
+    const uint64_t *prefab_keys = prop_keys(prefab_r);
+
+    ce_array_push_n(*keys, prefab_keys, prefab_n, _obj_allocator(obj));
+
+    for (uint64_t i = 1; i < obj->properties_count; ++i) {
+        if (prop_exist(prefab_r, obj->keys[i])) {
+            continue;
+        }
+
+        ce_array_push(*keys, obj->keys[i], _obj_allocator(obj));
+    }
+}
+
+// Keys are built on create and commit, later only if prefab keys change.
+static void _instance_build_keys(object_t *obj) {
+    object_t *prefab = _prefab_obj(obj);
+
+    if (!prefab) {
+        return;
+    }
+
+    const uint64_t stamp = _prefab_keys_stamp(obj);
+
+    ce_array_clean(obj->keys_view);
+    _instance_fill_keys(obj, prefab, &obj->keys_view);
+
+    atomic_store(&obj->keys_view_stamp, stamp);
+}
+
+// Readers can hold old keys_view, new one is built aside and old is retired.
+static uint64_t *_instance_keys(object_t *obj) {
+    const uint64_t stamp = _prefab_keys_stamp(obj);
+
+    if (atomic_load(&obj->keys_view_stamp) == stamp) {
+        return obj->keys_view;
+    }
+
+    ce_os_thread_a0->spin_lock(&obj->keys_view_lock);
+
+    object_t *prefab = _prefab_obj(obj);
+    if (prefab && (atomic_load(&obj->keys_view_stamp) != stamp)) {
+        uint64_t *old_keys = obj->keys_view;
+
+        uint64_t *keys = NULL;
+        _instance_fill_keys(obj, prefab, &keys);
+
+        obj->keys_view = keys;
+        atomic_store(&obj->keys_view_stamp, stamp);
+
+        _retire(_get_db(obj->db), (retired_value_t) {
+                .type = CDB_TYPE_NONE,
+                .keys = old_keys,
+        });
+    }
+
+    ce_os_thread_a0->spin_unlock(&obj->keys_view_lock);
+
+    return obj->keys_view;
+}
+
+static const uint64_t *prop_keys(const ce_cdb_obj_o0 *reader) {
+    object_t *obj = _get_object_from_o(reader);
+
+    if (!obj) {
+        return 0;
+    }
+
+    if (obj->flags & _OBJ_FLAG_WRITER) {
+        _writer_build_keys(obj);
+        return obj->keys_view;
+    }
+
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        return obj->storage->prop_name;
+    } else if (obj->prefab) {
+        return _instance_keys(obj);
+    } else {
+        return obj->keys + 1;
+    }
+}
+
+static uint64_t prop_count(const ce_cdb_obj_o0 *reader) {
+    object_t *obj = _get_object_from_o(reader);
+
+    if (!obj) {
+        return 0;
+    }
+
+    if (obj->flags & _OBJ_FLAG_WRITER) {
+        _writer_build_keys(obj);
+        return ce_array_size(obj->keys_view);
+    }
+
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        return ce_array_size(obj->storage->prop_name);
+    } else if (obj->prefab) {
+        return ce_array_size(_instance_keys(obj));
+    } else {
+        return obj->properties_count - 1;
+    }
+}
+
+
+bool prop_equal(const ce_cdb_obj_o0 *r1,
+                const ce_cdb_obj_o0 *r2,
+                uint64_t prorp) {
+    enum ce_cdb_type_e0 t = prop_type(r1, prorp);
+
+    if (!prop_exist(r1, prorp) || !prop_exist(r2, prorp)) {
+        return false;
+    }
+
+    switch (t) {
+        case CDB_TYPE_NONE:
+            break;
+        case CDB_TYPE_UINT64:
+            return read_uint64(r1, prorp, 0) == read_uint64(r2, prorp, 0);
+            break;
+        case CDB_TYPE_PTR:
+            return read_ptr(r1, prorp, 0) == read_ptr(r2, prorp, 0);
+            break;
+        case CDB_TYPE_REF:
+            return read_ref(r1, prorp, 0) == read_ref(r2, prorp, 0);
+            break;
+        case CDB_TYPE_FLOAT:
+            return read_float(r1, prorp, 0) == read_float(r2, prorp, 0);
+            break;
+        case CDB_TYPE_BOOL:
+            return read_bool(r1, prorp, 0) == read_bool(r2, prorp, 0);
+            break;
+
+        case CDB_TYPE_STR: {
+            const char *s1 = read_string(r1, prorp, 0);
+            const char *s2 = read_string(r2, prorp, 0);
+
+            if (s1 == s2) {
+                return true;
+            }
+
+            if (s1 == NULL || s2 == NULL) {
+                return false;
+            }
+
+            return !strcmp(s1, s2);
+        }
+            break;
+        case CDB_TYPE_SUBOBJECT:
+            return read_subobject(r1, prorp, 0) == read_subobject(r2, prorp, 0);
+            break;
+        case CDB_TYPE_BLOB:
+            break;
+
+        default:
+            break;
+    }
+
+    return false;
+}
+
+void prop_copy(const ce_cdb_obj_o0 *from,
+               ce_cdb_obj_o0 *to,
+               uint64_t prop) {
+    enum ce_cdb_type_e0 t = prop_type(from, prop);
+    union ce_cdb_value_u0 v;
+    switch (t) {
+        case CDB_TYPE_NONE:
+            break;
+
+        case CDB_TYPE_UINT64:
+            v.uint64 = read_uint64(from, prop, 0);
+            set_uint64(to, prop, v.uint64);
+            break;
+        case CDB_TYPE_PTR:
+            v.ptr = read_ptr(from, prop, 0);
+            set_ptr(to, prop, v.ptr);
+            break;
+
+        case CDB_TYPE_REF:
+            v.ref = read_ref(from, prop, 0);
+            set_ref(to, prop, v.ref);
+            break;
+
+        case CDB_TYPE_FLOAT:
+            v.f = read_float(from, prop, 0);
+            set_float(to, prop, v.f);
+            break;
+
+        case CDB_TYPE_BOOL:
+            v.b = read_bool(from, prop, 0);
+            set_bool(to, prop, v.b);
+            break;
+
+        case CDB_TYPE_STR:
+            v.str = (char *) read_string(from, prop, 0);
+            set_string(to, prop, v.str);
+            break;
+
+        case CDB_TYPE_SUBOBJECT:
+            v.subobj = read_subobject(from, prop, 0);
+            set_subobject(to, prop, v.subobj);
+            break;
+
+        case CDB_TYPE_SET_SUBOBJECT: {
+            uint64_t n = read_objset_count(from, prop);
+            uint64_t k[n];
+            read_objset(from, prop, k);
+            for (int j = 0; j < n; ++j) {
+                uint64_t new_subobj = create_from(ce_cdb_a0->db(), k[j]);
+                add_obj(to, prop, new_subobj);
+            }
+        }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void _prop_move(const ce_cdb_obj_o0 *from,
+                ce_cdb_obj_o0 *to,
+                uint64_t prop) {
+    enum ce_cdb_type_e0 t = prop_type(from, prop);
+    union ce_cdb_value_u0 v;
+    switch (t) {
+        case CDB_TYPE_NONE:
+            break;
+
+        case CDB_TYPE_UINT64:
+            v.uint64 = read_uint64(from, prop, 0);
+            _set_uint64(to, prop, v.uint64, false);
+            break;
+        case CDB_TYPE_PTR:
+            v.ptr = read_ptr(from, prop, 0);
+            _set_ptr(to, prop, v.ptr, false);
+            break;
+
+        case CDB_TYPE_REF:
+            v.ref = read_ref(from, prop, 0);
+            _set_ref(to, prop, v.ref, false);
+            break;
+
+        case CDB_TYPE_FLOAT:
+            v.f = read_float(from, prop, 0);
+            _set_float(to, prop, v.f, false);
+            break;
+
+        case CDB_TYPE_BOOL:
+            v.b = read_bool(from, prop, 0);
+            _set_bool(to, prop, v.b, false);
+            break;
+
+        case CDB_TYPE_STR:
+            v.str = (char *) read_string(from, prop, 0);
+            _set_string(to, prop, v.str, false);
+            break;
+
+        case CDB_TYPE_SUBOBJECT:
+            v.subobj = read_subobject(from, prop, 0);
+            _set_subobject(to, prop, v.subobj, false);
+            break;
+
+        case CDB_TYPE_BLOB:
+            break;
+
+        case CDB_TYPE_SET_SUBOBJECT:
+            v.set = read_subobject(from, prop, 0);
+            _move_set(to, prop, v.set, false);
+    }
+}
+
+static struct ce_cdb_t0 global_db() {
+    return _G.global_db;
+}
+
+void set_type(ce_cdb_t0 _db,
+              uint64_t _obj,
+              uint64_t type) {
+    if (!_obj) {
+        return;
+    }
+
+    db_t *db = _get_db(_db);
+
+    object_t *obj = _get_object_from_uid(db, _obj);
+    _snapshot_keep(db, _obj, obj);
+
+    _index_type(db, obj->type, _obj, false);
+    obj->type = type;
+    _index_type(db, type, _obj, true);
+}
+
+
+uint64_t key(ce_cdb_t0 _db,
+             uint64_t _obj) {
+    db_t *db = _get_db(_db);
+
+    object_t *obj = _get_object_from_uid(db, _obj);
+    return obj->key;
+}
+
+void move(ce_cdb_t0 _db,
+          uint64_t _from_obj,
+          uint64_t _to) {
+    db_t *db = _get_db(_db);
+
+    object_t *from = _get_object_from_uid(db, _from_obj);
+
+    object_t **obj_addr = (object_t **) _to;
+
+    *obj_addr = from;
+}
+
+void move_prop(ce_cdb_obj_o0 *from_w,
+               ce_cdb_obj_o0 *to_w,
+               uint64_t prop) {
+    _prop_move(from_w, to_w, prop);
+
+    object_t *writer = _get_object_from_o(from_w);
+    object_t *to = _get_object_from_o(to_w);
+
+    if (writer->flags & _OBJ_FLAG_TYPED_OBJ) {
+        return;
+    }
+
+    ce_cdb_value_u0 *value_ptr = _get_value_ptr_generic(writer, prop);
+
+    if (value_ptr) {
+        enum ce_cdb_type_e0 type = prop_type(from_w, prop);
+        ce_cdb_value_u0 val = *value_ptr;
+
+        _object_remove_property(writer, prop);
+
+        _add_change(writer, (ce_cdb_prop_ev_t0) {
+                .obj = writer->orig_obj,
+                .prop=prop,
+                .ev_type = CE_CDB_PROP_MOVE_EVENT,
+                .prop_type = type,
+                .to = to->orig_obj,
+                .value = val,
+        });
+    }
+}
+
+void move_objset_obj(ce_cdb_obj_o0 *from_w,
+                     ce_cdb_obj_o0 *to_w,
+                     uint64_t prop,
+                     uint64_t obj) {
+    object_t *writer = _get_object_from_o(from_w);
+    object_t *to = _get_object_from_o(to_w);
+
+    if (!_get_value_ptr_generic(writer, prop)) {
+        return;
+    }
+
+    ce_cdb_value_u0 *from_v = _get_or_create_value_ptr_generic(writer, prop, CDB_TYPE_SET_SUBOBJECT);
+    ce_cdb_value_u0 *to_v = _get_or_create_value_ptr_generic(to, prop, CDB_TYPE_SET_SUBOBJECT);
+
+    if (!from_v || !to_v) {
+        return;
+    }
+
+    db_t *db = _get_db(writer->db);
+
+    _writer_own_set(db, writer, prop, from_v);
+    _writer_own_set(db, to, prop, to_v);
+
+    if (_remove_from_set(db, from_v->set, obj)) {
+        _index_ref(db, obj, writer->orig_obj, false);
+    }
+
+    if (_add_to_set(db, to_v->set, obj)) {
+        _index_ref(db, obj, to->orig_obj, true);
+    }
+
+    if (obj) {
+        struct object_t *subobj = _get_object_from_uid(db, obj);
+        _snapshot_keep(db, obj, subobj);
+        subobj->parent = to->orig_obj;
+        subobj->key = prop;
+    }
+
+    _add_change(writer, (ce_cdb_prop_ev_t0) {
+            .obj = writer->orig_obj,
+            .prop=prop,
+            .ev_type = CE_CDB_PROP_MOVE_EVENT,
+            .prop_type =  CDB_TYPE_SET_SUBOBJECT,
+            .to = to->orig_obj,
+            .value.subobj = obj,
+    });
+}
+
+static void _push_space(char **buffer,
+                        uint32_t level) {
+    for (int j = 0; j < level; ++j) {
+        ce_buffer_printf(buffer, _G.allocator, "  ");
+    }
+}
+
+static void dump_str(ce_cdb_t0 _db,
+                     char **buffer,
+                     uint64_t from,
+                     uint32_t level) {
+    const ce_cdb_obj_o0 *reader = read(_db, from);
+
+    const uint32_t prop_count = ce_cdb_a0->prop_count(reader);
+    const uint64_t *keys = prop_keys(reader);
+
+    _push_space(buffer, level);
+    ce_buffer_printf(buffer, _G.allocator, "cdb_uid: 0x%llx\n", from);
+
+    uint64_t type = ce_cdb_a0->obj_type(_db, from);
+    const char *type_str = ce_id_a0->str_from_id64(type);
+    if (type_str) {
+        _push_space(buffer, level);
+        ce_buffer_printf(buffer, _G.allocator, "cdb_type: %s\n", type_str);
+    } else {
+        if (type) {
+            _push_space(buffer, level);
+            ce_buffer_printf(buffer, _G.allocator, "cdb_type: 0x%llx\n", type);
+        }
+    }
+
+    uint64_t instance_of = ce_cdb_a0->read_instance_of(reader);
+    if (instance_of) {
+        _push_space(buffer, level);
+        ce_buffer_printf(buffer, _G.allocator, "cdb_instance: 0x%llx\n",
+                         instance_of);
+    }
+
+    for (int i = 0; i < prop_count; ++i) {
+        uint64_t key = keys[i];
+
+        if (key == CDB_INSTANCE_PROP) {
+            continue;
+        }
+
+        if (instance_of) {
+            const ce_cdb_obj_o0 *ir = ce_cdb_a0->read(_db, instance_of);
+            if (prop_equal(ir, reader, key)) {
+                continue;
+            }
+        }
+
+        const char *k = ce_id_a0->str_from_id64(key);
+
+        enum ce_cdb_type_e0 type = ce_cdb_a0->prop_type(reader, key);
+
+
+        if ((type == CDB_TYPE_BLOB) || (type == CDB_TYPE_PTR)) {
+            continue;
+        }
+
+
+        _push_space(buffer, level);
+
+        const char *sufix = "";
+
+        if (k) {
+            ce_buffer_printf(buffer, _G.allocator, "%s%s:", k, sufix);
+        } else {
+            ce_buffer_printf(buffer, _G.allocator, "0x%llx%s:", key, sufix);
+        }
+
+        switch (type) {
+            case CDB_TYPE_SUBOBJECT: {
+                uint64_t s = ce_cdb_a0->read_subobject(reader, key, 0);
+                ce_buffer_printf(buffer, _G.allocator, "\n");
+                dump_str(_db, buffer, s, level + 1);
+            }
+                break;
+
+            case CDB_TYPE_SET_SUBOBJECT: {
+                ce_buffer_printf(buffer, _G.allocator, "\n");
+
+                uint64_t num = read_objset_count(reader, key);
+                uint64_t objs[num];
+                read_objset(reader, key, objs);
+
+                _push_space(buffer, level + 1);
+                ce_buffer_printf(buffer, _G.allocator, "cdb_type: cdb_objset\n");
+
+                for (int j = 0; j < num; ++j) {
+                    uint64_t obj = objs[j];
+
+                    _push_space(buffer, level + 1);
+                    ce_buffer_printf(buffer, _G.allocator, "0x%llx:\n", obj);
+
+                    dump_str(_db, buffer, obj, level + 2);
+                }
+            }
+                break;
+
+
+            case CDB_TYPE_FLOAT: {
+                float f = ce_cdb_a0->read_float(reader, key, 0);
+                ce_buffer_printf(buffer, _G.allocator, " %f\n", f);
+            }
+                break;
+
+            case CDB_TYPE_STR: {
+                const char *s = ce_cdb_a0->read_str(reader, key, 0);
+                ce_buffer_printf(buffer, _G.allocator, " %s\n", s);
+            }
+                break;
+
+            case CDB_TYPE_BOOL: {
+                bool b = ce_cdb_a0->read_bool(reader, key, 0);
+                if (b) {
+                    ce_buffer_printf(buffer, _G.allocator, " true\n");
+                } else {
+                    ce_buffer_printf(buffer, _G.allocator, " false\n");
+                }
+            }
+                break;
+
+            case CDB_TYPE_NONE: {
+                ce_buffer_printf(buffer, _G.allocator, " none\n");
+            }
+                break;
+
+            case CDB_TYPE_UINT64: {
+                uint64_t i = ce_cdb_a0->read_uint64(reader, key, 0);
+                ce_buffer_printf(buffer, _G.allocator, " %llu\n", i);
+            }
+                break;
+
+            case CDB_TYPE_REF: {
+                uint64_t ref = ce_cdb_a0->read_ref(reader, key, 0);
+                ce_buffer_printf(buffer, _G.allocator, " 0x%llx\n", ref);
+            }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+}
+
+void log_obj(const char *where,
+             ce_cdb_t0 db,
+             uint64_t obj) {
+    char *buffer = NULL;
+    ce_cdb_a0->dump_str(db, &buffer, obj, 0);
+    ce_log_a0->debug(where, "%s", buffer);
+    ce_buffer_free(buffer, ce_memory_a0->system);
+
+}
+
+static uint64_t find_root(ce_cdb_t0 _db,
+                          uint64_t _obj) {
+    db_t *db = _get_db(_db);
+
+    object_t *obj = _get_object_from_uid(db, _obj);
+
+    if (!obj) {
+        return 0;
+    }
+
+    if (!obj->parent) {
+        return _obj;
+    }
+
+    return find_root(_db, obj->parent);
+}
+
+// Instance read not overridden value from prefab so value change is only
+// notified, new or removed prop rebuild instance keys on read. Subobject,
+// set and removed override still need instance writer.
+static void _dispatch_instances(db_t *db_inst,
+                                object_t *obj,
+                                const ce_cdb_prop_ev_t0 *events,
+                                uint32_t events_n) {
+    if (!events_n) {
+        return;
+    }
+
+    ce_cdb_t0 db = obj->db;
+    ce_cdb_prop_ev_t0 *inherited = NULL;
+
+    for (uint32_t i = 0; i < ce_array_size(obj->instances); ++i) {
+        uint64_t inst_uid = obj->instances[i];
+
+        object_t **inst_id = _get_objectid_from_uid(db_inst, inst_uid);
+        if (!inst_id) {
+            continue;
+        }
+
+        object_t *inst = *inst_id;
+
+        ce_array_clean(inherited);
+        bool need_writer = false;
+
+        for (uint32_t j = 0; j < events_n; ++j) {
+            const ce_cdb_prop_ev_t0 *ev = &events[j];
+            bool own = _find_prop_index(inst, ev->prop) != 0;
+
+            if (((ev->ev_type == CE_CDB_PROP_CHANGE_EVENT)
+                 && (ev->prop_type != CDB_TYPE_SUBOBJECT))
+                || (ev->ev_type == CE_CDB_PROP_REMOVE_EVENT)) {
+                if (own) {
+                    need_writer |= ev->ev_type == CE_CDB_PROP_REMOVE_EVENT;
+                    continue;
+                }
+
+                ce_cdb_prop_ev_t0 inst_ev = *ev;
+                inst_ev.obj = inst_uid;
+                ce_array_push(inherited, inst_ev, _G.allocator);
+                continue;
+            }
+
+            need_writer = true;
+        }
+
+        if (need_writer) {
+            ce_cdb_obj_o0 *w = write_begin(db, inst_uid);
+
+            for (uint32_t j = 0; j < events_n; ++j) {
+                const ce_cdb_prop_ev_t0 *ev = &events[j];
+
+                if (ev->ev_type == CE_CDB_PROP_CHANGE_EVENT) {
+                    if (ev->prop_type == CDB_TYPE_SUBOBJECT) {
+                        uint64_t new_so = create_from(db, ev->new_value.subobj);
+                        set_subobject(w, ev->prop, new_so);
+                    }
+                } else if (ev->ev_type == CE_CDB_PROP_REMOVE_EVENT) {
+                    if (_find_prop_index(inst, ev->prop)) {
+                        remove_property(w, ev->prop);
+                    }
+                } else if (ev->ev_type == CE_CDB_OBJSET_ADD_EVENT) {
+                    uint64_t new_obj = create_from(db, ev->new_value.subobj);
+                    ce_cdb_a0->objset_add_obj(w, ev->prop, new_obj);
+                } else if (ev->ev_type == CE_CDB_OBJSET_REMOVE_EVENT) {
+                    ce_cdb_a0->objset_remove_obj(w, ev->prop, ev->old_value.subobj);
+                }
+            }
+
+            // Commit also rebuild instance keys.
+            write_commit(w);
+            inst = *inst_id;
+        }
+
+        const uint32_t inherited_n = ce_array_size(inherited);
+        if (inherited_n) {
+            _add_changed_obj(db_inst, inst);
+            _publish_events(&db_inst->obj_listeners, inst->type, inherited, inherited_n);
+            _publish_events(&inst->obj_listeners, inst->type, inherited, inherited_n);
+        }
+
+        // Instances of instance inherit through it.
+        _dispatch_instances(db_inst, inst, inherited, inherited_n);
+    }
+
+    ce_array_free(inherited, _G.allocator);
+}
+
+const struct ce_cdb_prop_ev_t0 *changed(const ce_cdb_obj_o0 *reader,
+                                        uint32_t *n) {
+    object_t *obj = (object_t *) reader;
+    *n = ce_array_size(obj->changed);
+    if (*n) {
+        return obj->changed;
+    }
+    return NULL;
+}
+
+ct_cdb_ev_queue_o0 *add_changed_obj_listener(ce_cdb_t0 _db) {
+    db_t *db = _get_db(_db);
+    return (ct_cdb_ev_queue_o0 *) _new_changed_obj_events_listener(db, NULL);
+}
+
+ct_cdb_ev_queue_o0 *add_changed_obj_listener_filter(ce_cdb_t0 _db,
+                                                    const ce_cdb_listener_filter_t0 *filter) {
+    db_t *db = _get_db(_db);
+    return (ct_cdb_ev_queue_o0 *) _new_changed_obj_events_listener(db, filter);
+}
+
+bool pop_changed_obj(ct_cdb_ev_queue_o0 *q,
+                     ce_cdb_ev_t0 *ev) {
+    return _listener_pop((listener_t *) q, ev);
+}
+
+ct_cdb_ev_queue_o0 *add_obj_listener(ce_cdb_t0 _db) {
+    db_t *db = _get_db(_db);
+    return (ct_cdb_ev_queue_o0 *) _new_obj_events_listener(db, NULL);
+}
+
+ct_cdb_ev_queue_o0 *add_obj_listener_filter(ce_cdb_t0 _db,
+                                            const ce_cdb_listener_filter_t0 *filter) {
+    db_t *db = _get_db(_db);
+    return (ct_cdb_ev_queue_o0 *) _new_obj_events_listener(db, filter);
+}
+
+ct_cdb_ev_queue_o0 *add_obj_listener2(ce_cdb_t0 _db,
+                                      uint64_t _obj) {
+    db_t *db = _get_db(_db);
+    return (ct_cdb_ev_queue_o0 *) _new_obj_events_listener2(db, _obj);
+}
+
+bool pop_obj_events(ct_cdb_ev_queue_o0 *q,
+                    ce_cdb_prop_ev_t0 *ev) {
+    return _listener_pop((listener_t *) q, ev);
+}
+
+
+bool pop_obj_events2(ct_cdb_ev_queue_o0 *q,
+                     ce_cdb_prop_ev_t0 *ev) {
+    return _listener_pop((listener_t *) q, ev);
+}
+
+void listener_stats(ct_cdb_ev_queue_o0 *q,
+                    ce_cdb_listener_stats_t0 *stats) {
+    listener_t *l = (listener_t *) q;
+
+    *stats = (ce_cdb_listener_stats_t0) {
+            .pushed = atomic_load(&l->pushed),
+            .dropped = atomic_load(&l->dropped),
+            .overflows = atomic_load(&l->overflows),
+            .queued = ce_mpmc_size(&l->queue),
+    };
+}
+
+const uint64_t *changed_objects(ce_cdb_t0 _db,
+                                uint32_t *n) {
+    db_t *db = _get_db(_db);
+
+
+    uint32_t ch_n = ce_array_size(db->changed_obj);
+    if (!ch_n) {
+        *n = 0;
+        return NULL;
+    }
+
+    *n = ch_n;
+    return db->changed_obj;
+}
+
+void set_parent(ce_cdb_t0 _db,
+                uint64_t object,
+                uint64_t parent) {
+    db_t *db = _get_db(_db);
+
+    object_t *from = _get_object_from_uid(db, object);
+    from->parent = parent;
+}
+
+uint64_t read_instance_of(const ce_cdb_obj_o0 *reader) {
+    object_t *obj = _get_object_from_o(reader);
+    if (!obj) {
+        return 0;
+    }
+
+    return obj->instance_of;
+}
+
+static uint32_t _load_blob(db_t *db,
+                           const char *input,
+                           uint64_t size,
+                           bool mapped) {
+    void *data = (void *) input;
+
+    uint32_t blob_idx = _new_blob(db);
+
+    if (mapped) {
+        *_blob_mapped(db, blob_idx) = true;
+    } else {
+        void *copy = CE_ALLOC(db->allocator, char, size);
+        memcpy(copy, data, size);
+        data = copy;
+    }
+
+    *_get_blob(db, blob_idx) = (ce_cdb_blob_t0) {
+            .size = size,
+            .data = data,
+    };
+
+    return blob_idx;
+}
+
+static void _load_value(object_t *obj,
+                        uint64_t name,
+                        enum ce_cdb_type_e0 t,
+                        ce_cdb_value_u0 v) {
+    if (name == CDB_INSTANCE_PROP) {
+        return;
+    }
+
+    if (obj->flags & _OBJ_FLAG_TYPED_OBJ) {
+        type_storage_t *storage = obj->storage;
+        uint64_t idx = ce_hash_lookup(&storage->prop_idx, name, UINT64_MAX);
+
+        if ((idx == UINT64_MAX) || (storage->prop_type[idx] != t)) {
+            return;
+        }
+    }
+
+    ce_cdb_value_u0 *value_ptr = _get_or_create_value_ptr_generic(obj, name, t);
+    if (value_ptr) {
+        memcpy(value_ptr, &v, _TYPE_INFO[t].size);
+    }
+}
+
+static void _load(ce_cdb_t0 db,
+                  const char *input,
+                  uint64_t _obj,
+                  struct ce_alloc_t0 *allocator,
+                  bool mapped) {
+    db_t *db_inst = _get_db(db);
+
+    const struct cdb_binobj_header *header;
+    header = (const struct cdb_binobj_header *) input;
+
+    if (header->version != CDB_BINOBJ_VERSION) {
+        ce_log_a0->error(LOG_WHERE, "Invalid binary object version %llu for 0x%llx",
+                         header->version, _obj);
+        return;
+    }
+
+    uint64_t instanceof = header->instance_of;
+
+    if (instanceof) {
+        _create_from_uid(db, instanceof, _obj, true);
+    } else {
+        create_object_uid(db, _obj, header->type);
+    }
+
+    object_t *obj = _get_object_from_uid(db_inst, _obj);
+    obj->parent = header->parent;
+
+    const uint64_t slot_n = header->properties_count + 1;
+    const uint64_t *keys = (const uint64_t *) (header + 1);
+    const ce_cdb_value_u0 *values = (const ce_cdb_value_u0 *) (keys + slot_n);
+    const uint8_t *ptype = (const uint8_t *) (values + slot_n);
+    const char *str_buffer = (const char *) (ptype + _BINOBJ_ALIGN(slot_n));
+    const char *blob_buffer = str_buffer + header->string_buffer_size;
+    const char *set_buffer = blob_buffer + header->blob_buffer_size;
+
+    if (!header->properties_count) {
+        return;
+    }
+
+    // Loaded values overwrite defaults directly.
+    _index_obj_refs(db_inst, obj, false, false);
+
+    ce_cdb_obj_o0 *w = (ce_cdb_obj_o0 *) obj;
+
+    for (uint64_t i = 1; i < slot_n; ++i) {
+        uint64_t name = keys[i];
+        enum ce_cdb_type_e0 t = ptype[i];
+        ce_cdb_value_u0 v = values[i];
+
+        switch (t) {
+            case CDB_TYPE_NONE:
+                continue;
+
+            case CDB_TYPE_STR: {
+                const char *str = str_buffer + v.uint64;
+                v.str = mapped ? (char *) str : ce_memory_a0->str_dup(str, allocator);
+            }
+                break;
+
+            case CDB_TYPE_BLOB: {
+                const char *blob = blob_buffer + v.uint64;
+                v.blob = _load_blob(db_inst, blob + sizeof(uint64_t),
+                                    *((uint64_t *) blob), mapped);
+            }
+                break;
+
+            case CDB_TYPE_SUBOBJECT:
+                set_subobject(w, name, v.subobj);
+                continue;
+
+            case CDB_TYPE_SET_SUBOBJECT: {
+                const uint64_t *set = (const uint64_t *) (set_buffer + v.uint64);
+
+                uint64_t size = set[0];
+                for (uint64_t j = 0; j < size; ++j) {
+                    add_obj(w, name, set[1 + j]);
+                }
+            }
+                continue;
+
+            default:
+                break;
+        }
+
+        _load_value(obj, name, t, v);
+    }
+
+    _index_obj_refs(db_inst, obj, true, false);
+
+    _instance_build_keys(obj);
+    ce_array_clean(obj->changed);
+}
+
+typedef struct compact_reader_t {
+    ce_cdb_t0 db;
+    db_t *db_inst;
+    ce_alloc_t0 *allocator;
+    bool mapped;
+    bool inline_subobj;
+
+    const uint64_t *keys;
+    const char **strs;
+} compact_reader_t;
+
+static const uint8_t *_load_compact_obj(compact_reader_t *r,
+                                        const uint8_t *p,
+                                        uint64_t uid,
+                                        uint64_t parent) {
+    uint64_t type = r->keys[_read_varint(&p)];
+    uint64_t instanceof = _read_u64(&p);
+
+    if (instanceof) {
+        _create_from_uid(r->db, instanceof, uid, true);
+    } else {
+        create_object_uid(r->db, uid, type);
+    }
+
+    object_t *obj = _get_object_from_uid(r->db_inst, uid);
+    obj->parent = parent;
+
+    _index_obj_refs(r->db_inst, obj, false, false);
+
+    ce_cdb_obj_o0 *w = (ce_cdb_obj_o0 *) obj;
+
+    const uint64_t prop_n = _read_varint(&p);
+
+    // All props come at once, size arrays so they do not regrow.
+    if (!(obj->flags & _OBJ_FLAG_TYPED_OBJ)) {
+        const uint64_t capacity = obj->properties_count + prop_n + 1;
+        ce_alloc_t0 *a = _obj_allocator(obj);
+
+        ce_array_set_capacity(obj->keys, capacity, a);
+        ce_array_set_capacity(obj->property_type, capacity, a);
+        ce_array_set_capacity(obj->values, capacity, a);
+    }
+    for (uint64_t i = 0; i < prop_n; ++i) {
+        uint64_t name = r->keys[_read_varint(&p)];
+        enum ce_cdb_type_e0 t = *p++;
+
+        ce_cdb_value_u0 v = {};
+
+        switch (t) {
+            case CDB_TYPE_UINT64:
+                v.uint64 = _read_varint(&p);
+                break;
+
+            case CDB_TYPE_PTR:
+                v.ptr = (void *) _read_varint(&p);
+                break;
+
+            case CDB_TYPE_REF:
+                v.ref = _read_u64(&p);
+                break;
+
+            case CDB_TYPE_FLOAT:
+                memcpy(&v.f, p, sizeof(float));
+                p += sizeof(float);
+                break;
+
+            case CDB_TYPE_BOOL:
+                v.b = *p++ != 0;
+                break;
+
+            case CDB_TYPE_STR: {
+                const char *str = r->strs[_read_varint(&p)];
+                v.str = r->mapped ? (char *) str
+                                  : ce_memory_a0->str_dup(str, r->allocator);
+            }
+                break;
+
+            case CDB_TYPE_BLOB: {
+                uint64_t size = _read_varint(&p);
+                v.blob = _load_blob(r->db_inst, (const char *) p, size, r->mapped);
+                p += size;
+            }
+                break;
+
+            case CDB_TYPE_SUBOBJECT: {
+                uint64_t subobj = _read_u64(&p);
+                if (r->inline_subobj && subobj) {
+                    p = _load_compact_obj(r, p, subobj, uid);
+                }
+
+                set_subobject(w, name, subobj);
+            }
+                continue;
+
+            case CDB_TYPE_SET_SUBOBJECT: {
+                uint64_t n = _read_varint(&p);
+                for (uint64_t j = 0; j < n; ++j) {
+                    uint64_t subobj = _read_u64(&p);
+                    if (r->inline_subobj) {
+                        p = _load_compact_obj(r, p, subobj, uid);
+                    }
+
+                    add_obj(w, name, subobj);
+                }
+            }
+                continue;
+
+            default:
+                continue;
+        }
+
+        _load_value(obj, name, t, v);
+    }
+
+    _index_obj_refs(r->db_inst, obj, true, false);
+
+    _instance_build_keys(obj);
+    ce_array_clean(obj->changed);
+    return p;
+}
 
-    object_t *from = _get_object_from_uid(db, _from_obj);
+static void _load_compact(ce_cdb_t0 db,
+                          const char *input,
+                          uint64_t _obj,
+                          struct ce_alloc_t0 *allocator,
+                          bool mapped) {
+    const uint8_t *p = (const uint8_t *) input + 1;
 
-    object_t **obj_addr = (object_t **) _to;
+    uint64_t flags = _read_varint(&p);
 
-    *obj_addr = from;
-}
+    const uint64_t key_n = _read_varint(&p);
 
-void move_prop(ce_cdb_obj_o0 *from_w,
-               ce_cdb_obj_o0 *to_w,
-               uint64_t prop) {
-    _prop_move(from_w, to_w, prop);
+    // keys are not aligned in stream
+    uint64_t *keys = CE_ALLOC(_G.allocator, uint64_t, sizeof(uint64_t) * key_n);
+    memcpy(keys, p, sizeof(uint64_t) * key_n);
+    p += sizeof(uint64_t) * key_n;
 
-    object_t *writer = _get_object_from_o(from_w);
-    object_t *to = _get_object_from_o(to_w);
+    const uint64_t str_n = _read_varint(&p);
+    const char **strs = CE_ALLOC(_G.allocator, const char *, sizeof(char *) * str_n);
+    for (uint64_t i = 0; i < str_n; ++i) {
+        uint64_t len = _read_varint(&p);
+        strs[i] = (const char *) p;
+        p += len + 1;
+    }
 
-    uint64_t idx = _find_prop_index(writer, prop);
+    uint64_t parent = _read_u64(&p);
 
-    if (idx) {
-        uint64_t last_idx = --writer->properties_count;
-        ce_hash_add(&writer->prop_map, writer->keys[last_idx], idx, _G.allocator);
+    compact_reader_t r = {
+            .db = db,
+            .db_inst = _get_db(db),
+            .allocator = allocator,
+            .mapped = mapped,
+            .inline_subobj = (flags & CDB_COMPACT_INLINE) != 0,
+            .keys = keys,
+            .strs = strs,
+    };
 
-        ce_cdb_value_u0 val = writer->values[idx];
+    _load_compact_obj(&r, p, _obj, parent);
+
+    CE_FREE(_G.allocator, keys);
+    CE_FREE(_G.allocator, strs);
+}
 
-        writer->keys[idx] = writer->keys[last_idx];
-        writer->property_type[idx] = writer->property_type[last_idx];
-        writer->values[idx] = writer->values[last_idx];
+static void load(ce_cdb_t0 db,
+                 const char *input,
+                 uint64_t _obj,
+                 struct ce_alloc_t0 *allocator) {
+    // Arena db own all its data, strings must die with it.
+    if (_get_db(db)->flags & CDB_DB_FLAG_ARENA) {
+        allocator = _get_db(db)->allocator;
+    }
 
-        ce_array_pop_back(writer->keys);
-        ce_array_pop_back(writer->property_type);
-        ce_array_pop_back(writer->values);
+    if (input[0] == CDB_BINOBJ_COMPACT_VERSION) {
+        _load_compact(db, input, _obj, allocator, false);
+        return;
+    }
 
-        ce_hash_remove(&writer->prop_map, prop);
+    _load(db, input, _obj, allocator, false);
+}
 
-        _add_change(writer, (ce_cdb_prop_ev_t0) {
-                .obj = writer->orig_obj,
-                .prop=prop,
-                .ev_type = CE_CDB_PROP_MOVE_EVENT,
-                .prop_type = writer->property_type[idx],
-                .to = to->orig_obj,
-                .value = val,
-        });
+static void load_mapped(ce_cdb_t0 db,
+                        const char *input,
+                        uint64_t _obj) {
+    if (input[0] == CDB_BINOBJ_COMPACT_VERSION) {
+        _load_compact(db, input, _obj, _get_db(db)->allocator, true);
+        return;
     }
+
+    _load(db, input, _obj, _get_db(db)->allocator, true);
 }
 
-void move_objset_obj(ce_cdb_obj_o0 *from_w,
-                     ce_cdb_obj_o0 *to_w,
-                     uint64_t prop,
-                     uint64_t obj) {
-    object_t *writer = _get_object_from_o(from_w);
-    object_t *to = _get_object_from_o(to_w);
+void _init_from_defs(ce_cdb_t0 db,
+                     object_t *obj,
+                     const ce_cdb_type_def_t0 *def) {
 
-    ce_cdb_value_u0 *from_v = _get_value_ptr_generic(writer, prop);
-    ce_cdb_value_u0 *to_v = _get_or_create_value_ptr_generic(to, prop, CDB_TYPE_SET_SUBOBJECT);
+    ce_cdb_obj_o0 *w = (ce_cdb_obj_o0 *) obj;
 
-    db_t *db = _get_db(writer->db);
+    for (uint32_t i = 0; i < def->num; ++i) {
+        ce_cdb_prop_def_t0 *prop_def = &def->defs[i];
+        uint64_t prop_name = ce_id_a0->id64(prop_def->name);
+        enum ce_cdb_type_e0 t = prop_def->type;
 
-    if (!to_v->set) {
-        to_v->set = _new_set(db);
-    }
+        switch (t) {
+            case CDB_TYPE_NONE:
+                break;
+            case CDB_TYPE_UINT64:
+                set_uint64(w, prop_name, prop_def->value.uint64);
+                break;
+            case CDB_TYPE_PTR:
+                set_ptr(w, prop_name, prop_def->value.ptr);
+                break;
+            case CDB_TYPE_REF:
+                set_ref(w, prop_name, prop_def->value.ref);
+                break;
+            case CDB_TYPE_FLOAT:
+                set_float(w, prop_name, prop_def->value.f);
+                break;
+            case CDB_TYPE_BOOL:
+                set_bool(w, prop_name, prop_def->value.b);
+                break;
+            case CDB_TYPE_STR:
+                set_string(w, prop_name, prop_def->value.str);
+                break;
+            case CDB_TYPE_SUBOBJECT: {
+                uint64_t sub_obj = create_object(db, prop_def->obj_type);
+                set_subobject(w, prop_name, sub_obj);
+            }
+                break;
+            case CDB_TYPE_BLOB: {
+                set_blob(w, prop_name, NULL, 0);
+            }
+                break;
 
-    _remove_from_set(db, from_v->set, obj);
-    _add_to_set(db, to_v->set, obj);
+            case CDB_TYPE_SET_SUBOBJECT: {
+                object_t *writer = _get_object_from_o(w);
+                db_t *dbinst = _get_db(db);
 
-    if (obj) {
-        struct object_t *subobj = _get_object_from_uid(db, obj);
-        subobj->parent = to->orig_obj;
-        subobj->key = prop;
-    }
+                ce_cdb_value_u0 *v = _get_or_create_value_ptr_generic(writer, prop_name,
+                                                                      CDB_TYPE_SET_SUBOBJECT);
+                v->set = _new_set(dbinst);
+            }
+                break;
 
-    _add_change(writer, (ce_cdb_prop_ev_t0) {
-            .obj = writer->orig_obj,
-            .prop=prop,
-            .ev_type = CE_CDB_PROP_MOVE_EVENT,
-            .prop_type =  CDB_TYPE_SET_SUBOBJECT,
-            .to = to->orig_obj,
-            .value.subobj = obj,
-    });
+        }
+    }
 }
 
-static void _push_space(char **buffer,
-                        uint32_t level) {
-    for (int j = 0; j < level; ++j) {
-        ce_buffer_printf(buffer, _G.allocator, "  ");
+// snapshot
+static snapshot_t *_get_snapshot(db_t *db,
+                                 ce_cdb_snapshot_t0 snapshot) {
+    if (!snapshot.idx || (snapshot.idx > ce_array_size(db->snapshots))) {
+        return NULL;
     }
-}
 
-static void dump_str(ce_cdb_t0 _db,
-                     char **buffer,
-                     uint64_t from,
-                     uint32_t level) {
-    const ce_cdb_obj_o0 *reader = read(_db, from);
+    snapshot_t *s = &db->snapshots[snapshot.idx - 1];
+    return s->used ? s : NULL;
+}
 
-    const uint32_t prop_count = ce_cdb_a0->prop_count(reader);
-    const uint64_t *keys = prop_keys(reader);
+static ce_cdb_snapshot_t0 create_snapshot(ce_cdb_t0 db) {
+    db_t *db_inst = _get_db(db);
 
-    _push_space(buffer, level);
-    ce_buffer_printf(buffer, _G.allocator, "cdb_uid: 0x%llx\n", from);
+    ce_os_thread_a0->spin_lock(&db_inst->snapshot_lock);
 
-    uint64_t type = ce_cdb_a0->obj_type(_db, from);
-    const char *type_str = ce_id_a0->str_from_id64(type);
-    if (type_str) {
-        _push_space(buffer, level);
-        ce_buffer_printf(buffer, _G.allocator, "cdb_type: %s\n", type_str);
-    } else {
-        if (type) {
-            _push_space(buffer, level);
-            ce_buffer_printf(buffer, _G.allocator, "cdb_type: 0x%llx\n", type);
+    uint32_t idx = 0;
+    const uint32_t snapshots_n = ce_array_size(db_inst->snapshots);
+    for (; idx < snapshots_n; ++idx) {
+        if (!db_inst->snapshots[idx].used) {
+            break;
         }
     }
 
-    uint64_t instance_of = ce_cdb_a0->read_instance_of(reader);
-    if (instance_of) {
-        _push_space(buffer, level);
-        ce_buffer_printf(buffer, _G.allocator, "cdb_instance: 0x%llx\n",
-                         instance_of);
+    if (idx == snapshots_n) {
+        ce_array_push(db_inst->snapshots, (snapshot_t) {}, _G.allocator);
     }
 
-    for (int i = 0; i < prop_count; ++i) {
-        uint64_t key = keys[i];
+    db_inst->snapshots[idx] = (snapshot_t) {.used = true};
+    atomic_fetch_add(&db_inst->snapshot_n, 1);
 
-        if (key == CDB_INSTANCE_PROP) {
-            continue;
-        }
+    ce_os_thread_a0->spin_unlock(&db_inst->snapshot_lock);
 
-        if (instance_of) {
-            const ce_cdb_obj_o0 *ir = ce_cdb_a0->read(_db, instance_of);
-            if (prop_equal(ir, reader, key)) {
-                continue;
-            }
-        }
+    return (ce_cdb_snapshot_t0) {.idx = idx + 1};
+}
 
-        const char *k = ce_id_a0->str_from_id64(key);
+static void release_snapshot(ce_cdb_t0 db,
+                             ce_cdb_snapshot_t0 snapshot) {
+    db_t *db_inst = _get_db(db);
 
-        enum ce_cdb_type_e0 type = ce_cdb_a0->prop_type(reader, key);
+    ce_os_thread_a0->spin_lock(&db_inst->snapshot_lock);
+
+    snapshot_t *s = _get_snapshot(db_inst, snapshot);
+    if (!s) {
+        ce_os_thread_a0->spin_unlock(&db_inst->snapshot_lock);
+        return;
+    }
 
+    const uint32_t uids_n = ce_array_size(s->uids);
+    for (uint32_t i = 0; i < uids_n; ++i) {
+        object_t *copy = (object_t *) ce_hash_lookup(&s->objs, s->uids[i], 0);
 
-        if ((type == CDB_TYPE_BLOB) || (type == CDB_TYPE_PTR)) {
+        if (!copy || --copy->snapshot_refs) {
             continue;
         }
 
+        _snapshot_foreach_value(db_inst, copy, _snapshot_free_value);
+        _destroy_object(db_inst, copy);
+    }
 
-        _push_space(buffer, level);
-
-        const char *sufix = "";
+    ce_hash_free(&s->objs, _G.allocator);
+    ce_array_free(s->uids, _G.allocator);
+    *s = (snapshot_t) {};
 
-        if (k) {
-            ce_buffer_printf(buffer, _G.allocator, "%s%s:", k, sufix);
-        } else {
-            ce_buffer_printf(buffer, _G.allocator, "0x%llx%s:", key, sufix);
-        }
+    atomic_fetch_sub(&db_inst->snapshot_n, 1);
 
-        switch (type) {
-            case CDB_TYPE_SUBOBJECT: {
-                uint64_t s = ce_cdb_a0->read_subobject(reader, key, 0);
-                ce_buffer_printf(buffer, _G.allocator, "\n");
-                dump_str(_db, buffer, s, level + 1);
-            }
-                break;
+    ce_os_thread_a0->spin_unlock(&db_inst->snapshot_lock);
+}
 
-            case CDB_TYPE_SET_SUBOBJECT: {
-                ce_buffer_printf(buffer, _G.allocator, "\n");
+static void _snapshot_restore_obj(db_t *db,
+                                  uint64_t uid,
+                                  object_t *copy) {
+    // Copy again, snapshot can be restored more times.
+    object_t *obj = _snapshot_copy(db, copy);
 
-                uint64_t num = read_objset_count(reader, key);
-                uint64_t objs[num];
-                read_objset(reader, key, objs);
+    object_t **objid = _get_objectid_from_uid(db, uid);
+    if (objid) {
+        object_t *cur = *objid;
+        _snapshot_keep(db, uid, cur);
 
-                _push_space(buffer, level + 1);
-                ce_buffer_printf(buffer, _G.allocator, "cdb_type: cdb_objset\n");
+        obj->id = objid;
+        obj->obj_listeners = cur->obj_listeners;
 
-                for (int j = 0; j < num; ++j) {
-                    uint64_t obj = objs[j];
+        _index_obj(db, cur, false);
 
-                    _push_space(buffer, level + 1);
-                    ce_buffer_printf(buffer, _G.allocator, "0x%llx:\n", obj);
+        uint64_t read_epoch = _lock_object(cur);
+        *objid = obj;
+        _unlock_object(cur, read_epoch);
 
-                    dump_str(_db, buffer, obj, level + 2);
-                }
-            }
-                break;
+        _destroy_object(db, cur);
+    } else {
+        _snapshot_keep(db, uid, NULL);
 
+        objid = _new_obj_id(db);
+        *objid = obj;
+        _set_uid_objid(db, uid, objid);
+        obj->id = objid;
+    }
 
-            case CDB_TYPE_FLOAT: {
-                float f = ce_cdb_a0->read_float(reader, key, 0);
-                ce_buffer_printf(buffer, _G.allocator, " %f\n", f);
-            }
-                break;
+    _index_obj(db, obj, true);
 
-            case CDB_TYPE_STR: {
-                const char *s = ce_cdb_a0->read_str(reader, key, 0);
-                ce_buffer_printf(buffer, _G.allocator, " %s\n", s);
-            }
-                break;
+    _add_changed_obj(db, obj);
+    _resync_listeners(&obj->obj_listeners);
+}
 
-            case CDB_TYPE_BOOL: {
-                bool b = ce_cdb_a0->read_bool(reader, key, 0);
-                if (b) {
-                    ce_buffer_printf(buffer, _G.allocator, " true\n");
-                } else {
-                    ce_buffer_printf(buffer, _G.allocator, " false\n");
-                }
-            }
-                break;
+// Only objects changed after snapshot are touched. Do not call it while
+// some writer is open.
+static void restore_snapshot(ce_cdb_t0 db,
+                             ce_cdb_snapshot_t0 snapshot) {
+    db_t *db_inst = _get_db(db);
 
-            case CDB_TYPE_NONE: {
-                ce_buffer_printf(buffer, _G.allocator, " none\n");
-            }
-                break;
+    snapshot_t *s = _get_snapshot(db_inst, snapshot);
+    if (!s) {
+        return;
+    }
 
-            case CDB_TYPE_UINT64: {
-                uint64_t i = ce_cdb_a0->read_uint64(reader, key, 0);
-                ce_buffer_printf(buffer, _G.allocator, " %llu\n", i);
-            }
-                break;
+    // Restore can add to other snapshots => db->snapshots can move.
+    const uint32_t uids_n = ce_array_size(s->uids);
 
-            case CDB_TYPE_REF: {
-                uint64_t ref = ce_cdb_a0->read_ref(reader, key, 0);
-                ce_buffer_printf(buffer, _G.allocator, " 0x%llx\n", ref);
-            }
-                break;
+    for (uint32_t i = 0; i < uids_n; ++i) {
+        s = _get_snapshot(db_inst, snapshot);
+        uint64_t uid = s->uids[i];
 
-            default:
-                break;
+        if (!ce_hash_lookup(&s->objs, uid, 0) && _get_objectid_from_uid(db_inst, uid)) {
+            destroy_object(db, uid);
         }
     }
 
-}
+    // Free destroyed objects now, restored one get new id.
+    _gc_free_task(&(gc_task_t) {.db = db_inst});
 
-void log_obj(const char *where,
-             ce_cdb_t0 db,
-             uint64_t obj) {
-    char *buffer = NULL;
-    ce_cdb_a0->dump_str(db, &buffer, obj, 0);
-    ce_log_a0->debug(where, "%s", buffer);
-    ce_buffer_free(buffer, ce_memory_a0->system);
+    for (uint32_t i = 0; i < uids_n; ++i) {
+        s = _get_snapshot(db_inst, snapshot);
+        uint64_t uid = s->uids[i];
+        object_t *copy = (object_t *) ce_hash_lookup(&s->objs, uid, 0);
 
-}
+        if (copy) {
+            _snapshot_restore_obj(db_inst, uid, copy);
+        }
+    }
 
-static uint64_t find_root(ce_cdb_t0 _db,
-                          uint64_t _obj) {
-    db_t *db = _get_db(_db);
+    // Prefab can be restored with new id after its instances.
+    for (uint32_t i = 0; i < uids_n; ++i) {
+        s = _get_snapshot(db_inst, snapshot);
+        uint64_t uid = s->uids[i];
 
-    object_t *obj = _get_object_from_uid(db, _obj);
+        if (!ce_hash_lookup(&s->objs, uid, 0)) {
+            continue;
+        }
 
-    if (!obj) {
-        return 0;
+        object_t *obj = *_get_objectid_from_uid(db_inst, uid);
+        if (obj->instance_of) {
+            obj->prefab = _get_objectid_from_uid(db_inst, obj->instance_of);
+            _instance_build_keys(obj);
+        }
     }
 
-    if (!obj->parent) {
-        return _obj;
-    }
+    _resync_listeners(&db_inst->obj_listeners);
+}
 
-    return find_root(_db, obj->parent);
+static uint32_t snapshot_objs(ce_cdb_t0 db,
+                              ce_cdb_snapshot_t0 snapshot,
+                              const uint64_t **objs) {
+    snapshot_t *s = _get_snapshot(_get_db(db), snapshot);
+
+    *objs = s ? s->uids : NULL;
+    return s ? ce_array_size(s->uids) : 0;
 }
 
-static void _dispatch_instances(ce_cdb_t0 db,
-                                struct object_t *orig_obj) {
-    const int changed_prop_n = ce_array_size(orig_obj->changed);
+static const ce_cdb_obj_o0 *read_snapshot(ce_cdb_t0 db,
+                                          ce_cdb_snapshot_t0 snapshot,
+                                          uint64_t obj) {
+    db_t *db_inst = _get_db(db);
+
+    ce_os_thread_a0->spin_lock(&db_inst->snapshot_lock);
 
-    if (!changed_prop_n) {
-        return;
+    snapshot_t *s = _get_snapshot(db_inst, snapshot);
+    bool changed = s && ce_hash_contain(&s->objs, obj);
+    object_t *copy = changed ? (object_t *) ce_hash_lookup(&s->objs, obj, 0) : NULL;
+
+    ce_os_thread_a0->spin_unlock(&db_inst->snapshot_lock);
+
+    if (!changed) {
+        return read(db, obj);
     }
 
-    const int instances_n = ce_array_size(orig_obj->instances);
-    for (int i = 0; i < instances_n; ++i) {
-        uint64_t inst_obj = orig_obj->instances[i];
+    return (const ce_cdb_obj_o0 *) copy;
+}
 
-        ce_cdb_obj_o0 *w = write_begin(db, inst_obj);
-        const uint32_t chn = ce_array_size(orig_obj->changed);
-        for (int j = 0; j < chn; ++j) {
-            ce_cdb_prop_ev_t0 *ev = &orig_obj->changed[j];
-            enum ce_cdb_type_e0 t = prop_type((ce_cdb_obj_o0 *) orig_obj, ev->prop);
+// Delta
+// Record: u8 version | u8 flags | u64 uid | u64 type | u64 instance_of |
+//         varint ops_n | ops_n * (u8 ev | u64 prop | u8 type | value)
+// Value use compact encoding, but strings and keys are inline.
+#define CDB_DELTA_VERSION 3
 
-            if (ev->ev_type == CE_CDB_PROP_CHANGE_EVENT) {
-                switch (t) {
-                    case CDB_TYPE_NONE:
-                        break;
+enum {
+    _DELTA_CREATE = 1 << 0,
+    _DELTA_DESTROY = 1 << 1,
+};
 
-                    case CDB_TYPE_UINT64: {
-                        uint64_t u = read_uint64(w, ev->prop, 0);
-                        if (u == ev->old_value.uint64) {
-                            set_uint64(w, ev->prop, ev->new_value.uint64);
-                        }
-                    }
-                        break;
+enum {
+    _DELTA_OP_CHANGE = 0,
+    _DELTA_OP_REMOVE = 1,
+};
 
-                    case CDB_TYPE_FLOAT: {
-                        float f = read_float(w, ev->prop, 0);
-                        if (f == ev->old_value.f) {
-                            set_float(w, ev->prop, ev->new_value.f);
-                        }
-                    }
-                        break;
+typedef struct delta_stream_t {
+    ce_cdb_t0 db;
+    ce_vio_t0 *vio;
+    ce_alloc_t0 *allocator;
+    ce_cdb_snapshot_t0 snapshot;
+    char *buffer;
+} delta_stream_t;
+
+// Destroyed objects live until gc, for delta they are gone.
+static object_t *_delta_alive(db_t *db_inst,
+                              uint64_t uid) {
+    object_t **objid = _get_objectid_from_uid(db_inst, uid);
+    if (!objid) {
+        return NULL;
+    }
 
-                    case CDB_TYPE_BOOL: {
-                        bool b = read_bool(w, ev->prop, 0);
-                        if (b == ev->old_value.b) {
-                            set_bool(w, ev->prop, ev->new_value.b);
-                        }
-                    }
-                        break;
+    ce_os_thread_a0->spin_lock(&db_inst->destroy_lock);
+    bool destroyed = ce_hash_contain(&db_inst->to_free_set, uid);
+    ce_os_thread_a0->spin_unlock(&db_inst->destroy_lock);
 
-                    case CDB_TYPE_STR: {
-                        const char *str = read_string(w, ev->prop, 0);
-                        if (!str || !ev->old_value.str || !strcmp(str, ev->old_value.str)) {
-                            set_string(w, ev->prop, ev->new_value.str);
-                        }
-                    }
-                        break;
+    return destroyed ? NULL : *objid;
+}
 
-                    case CDB_TYPE_PTR: {
-                        void *ptr = read_ptr(w, ev->prop, 0);
-                        if (ptr == ev->old_value.ptr) {
-                            set_ptr(w, ev->prop, ev->new_value.ptr);
-                        }
-                    }
-                        break;
+static bool _delta_value_eq(db_t *db_a,
+                            db_t *db_b,
+                            enum ce_cdb_type_e0 type,
+                            const ce_cdb_value_u0 *a,
+                            const ce_cdb_value_u0 *b) {
+    switch (type) {
+        case CDB_TYPE_STR:
+            return (a->str == b->str) || (a->str && b->str && !strcmp(a->str, b->str));
 
-                    case CDB_TYPE_SUBOBJECT: {
-                        uint64_t new_so = create_from(db, ev->new_value.subobj);
-                        set_subobject(w, ev->prop, new_so);
-                    }
+        case CDB_TYPE_BLOB: {
+            const ce_cdb_blob_t0 *ba = _get_blob(db_a, a->blob);
+            const ce_cdb_blob_t0 *bb = _get_blob(db_b, b->blob);
+            return (ba->size == bb->size)
+                   && (!ba->size || !memcmp(ba->data, bb->data, ba->size));
+        }
 
-                        break;
+        case CDB_TYPE_SET_SUBOBJECT: {
+            set_t *sa = _get_set(db_a, a->set);
+            set_t *sb = _get_set(db_b, b->set);
+            const uint32_t na = sa ? ce_array_size(sa->objs) : 0;
+            const uint32_t nb = sb ? ce_array_size(sb->objs) : 0;
 
-                    case CDB_TYPE_REF: {
-                        uint64_t ref = read_ref(w, ev->prop, 0);
-                        if (ref == ev->old_value.ref) {
-                            set_ref(w, ev->prop, ev->new_value.ref);
-                        }
-                    }
-                        break;
+            if (na != nb) {
+                return false;
+            }
 
-                    default:
-                        break;
+            for (uint32_t i = 0; i < na; ++i) {
+                if (!ce_hash_contain(&sb->set, sa->objs[i])) {
+                    return false;
                 }
-            } else if (ev->ev_type == CE_CDB_PROP_REMOVE_EVENT) {
-                remove_property(w, ev->prop);
-            } else if (ev->ev_type == CE_CDB_OBJSET_ADD_EVENT) {
-                uint64_t obj = ev->new_value.subobj;
-                uint64_t new_obj = create_from(db, obj);
-                ce_cdb_a0->objset_add_obj(w, ev->prop, new_obj);
-            } else if (ev->ev_type == CE_CDB_OBJSET_REMOVE_EVENT) {
-                ce_cdb_a0->objset_remove_obj(w, ev->prop, ev->old_value.subobj);
             }
+
+            return true;
         }
-        write_commit(w);
-    }
-}
 
-const struct ce_cdb_prop_ev_t0 *changed(const ce_cdb_obj_o0 *reader,
-                                        uint32_t *n) {
-    object_t *obj = (object_t *) reader;
-    *n = ce_array_size(obj->changed);
-    if (*n) {
-        return obj->changed;
+        default:
+            return !memcmp(a, b, _TYPE_INFO[type].size);
     }
-    return NULL;
 }
 
-ct_cdb_ev_queue_o0 *add_changed_obj_listener(ce_cdb_t0 _db) {
-    db_t *db = _get_db(_db);
-    return (ct_cdb_ev_queue_o0 *) _new_changed_obj_events_listener(db);
-}
+// Changes from -> to as prop events, from == NULL => all props of to.
+// Objects can be from different db.
+static void _delta_events(object_t *from,
+                          object_t *to,
+                          ce_cdb_prop_ev_t0 **events,
+                          ce_alloc_t0 *allocator) {
+    db_t *to_db = _get_db(to->db);
+    db_t *from_db = from ? _get_db(from->db) : NULL;
 
-bool pop_changed_obj(ct_cdb_ev_queue_o0 *q,
-                     ce_cdb_ev_t0 *ev) {
-    ce_mpmc_queue_t0 *qq = (ce_mpmc_queue_t0 *) q;
-    return ce_mpmc_dequeue(qq, ev);
-}
+    const uint64_t to_n = _own_prop_n(to);
+    for (uint64_t i = 0; i < to_n; ++i) {
+        uint64_t key;
+        enum ce_cdb_type_e0 type;
+        ce_cdb_value_u0 *v = _own_prop(to, i, &key, &type);
 
-ct_cdb_ev_queue_o0 *add_obj_listener(ce_cdb_t0 _db) {
-    db_t *db = _get_db(_db);
-    return (ct_cdb_ev_queue_o0 *) _new_obj_events_listener(db);
-}
+        if (type == CDB_TYPE_NONE) {
+            continue;
+        }
 
-ct_cdb_ev_queue_o0 *add_obj_listener2(ce_cdb_t0 _db,
-                                      uint64_t _obj) {
-    db_t *db = _get_db(_db);
-    return (ct_cdb_ev_queue_o0 *) _new_obj_events_listener2(db, _obj);
-}
+        enum ce_cdb_type_e0 from_type = CDB_TYPE_NONE;
+        ce_cdb_value_u0 *from_v = from ? _own_prop_find(from, key, &from_type) : NULL;
 
-bool pop_obj_events(ct_cdb_ev_queue_o0 *q,
-                    ce_cdb_prop_ev_t0 *ev) {
-    ce_mpmc_queue_t0 *qq = (ce_mpmc_queue_t0 *) q;
-    return ce_mpmc_dequeue(qq, ev);
-}
+        if (from_v && (from_type == type) && _delta_value_eq(from_db, to_db, type, from_v, v)) {
+            continue;
+        }
 
+        ce_array_push(*events, ((ce_cdb_prop_ev_t0) {
+                .ev_type = CE_CDB_PROP_CHANGE_EVENT,
+                .obj = to->orig_obj,
+                .prop = key,
+                .prop_type = type,
+                .new_value = *v,
+        }), allocator);
+    }
 
-bool pop_obj_events2(ct_cdb_ev_queue_o0 *q,
-                     ce_cdb_prop_ev_t0 *ev) {
-    ce_mpmc_queue_t0 *qq = (ce_mpmc_queue_t0 *) q;
-    return ce_mpmc_dequeue(qq, ev);
-}
+    if (!from) {
+        return;
+    }
 
-const uint64_t *destroyed(ce_cdb_t0 _db,
-                          uint32_t *n) {
-    db_t *db = _get_db(_db);
+    const uint64_t from_n = _own_prop_n(from);
+    for (uint64_t i = 0; i < from_n; ++i) {
+        uint64_t key;
+        enum ce_cdb_type_e0 type;
+        _own_prop(from, i, &key, &type);
 
-    *n = db->to_free_objects_uid_n;
+        enum ce_cdb_type_e0 to_type;
+        if ((type == CDB_TYPE_NONE) || _own_prop_find(to, key, &to_type)) {
+            continue;
+        }
 
-    return db->to_free_objects_uid;
+        ce_array_push(*events, ((ce_cdb_prop_ev_t0) {
+                .ev_type = CE_CDB_PROP_REMOVE_EVENT,
+                .obj = to->orig_obj,
+                .prop = key,
+                .prop_type = type,
+        }), allocator);
+    }
 }
 
-const uint64_t *changed_objects(ce_cdb_t0 _db,
-                                uint32_t *n) {
-    db_t *db = _get_db(_db);
-
-
-    uint32_t ch_n = ce_array_size(db->changed_obj);
-    if (!ch_n) {
-        *n = 0;
-        return NULL;
-    }
+static void _delta_write_value(char **out,
+                               db_t *db,
+                               enum ce_cdb_type_e0 type,
+                               ce_cdb_value_u0 v,
+                               ce_alloc_t0 *a) {
+    switch (type) {
+        case CDB_TYPE_UINT64:
+            _write_varint(out, v.uint64, a);
+            break;
 
-    *n = ch_n;
-    return db->changed_obj;
-}
+        case CDB_TYPE_PTR:
+            _write_u64(out, (uint64_t) v.ptr, a);
+            break;
 
-void set_parent(ce_cdb_t0 _db,
-                uint64_t object,
-                uint64_t parent) {
-    db_t *db = _get_db(_db);
+        case CDB_TYPE_REF:
+            _write_u64(out, v.ref, a);
+            break;
 
-    object_t *from = _get_object_from_uid(db, object);
-    from->parent = parent;
-}
+        case CDB_TYPE_FLOAT:
+            ce_array_push_n(*out, (char *) &v.f, sizeof(float), a);
+            break;
 
-uint64_t read_instance_of(const ce_cdb_obj_o0 *reader) {
-    object_t *obj = _get_object_from_o(reader);
-    if (!obj) {
-        return 0;
-    }
+        case CDB_TYPE_BOOL:
+            ce_array_push(*out, (char) v.b, a);
+            break;
 
-    return obj->instance_of;
-}
+        case CDB_TYPE_STR: {
+            uint64_t len = v.str ? strlen(v.str) : 0;
+            _write_varint(out, len, a);
+            ce_array_push_n(*out, v.str, len, a);
+        }
+            break;
 
-static void load(ce_cdb_t0 db,
-                 const char *input,
-                 uint64_t _obj,
-                 struct ce_alloc_t0 *allocator) {
-    db_t *db_inst = _get_db(db);
+        case CDB_TYPE_SUBOBJECT:
+            _write_u64(out, v.subobj, a);
+            break;
 
-    const struct cdb_binobj_header *header;
-    header = (const struct cdb_binobj_header *) input;
+        case CDB_TYPE_BLOB: {
+            ce_cdb_blob_t0 *blob = _get_blob(db, v.blob);
+            _write_varint(out, blob->size, a);
+            if (blob->size) {
+                ce_array_push_n(*out, (char *) blob->data, blob->size, a);
+            }
+        }
+            break;
 
-    uint64_t instanceof = header->instance_of;
+        case CDB_TYPE_SET_SUBOBJECT: {
+            set_t *set = _get_set(db, v.set);
+            uint32_t n = set ? ce_array_size(set->objs) : 0;
+            _write_varint(out, n, a);
+            for (uint32_t i = 0; i < n; ++i) {
+                _write_u64(out, set->objs[i], a);
+            }
+        }
+            break;
 
-    if (instanceof) {
-        _create_from_uid(db, instanceof, _obj, true);
-    } else {
-        create_object_uid(db, _obj, header->type);
+        default:
+            break;
     }
+}
 
-    object_t *obj = _get_object_from_uid(db_inst, _obj);
-    obj->parent = header->parent;
+static void _delta_write_header(char **out,
+                                uint8_t flags,
+                                object_t *obj,
+                                uint64_t ops_n,
+                                ce_alloc_t0 *a) {
+    ce_array_push(*out, (char) CDB_DELTA_VERSION, a);
+    ce_array_push(*out, (char) flags, a);
+    _write_u64(out, obj->orig_obj, a);
+    _write_u64(out, obj->type, a);
+    _write_u64(out, obj->instance_of, a);
+    _write_varint(out, ops_n, a);
+}
 
-    uint64_t *keys = (uint64_t *) (header + 1);
-    uint8_t *ptype = (uint8_t *) (keys + header->properties_count);
-    ce_cdb_value_u0 *values = (ce_cdb_value_u0 *) (ptype + header->properties_count);
-    const char *strbuffer = (char *) (values + header->properties_count);
-    const char *blob_buffer = (char *) (strbuffer + header->string_buffer_size);
-    const char *set_buffer = (char *) (blob_buffer + header->blob_buffer_size);
+static void diff(const ce_cdb_obj_o0 *_from,
+                 const ce_cdb_obj_o0 *_to,
+                 char **output,
+                 ce_alloc_t0 *allocator) {
+    object_t *from = _get_object_from_o(_from);
+    object_t *to = _get_object_from_o(_to);
 
-    if (!header->properties_count) {
+    if (!to) {
+        if (from) {
+            _delta_write_header(output, _DELTA_DESTROY, from, 0, allocator);
+        }
         return;
     }
 
-    struct object_t fakeo = {
-            .properties_count  = header->properties_count,
-            .keys = keys,
-            .property_type = ptype,
-            .values = values,
-    };
+    ce_cdb_prop_ev_t0 *events = NULL;
+    _delta_events(from, to, &events, allocator);
 
-    uint32_t prop_n = header->properties_count;
-    for (int i = 0; i < prop_n; ++i) {
-        switch (ptype[i]) {
-            case CDB_TYPE_STR: {
-                uint64_t str_offset = fakeo.values[i].uint64;
+    const uint32_t events_n = ce_array_size(events);
+    if (!from || events_n) {
+        db_t *db = _get_db(to->db);
+
+        _delta_write_header(output, from ? 0 : _DELTA_CREATE, to, events_n, allocator);
 
-                char *dup_str = ce_memory_a0->str_dup(strbuffer + str_offset, allocator);
+        for (uint32_t i = 0; i < events_n; ++i) {
+            ce_cdb_prop_ev_t0 *ev = &events[i];
+            bool remove = ev->ev_type == CE_CDB_PROP_REMOVE_EVENT;
 
-                ce_cdb_value_u0 *value_ptr = &fakeo.values[i];
-                value_ptr->str = dup_str;
+            ce_array_push(*output, (char) (remove ? _DELTA_OP_REMOVE : _DELTA_OP_CHANGE),
+                          allocator);
+            _write_u64(output, ev->prop, allocator);
+            ce_array_push(*output, (char) ev->prop_type, allocator);
+
+            if (!remove) {
+                _delta_write_value(output, db, ev->prop_type, ev->new_value, allocator);
             }
+        }
+    }
 
-                break;
+    ce_array_free(events, allocator);
+}
 
-            case CDB_TYPE_SET_SUBOBJECT: {
-                uint64_t name = keys[i];
-                uint64_t set_offset = fakeo.values[i].uint64;
+static void _delta_apply_set(ce_cdb_obj_o0 *w,
+                             uint64_t prop,
+                             const uint8_t **p) {
+    const uint64_t n = _read_varint(p);
 
-                uint64_t size = *((uint64_t *) (set_buffer + set_offset));
-                uint64_t *data = (uint64_t *) (set_buffer + set_offset + sizeof(uint64_t));
+    uint64_t objs[n];
+    for (uint64_t i = 0; i < n; ++i) {
+        objs[i] = _read_u64(p);
+    }
 
-                for (int j = 0; j < size; ++j) {
-                    uint64_t subobj = data[j];
-                    add_obj((ce_cdb_obj_o0 *) obj, name, subobj);
-                }
-            }
-                break;
+    const uint64_t old_n = read_objset_count(w, prop);
+    uint64_t old_objs[old_n];
+    ce_cdb_a0->read_objset(w, prop, old_objs);
 
-            case CDB_TYPE_BLOB: {
-                uint64_t blob_offset = fakeo.values[i].uint64;
+    // Removed objects are destroyed by own record if they are.
+    for (uint64_t i = 0; i < old_n; ++i) {
+        bool keep = false;
+        for (uint64_t j = 0; (j < n) && !keep; ++j) {
+            keep = objs[j] == old_objs[i];
+        }
+
+        if (!keep) {
+            _remove_obj(w, prop, old_objs[i]);
+        }
+    }
 
-                uint64_t size = *((uint64_t *) (blob_buffer + blob_offset));
-                const char *blob_data = ((blob_buffer + blob_offset + sizeof(uint64_t)));
+    for (uint64_t i = 0; i < n; ++i) {
+        add_obj(w, prop, objs[i]);
+    }
+}
 
-                char *copy_blob_data = CE_ALLOC(allocator, char, size);
-                memcpy(copy_blob_data, blob_data, size);
+static const uint8_t *_delta_apply_record(ce_cdb_t0 db,
+                                          const uint8_t *p) {
+    db_t *db_inst = _get_db(db);
 
-                uint32_t blob_idx = _new_blob(db_inst);
-                ce_cdb_blob_t0 *blob = _get_blob(db_inst, blob_idx);
+    if (*p++ != CDB_DELTA_VERSION) {
+        ce_log_a0->error(LOG_WHERE, "Invalid delta version");
+        return NULL;
+    }
 
-                *blob = (ce_cdb_blob_t0) {
-                        .size = size,
-                        .data = copy_blob_data
-                };
+    const uint8_t flags = *p++;
+    const uint64_t uid = _read_u64(&p);
+    const uint64_t type = _read_u64(&p);
+    const uint64_t instance_of = _read_u64(&p);
+    const uint64_t ops_n = _read_varint(&p);
 
-                ce_cdb_value_u0 *value_ptr = &fakeo.values[i];
-                value_ptr->blob = blob_idx;
+    const bool alive = _delta_alive(db_inst, uid) != NULL;
 
+    if (flags & _DELTA_DESTROY) {
+        if (alive) {
+            destroy_object(db, uid);
+        }
+        return p;
+    }
 
-            }
-                break;
+    if (!alive) {
+        if (instance_of) {
+            _create_from_uid(db, instance_of, uid, true);
+        } else {
+            create_object_uid(db, uid, type);
         }
     }
 
-    for (int i = 0; i < prop_n; ++i) {
-        uint64_t name = keys[i];
+    if (!ops_n) {
+        return p;
+    }
 
-        if (name == CDB_INSTANCE_PROP) {
-            continue;
-        }
+    ce_cdb_obj_o0 *w = write_begin(db, uid);
 
-        enum ce_cdb_type_e0 t = ptype[i];
+    for (uint64_t i = 0; i < ops_n; ++i) {
+        const uint8_t op = *p++;
+        const uint64_t prop = _read_u64(&p);
+        const enum ce_cdb_type_e0 t = *p++;
 
-        union ce_cdb_value_u0 *value_ptr = &fakeo.values[i];
+        if (op == _DELTA_OP_REMOVE) {
+            remove_property(w, prop);
+            continue;
+        }
 
         switch (t) {
             case CDB_TYPE_UINT64:
-                set_uint64((ce_cdb_obj_o0 *) obj, name, value_ptr->uint64);
+                set_uint64(w, prop, _read_varint(&p));
                 break;
+
             case CDB_TYPE_PTR:
-                set_ptr((ce_cdb_obj_o0 *) obj, name, value_ptr->ptr);
+                set_ptr(w, prop, (void *) _read_u64(&p));
                 break;
+
             case CDB_TYPE_REF:
-                set_ref((ce_cdb_obj_o0 *) obj, name, value_ptr->ref);
+                set_ref(w, prop, _read_u64(&p));
                 break;
-            case CDB_TYPE_FLOAT:
-                set_float((ce_cdb_obj_o0 *) obj, name, value_ptr->f);
+
+            case CDB_TYPE_FLOAT: {
+                float f;
+                memcpy(&f, p, sizeof(float));
+                p += sizeof(float);
+                set_float(w, prop, f);
+            }
                 break;
+
             case CDB_TYPE_BOOL:
-                set_bool((ce_cdb_obj_o0 *) obj, name, value_ptr->b);
+                set_bool(w, prop, *p++ != 0);
                 break;
-            case CDB_TYPE_STR:
-                set_string((ce_cdb_obj_o0 *) obj, name, value_ptr->str);
+
+            case CDB_TYPE_STR: {
+                uint64_t len = _read_varint(&p);
+                char str[len + 1];
+                memcpy(str, p, len);
+                str[len] = '\0';
+                p += len;
+                set_string(w, prop, str);
+            }
                 break;
+
             case CDB_TYPE_SUBOBJECT:
-                set_subobject((ce_cdb_obj_o0 *) obj, name, value_ptr->subobj);
+                set_subobject(w, prop, _read_u64(&p));
                 break;
+
             case CDB_TYPE_BLOB: {
-                ce_cdb_blob_t0 *blob = _get_blob(db_inst, value_ptr->blob);
-                set_blob((ce_cdb_obj_o0 *) obj, name, blob->data, blob->size);
+                uint64_t size = _read_varint(&p);
+                set_blob(w, prop, (void *) p, size);
+                p += size;
             }
                 break;
+
+            case CDB_TYPE_SET_SUBOBJECT:
+                _delta_apply_set(w, prop, &p);
+                break;
+
             default:
                 break;
         }
     }
 
-    ce_array_clean(obj->changed);
+    write_commit(w);
+
+    return p;
 }
 
-void _init_from_defs(ce_cdb_t0 db,
-                     object_t *obj,
-                     const ce_cdb_type_def_t0 *def) {
+static void apply_delta(ce_cdb_t0 db,
+                        const char *input,
+                        uint64_t size) {
+    const uint8_t *p = (const uint8_t *) input;
+    const uint8_t *end = p + size;
 
-    ce_cdb_obj_o0 *w = (ce_cdb_obj_o0 *) obj;
+    while (p && (p < end)) {
+        p = _delta_apply_record(db, p);
+    }
+}
 
-    for (uint32_t i = 0; i < def->num; ++i) {
-        ce_cdb_prop_def_t0 *prop_def = &def->defs[i];
-        uint64_t prop_name = ce_id_a0->id64(prop_def->name);
-        enum ce_cdb_type_e0 t = prop_def->type;
+static ce_cdb_delta_stream_o0 *create_delta_stream(ce_cdb_t0 db,
+                                                   ce_vio_t0 *vio,
+                                                   ce_alloc_t0 *allocator) {
+    delta_stream_t *stream = CE_ALLOC(allocator, delta_stream_t, sizeof(delta_stream_t));
 
-        switch (t) {
-            case CDB_TYPE_NONE:
-                break;
-            case CDB_TYPE_UINT64:
-                set_uint64(w, prop_name, prop_def->value.uint64);
-                break;
-            case CDB_TYPE_PTR:
-                set_ptr(w, prop_name, prop_def->value.ptr);
-                break;
-            case CDB_TYPE_REF:
-                set_ref(w, prop_name, prop_def->value.ref);
-                break;
-            case CDB_TYPE_FLOAT:
-                set_float(w, prop_name, prop_def->value.f);
-                break;
-            case CDB_TYPE_BOOL:
-                set_bool(w, prop_name, prop_def->value.b);
-                break;
-            case CDB_TYPE_STR:
-                set_string(w, prop_name, prop_def->value.str);
-                break;
-            case CDB_TYPE_SUBOBJECT: {
-                uint64_t sub_obj = create_object(db, prop_def->obj_type);
-                set_subobject(w, prop_name, sub_obj);
-            }
-                break;
-            case CDB_TYPE_BLOB: {
-                set_blob(w, prop_name, NULL, 0);
-            }
+    *stream = (delta_stream_t) {
+            .db = db,
+            .vio = vio,
+            .allocator = allocator,
+            .snapshot = create_snapshot(db),
+    };
 
-            case CDB_TYPE_SET_SUBOBJECT: {
-                object_t *writer = _get_object_from_o(w);
-                if (writer->flags & _OBJ_FLAG_TYPED_OBJ) {
+    return (ce_cdb_delta_stream_o0 *) stream;
+}
 
-                } else {
-                    db_t *dbinst = _get_db(db);
+// Frame: u64 size | records. Objects changed since last flush are diffed
+// against snapshot of last flush.
+static void delta_stream_flush(ce_cdb_delta_stream_o0 *_stream) {
+    delta_stream_t *stream = (delta_stream_t *) _stream;
+    db_t *db_inst = _get_db(stream->db);
 
-                    uint64_t idx = _object_new_property(writer, prop_name,
-                                                        CDB_TYPE_SET_SUBOBJECT,
-                                                        _G.allocator);
-                    uint32_t new_set_idx = _new_set(dbinst);
-                    writer->values[idx].set = new_set_idx;
-                }
-            }
-                break;
+    const uint64_t *objs;
+    const uint32_t objs_n = snapshot_objs(stream->db, stream->snapshot, &objs);
 
+    if (!objs_n) {
+        return;
+    }
+
+    ce_array_clean(stream->buffer);
+    ce_array_resize(stream->buffer, sizeof(uint64_t), stream->allocator);
+
+    // Create all objects first, props can point to objects created in same frame.
+    for (uint32_t i = 0; i < objs_n; ++i) {
+        object_t *obj = _delta_alive(db_inst, objs[i]);
+        if (obj && !read_snapshot(stream->db, stream->snapshot, objs[i])) {
+            _delta_write_header(&stream->buffer, _DELTA_CREATE, obj, 0, stream->allocator);
         }
     }
+
+    for (uint32_t i = 0; i < objs_n; ++i) {
+        diff(read_snapshot(stream->db, stream->snapshot, objs[i]),
+             (const ce_cdb_obj_o0 *) _delta_alive(db_inst, objs[i]),
+             &stream->buffer, stream->allocator);
+    }
+
+    uint64_t size = ce_array_size(stream->buffer) - sizeof(uint64_t);
+    memcpy(stream->buffer, &size, sizeof(uint64_t));
+
+    stream->vio->vt->write(stream->vio->inst, stream->buffer, sizeof(char),
+                           ce_array_size(stream->buffer));
+
+    release_snapshot(stream->db, stream->snapshot);
+    stream->snapshot = create_snapshot(stream->db);
+}
+
+static void destroy_delta_stream(ce_cdb_delta_stream_o0 *_stream) {
+    delta_stream_t *stream = (delta_stream_t *) _stream;
+
+    release_snapshot(stream->db, stream->snapshot);
+    ce_array_free(stream->buffer, stream->allocator);
+    CE_FREE(stream->allocator, stream);
 }
 
 static struct ce_cdb_a0 cdb_api = {
@@ -3317,13 +6475,30 @@ static struct ce_cdb_a0 cdb_api = {
         .create_from = create_from,
         .set_instance_of = set_instance_of,
         .destroy_object = destroy_object,
+        .destroy_pending = destroy_pending,
+        .flush_destroy = flush_destroy,
 
         .gc = gc,
+        .set_gc_budget = set_gc_budget,
+        .create_snapshot = create_snapshot,
+        .restore_snapshot = restore_snapshot,
+        .release_snapshot = release_snapshot,
+        .snapshot_objs = snapshot_objs,
+        .read_snapshot = read_snapshot,
+        .diff = diff,
+        .apply_delta = apply_delta,
+        .create_delta_stream = create_delta_stream,
+        .delta_stream_flush = delta_stream_flush,
+        .destroy_delta_stream = destroy_delta_stream,
+        .objs_by_type = objs_by_type,
+        .referrers = referrers,
 
         .dump_str = dump_str,
         .log_obj = log_obj,
         .dump = dump,
+        .dump_compact = dump_compact,
         .load = load,
+        .load_mapped = load_mapped,
 
         .find_root = find_root,
         .prop_exist = prop_exist,
@@ -3336,15 +6511,20 @@ static struct ce_cdb_a0 cdb_api = {
         .parent = parent,
 
         .read = read,
+        .read_pin = read_pin,
+        .read_unpin = read_unpin,
         .read_to = read_to,
         .read_prop_to = read_prop_to,
         .read_instance_of = read_instance_of,
         .new_changed_obj_listener = add_changed_obj_listener,
+        .new_changed_obj_listener_filter = add_changed_obj_listener_filter,
         .pop_changed_obj = pop_changed_obj,
         .new_objs_listener = add_obj_listener,
+        .new_objs_listener_filter = add_obj_listener_filter,
         .pop_objs_events = pop_obj_events,
         .new_obj_listener = add_obj_listener2,
         .pop_obj_events = pop_obj_events2,
+        .listener_stats = listener_stats,
         .read_float = read_float,
         .read_bool = read_bool,
         .read_str = read_string,
@@ -3356,6 +6536,20 @@ static struct ce_cdb_a0 cdb_api = {
         .read_objset = read_objset,
         .read_objset_num = read_objset_count,
 
+        .prop_index = prop_index,
+        .read_float_idx = read_float_idx,
+        .read_bool_idx = read_bool_idx,
+        .read_str_idx = read_string_idx,
+        .read_uint64_idx = read_uint64_idx,
+        .read_ptr_idx = read_ptr_idx,
+        .read_ref_idx = read_ref_idx,
+        .read_subobject_idx = read_subobject_idx,
+        .read_objset_num_idx = read_objset_num_idx,
+        .read_objset_idx = read_objset_idx,
+
+        .create_layout = create_layout,
+        .read_view = read_view,
+
         .write_begin = write_begin,
         .write_commit = write_commit,
         .write_try_commit = write_try_commit,
@@ -3384,9 +6578,11 @@ void CE_MODULE_LOAD(cdb)(struct ce_api_a0 *api,
 
     _G = (struct _G) {
             .allocator = ce_memory_a0->system,
+            .epoch = 1,
+            .layouts_n = 1,
     };
 
-    _G.global_db = create_db(MAX_OBJECTS);
+    _G.global_db = create_db(MAX_OBJECTS, CDB_DB_FLAG_TYPE_INDEX | CDB_DB_FLAG_REF_INDEX);
 
     api->register_api(CE_CDB_API, &cdb_api, sizeof(cdb_api));
 }
@@ -3397,5 +6593,11 @@ void CE_MODULE_UNLOAD(cdb)(struct ce_api_a0 *api,
     CE_UNUSED(reload);
     CE_UNUSED(api);
 
+    for (uint32_t i = 1; i < _G.layouts_n && i < MAX_LAYOUTS; ++i) {
+        ce_array_free(_G.layouts[i].props, _G.allocator);
+        ce_array_free(_G.layouts[i].copies, _G.allocator);
+        ce_array_free(_G.layouts[i].slow_props, _G.allocator);
+    }
+
     _G = (struct _G) {};
 }
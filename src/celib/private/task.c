@@ -235,6 +235,7 @@ static struct ce_task_a0 _task_api = {
         .add = add,
         .wait_for_counter = wait_atomic,
         .wait_for_counter_no_work = wait_for_counter_no_work,
+        .do_work = do_work,
 };
 
 struct ce_task_a0 *ce_task_a0 = &_task_api;
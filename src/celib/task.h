@@ -45,6 +45,10 @@ struct ce_task_a0 {
 
     void (*wait_for_counter_no_work)(ce_task_counter_t0 *signal,
                                      int32_t value);
+
+    //! Run one queued task on calling thread
+    //! \return 0 if there is no task
+    int (*do_work)();
 };
 
 CE_MODULE(ce_task_a0);
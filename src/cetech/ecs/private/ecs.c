@@ -101,6 +101,10 @@ typedef struct world_instance_t {
     entity_storage_t *entity_storage;
 
     ce_hash_t component_obj_map;
+
+    // Root entity -> resource retained by spawn
+    ce_hash_t spawned_resource;
+
     spawn_infos_t obj_spawninfo;
     spawn_infos_t comp_spawninfo;
 
@@ -956,6 +960,12 @@ static void destroy(ct_world_t0 world,
         }
 
         _free_spawninfo_ent(&w->obj_spawninfo, ent_obj, ent);
+
+        uint64_t resource = ce_hash_lookup(&w->spawned_resource, ent.h, 0);
+        if (resource) {
+            ce_hash_remove(&w->spawned_resource, ent.h);
+            ct_resource_a0->release(resource);
+        }
     }
 }
 
@@ -1085,6 +1095,9 @@ static struct ct_entity_t0 spawn_entity(ct_world_t0 world,
     ct_entity_t0 root_ent;
     create_entities_objs(world, &root_ent, 1, &entity_obj);
 
+    ct_resource_a0->retain(name);
+    ce_hash_add(&w->spawned_resource, root_ent.h, name, _G.allocator);
+
     const ce_cdb_obj_o0 *ent_reader = ce_cdb_a0->read(ce_cdb_a0->db(), entity_obj);
 
     uint64_t components_n = ce_cdb_a0->read_objset_num(ent_reader, ENTITY_COMPONENTS);
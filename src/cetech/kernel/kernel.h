@@ -35,6 +35,9 @@ extern "C" {
 #define CONFIG_DAEMON \
      CE_ID64_0("daemon", 0xc3b953e09c1d1f60ULL)
 
+#define CONFIG_GC_BUDGET \
+     CE_ID64_0("core.gc_budget_us", 0xa0b7552bcee65b55ULL)
+
 #define SOURCE_ROOT \
     CE_ID64_0("source", 0x921f1370045bad6eULL)
 
@@ -210,6 +210,10 @@ void _init_config() {
         ce_cdb_a0->set_uint64(writer, CONFIG_WAIT, 0);
     }
 
+    if (!ce_cdb_a0->prop_exist(writer, CONFIG_GC_BUDGET)) {
+        ce_cdb_a0->set_uint64(writer, CONFIG_GC_BUDGET, 2000);
+    }
+
     ce_cdb_a0->write_commit(writer);
 }
 
@@ -410,6 +414,9 @@ static void cetech_kernel_start() {
 
     _G.is_running = 1;
 
+    reader = ce_cdb_a0->read(ce_cdb_a0->db(), _G.config_object);
+    ce_cdb_a0->set_gc_budget(ce_cdb_a0->read_uint64(reader, CONFIG_GC_BUDGET, 0));
+
     const uint64_t fq = ce_os_time_a0->perf_freq();
     uint64_t last_tick = ce_os_time_a0->perf_counter();
 
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 #include "celib/memory/allocator.h"
 #include "celib/id.h"
@@ -42,6 +43,23 @@
 #define LOG_WHERE "material"
 
 
+enum material_variable_type {
+    MAT_VAR_NONE = 0,
+    MAT_VAR_INT,
+    MAT_VAR_TEXTURE,
+    MAT_VAR_TEXTURE_HANDLER, //TODO: RENAME
+    MAT_VAR_COLOR4,
+    MAT_VAR_VEC4,
+    MAT_VAR_COUNT,
+};
+
+// Variable values filled by cdb view
+typedef struct material_var_view_t {
+    uint64_t handler;
+    uint64_t value;
+    float v[4];
+} material_var_view_t;
+
 //==============================================================================
 // GLobals
 //==============================================================================
@@ -49,6 +67,12 @@
 static struct _G {
     ce_cdb_t0 db;
     ce_alloc_t0 *allocator;
+
+    // submit read props by index
+    uint32_t layers_prop;
+    uint32_t layer_shader_prop;
+    uint32_t layer_variables_prop;
+    ce_cdb_layout_t0 var_layout[MAT_VAR_COUNT];
 } _G;
 
 
@@ -56,15 +80,6 @@ static struct _G {
 // Resource
 //==============================================================================
 
-enum material_variable_type {
-    MAT_VAR_NONE = 0,
-    MAT_VAR_INT,
-    MAT_VAR_TEXTURE,
-    MAT_VAR_TEXTURE_HANDLER, //TODO: RENAME
-    MAT_VAR_COLOR4,
-    MAT_VAR_VEC4,
-};
-
 
 static bgfx_uniform_type_t _type_to_bgfx[] = {
         [MAT_VAR_NONE] = BGFX_UNIFORM_TYPE_COUNT,
@@ -424,18 +439,19 @@ static void submit(uint64_t material,
                    uint8_t viewid) {
     const ce_cdb_obj_o0 *mat_reader = ce_cdb_a0->read(ce_cdb_a0->db(), material);
 
-    uint64_t layers_n = ce_cdb_a0->read_objset_num(mat_reader, MATERIAL_LAYERS);
+    uint64_t layers_n = ce_cdb_a0->read_objset_num_idx(mat_reader, _G.layers_prop);
     uint64_t layers_keys[layers_n];
-    ce_cdb_a0->read_objset(mat_reader, MATERIAL_LAYERS, layers_keys);
+    ce_cdb_a0->read_objset_idx(mat_reader, _G.layers_prop, layers_keys);
 
     for (int i = 0; i < layers_n; ++i) {
         uint64_t layer = layers_keys[i];
 
         const ce_cdb_obj_o0 *layer_reader = ce_cdb_a0->read(ce_cdb_a0->db(), layer);
 
-        uint64_t key_count = ce_cdb_a0->read_objset_num(layer_reader, MATERIAL_VARIABLES_PROP);
+        uint64_t key_count = ce_cdb_a0->read_objset_num_idx(layer_reader,
+                                                            _G.layer_variables_prop);
         uint64_t keys[key_count];
-        ce_cdb_a0->read_objset(layer_reader, MATERIAL_VARIABLES_PROP, keys);
+        ce_cdb_a0->read_objset_idx(layer_reader, _G.layer_variables_prop, keys);
 
         uint8_t texture_stage = 0;
         for (int j = 0; j < key_count; ++j) {
@@ -444,44 +460,40 @@ static void submit(uint64_t material,
             uint64_t var_type = ce_cdb_a0->obj_type(ce_cdb_a0->db(), var);
             uint64_t type = _cdb_type_to_type(var_type);
 
-            bgfx_uniform_handle_t handle = {
-                    .idx = (uint16_t) ce_cdb_a0->read_uint64(var_reader,
-                                                             MATERIAL_VAR_HANDLER_PROP, 0)
-            };
+            if (type == MAT_VAR_NONE) {
+                continue;
+            }
+
+            material_var_view_t var_view = {.v = {1.0f, 1.0f, 1.0f, 1.0f}};
+            ce_cdb_a0->read_view(var_reader, _G.var_layout[type], &var_view);
+
+            bgfx_uniform_handle_t handle = {.idx = (uint16_t) var_view.handler};
 
             switch (type) {
                 case MAT_VAR_NONE:
                     break;
 
                 case MAT_VAR_INT: {
-                    uint64_t v = ce_cdb_a0->read_uint64(var_reader, MATERIAL_VAR_VALUE_PROP, 0);
-                    ct_gfx_a0->bgfx_set_uniform(handle, &v, 1);
+                    ct_gfx_a0->bgfx_set_uniform(handle, &var_view.value, 1);
                 }
                     break;
 
                 case MAT_VAR_TEXTURE: {
-                    uint64_t tn = ce_cdb_a0->read_uint64(var_reader, MATERIAL_VAR_VALUE_PROP, 0);
-                    ct_gfx_a0->bgfx_set_texture(texture_stage++, handle, ct_texture_a0->get(tn), 0);
+                    ct_gfx_a0->bgfx_set_texture(texture_stage++, handle,
+                                                ct_texture_a0->get(var_view.value), 0);
                 }
                     break;
 
                 case MAT_VAR_TEXTURE_HANDLER: {
-                    uint64_t t = ce_cdb_a0->read_uint64(var_reader, MATERIAL_VAR_VALUE_PROP, 0);
                     ct_gfx_a0->bgfx_set_texture(texture_stage++, handle,
-                                                (bgfx_texture_handle_t) {.idx=(uint16_t) t}, 0);
+                                                (bgfx_texture_handle_t) {.idx=(uint16_t) var_view.value},
+                                                0);
                 }
                     break;
 
                 case MAT_VAR_COLOR4:
                 case MAT_VAR_VEC4: {
-                    float v[4] = {
-                            ce_cdb_a0->read_float(var_reader, MATERIAL_VAR_VALUE_PROP_X, 1.0f),
-                            ce_cdb_a0->read_float(var_reader, MATERIAL_VAR_VALUE_PROP_Y, 1.0f),
-                            ce_cdb_a0->read_float(var_reader, MATERIAL_VAR_VALUE_PROP_Z, 1.0f),
-                            ce_cdb_a0->read_float(var_reader, MATERIAL_VAR_VALUE_PROP_W, 1.0f)
-                    };
-
-                    ct_gfx_a0->bgfx_set_uniform(handle, &v, 1);
+                    ct_gfx_a0->bgfx_set_uniform(handle, &var_view.v, 1);
                 }
                     break;
                 default:
@@ -491,7 +503,7 @@ static void submit(uint64_t material,
             }
         }
 
-        uint64_t shader = ce_cdb_a0->read_ref(layer_reader, MATERIAL_SHADER_PROP, 0);
+        uint64_t shader = ce_cdb_a0->read_ref_idx(layer_reader, _G.layer_shader_prop, 0);
 
         uint64_t shader_obj = shader;
 
@@ -732,6 +744,19 @@ static struct ct_property_editor_i0 color_property_editor_api = {
 };
 
 
+static const ce_cdb_view_prop_t0 _texture_var_view[] = {
+        {.prop = MATERIAL_VAR_HANDLER_PROP, .offset = offsetof(material_var_view_t, handler)},
+        {.prop = MATERIAL_VAR_VALUE_PROP, .offset = offsetof(material_var_view_t, value)},
+};
+
+static const ce_cdb_view_prop_t0 _vec4_var_view[] = {
+        {.prop = MATERIAL_VAR_HANDLER_PROP, .offset = offsetof(material_var_view_t, handler)},
+        {.prop = MATERIAL_VAR_VALUE_PROP_X, .offset = offsetof(material_var_view_t, v[0])},
+        {.prop = MATERIAL_VAR_VALUE_PROP_Y, .offset = offsetof(material_var_view_t, v[1])},
+        {.prop = MATERIAL_VAR_VALUE_PROP_Z, .offset = offsetof(material_var_view_t, v[2])},
+        {.prop = MATERIAL_VAR_VALUE_PROP_W, .offset = offsetof(material_var_view_t, v[3])},
+};
+
 void CE_MODULE_LOAD(material)(struct ce_api_a0 *api,
                               int reload) {
     CE_UNUSED(reload);
@@ -775,6 +800,27 @@ void CE_MODULE_LOAD(material)(struct ce_api_a0 *api,
 
     ce_cdb_a0->reg_obj_type(MATERIAL_VAR_TYPE_VEC4,
                             material_vec4_prop, CE_ARRAY_LEN(material_vec4_prop));
+
+    _G.layers_prop = ce_cdb_a0->prop_index(MATERIAL_TYPE, MATERIAL_LAYERS);
+    _G.layer_shader_prop = ce_cdb_a0->prop_index(MATERIAL_LAYER_TYPE, MATERIAL_SHADER_PROP);
+    _G.layer_variables_prop = ce_cdb_a0->prop_index(MATERIAL_LAYER_TYPE,
+                                                    MATERIAL_VARIABLES_PROP);
+
+    _G.var_layout[MAT_VAR_TEXTURE] = ce_cdb_a0->create_layout(MATERIAL_VAR_TYPE_TEXTURE,
+                                                              _texture_var_view,
+                                                              CE_ARRAY_LEN(_texture_var_view));
+
+    _G.var_layout[MAT_VAR_TEXTURE_HANDLER] = ce_cdb_a0->create_layout(
+            MATERIAL_VAR_TYPE_TEXTURE_HANDLER,
+            _texture_var_view, CE_ARRAY_LEN(_texture_var_view));
+
+    _G.var_layout[MAT_VAR_COLOR4] = ce_cdb_a0->create_layout(MATERIAL_VAR_TYPE_COLOR,
+                                                             _vec4_var_view,
+                                                             CE_ARRAY_LEN(_vec4_var_view));
+
+    _G.var_layout[MAT_VAR_VEC4] = ce_cdb_a0->create_layout(MATERIAL_VAR_TYPE_VEC4,
+                                                           _vec4_var_view,
+                                                           CE_ARRAY_LEN(_vec4_var_view));
 }
 
 void CE_MODULE_UNLOAD(material)(struct ce_api_a0 *api,
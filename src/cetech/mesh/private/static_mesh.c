@@ -44,6 +44,7 @@ static struct _G {
 typedef struct mesh_render_data {
     uint8_t viewid;
     uint64_t layer_name;
+    uint32_t geom_objs_prop;
 } mesh_render_data;
 
 void foreach_static_mesh(ct_world_t0 world,
@@ -66,7 +67,8 @@ void foreach_static_mesh(ct_world_t0 world,
 
         const ce_cdb_obj_o0 *scene_reader = ce_cdb_a0->read(ce_cdb_a0->db(), m_c.scene);
 
-        uint64_t geom_objs = ce_cdb_a0->read_subobject(scene_reader, SCENE_GEOM_OBJS, 0);
+        uint64_t geom_objs = ce_cdb_a0->read_subobject_idx(scene_reader,
+                                                           data->geom_objs_prop, 0);
         const ce_cdb_obj_o0 *geom_objs_r = ce_cdb_a0->read(ce_cdb_a0->db(), geom_objs);
 
         uint64_t geom_obj = ce_cdb_a0->read_ref(geom_objs_r, m_c.mesh, 0);
@@ -148,6 +150,7 @@ void render(ct_world_t0 world,
     mesh_render_data render_data = {
             .viewid = viewid,
             .layer_name = _GBUFFER,
+            .geom_objs_prop = ce_cdb_a0->prop_index(SCENE_TYPE, SCENE_GEOM_OBJS),
     };
 
     ct_ecs_a0->process_serial(world,
@@ -2,6 +2,7 @@
 // Includes
 //==============================================================================
 #include <inttypes.h>
+#include <stdatomic.h>
 
 #include <celib/macros.h>
 #include <celib/memory/allocator.h>
@@ -18,10 +19,13 @@
 #include <celib/id.h>
 #include <celib/os/time.h>
 #include <celib/os/vio.h>
+#include <celib/os/thread.h>
+#include <celib/task.h>
 
 #include <cetech/kernel/kernel.h>
 #include <cetech/resource/resourcedb.h>
 #include <cetech/resource/resource_compiler.h>
+#include <cetech/game/game_system.h>
 #include <stdlib.h>
 
 
@@ -34,13 +38,111 @@
 #define _G ResourceManagerGlobals
 #define LOG_WHERE "resource"
 
+#define STREAM_DECODE_BATCH 256
+
+// Status of finished request is kept for this many frames.
+#define STREAM_STATUS_FRAMES 120
+
+#define CONFIG_RESOURCE_BUDGET \
+     CE_ID64_0("resource.budget_mb", 0xb14cf883e759d7e1ULL)
+
+enum {
+    CREATE_EXIST = 0,
+    CREATE_NEW,
+};
+
 //==============================================================================
 // Gloals
 //==============================================================================
 
+typedef struct load_request_t {
+    uint64_t handle;
+    enum ct_resource_load_status_e0 status;
+    enum ct_resource_load_priority_e0 priority;
+    ct_resource_loaded_t loaded;
+    void *data;
+    bool ok;
+
+    uint64_t *roots;
+    uint32_t roots_n;
+
+    // Dependency closure of roots, filled by read task.
+    uint64_t *uids;
+    const char **blobs;
+    uint32_t n;
+
+    atomic_bool read_done;
+    ce_task_counter_t0 *read_counter;
+
+    // Next uid to create.
+    uint32_t decoded;
+    uint32_t *sizes;
+
+    // Created objects and objects they load, online on main thread.
+    uint64_t *online;
+} load_request_t;
+
+typedef struct resource_entry_t {
+    uint64_t uid;
+    uint64_t type;
+    uint64_t size;
+
+    // Resources referenced by this one, retained while it is loaded.
+    uint64_t *deps;
+
+    uint32_t refs;
+    uint64_t lru_stamp;
+
+    bool loaded;
+    bool online;
+
+    // Reserved by thread that decode it, loaded is set after.
+    bool loading;
+
+    // Only resources that were ever retained are evicted.
+    bool evictable;
+} resource_entry_t;
+
+typedef struct lru_item_t {
+    uint64_t uid;
+    uint64_t stamp;
+} lru_item_t;
+
+typedef struct finished_status_t {
+    uint64_t handle;
+    uint64_t frame;
+} finished_status_t;
+
 struct _G {
     ce_hash_t type_map;
 
+    // Guard object creation and entries, sync load can run with stream
+    // decode.
+    ce_spinlock_t0 load_lock;
+    ce_hash_t entries;
+
+    // Released resources, oldest first. Item is stale if entry stamp differ.
+    lru_item_t *lru;
+    uint32_t lru_head;
+    uint64_t lru_clock;
+
+    uint64_t budget;
+    uint64_t resident;
+    ce_hash_t type_resident;
+
+    uint64_t next_handle;
+    load_request_t **requests;
+    ce_hash_t status;
+
+    // Finished handles, oldest first, dropped from status after
+    // STREAM_STATUS_FRAMES.
+    finished_status_t *finished;
+    uint64_t frame;
+
+    load_request_t *decoding;
+    atomic_bool decode_done;
+    ce_task_counter_t0 *decode_counter;
+
     ce_cdb_t0 db;
 
     uint64_t config;
@@ -51,6 +153,248 @@ struct _G {
 // Private
 //==============================================================================
 
+static struct ct_resource_i0 *get_resource_interface(uint64_t type);
+
+// Lock is recursive on thread, cdb loader can load prefab inside load.
+static CE_THREAD_LOCAL uint32_t _load_depth;
+
+// Request decoded on this thread, nested loads online with it.
+static CE_THREAD_LOCAL load_request_t *_decode_request;
+
+static void _load_lock() {
+    if (!_load_depth++) {
+        ce_os_thread_a0->spin_lock(&_G.load_lock);
+    }
+}
+
+static void _load_unlock() {
+    if (!--_load_depth) {
+        ce_os_thread_a0->spin_unlock(&_G.load_lock);
+    }
+}
+
+static resource_entry_t *_get_entry(uint64_t uid) {
+    return (resource_entry_t *) ce_hash_lookup(&_G.entries, uid, 0);
+}
+
+static resource_entry_t *_new_entry(uint64_t uid) {
+    resource_entry_t *entry = _get_entry(uid);
+
+    if (!entry) {
+        entry = CE_ALLOC(_G.allocator, resource_entry_t,
+                         sizeof(resource_entry_t));
+        *entry = (resource_entry_t) {.uid = uid};
+        ce_hash_add(&_G.entries, uid, (uint64_t) entry, _G.allocator);
+    }
+
+    return entry;
+}
+
+static void _add_resident(uint64_t type,
+                          int64_t size) {
+    _G.resident += size;
+
+    uint64_t type_size = ce_hash_lookup(&_G.type_resident, type, 0);
+    ce_hash_add(&_G.type_resident, type, type_size + size, _G.allocator);
+}
+
+static void _collect_deps(uint64_t root,
+                          uint64_t obj,
+                          uint64_t **deps) {
+    const ce_cdb_obj_o0 *r = ce_cdb_a0->read(_G.db, obj);
+
+    uint64_t prefab = ce_cdb_a0->read_instance_of(r);
+    if (prefab) {
+        ce_array_push(*deps, prefab, _G.allocator);
+    }
+
+    const uint64_t k_n = ce_cdb_a0->prop_count(r);
+    const uint64_t *ks = ce_cdb_a0->prop_keys(r);
+
+    for (uint64_t i = 0; i < k_n; ++i) {
+        uint64_t k = ks[i];
+
+        switch (ce_cdb_a0->prop_type(r, k)) {
+            case CDB_TYPE_REF: {
+                uint64_t ref = ce_cdb_a0->read_ref(r, k, 0);
+                if (ref && (ref != root)) {
+                    ce_array_push(*deps, ref, _G.allocator);
+                }
+            }
+                break;
+
+            case CDB_TYPE_SUBOBJECT: {
+                uint64_t subobj = ce_cdb_a0->read_subobject(r, k, 0);
+                if (subobj) {
+                    _collect_deps(root, subobj, deps);
+                }
+            }
+                break;
+
+            case CDB_TYPE_SET_SUBOBJECT: {
+                uint64_t n = ce_cdb_a0->read_objset_num(r, k);
+                uint64_t objs[n];
+                ce_cdb_a0->read_objset(r, k, objs);
+
+                for (uint64_t j = 0; j < n; ++j) {
+                    _collect_deps(root, objs[j], deps);
+                }
+            }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void retain(uint64_t uid) {
+    _load_lock();
+
+    resource_entry_t *entry = _new_entry(uid);
+    ++entry->refs;
+    entry->evictable = true;
+
+    _load_unlock();
+}
+
+static void release(uint64_t uid) {
+    _load_lock();
+
+    resource_entry_t *entry = _get_entry(uid);
+
+    if (entry && entry->refs && !--entry->refs) {
+        entry->lru_stamp = ++_G.lru_clock;
+
+        lru_item_t item = {.uid = uid, .stamp = entry->lru_stamp};
+        ce_array_push(_G.lru, item, _G.allocator);
+    }
+
+    _load_unlock();
+}
+
+// Entry is reserved under lock, decode and type query run outside so more
+// decode tasks work at once.
+static int _create_object(uint64_t uid,
+                          const char *blob,
+                          uint32_t size) {
+    _load_lock();
+
+    resource_entry_t *entry = _new_entry(uid);
+
+    if (entry->loaded || entry->loading) {
+        _load_unlock();
+
+        // Other thread decode it, wait so object exist after return. Nested
+        // load keep lock so it can not wait.
+        while (!_load_depth) {
+            _load_lock();
+            bool loading = entry->loading;
+            _load_unlock();
+
+            if (!loading) {
+                break;
+            }
+
+            ce_os_thread_a0->yield();
+        }
+
+        return CREATE_EXIST;
+    }
+
+    entry->loading = true;
+
+    _load_unlock();
+
+    // Evicted object is still in cdb until gc, free it before load again.
+    if (ce_cdb_a0->destroy_pending(_G.db, uid)) {
+        ce_cdb_a0->flush_destroy(_G.db, uid);
+    }
+
+    ct_resourcedb_a0->load_blob(_G.db, blob, uid, _G.allocator);
+
+    uint64_t type = ct_resourcedb_a0->get_resource_type(
+            (ct_resource_id_t0) {.uid = uid});
+
+    uint64_t *deps = NULL;
+    _collect_deps(uid, uid, &deps);
+
+    _load_lock();
+
+    entry->loading = false;
+    entry->loaded = true;
+    entry->size = size;
+    entry->type = type;
+    entry->deps = deps;
+
+    _add_resident(entry->type, size);
+
+    const uint32_t deps_n = ce_array_size(entry->deps);
+    for (uint32_t i = 0; i < deps_n; ++i) {
+        retain(entry->deps[i]);
+    }
+
+    _load_unlock();
+
+    return CREATE_NEW;
+}
+
+static void _unload(resource_entry_t *entry) {
+    ct_resource_i0 *resource_i = get_resource_interface(entry->type);
+
+    ce_log_a0->debug(LOG_WHERE, "Unload resource 0x%llx", entry->uid);
+
+    if (resource_i && resource_i->offline) {
+        resource_i->offline(entry->uid, entry->uid);
+    }
+
+    ce_cdb_a0->destroy_object(_G.db, entry->uid);
+
+    _load_lock();
+
+    _add_resident(entry->type, -(int64_t) entry->size);
+
+    const uint32_t deps_n = ce_array_size(entry->deps);
+    for (uint32_t i = 0; i < deps_n; ++i) {
+        release(entry->deps[i]);
+    }
+    ce_array_free(entry->deps, _G.allocator);
+
+    entry->loaded = false;
+    entry->online = false;
+    entry->size = 0;
+
+    _load_unlock();
+}
+
+// Unload least recently released resources until resident fit budget.
+static void _evict() {
+    while ((_G.resident > _G.budget)
+           && (_G.lru_head < ce_array_size(_G.lru))) {
+        lru_item_t item = _G.lru[_G.lru_head++];
+
+        _load_lock();
+        resource_entry_t *entry = _get_entry(item.uid);
+
+        bool evict = entry
+                     && entry->evictable
+                     && entry->online
+                     && !entry->refs
+                     && (entry->lru_stamp == item.stamp);
+        _load_unlock();
+
+        if (evict) {
+            _unload(entry);
+        }
+    }
+
+    if (_G.lru_head && (_G.lru_head * 2 >= ce_array_size(_G.lru))) {
+        const uint32_t lru_n = ce_array_size(_G.lru) - _G.lru_head;
+        memmove(_G.lru, _G.lru + _G.lru_head, sizeof(lru_item_t) * lru_n);
+        ce_array_resize(_G.lru, lru_n, _G.allocator);
+        _G.lru_head = 0;
+    }
+}
 
 //==============================================================================
 // Public interface
@@ -72,76 +416,405 @@ static struct ct_resource_i0 *get_resource_interface(uint64_t type) {
 }
 
 
+static void _online(uint64_t uid) {
+    _load_lock();
+    resource_entry_t *entry = _get_entry(uid);
+    if (entry) {
+        entry->online = true;
+    }
+    _load_unlock();
+
+    ct_resource_id_t0 rid = {.uid = uid};
+    uint64_t type = ct_resourcedb_a0->get_resource_type(rid);
+
+    struct ct_resource_i0 *resource_i = get_resource_interface(type);
+
+    if (resource_i && resource_i->online) {
+        resource_i->online(uid, uid);
+    }
+}
+
+// Keep only uids that are not loaded yet.
+static uint32_t _filter_loaded(uint64_t *uids,
+                               uint32_t n) {
+    uint32_t new_n = 0;
+
+    _load_lock();
+    for (uint32_t i = 0; i < n; ++i) {
+        resource_entry_t *entry = _get_entry(uids[i]);
+
+        if (entry && entry->loaded) {
+            continue;
+        }
+
+        uids[new_n++] = uids[i];
+    }
+    _load_unlock();
+
+    return new_n;
+}
+
+static bool _is_root(const uint64_t *names,
+                     size_t count,
+                     uint64_t uid) {
+    for (uint32_t i = 0; i < count; ++i) {
+        if (names[i] == uid) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static bool load(const uint64_t *names,
                  size_t count,
                  int force) {
     uint32_t start_ticks = ce_os_time_a0->ticks();
 
+    // Whole dependency closure is read in one batch, dependencies first.
+    uint64_t *closure = NULL;
+    ct_resourcedb_a0->get_closure(names, count, &closure, _G.allocator);
 
-    for (uint32_t i = 0; i < count; ++i) {
-        const uint64_t asset_name = names[i];
+    const uint32_t closure_n = _filter_loaded(closure, ce_array_size(closure));
+
+    const char **blobs = CE_ALLOC(_G.allocator, const char *,
+                                  sizeof(char *) * closure_n);
+    uint32_t *sizes = CE_ALLOC(_G.allocator, uint32_t,
+                               sizeof(uint32_t) * closure_n);
+    bool *created = CE_ALLOC(_G.allocator, bool, sizeof(bool) * closure_n);
 
-        ct_resource_id_t0 rid = {.uid = asset_name};
+    // Read without lock, stream decode can run meanwhile.
+    ct_resourcedb_a0->read_blobs(closure, closure_n, blobs, sizes,
+                                 _G.allocator);
 
-        if (!ct_resourcedb_a0->obj_exist(rid)) {
-            ce_log_a0->error(LOG_WHERE,
-                             "Obj 0x%llx does not exist in DB", rid.uid);
+    bool ok = true;
+    for (uint32_t i = 0; i < closure_n; ++i) {
+        created[i] = false;
 
-            return false;
+        if (!blobs[i]) {
+            if (_is_root(names, count, closure[i])) {
+                ce_log_a0->error(LOG_WHERE,
+                                 "Obj 0x%llx does not exist in DB", closure[i]);
+                ok = false;
+            }
+            continue;
         };
 
-        uint64_t type = ct_resourcedb_a0->get_resource_type((ct_resource_id_t0) {.uid=asset_name});
+        int create = _create_object(closure[i], blobs[i], sizes[i]);
+        ct_resourcedb_a0->free_blob(blobs[i], _G.allocator);
 
-        if (!ct_resourcedb_a0->load_cdb_file(rid, asset_name, type,
-                                             _G.allocator)) {
-            ce_log_a0->warning(LOG_WHERE,
-                               "Could not load resource 0x%llx", rid.uid);
+        created[i] = create == CREATE_NEW;
+    }
+
+    for (uint32_t i = 0; i < closure_n; ++i) {
+        if (!created[i]) {
             continue;
         }
 
-        struct ct_resource_i0 *resource_i = get_resource_interface(type);
-
-        if (!resource_i) {
+        if (_decode_request) {
+            ce_array_push(_decode_request->online, closure[i], _G.allocator);
             continue;
         }
 
-        if (resource_i->online) {
-            resource_i->online(names[i], asset_name);
-        }
+        _online(closure[i]);
     }
 
+    CE_FREE(_G.allocator, created);
+    CE_FREE(_G.allocator, sizes);
+    CE_FREE(_G.allocator, blobs);
+    ce_array_free(closure, _G.allocator);
+
     uint32_t now_ticks = ce_os_time_a0->ticks();
     uint32_t dt = now_ticks - start_ticks;
     ce_log_a0->debug(LOG_WHERE,
-                     "load time %f for %zu resource", dt * 0.001, count);
+                     "load time %f for %u resource", dt * 0.001, closure_n);
 
-    return true;
+    return ok;
 }
 
-void unload(const uint64_t *names,
-            size_t count) {
+static void _read_task(void *data) {
+    load_request_t *request = data;
 
-    for (uint32_t i = 0; i < count; ++i) {
-        if (1) {// TODO: ref counting
-            struct ct_resource_id_t0 rid = (ct_resource_id_t0) {
-                    .uid = names[i],
-            };
+    // Task can run over frame end, keep read objects alive over gc.
+    ce_cdb_a0->read_pin();
 
-            uint64_t type = ct_resourcedb_a0->get_resource_type(rid);
+    ct_resourcedb_a0->get_closure(request->roots, request->roots_n,
+                                  &request->uids, _G.allocator);
 
-            struct ct_resource_i0 *resource_i = get_resource_interface(type);
-            if (!resource_i) {
-                continue;
-            }
+    const uint32_t n = _filter_loaded(request->uids,
+                                      ce_array_size(request->uids));
 
-            ce_log_a0->debug(LOG_WHERE, "Unload resource 0x%llx", rid.uid);
+    request->blobs = CE_ALLOC(_G.allocator, const char *, sizeof(char *) * n);
+    request->sizes = CE_ALLOC(_G.allocator, uint32_t, sizeof(uint32_t) * n);
 
+    ct_resourcedb_a0->read_blobs(request->uids, n, request->blobs,
+                                 request->sizes, _G.allocator);
+
+    request->n = n;
+
+    ce_cdb_a0->read_unpin();
+
+    atomic_store(&request->read_done, true);
+}
+
+static void _decode_task(void *data) {
+    load_request_t *request = data;
+
+    ce_cdb_a0->read_pin();
+
+    _decode_request = request;
+
+    uint32_t end = request->decoded + STREAM_DECODE_BATCH;
+    if (end > request->n) {
+        end = request->n;
+    }
+
+    for (uint32_t i = request->decoded; i < end; ++i) {
+        if (!request->blobs[i]) {
+            continue;
+        }
+
+        int create = _create_object(request->uids[i], request->blobs[i],
+                                    request->sizes[i]);
+
+        if (create == CREATE_NEW) {
+            ce_array_push(request->online, request->uids[i], _G.allocator);
+        }
+
+        ct_resourcedb_a0->free_blob(request->blobs[i], _G.allocator);
+        request->blobs[i] = NULL;
+    }
+
+    request->decoded = end;
+
+    _decode_request = NULL;
+
+    ce_cdb_a0->read_unpin();
+
+    atomic_store(&_G.decode_done, true);
+}
+
+static uint64_t load_async(const uint64_t *uids,
+                           uint32_t n,
+                           enum ct_resource_load_priority_e0 priority,
+                           ct_resource_loaded_t loaded,
+                           void *data) {
+    load_request_t *request = CE_ALLOC(_G.allocator, load_request_t,
+                                       sizeof(load_request_t));
+
+    *request = (load_request_t) {
+            .handle = ++_G.next_handle,
+            .status = CT_RESOURCE_LOAD_READING,
+            .priority = priority,
+            .loaded = loaded,
+            .data = data,
+            .ok = true,
+            .roots_n = n,
+            .roots = CE_ALLOC(_G.allocator, uint64_t, sizeof(uint64_t) * n),
+    };
+
+    memcpy(request->roots, uids, sizeof(uint64_t) * n);
+    atomic_init(&request->read_done, false);
+
+    ce_array_push(_G.requests, request, _G.allocator);
+    ce_hash_add(&_G.status, request->handle, request->status, _G.allocator);
+
+    // Resolve closure and read it on worker, blobs are read in parallel.
+    ce_task_item_t0 task = {
+            .name = "resource_read",
+            .work = _read_task,
+            .data = request,
+    };
+
+    ce_task_a0->add(&task, 1, &request->read_counter);
+
+    return request->handle;
+}
+
+static enum ct_resource_load_status_e0 load_status(uint64_t handle) {
+    return (enum ct_resource_load_status_e0) ce_hash_lookup(&_G.status,
+                                                            handle,
+                                                            CT_RESOURCE_LOAD_NONE);
+}
+
+static void _set_status(load_request_t *request,
+                        enum ct_resource_load_status_e0 status) {
+    request->status = status;
+    ce_hash_add(&_G.status, request->handle, status, _G.allocator);
+
+    if ((status == CT_RESOURCE_LOAD_DONE)
+        || (status == CT_RESOURCE_LOAD_FAILED)) {
+        finished_status_t finished = {
+                .handle = request->handle,
+                .frame = _G.frame,
+        };
+        ce_array_push(_G.finished, finished, _G.allocator);
+    }
+}
+
+static void _drop_old_status() {
+    uint32_t old_n = 0;
+
+    const uint32_t finished_n = ce_array_size(_G.finished);
+    while ((old_n < finished_n)
+           && ((_G.finished[old_n].frame + STREAM_STATUS_FRAMES) <= _G.frame)) {
+        ce_hash_remove(&_G.status, _G.finished[old_n].handle);
+        ++old_n;
+    }
+
+    if (!old_n) {
+        return;
+    }
+
+    memmove(_G.finished, _G.finished + old_n,
+            sizeof(finished_status_t) * (finished_n - old_n));
+    ce_array_resize(_G.finished, finished_n - old_n, _G.allocator);
+}
 
-            if (resource_i->offline) {
-                resource_i->offline(names[i], rid.uid);
+static void _finish_request(load_request_t *request) {
+    const uint32_t online_n = ce_array_size(request->online);
+    for (uint32_t i = 0; i < online_n; ++i) {
+        _online(request->online[i]);
+    }
+
+    _set_status(request, request->ok ? CT_RESOURCE_LOAD_DONE
+                                     : CT_RESOURCE_LOAD_FAILED);
+
+    if (request->loaded) {
+        request->loaded(request->handle, request->ok, request->data);
+    }
+}
+
+static void _free_request(load_request_t *request) {
+    ce_array_free(request->online, _G.allocator);
+    CE_FREE(_G.allocator, request->sizes);
+    CE_FREE(_G.allocator, request->blobs);
+    ce_array_free(request->uids, _G.allocator);
+    CE_FREE(_G.allocator, request->roots);
+    CE_FREE(_G.allocator, request);
+}
+
+static void _stream_update(float dt) {
+    CE_UNUSED(dt);
+
+    ++_G.frame;
+    _drop_old_status();
+
+    if (_G.decoding && atomic_load(&_G.decode_done)) {
+        ce_task_a0->wait_for_counter_no_work(_G.decode_counter, 0);
+
+        load_request_t *request = _G.decoding;
+        _G.decoding = NULL;
+
+        if (request->decoded == request->n) {
+            _finish_request(request);
+        }
+    }
+
+    load_request_t *next = NULL;
+
+    const uint32_t request_n = ce_array_size(_G.requests);
+    for (uint32_t i = 0; i < request_n; ++i) {
+        load_request_t *request = _G.requests[i];
+
+        if ((request->status == CT_RESOURCE_LOAD_READING)
+            && atomic_load(&request->read_done)) {
+            ce_task_a0->wait_for_counter_no_work(request->read_counter, 0);
+
+            for (uint32_t j = 0; j < request->n; ++j) {
+                if (!request->blobs[j]
+                    && _is_root(request->roots, request->roots_n,
+                                request->uids[j])) {
+                    ce_log_a0->error(LOG_WHERE,
+                                     "Obj 0x%llx does not exist in DB",
+                                     request->uids[j]);
+                    request->ok = false;
+                }
             }
+
+            _set_status(request, CT_RESOURCE_LOAD_DECODING);
         }
+
+        if ((request->status != CT_RESOURCE_LOAD_DECODING)
+            || (request == _G.decoding)) {
+            continue;
+        }
+
+        if (!next || (request->priority > next->priority)) {
+            next = request;
+        }
+    }
+
+    // One decode at time, high priority request can overtake between batches.
+    if (!_G.decoding && next) {
+        if (next->decoded == next->n) {
+            _finish_request(next);
+        } else {
+            _G.decoding = next;
+            atomic_store(&_G.decode_done, false);
+
+            ce_task_item_t0 task = {
+                    .name = "resource_decode",
+                    .work = _decode_task,
+                    .data = next,
+            };
+
+            ce_task_a0->add(&task, 1, &_G.decode_counter);
+        }
+    }
+
+    uint32_t alive_n = 0;
+    for (uint32_t i = 0; i < request_n; ++i) {
+        load_request_t *request = _G.requests[i];
+
+        if ((request->status == CT_RESOURCE_LOAD_DONE)
+            || (request->status == CT_RESOURCE_LOAD_FAILED)) {
+            _free_request(request);
+            continue;
+        }
+
+        _G.requests[alive_n++] = request;
+    }
+    ce_array_resize(_G.requests, alive_n, _G.allocator);
+
+    _evict();
+}
+
+static uint64_t stream_task_name() {
+    return CT_RESOURCE_STREAM_TASK;
+}
+
+static uint64_t *stream_update_before(uint64_t *n) {
+    static uint64_t a[] = {
+            CT_GAME_TASK,
+    };
+
+    *n = CE_ARRAY_LEN(a);
+    return a;
+}
+
+static uint64_t *stream_update_after(uint64_t *n) {
+    static uint64_t a[] = {
+            CT_INPUT_TASK,
+    };
+
+    *n = CE_ARRAY_LEN(a);
+    return a;
+}
+
+static struct ct_kernel_task_i0 stream_task = {
+        .name = stream_task_name,
+        .update = _stream_update,
+        .update_before = stream_update_before,
+        .update_after = stream_update_after,
+};
+
+static uint64_t resident_bytes(uint64_t type) {
+    if (!type) {
+        return _G.resident;
     }
+
+    return ce_hash_lookup(&_G.type_resident, type, 0);
 }
 
 static bool cdb_loader(uint64_t uid) {
@@ -155,8 +828,8 @@ static bool dump_recursive(const char *filename,
     const uint64_t *ks = ce_cdb_a0->prop_keys(r);
 
     char *output = NULL;
-    ce_cdb_a0->dump(ce_cdb_a0->db(),
-                    obj, &output, _G.allocator);
+    ce_cdb_a0->dump_compact(ce_cdb_a0->db(),
+                            obj, &output, false, _G.allocator);
 
     ct_resource_id_t0 rid = {.uid=obj};
     ct_resourcedb_a0->put_resource_blob(rid,
@@ -222,6 +895,11 @@ static bool save(uint64_t uid) {
 static struct ct_resource_a0 resource_api = {
         .get_interface = get_resource_interface,
         .cdb_loader = cdb_loader,
+        .load_async = load_async,
+        .load_status = load_status,
+        .retain = retain,
+        .release = release,
+        .resident_bytes = resident_bytes,
         .save = save,
         .save_to_db = save_to_db,
 };
@@ -231,6 +909,7 @@ struct ct_resource_a0 *ct_resource_a0 = &resource_api;
 
 static void _init_api(struct ce_api_a0 *api) {
     api->register_api(CT_RESOURCE_API, &resource_api, sizeof(resource_api));
+    api->register_api(KERNEL_TASK_INTERFACE, &stream_task, sizeof(stream_task));
 
 }
 
@@ -244,6 +923,9 @@ static void _init_cvar(struct ce_config_a0 *config) {
     if (!ce_cdb_a0->prop_exist(writer, CONFIG_BUILD)) {
         ce_cdb_a0->set_str(writer, CONFIG_BUILD, "build");
     }
+    if (!ce_cdb_a0->prop_exist(writer, CONFIG_RESOURCE_BUDGET)) {
+        ce_cdb_a0->set_uint64(writer, CONFIG_RESOURCE_BUDGET, 512);
+    }
     ce_cdb_a0->write_commit(writer);
 }
 
@@ -255,6 +937,7 @@ void CE_MODULE_LOAD(resourcesystem)(struct ce_api_a0 *api,
     CE_INIT_API(api, ce_log_a0);
     CE_INIT_API(api, ce_id_a0);
     CE_INIT_API(api, ce_cdb_a0);
+    CE_INIT_API(api, ce_task_a0);
 
     _init_api(api);
     _init_cvar(ce_config_a0);
@@ -272,6 +955,8 @@ void CE_MODULE_LOAD(resourcesystem)(struct ce_api_a0 *api,
                            ce_cdb_a0->read_str(reader, CONFIG_BUILD, ""),
                            false);
 
+    _G.budget = ce_cdb_a0->read_uint64(reader, CONFIG_RESOURCE_BUDGET, 0) << 20;
+
     ce_api_a0->register_on_add(RESOURCE_I, _resource_api_add);
 }
 
@@ -281,5 +966,42 @@ void CE_MODULE_UNLOAD(resourcesystem)(struct ce_api_a0 *api,
     CE_UNUSED(reload);
     CE_UNUSED(api);
 
+    if (_G.decoding) {
+        ce_task_a0->wait_for_counter(_G.decode_counter, 0);
+    }
+
+    const uint32_t request_n = ce_array_size(_G.requests);
+    for (uint32_t i = 0; i < request_n; ++i) {
+        load_request_t *request = _G.requests[i];
+
+        if (request->status == CT_RESOURCE_LOAD_READING) {
+            ce_task_a0->wait_for_counter(request->read_counter, 0);
+        }
+
+        for (uint32_t j = 0; j < request->n; ++j) {
+            ct_resourcedb_a0->free_blob(request->blobs[j], _G.allocator);
+        }
+
+        _free_request(request);
+    }
+
+    ce_array_free(_G.requests, _G.allocator);
+    ce_hash_free(&_G.status, _G.allocator);
+    ce_array_free(_G.finished, _G.allocator);
+    for (uint32_t i = 0; i < _G.entries.n; ++i) {
+        uint64_t k = _G.entries.keys[i];
+        if ((k == EMPTY_SLOT) || (k == DELETE_SLOT)) {
+            continue;
+        }
+
+        resource_entry_t *entry = (resource_entry_t *) _G.entries.values[i];
+
+        ce_array_free(entry->deps, _G.allocator);
+        CE_FREE(_G.allocator, entry);
+    }
+
+    ce_array_free(_G.lru, _G.allocator);
+    ce_hash_free(&_G.entries, _G.allocator);
+    ce_hash_free(&_G.type_resident, _G.allocator);
     ce_hash_free(&_G.type_map, _G.allocator);
 }
@@ -24,8 +24,14 @@
 #include <cetech/kernel/kernel.h>
 #include <cetech/resource/resource_compiler.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
 #include <celib/os/path.h>
+#include <celib/os/process.h>
 #include <celib/os/time.h>
+#include <celib/os/thread.h>
+#include <celib/os/vio.h>
 
 #include "cetech/resource/resourcedb.h"
 
@@ -45,8 +51,19 @@
 static struct _G {
     uint64_t config;
     ce_alloc_t0 *allocator;
+
+    // Inputs reported by compilators, written after compile so workers
+    // do not wait for write lock.
+    ce_spinlock_t0 dependency_lock;
+    const char **dependency_who;
+    char **dependency_on;
+
+    atomic_uint external_running;
 } _G;
 
+// Source file of object compiled by this thread, for add_dependency.
+static CE_THREAD_LOCAL const char *_compile_filename;
+
 
 //==============================================================================
 // Private
@@ -219,11 +236,49 @@ uint64_t compile_obj(ce_cdb_t0 db,
     return obj;
 }
 
-void _scan_obj(const char *filename,
-               uint64_t key,
-               uint64_t obj,
-               struct ce_ba_graph_t *obj_graph,
-               struct ce_hash_t *obj_hash) {
+typedef struct scan_node_t scan_node_t;
+
+// Compile files changed or depend on changed file. Load files are their
+// dependencies, compiled objects are loaded from resourcedb.
+typedef struct scan_file_t {
+    const char *filename;
+    int64_t mtime;
+    uint64_t hash;
+    bool compile;
+    bool load;
+    bool scanned;
+    scan_node_t *nodes;
+} scan_file_t;
+
+// Scanned object. Deps are kept because ce_bag_build consumes graph edges.
+struct scan_node_t {
+    uint64_t uid;
+    uint64_t obj;
+    scan_file_t *file;
+    const char *type;
+    const char *name;
+    uint64_t *deps;
+
+    // Uid is new on every scan, compiled data have another one.
+    bool generated_uid;
+};
+
+typedef struct compile_item_t {
+    ce_cdb_t0 db;
+    uint64_t uid;
+    uint64_t input_obj;
+    const char *filename;
+    uint32_t level;
+    char *blob;
+} compile_item_t;
+
+#define COMPILE_TASK_BATCH 1024
+#define COMPILE_BLOB_BATCH 256
+#define COMPILE_COMMIT_FILES 256
+
+static void _scan_obj(scan_file_t *file,
+                      uint64_t obj,
+                      bool generated_uid) {
 
     const ce_cdb_obj_o0 *reader = ce_cdb_a0->read(ce_cdb_a0->db(), obj);
     const char *uid_s = ce_cdb_a0->read_str(reader, CDB_UID_PROP, NULL);
@@ -235,17 +290,11 @@ void _scan_obj(const char *filename,
     const char *type = ce_cdb_a0->read_str(reader, CDB_TYPE_PROP, "");
     const char *name = ce_cdb_a0->read_str(reader, ASSET_NAME_PROP, "");
 
-    ct_resource_id_t0 rid = {.uid = uid};
-    ct_resourcedb_a0->put_resource(rid, type, filename, name);
-
-
     const char *cdb_instance = ce_cdb_a0->read_str(reader, CDB_INSTANCE_PROP, NULL);
 
     const uint64_t n = ce_cdb_a0->prop_count(reader);
     const uint64_t *keys = ce_cdb_a0->prop_keys(reader);
 
-    ce_hash_add(obj_hash, uid, obj, _G.allocator);
-
     uint64_t *after = NULL;
 
     if (cdb_instance) {
@@ -277,6 +326,7 @@ void _scan_obj(const char *filename,
             const char *uid_s = ce_cdb_a0->read_str(subr, CDB_UID_PROP, NULL);
 
             uint64_t uid = 0;
+            bool generated = !uid_s;
 
             if (uid_s) {
                 uid = strtoul(uid_s, NULL, 0);
@@ -289,7 +339,7 @@ void _scan_obj(const char *filename,
                 ce_cdb_a0->write_commit(w);
             }
 
-            _scan_obj(filename, k, sub_obj, obj_graph, obj_hash);
+            _scan_obj(file, sub_obj, generated);
 
 
             ce_array_push(after, uid, _G.allocator);
@@ -307,64 +357,692 @@ void _scan_obj(const char *filename,
         }
     }
 
-    ce_bag_add(obj_graph, uid,
-               NULL, 0,
-               after, ce_array_size(after),
-               _G.allocator);
+    scan_node_t node = {
+            .uid = uid,
+            .obj = obj,
+            .file = file,
+            .type = type,
+            .name = name,
+            .deps = after,
+            .generated_uid = generated_uid,
+    };
+
+    ce_array_push(file->nodes, node, _G.allocator);
+}
+
+// Parse and scan one file. Nothing shared is written except uids of
+// subobjects of this file, resourcedb and graph are filled after.
+static void _scan_file_task(void *data) {
+    scan_file_t *file = data;
+
+    uint64_t obj = ce_ydb_a0->get_obj(file->filename);
+    _scan_obj(file, obj, false);
+}
+
+static void _check_file_task(void *data) {
+    scan_file_t *file = data;
+
+    file->compile = ct_resourcedb_a0->file_changed(file->filename,
+                                                   &file->mtime, &file->hash)
+                    || ct_resourcedb_a0->need_compile(file->filename);
+}
+
+static void _compile_task(void *data) {
+    compile_item_t *item = data;
+
+    ce_log_a0->info(LOG_WHERE, "Compile 0x%llx from %s",
+                    item->uid, item->filename);
+
+    // Compilator can wait for tasks and run other compile meanwhile.
+    const char *prev_filename = _compile_filename;
+
+    _compile_filename = item->filename;
+    compile_obj(item->db, item->input_obj, item->uid);
+    _compile_filename = prev_filename;
+}
+
+static void _dump_task(void *data) {
+    compile_item_t *item = data;
+    ce_cdb_a0->dump_compact(item->db, item->uid, &item->blob, false, _G.allocator);
+}
+
+// Task pool is bounded, big jobs go in chunks.
+static void _run_tasks(ce_task_item_t0 *tasks,
+                       uint64_t tasks_n) {
+    for (uint64_t i = 0; i < tasks_n; i += COMPILE_TASK_BATCH) {
+        uint64_t n = tasks_n - i;
+        if (n > COMPILE_TASK_BATCH) {
+            n = COMPILE_TASK_BATCH;
+        }
+
+        ce_task_counter_t0 *counter = NULL;
+        ce_task_a0->add(tasks + i, n, &counter);
+        ce_task_a0->wait_for_counter(counter, 0);
+    }
+}
+
+static void _run_items(compile_item_t *items,
+                       uint64_t items_n,
+                       void (*work)(void *data),
+                       const char *name) {
+    if (!items_n) {
+        return;
+    }
+
+    ce_task_item_t0 *tasks = CE_ALLOC(_G.allocator, ce_task_item_t0,
+                                      sizeof(ce_task_item_t0) * items_n);
+
+    for (uint64_t i = 0; i < items_n; ++i) {
+        tasks[i] = (ce_task_item_t0) {
+                .name = name,
+                .work = work,
+                .data = &items[i],
+        };
+    }
+
+    _run_tasks(tasks, items_n);
+
+    CE_FREE(_G.allocator, tasks);
+}
+
+// Compare binary and compact cdb format on compiled objects.
+// Objects are loaded in compile order so subobjects exist before parents.
+static void _cdb_format_bench(ce_cdb_t0 db,
+                              const uint64_t *objs,
+                              uint64_t objs_n) {
+    static const char *format_name[] = {"binary", "compact"};
+
+    const uint64_t fq = ce_os_time_a0->perf_freq();
+
+    for (uint32_t f = 0; f < CE_ARRAY_LEN(format_name); ++f) {
+        char **blobs = NULL;
+        uint64_t size = 0;
+
+        for (uint64_t i = 0; i < objs_n; ++i) {
+            char *output = NULL;
+
+            if (f) {
+                ce_cdb_a0->dump_compact(db, objs[i], &output, false, _G.allocator);
+            } else {
+                ce_cdb_a0->dump(db, objs[i], &output, _G.allocator);
+            }
+
+            size += ce_array_size(output);
+            ce_array_push(blobs, output, _G.allocator);
+        }
+
+        ce_cdb_t0 bench_db = ce_cdb_a0->create_db(objs_n * 2, CDB_DB_FLAG_ARENA);
+
+        uint64_t start = ce_os_time_a0->perf_counter();
+        for (uint64_t i = 0; i < objs_n; ++i) {
+            ce_cdb_a0->load(bench_db, blobs[i], objs[i], _G.allocator);
+        }
+        uint64_t dt = ce_os_time_a0->perf_counter() - start;
+
+        ce_cdb_a0->destroy_db(bench_db);
+
+        ce_log_a0->info(LOG_WHERE,
+                        "cdb bench %s: %llu objects, %llu bytes, decode %f ms",
+                        format_name[f], objs_n, size, (dt * 1000.0) / fq);
+
+        for (uint64_t i = 0; i < objs_n; ++i) {
+            ce_array_free(blobs[i], _G.allocator);
+        }
+        ce_array_free(blobs, _G.allocator);
+    }
+}
+
+static void _flush_dependencies() {
+    const uint32_t n = ce_array_size(_G.dependency_on);
+    for (uint32_t i = 0; i < n; ++i) {
+        ct_resourcedb_a0->add_dependency(_G.dependency_who[i],
+                                         _G.dependency_on[i]);
+        CE_FREE(_G.allocator, _G.dependency_on[i]);
+    }
+
+    ce_array_clean(_G.dependency_who);
+    ce_array_clean(_G.dependency_on);
+}
+
+// Source file dependencies from last build, as indexes to scan files.
+typedef struct file_graph_t {
+    ce_hash_t file_map;
+    uint32_t **depends;
+    uint32_t **dependents;
+} file_graph_t;
+
+static void _file_graph_init(file_graph_t *fg,
+                             scan_file_t *files,
+                             uint32_t files_n) {
+    *fg = (file_graph_t) {};
+
+    for (uint32_t i = 0; i < files_n; ++i) {
+        ce_hash_add(&fg->file_map, ce_id_a0->id64(files[i].filename), i,
+                    _G.allocator);
+
+        ce_array_push(fg->depends, NULL, _G.allocator);
+        ce_array_push(fg->dependents, NULL, _G.allocator);
+    }
+
+    uint64_t *file = NULL;
+    uint64_t *depend_on = NULL;
+    uint32_t dep_n = ct_resourcedb_a0->get_file_depends(&file, &depend_on,
+                                                        _G.allocator);
+
+    for (uint32_t i = 0; i < dep_n; ++i) {
+        uint64_t a = ce_hash_lookup(&fg->file_map, file[i], UINT64_MAX);
+        uint64_t b = ce_hash_lookup(&fg->file_map, depend_on[i], UINT64_MAX);
+
+        // External inputs are not scan files.
+        if ((a == UINT64_MAX) || (b == UINT64_MAX) || (a == b)) {
+            continue;
+        }
+
+        ce_array_push(fg->depends[a], b, _G.allocator);
+        ce_array_push(fg->dependents[b], a, _G.allocator);
+    }
+
+    ce_array_free(file, _G.allocator);
+    ce_array_free(depend_on, _G.allocator);
+}
+
+static void _file_graph_free(file_graph_t *fg) {
+    const uint32_t n = ce_array_size(fg->depends);
+    for (uint32_t i = 0; i < n; ++i) {
+        ce_array_free(fg->depends[i], _G.allocator);
+        ce_array_free(fg->dependents[i], _G.allocator);
+    }
+
+    ce_array_free(fg->depends, _G.allocator);
+    ce_array_free(fg->dependents, _G.allocator);
+    ce_hash_free(&fg->file_map, _G.allocator);
+}
+
+// Mark dependencies of file for load if they are not compiled.
+static void _mark_load(file_graph_t *fg,
+                       scan_file_t *files,
+                       uint32_t idx) {
+    uint32_t *stack = NULL;
+    ce_array_push(stack, idx, _G.allocator);
+
+    while (ce_array_size(stack)) {
+        uint32_t i = ce_array_back(stack);
+        ce_array_pop_back(stack);
+
+        const uint32_t dep_n = ce_array_size(fg->depends[i]);
+        for (uint32_t d = 0; d < dep_n; ++d) {
+            scan_file_t *dep = &files[fg->depends[i][d]];
+
+            if (dep->compile || dep->load) {
+                continue;
+            }
+
+            dep->load = true;
+            ce_array_push(stack, fg->depends[i][d], _G.allocator);
+        }
+    }
+
+    ce_array_free(stack, _G.allocator);
+}
+
+// Changed files and all their dependents are compiled.
+static void _mark_compile(file_graph_t *fg,
+                          scan_file_t *files,
+                          uint32_t files_n) {
+    uint32_t *stack = NULL;
+
+    for (uint32_t i = 0; i < files_n; ++i) {
+        if (files[i].compile) {
+            ce_array_push(stack, i, _G.allocator);
+        }
+    }
+
+    while (ce_array_size(stack)) {
+        uint32_t i = ce_array_back(stack);
+        ce_array_pop_back(stack);
+
+        const uint32_t dep_n = ce_array_size(fg->dependents[i]);
+        for (uint32_t d = 0; d < dep_n; ++d) {
+            scan_file_t *dep = &files[fg->dependents[i][d]];
+
+            if (dep->compile) {
+                continue;
+            }
+
+            dep->compile = true;
+            ce_array_push(stack, fg->dependents[i][d], _G.allocator);
+        }
+    }
+
+    ce_array_free(stack, _G.allocator);
+
+    for (uint32_t i = 0; i < files_n; ++i) {
+        if (files[i].compile) {
+            _mark_load(fg, files, i);
+        }
+    }
+}
+
+static void _run_files(scan_file_t *files,
+                       uint32_t files_n,
+                       bool (*filter)(scan_file_t *file),
+                       void (*work)(void *data),
+                       const char *name) {
+    ce_task_item_t0 *tasks = NULL;
+
+    for (uint32_t i = 0; i < files_n; ++i) {
+        if (filter && !filter(&files[i])) {
+            continue;
+        }
+
+        ce_task_item_t0 task = {
+                .name = name,
+                .work = work,
+                .data = &files[i],
+        };
+        ce_array_push(tasks, task, _G.allocator);
+    }
+
+    _run_tasks(tasks, ce_array_size(tasks));
+
+    ce_array_free(tasks, _G.allocator);
+}
+
+// Load compiled object and subobjects it points to. Generated uids of
+// subobjects differ between scans, so they are found from loaded data.
+static void _load_compiled(ce_cdb_t0 db,
+                           uint64_t uid,
+                           ce_hash_t *loaded) {
+    if (!uid || ce_hash_contain(loaded, uid)) {
+        return;
+    }
+
+    ce_hash_add(loaded, uid, 1, _G.allocator);
+
+    if (!ct_resourcedb_a0->load_cdb_file_to(db, (ct_resource_id_t0) {.uid=uid},
+                                            uid, _G.allocator)) {
+        return;
+    }
+
+    const ce_cdb_obj_o0 *r = ce_cdb_a0->read(db, uid);
+
+    const uint64_t n = ce_cdb_a0->prop_count(r);
+    const uint64_t *keys = ce_cdb_a0->prop_keys(r);
+
+    for (uint32_t i = 0; i < n; ++i) {
+        enum ce_cdb_type_e0 t = ce_cdb_a0->prop_type(r, keys[i]);
+
+        if (t == CDB_TYPE_SUBOBJECT) {
+            _load_compiled(db, ce_cdb_a0->read_subobject(r, keys[i], 0), loaded);
+        } else if (t == CDB_TYPE_SET_SUBOBJECT) {
+            uint64_t set_n = ce_cdb_a0->read_objset_num(r, keys[i]);
+            uint64_t set[set_n];
+            ce_cdb_a0->read_objset(r, keys[i], set);
+
+            for (uint64_t j = 0; j < set_n; ++j) {
+                _load_compiled(db, set[j], loaded);
+            }
+        }
+    }
+}
+
+static bool _need_scan(scan_file_t *file) {
+    return (file->compile || file->load) && !file->scanned;
 }
 
 void _scan_files(char **files,
                  uint32_t files_count) {
     ce_ba_graph_t obj_graph = {};
     ce_hash_t obj_hash = {};
+    ce_hash_t level_hash = {};
+    ce_hash_t loaded = {};
 
-    ce_cdb_t0 db = ce_cdb_a0->create_db(1000000);
+    ce_cdb_t0 db = ce_cdb_a0->create_db(1000000, CDB_DB_FLAG_ARENA);
 
+    scan_file_t *scan_files = NULL;
     for (uint32_t i = 0; i < files_count; ++i) {
         const char *filename = files[i];
         if (ce_id_a0->id64(filename) == ce_id_a0->id64("global.yml")) {
             continue;
         }
 
-        int64_t mtime = ce_fs_a0->file_mtime(SOURCE_ROOT, filename);
-        ct_resourcedb_a0->put_file(filename, mtime);
+        ce_array_push(scan_files, ((scan_file_t) {.filename = filename}),
+                      _G.allocator);
+    }
+
+    const uint32_t scan_files_n = ce_array_size(scan_files);
 
-        uint64_t obj = ce_ydb_a0->get_obj(filename);
-        _scan_obj(filename, 0, obj, &obj_graph, &obj_hash);
+    // Compare files with build manifest in parallel.
+    _run_files(scan_files, scan_files_n, NULL, _check_file_task,
+               "resource_check");
+
+    file_graph_t file_graph;
+    _file_graph_init(&file_graph, scan_files, scan_files_n);
+    _mark_compile(&file_graph, scan_files, scan_files_n);
+
+    // Parse and scan files in parallel. New dependency of compiled file is not
+    // in file graph yet, its file is found by uid and scanned in next pass.
+    while (true) {
+        _run_files(scan_files, scan_files_n, _need_scan, _scan_file_task,
+                   "resource_scan");
+
+        scan_file_t **scanned = NULL;
+        for (uint32_t i = 0; i < scan_files_n; ++i) {
+            scan_file_t *file = &scan_files[i];
+
+            if (!_need_scan(file)) {
+                continue;
+            }
+
+            file->scanned = true;
+            ce_array_push(scanned, file, _G.allocator);
+
+            const uint32_t nodes_n = ce_array_size(file->nodes);
+            for (uint32_t j = 0; j < nodes_n; ++j) {
+                scan_node_t *node = &file->nodes[j];
+                ce_hash_add(&obj_hash, node->uid, (uint64_t) node, _G.allocator);
+            }
+        }
 
-//        ce_cdb_a0->log_obj("AAA", ce_cdb_a0->db(), obj);
+        bool new_load = false;
+
+        const uint32_t scanned_n = ce_array_size(scanned);
+        for (uint32_t i = 0; i < scanned_n; ++i) {
+            scan_file_t *file = scanned[i];
+
+            const uint32_t nodes_n = ce_array_size(file->nodes);
+            for (uint32_t j = 0; j < nodes_n; ++j) {
+                scan_node_t *node = &file->nodes[j];
+
+                const uint32_t deps_n = ce_array_size(node->deps);
+                for (uint32_t d = 0; d < deps_n; ++d) {
+                    if (ce_hash_contain(&obj_hash, node->deps[d])) {
+                        continue;
+                    }
+
+                    char filename[256] = {};
+                    if (!ct_resourcedb_a0->get_resource_filename(
+                            (ct_resource_id_t0) {.uid=node->deps[d]},
+                            filename, CE_ARRAY_LEN(filename))) {
+                        continue;
+                    }
+
+                    uint64_t idx = ce_hash_lookup(&file_graph.file_map,
+                                                  ce_id_a0->id64(filename),
+                                                  UINT64_MAX);
+                    if (idx == UINT64_MAX) {
+                        continue;
+                    }
+
+                    scan_file_t *dep_file = &scan_files[idx];
+                    if (dep_file->compile || dep_file->load) {
+                        continue;
+                    }
+
+                    dep_file->load = true;
+                    _mark_load(&file_graph, scan_files, idx);
+                    new_load = true;
+                }
+            }
+        }
+
+        ce_array_free(scanned, _G.allocator);
+
+        if (!new_load) {
+            break;
+        }
+    }
+
+    _file_graph_free(&file_graph);
+
+    // Resourcedb and graph are filled in file order.
+    ct_resourcedb_resource_t0 *resources = NULL;
+    uint32_t compile_files_n = 0;
+
+    ct_resourcedb_a0->begin();
+    for (uint32_t i = 0; i < scan_files_n; ++i) {
+        scan_file_t *file = &scan_files[i];
+
+        if (!file->scanned) {
+            continue;
+        }
+
+        const uint32_t nodes_n = ce_array_size(file->nodes);
+        for (uint32_t j = 0; j < nodes_n; ++j) {
+            scan_node_t *node = &file->nodes[j];
+
+            ce_bag_add(&obj_graph, node->uid,
+                       NULL, 0,
+                       node->deps, ce_array_size(node->deps),
+                       _G.allocator);
+        }
+
+        if (!file->compile) {
+            continue;
+        }
+
+        ce_array_clean(resources);
+        for (uint32_t j = 0; j < nodes_n; ++j) {
+            scan_node_t *node = &file->nodes[j];
+
+            ct_resourcedb_resource_t0 r = {
+                    .uid = node->uid,
+                    .type = node->type,
+                    .filename = file->filename,
+                    .name = node->name,
+            };
+            ce_array_push(resources, r, _G.allocator);
+        }
+
+        ct_resourcedb_a0->put_file(file->filename, file->mtime);
+        ct_resourcedb_a0->clean_file_depend(file->filename);
+        ct_resourcedb_a0->put_resources(resources, ce_array_size(resources));
+
+        if (!(++compile_files_n % COMPILE_COMMIT_FILES)) {
+            ct_resourcedb_a0->commit();
+            ct_resourcedb_a0->begin();
+        }
     }
+    ct_resourcedb_a0->commit();
+
+    ce_array_free(resources, _G.allocator);
+
+    ce_log_a0->info(LOG_WHERE, "Compile %u of %u files",
+                    compile_files_n, scan_files_n);
 
     ce_bag_build(&obj_graph, _G.allocator);
 
+    // Objects of load files are loaded here in graph order, so prefabs
+    // exist before instances. Level is longest path from leaf, objects on
+    // same level are independent.
     const uint64_t output_n = ce_array_size(obj_graph.output);
-    for (int k = 0; k < output_n; ++k) {
-        uint64_t obj = obj_graph.output[k];
+    compile_item_t *items = CE_ALLOC(_G.allocator, compile_item_t,
+                                     sizeof(compile_item_t) * output_n);
+
+    uint64_t items_n = 0;
+    uint32_t level_n = 0;
+    for (uint64_t k = 0; k < output_n; ++k) {
+        uint64_t uid = obj_graph.output[k];
+        ct_resource_id_t0 rid = {.uid=uid};
+
+        scan_node_t *node = (scan_node_t *) ce_hash_lookup(&obj_hash, uid, 0);
+
+        if (node ? node->file->load : ct_resourcedb_a0->obj_exist(rid)) {
+            if (!node || !node->generated_uid) {
+                _load_compiled(db, uid, &loaded);
+            }
+            continue;
+        }
+
+        uint32_t level = 0;
+        const char *filename = "";
+        uint64_t input_obj = 0;
+
+        if (node) {
+            const uint32_t deps_n = ce_array_size(node->deps);
+            for (uint32_t d = 0; d < deps_n; ++d) {
+                uint64_t dep_level = ce_hash_lookup(&level_hash, node->deps[d], 0);
+                if (dep_level > level) {
+                    level = dep_level;
+                }
+            }
+
+            filename = node->file->filename;
+            input_obj = node->obj;
+        }
+
+        ce_hash_add(&level_hash, uid, level + 1, _G.allocator);
+
+        items[items_n++] = (compile_item_t) {
+                .db = db,
+                .uid = uid,
+                .input_obj = input_obj,
+                .filename = filename,
+                .level = level,
+        };
+
+        if (level + 1 > level_n) {
+            level_n = level + 1;
+        }
+    }
 
-        char filename[256] = {};
-        ct_resourcedb_a0->get_resource_filename(
-                (ct_resource_id_t0) {.uid=obj},
-                filename, CE_ARRAY_LEN(filename));
+    // Sort by level and compile level by level.
+    uint64_t *level_start = CE_ALLOC(_G.allocator, uint64_t,
+                                     sizeof(uint64_t) * (level_n + 1));
+    memset(level_start, 0, sizeof(uint64_t) * (level_n + 1));
 
-        ce_log_a0->info(LOG_WHERE, "Compile 0x%llx from %s", obj, filename);
+    for (uint64_t k = 0; k < items_n; ++k) {
+        ++level_start[items[k].level + 1];
+    }
+
+    for (uint32_t l = 0; l < level_n; ++l) {
+        level_start[l + 1] += level_start[l];
+    }
+
+    compile_item_t *sorted = CE_ALLOC(_G.allocator, compile_item_t,
+                                      sizeof(compile_item_t) * output_n);
+
+    uint64_t *level_pos = CE_ALLOC(_G.allocator, uint64_t,
+                                   sizeof(uint64_t) * (level_n + 1));
+    memcpy(level_pos, level_start, sizeof(uint64_t) * (level_n + 1));
 
-        uint64_t cobj = ce_hash_lookup(&obj_hash, obj, 0);
-        compile_obj(db, cobj, obj);
+    for (uint64_t k = 0; k < items_n; ++k) {
+        sorted[level_pos[items[k].level]++] = items[k];
     }
 
-    for (int k = 0; k < output_n; ++k) {
-        uint64_t obj = obj_graph.output[k];
+    for (uint32_t l = 0; l < level_n; ++l) {
+        _run_items(sorted + level_start[l],
+                   level_start[l + 1] - level_start[l],
+                   _compile_task, "resource_compile");
+    }
+
+    // Dump in parallel, write blobs in batches.
+    for (uint64_t k = 0; k < items_n; k += COMPILE_BLOB_BATCH) {
+        uint64_t batch_n = items_n - k;
+        if (batch_n > COMPILE_BLOB_BATCH) {
+            batch_n = COMPILE_BLOB_BATCH;
+        }
+
+        _run_items(sorted + k, batch_n, _dump_task, "resource_dump");
 
-        char *output = NULL;
-        ce_cdb_a0->dump(db, obj, &output, _G.allocator);
-        ct_resourcedb_a0->put_resource_blob((ct_resource_id_t0) {.uid=obj},
-                                            output,
-                                            ce_array_size(output));
+        ct_resourcedb_a0->begin();
+        for (uint64_t i = k; i < k + batch_n; ++i) {
+            compile_item_t *item = &sorted[i];
 
-        ce_buffer_free(output, _G.allocator);
+            ct_resourcedb_a0->put_resource_blob((ct_resource_id_t0) {.uid=item->uid},
+                                                item->blob,
+                                                ce_array_size(item->blob));
+
+            scan_node_t *node = (scan_node_t *) ce_hash_lookup(&obj_hash,
+                                                               item->uid, 0);
+            if (node) {
+                ct_resourcedb_a0->set_resource_depends(item->uid, node->deps,
+                                                       ce_array_size(node->deps));
+            }
+
+            ce_buffer_free(item->blob, _G.allocator);
+        }
+        ct_resourcedb_a0->commit();
+    }
+
+    // Manifest is written last, interrupted build compile files again.
+    ct_resourcedb_a0->begin();
+    _flush_dependencies();
+    ct_resourcedb_a0->put_touched_files();
+
+    for (uint32_t i = 0; i < scan_files_n; ++i) {
+        scan_file_t *file = &scan_files[i];
+
+        if (!file->compile) {
+            continue;
+        }
+
+        ce_hash_t dep_set = {};
+
+        const uint32_t nodes_n = ce_array_size(file->nodes);
+        for (uint32_t j = 0; j < nodes_n; ++j) {
+            scan_node_t *node = &file->nodes[j];
+
+            const uint32_t deps_n = ce_array_size(node->deps);
+            for (uint32_t d = 0; d < deps_n; ++d) {
+                scan_node_t *dep = (scan_node_t *) ce_hash_lookup(&obj_hash,
+                                                                  node->deps[d],
+                                                                  0);
+
+                if (!dep || (dep->file == file)) {
+                    continue;
+                }
+
+                uint64_t dep_id = ce_id_a0->id64(dep->file->filename);
+                if (ce_hash_contain(&dep_set, dep_id)) {
+                    continue;
+                }
+
+                ce_hash_add(&dep_set, dep_id, 1, _G.allocator);
+                ct_resourcedb_a0->set_file_depend(file->filename,
+                                                  dep->file->filename);
+            }
+        }
+
+        ce_hash_free(&dep_set, _G.allocator);
+
+        ct_resourcedb_a0->put_file_hash(file->filename, file->mtime, file->hash);
+    }
+    ct_resourcedb_a0->commit();
+
+    const ce_cdb_obj_o0 *config_r = ce_cdb_a0->read(ce_cdb_a0->db(), _G.config);
+    if (ce_cdb_a0->read_uint64(config_r, CONFIG_CDB_BENCH, 0)) {
+        uint64_t *compiled = NULL;
+        for (uint64_t k = 0; k < items_n; ++k) {
+            ce_array_push(compiled, items[k].uid, _G.allocator);
+        }
+
+        _cdb_format_bench(db, compiled, items_n);
+        ce_array_free(compiled, _G.allocator);
     }
 
     ce_cdb_a0->destroy_db(db);
+
+    CE_FREE(_G.allocator, level_pos);
+    CE_FREE(_G.allocator, level_start);
+    CE_FREE(_G.allocator, sorted);
+    CE_FREE(_G.allocator, items);
+
+    for (uint32_t i = 0; i < scan_files_n; ++i) {
+        scan_file_t *file = &scan_files[i];
+
+        const uint32_t nodes_n = ce_array_size(file->nodes);
+        for (uint32_t j = 0; j < nodes_n; ++j) {
+            ce_array_free(file->nodes[j].deps, _G.allocator);
+        }
+
+        ce_array_free(file->nodes, _G.allocator);
+    }
+    ce_array_free(scan_files, _G.allocator);
+
+    ce_hash_free(&loaded, _G.allocator);
+    ce_hash_free(&level_hash, _G.allocator);
+    ce_hash_free(&obj_hash, _G.allocator);
 }
 
 //==============================================================================
@@ -401,11 +1079,35 @@ void resource_compiler_compile_all() {
     ce_fs_a0->listdir_free(files, files_count,
                            _G.allocator);
 
+    const ce_cdb_obj_o0 *reader = ce_cdb_a0->read(ce_cdb_a0->db(), _G.config);
+    if (ce_cdb_a0->read_uint64(reader, CONFIG_COOK, 0)) {
+        ct_resourcedb_a0->cook(ce_cdb_a0->read_uint64(reader,
+                                                      CONFIG_COOK_COMPRESS,
+                                                      0));
+    }
+
     uint32_t now_ticks = ce_os_time_a0->ticks();
     uint32_t dt = now_ticks - start_ticks;
     ce_log_a0->debug("resource_compiler", "compile time %f", dt * 0.001);
 }
 
+void resource_compiler_add_dependency(const char *filename) {
+    // Only compile thread know which file is compiled.
+    if (!_compile_filename) {
+        ce_log_a0->warning(LOG_WHERE,
+                           "Dependency %s is not added outside of compile "
+                           "thread", filename);
+        return;
+    }
+
+    char *on = ce_memory_a0->str_dup(filename, _G.allocator);
+
+    ce_os_thread_a0->spin_lock(&_G.dependency_lock);
+    ce_array_push(_G.dependency_who, _compile_filename, _G.allocator);
+    ce_array_push(_G.dependency_on, on, _G.allocator);
+    ce_os_thread_a0->spin_unlock(&_G.dependency_lock);
+}
+
 char *resource_compiler_get_tmp_dir(ce_alloc_t0 *alocator,
                                     const char *platform) {
 
@@ -443,6 +1145,108 @@ char *resource_compiler_external_join(ce_alloc_t0 *alocator,
     return result;
 }
 
+int resource_compiler_external_exec(const char *cmd) {
+    const ce_cdb_obj_o0 *reader = ce_cdb_a0->read(ce_cdb_a0->db(), _G.config);
+    uint32_t jobs = ce_cdb_a0->read_uint64(reader, CONFIG_EXTERNAL_JOBS, 4);
+
+    if (!jobs) {
+        jobs = 1;
+    }
+
+    for (;;) {
+        uint32_t running = atomic_load(&_G.external_running);
+
+        if ((running < jobs)
+            && atomic_compare_exchange_weak(&_G.external_running,
+                                            &running, running + 1)) {
+            break;
+        }
+
+        // Run other tasks while all slots are used.
+        if (!ce_task_a0->do_work()) {
+            ce_os_thread_a0->yield();
+        }
+    }
+
+    int status = ce_os_process_a0->exec(cmd);
+
+    atomic_fetch_sub(&_G.external_running, 1);
+
+    return status;
+}
+
+char *resource_compiler_get_cache_path(ce_alloc_t0 *alocator,
+                                       const char *platform,
+                                       uint64_t key,
+                                       const char *ext) {
+    char *build_dir = resource_compiler_get_build_dir(alocator, platform);
+
+    char *cache_dir = NULL;
+    ce_os_path_a0->join(&cache_dir, alocator, 2, build_dir, "cache");
+    ce_os_path_a0->make_path(cache_dir);
+
+    char *buffer = NULL;
+    ce_buffer_printf(&buffer, alocator, "%s/%016llx.%s",
+                     cache_dir, (unsigned long long) key, ext);
+
+    ce_buffer_free(cache_dir, alocator);
+    ce_buffer_free(build_dir, alocator);
+
+    return buffer;
+}
+
+char *resource_compiler_read_file(ce_alloc_t0 *alocator,
+                                  const char *path,
+                                  uint64_t *size) {
+    ce_vio_t0 *file = ce_os_vio_a0->from_file(path, VIO_OPEN_READ);
+
+    if (!file) {
+        return NULL;
+    }
+
+    *size = file->vt->size(file->inst);
+    char *data = CE_ALLOC(alocator, char, *size + 1);
+    file->vt->read(file->inst, data, sizeof(char), *size);
+    ce_os_vio_a0->close(file);
+
+    data[*size] = '\0';
+
+    return data;
+}
+
+char *resource_compiler_cached_exec(ce_alloc_t0 *alocator,
+                                    const char *platform,
+                                    uint64_t key,
+                                    const char *ext,
+                                    ct_resource_compiler_run_t run,
+                                    void *data,
+                                    uint64_t *size) {
+    char *cache_path = resource_compiler_get_cache_path(alocator, platform,
+                                                        key, ext);
+
+    char *output = resource_compiler_read_file(alocator, cache_path, size);
+
+    if (!output) {
+        // Unique tmp output, same key can compile on more workers.
+        char *tmp_path = NULL;
+        ce_buffer_printf(&tmp_path, alocator, "%s.%llx.tmp", cache_path,
+                         (unsigned long long) ce_os_thread_a0->actual_id());
+
+        if (!run(tmp_path, data)) {
+            rename(tmp_path, cache_path);
+            output = resource_compiler_read_file(alocator, cache_path, size);
+        } else {
+            remove(tmp_path);
+        }
+
+        ce_buffer_free(tmp_path, alocator);
+    }
+
+    ce_buffer_free(cache_path, alocator);
+
+    return output;
+}
+
 static void _init_cvar(struct ce_config_a0 *config) {
     ce_cdb_obj_o0 *writer = ce_cdb_a0->write_begin(ce_cdb_a0->db(), _G.config);
     if (!ce_cdb_a0->prop_exist(writer, CONFIG_SRC)) {
@@ -457,6 +1261,10 @@ static void _init_cvar(struct ce_config_a0 *config) {
         ce_cdb_a0->set_str(writer, CONFIG_EXTERNAL, "externals/build");
     }
 
+    if (!ce_cdb_a0->prop_exist(writer, CONFIG_EXTERNAL_JOBS)) {
+        ce_cdb_a0->set_uint64(writer, CONFIG_EXTERNAL_JOBS, 4);
+    }
+
     ce_cdb_a0->write_commit(writer);
 }
 
@@ -464,6 +1272,11 @@ static struct ct_resource_compiler_a0 resource_compiler_api = {
         .compile_all = resource_compiler_compile_all,
         .get_tmp_dir = resource_compiler_get_tmp_dir,
         .external_join = resource_compiler_external_join,
+        .add_dependency = resource_compiler_add_dependency,
+        .external_exec = resource_compiler_external_exec,
+        .get_cache_path = resource_compiler_get_cache_path,
+        .read_file = resource_compiler_read_file,
+        .cached_exec = resource_compiler_cached_exec,
 };
 
 
@@ -526,4 +1339,6 @@ void CE_MODULE_UNLOAD(resourcecompiler)(struct ce_api_a0 *api,
     CE_UNUSED(reload);
     CE_UNUSED(api);
 
+    ce_array_free(_G.dependency_who, _G.allocator);
+    ce_array_free(_G.dependency_on, _G.allocator);
 }
@@ -0,0 +1,360 @@
+//
+//                          **Resource pack**
+//
+// One file per platform with all compiled objects:
+//
+// header | payloads, each PACK_ALIGN aligned | depends | index sorted by uid
+//
+// Entry with raw_size != size is zlib compressed. Entry depends are uids of
+// its direct dependencies in pack. Runtime map whole pack and find objects by
+// binary search.
+
+#include <stdlib.h>
+#include <zlib.h>
+
+#define PACK_MAGIC 0x4b504543 // CEPK
+#define PACK_VERSION 2
+#define PACK_ALIGN 64
+
+typedef struct pack_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t entry_n;
+    uint64_t index_offset;
+    uint64_t _pad;
+} pack_header_t;
+
+typedef struct pack_entry_t {
+    uint64_t uid;
+    uint64_t type;
+    uint64_t offset;
+    uint64_t deps_offset;
+    uint32_t size;
+    uint32_t raw_size;
+    uint32_t deps_n;
+    uint32_t _pad;
+} pack_entry_t;
+
+static int _pack_entry_cmp(const void *a,
+                           const void *b) {
+    uint64_t ua = ((const pack_entry_t *) a)->uid;
+    uint64_t ub = ((const pack_entry_t *) b)->uid;
+    return (ua > ub) - (ua < ub);
+}
+
+static const pack_entry_t *_pack_search(const pack_entry_t *entries,
+                                        uint64_t entry_n,
+                                        uint64_t uid) {
+    uint64_t first = 0;
+    uint64_t last = entry_n;
+
+    while (first < last) {
+        uint64_t mid = first + ((last - first) >> 1);
+
+        if (entries[mid].uid < uid) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+
+    if ((first < entry_n) && (entries[first].uid == uid)) {
+        return &entries[first];
+    }
+
+    return NULL;
+}
+
+static const pack_entry_t *_pack_find(uint64_t uid) {
+    return _pack_search(_G.pack_entries, _G.pack_entry_n, uid);
+}
+
+static const uint64_t *_pack_depends(const pack_entry_t *entry) {
+    return (const uint64_t *) (_G.pack + entry->deps_offset);
+}
+
+static bool _pack_is_mapped(const char *data) {
+    return _G.pack
+           && ((const uint8_t *) data >= _G.pack)
+           && ((const uint8_t *) data < (_G.pack + _G.pack_size));
+}
+
+// Return uncompressed data, raw entry point into pack, compressed one is
+// allocated from alloc. Free it with _pack_data_free.
+static const char *_pack_data(const pack_entry_t *entry,
+                              ce_alloc_t0 *alloc) {
+    const uint8_t *data = _G.pack + entry->offset;
+
+    if (entry->raw_size == entry->size) {
+        return (const char *) data;
+    }
+
+    uint8_t *raw = CE_ALLOC(alloc, uint8_t, entry->raw_size);
+    uLongf raw_size = entry->raw_size;
+
+    if (uncompress(raw, &raw_size, data, entry->size) != Z_OK) {
+        ce_log_a0->error(LOG_WHERE, "Corrupted pack entry 0x%llx",
+                         entry->uid);
+        CE_FREE(alloc, raw);
+        return NULL;
+    }
+
+    return (const char *) raw;
+}
+
+static void _pack_data_free(const char *data,
+                            ce_alloc_t0 *alloc) {
+    if (data && !_pack_is_mapped(data)) {
+        CE_FREE(alloc, (void *) data);
+    }
+}
+
+// Payload and depends of every entry must be inside mapped file.
+static bool _pack_entries_valid(const pack_entry_t *entries,
+                                uint64_t entry_n,
+                                uint64_t size) {
+    for (uint64_t i = 0; i < entry_n; ++i) {
+        const pack_entry_t *entry = &entries[i];
+
+        if ((entry->offset > size)
+            || (entry->size > (size - entry->offset))) {
+            return false;
+        }
+
+        if (entry->deps_n
+            && ((entry->deps_offset > size)
+                || (entry->deps_n > (size - entry->deps_offset)
+                                    / sizeof(uint64_t)))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool _pack_open(const char *path) {
+    uint64_t size = 0;
+    const uint8_t *pack = ce_os_vio_a0->map(path, &size);
+
+    if (!pack) {
+        return false;
+    }
+
+    const pack_header_t *header = (const pack_header_t *) pack;
+
+    if ((size < sizeof(pack_header_t))
+        || (header->magic != PACK_MAGIC)
+        || (header->version != PACK_VERSION)
+        || (header->index_offset > size)
+        || (header->entry_n > (size - header->index_offset)
+                              / sizeof(pack_entry_t))
+        || !_pack_entries_valid(
+                (const pack_entry_t *) (pack + header->index_offset),
+                header->entry_n, size)) {
+        ce_log_a0->error(LOG_WHERE, "Invalid pack %s", path);
+        ce_os_vio_a0->unmap(pack, size);
+        return false;
+    }
+
+    _G.pack = pack;
+    _G.pack_size = size;
+    _G.pack_entries = (const pack_entry_t *) (pack + header->index_offset);
+    _G.pack_entry_n = header->entry_n;
+
+    ce_log_a0->info(LOG_WHERE, "Use pack %s with %llu objects", path,
+                    header->entry_n);
+
+    return true;
+}
+
+static void _pack_close() {
+    if (!_G.pack) {
+        return;
+    }
+
+    ce_os_vio_a0->unmap(_G.pack, _G.pack_size);
+    _G.pack = NULL;
+    _G.pack_entries = NULL;
+    _G.pack_entry_n = 0;
+}
+
+static bool _pack_write(ce_vio_t0 *file,
+                        const void *data,
+                        uint64_t size) {
+    return file->vt->write(file->inst, data, 1, size) == size;
+}
+
+// Depends of entry are stored together, rows come sorted by uid.
+static bool _pack_write_depends(ce_vio_t0 *file,
+                                pack_entry_t *entries,
+                                uint32_t entry_n,
+                                uint64_t *offset) {
+    sqlite3 *_db = _opendb();
+
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v2(_db,
+                       "SELECT uid, depend_on FROM resource_depend ORDER BY uid;",
+                       -1, &stmt, NULL);
+
+    if (!stmt) {
+        return false;
+    }
+
+    bool ok = true;
+    while (ok && (_step(_db, stmt) == SQLITE_ROW)) {
+        uint64_t uid = sqlite3_column_int64(stmt, 0);
+        uint64_t depend_on = sqlite3_column_int64(stmt, 1);
+
+        pack_entry_t *entry = (pack_entry_t *) _pack_search(entries, entry_n,
+                                                            uid);
+
+        if (!entry || !_pack_search(entries, entry_n, depend_on)) {
+            continue;
+        }
+
+        if (!entry->deps_n) {
+            entry->deps_offset = *offset;
+        }
+
+        ok = _pack_write(file, &depend_on, sizeof(depend_on));
+        *offset += sizeof(depend_on);
+        ++entry->deps_n;
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+// Pack is written to tmp file and renamed over old one only when complete.
+static bool builddb_cook(bool compress) {
+    if (_no_db(__func__)) {
+        return false;
+    }
+
+    sqlite3 *_db = _opendb();
+
+    sqlite3_stmt *stmt = NULL;
+    sqlite3_prepare_v2(_db,
+                       "SELECT resource.uid, resource.type, resource_data.data\n"
+                       "FROM resource_data\n"
+                       "JOIN resource ON resource.uid = resource_data.uid\n"
+                       "WHERE resource.type IS NOT NULL;",
+                       -1, &stmt, NULL);
+
+    if (!stmt) {
+        return false;
+    }
+
+    char tmp_path[4096] = {};
+    snprintf(tmp_path, CE_ARRAY_LEN(tmp_path), "%s.tmp", _G._pack_path);
+
+    ce_vio_t0 *file = ce_os_vio_a0->from_file(tmp_path, VIO_OPEN_WRITE);
+    if (!file) {
+        ce_log_a0->error(LOG_WHERE, "Could not open %s", tmp_path);
+        sqlite3_finalize(stmt);
+        return false;
+    }
+
+    static const uint8_t zero[PACK_ALIGN] = {};
+
+    pack_header_t header = {
+            .magic = PACK_MAGIC,
+            .version = PACK_VERSION,
+    };
+
+    bool ok = _pack_write(file, &header, sizeof(header));
+    uint64_t offset = sizeof(header);
+
+    pack_entry_t *entries = NULL;
+    uint8_t *compressed = NULL;
+    uint64_t raw_total = 0;
+
+    while (ok && (_step(_db, stmt) == SQLITE_ROW)) {
+        const uint8_t *data = sqlite3_column_blob(stmt, 2);
+        uint32_t raw_size = sqlite3_column_bytes(stmt, 2);
+
+        if (!data) {
+            continue;
+        }
+
+        uint32_t pad = (PACK_ALIGN - (offset & (PACK_ALIGN - 1))) & (PACK_ALIGN - 1);
+        ok = _pack_write(file, zero, pad);
+        offset += pad;
+
+        pack_entry_t entry = {
+                .uid = sqlite3_column_int64(stmt, 0),
+                .type = ce_id_a0->id64((const char *) sqlite3_column_text(stmt, 1)),
+                .offset = offset,
+                .size = raw_size,
+                .raw_size = raw_size,
+        };
+
+        if (compress) {
+            uLongf size = compressBound(raw_size);
+            ce_array_resize(compressed, size, _G.alloc);
+
+            // Keep raw data if compression save less than 1/8.
+            if ((compress2(compressed, &size, data, raw_size,
+                           Z_BEST_SPEED) == Z_OK)
+                && (size < (raw_size - (raw_size >> 3)))) {
+                entry.size = size;
+                data = compressed;
+            }
+        }
+
+        ok = ok && _pack_write(file, data, entry.size);
+        offset += entry.size;
+        raw_total += raw_size;
+
+        ce_array_push(entries, entry, _G.alloc);
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_finalize(stmt);
+
+    const uint32_t entry_n = ce_array_size(entries);
+
+    if (entry_n) {
+        qsort(entries, entry_n, sizeof(pack_entry_t), _pack_entry_cmp);
+    }
+
+    uint32_t pad = (PACK_ALIGN - (offset & (PACK_ALIGN - 1))) & (PACK_ALIGN - 1);
+    ok = ok && _pack_write(file, zero, pad);
+    offset += pad;
+
+    header.entry_n = entry_n;
+
+    ok = ok && _pack_write_depends(file, entries, entry_n, &offset);
+
+    header.index_offset = offset;
+
+    ok = ok && _pack_write(file, entries, sizeof(pack_entry_t) * entry_n);
+
+    file->vt->seek(file->inst, 0, VIO_SEEK_SET);
+    ok = ok && _pack_write(file, &header, sizeof(header));
+
+    ce_os_vio_a0->close(file);
+
+    if (ok && rename(tmp_path, _G._pack_path)) {
+        ce_log_a0->error(LOG_WHERE, "Could not rename %s", tmp_path);
+        ok = false;
+    }
+
+    if (!ok) {
+        remove(tmp_path);
+    }
+
+    if (ok) {
+        ce_log_a0->info(LOG_WHERE, "Cooked %u objects to %s (%llu/%llu bytes)",
+                        entry_n, _G._pack_path, offset, raw_total);
+    } else {
+        ce_log_a0->error(LOG_WHERE, "Could not write %s", _G._pack_path);
+    }
+
+    ce_array_free(compressed, _G.alloc);
+    ce_array_free(entries, _G.alloc);
+
+    return ok;
+}
@@ -22,19 +22,27 @@
 #include <celib/containers/hash.h>
 #include <celib/os/path.h>
 #include <celib/os/thread.h>
+#include <celib/os/vio.h>
+#include <celib/os/error.h>
+#include <celib/containers/array.h>
 
 #include "cetech/resource/resourcedb.h"
 
 #define LOG_WHERE "builddb"
 #define MAX_WORKERS TASK_MAX_WORKERS
 
+// Uids per "WHERE uid IN (...)" query.
+#define LOAD_BATCH 64
+
+// Writer wait for other connection commit at most this long.
+#define BUSY_TIMEOUT_MS 5000
+
 #define _G BUILDDB_GLOBALS
 
 struct sqls_s {
     sqlite3_stmt *put_file;
     sqlite3_stmt *put_resource;
     sqlite3_stmt *put_file_blob;
-    sqlite3_stmt *load_file_blob;
     sqlite3_stmt *set_file_depend;
     sqlite3_stmt *get_filename;
     sqlite3_stmt *get_fullname;
@@ -46,19 +54,52 @@ struct sqls_s {
     sqlite3_stmt *get_file_id;
     sqlite3_stmt *resource_type;
     sqlite3_stmt *resource_exist;
+    sqlite3_stmt *get_file_hash;
+    sqlite3_stmt *put_file_hash;
+    sqlite3_stmt *clean_file_depend;
+    sqlite3_stmt *get_file_depends;
+    sqlite3_stmt *put_resource_depend;
+    sqlite3_stmt *clean_resource_depend;
+};
+
+// Read only connection statements.
+struct read_sqls_s {
+    sqlite3_stmt *load_blob;
+    sqlite3_stmt *load_blobs;
+    sqlite3_stmt *load_depends;
 };
 
+// File with same content and new mtime, written after check phase.
+typedef struct touched_file_t {
+    char *filename;
+    int64_t mtime;
+    uint64_t hash;
+} touched_file_t;
+
 static struct _G {
     sqlite3 *db[MAX_WORKERS];
     struct sqls_s sqls[MAX_WORKERS];
 
+    sqlite3 *read_db[MAX_WORKERS];
+    struct read_sqls_s read_sqls[MAX_WORKERS];
+    uint32_t transaction_depth[MAX_WORKERS];
+
     ce_spinlock_t0 type_cache_lock;
     ce_hash_t type_cache;
 
     ce_spinlock_t0 uid_cache_lock;
     ce_hash_t uid_cache;
 
+    ce_spinlock_t0 touched_lock;
+    touched_file_t *touched;
+
+    const uint8_t *pack;
+    uint64_t pack_size;
+    const struct pack_entry_t *pack_entries;
+    uint64_t pack_entry_n;
+
     char *_logdb_path;
+    char *_pack_path;
     ce_alloc_t0 *alloc;
 } _G = {};
 
@@ -85,6 +126,20 @@ const char *CREATE_SQL[] = {
         "FOREIGN KEY(depend_on) REFERENCES files(id)\n"
         ");",
 
+        "CREATE TABLE IF NOT EXISTS file_hash (\n"
+        "id       INTEGER PRIMARY KEY                     NOT NULL,\n"
+        "mtime    INTEGER                                 NOT NULL,\n"
+        "hash     INTEGER                                 NOT NULL\n"
+        ");",
+
+        "CREATE TABLE IF NOT EXISTS resource_depend (\n"
+        "uid       INTEGER                                NOT NULL,\n"
+        "depend_on INTEGER                                NOT NULL\n"
+        ");",
+
+        "CREATE INDEX IF NOT EXISTS resource_depend_uid\n"
+        "ON resource_depend (uid);",
+
         "CREATE TABLE IF NOT EXISTS resource_data (\n"
         "uid      INTEGER                                 NOT NULL,\n"
         "data     BLOB,                                            \n"
@@ -111,9 +166,6 @@ static struct {
         _STATMENT(put_resource,
                   "INSERT OR REPLACE INTO resource (uid, type, name, file) VALUES(?1, ?2, ?3, ?4);"),
 
-        _STATMENT(load_file_blob,
-                  "SELECT data FROM resource_data WHERE uid = ?1"),
-
         _STATMENT(set_file_depend,
                   "INSERT INTO file_dependency (file, depend_on) VALUES (?1, ?2);"),
 
@@ -140,7 +192,7 @@ static struct {
 
         _STATMENT(need_compile,
                   "SELECT\n"
-                  "     files.filename, files.mtime\n"
+                  "     files.filename\n"
                   "FROM\n"
                   "    file_dependency\n"
                   "JOIN\n"
@@ -148,6 +200,24 @@ static struct {
                   "WHERE\n"
                   "    file_dependency.file = ?1\n"),
 
+        _STATMENT(get_file_hash,
+                  "SELECT mtime, hash FROM file_hash WHERE id = ?1"),
+
+        _STATMENT(put_file_hash,
+                  "INSERT OR REPLACE INTO file_hash (id, mtime, hash) VALUES(?1, ?2, ?3);"),
+
+        _STATMENT(clean_file_depend,
+                  "DELETE FROM file_dependency WHERE file = ?1;"),
+
+        _STATMENT(get_file_depends,
+                  "SELECT file, depend_on FROM file_dependency"),
+
+        _STATMENT(put_resource_depend,
+                  "INSERT INTO resource_depend (uid, depend_on) VALUES (?1, ?2);"),
+
+        _STATMENT(clean_resource_depend,
+                  "DELETE FROM resource_depend WHERE uid = ?1;"),
+
         _STATMENT(get_file_id,
                   "SELECT id FROM files WHERE filename = ?1"),
 
@@ -168,34 +238,20 @@ static struct {
 
 static int _step(sqlite3 *db,
                  sqlite3_stmt *stmt) {
-    int rc;
-    int run = 0;
-
-    do {
-        rc = sqlite3_step(stmt);
-        switch (rc) {
-            case SQLITE_LOCKED:
-                ce_log_a0->warning(LOG_WHERE, "SQL locked '%s' (%d): %s",
-                                   sqlite3_sql(stmt), rc, sqlite3_errmsg(db));
-                run = 1;
-                continue;
+    int rc = sqlite3_step(stmt);
 
-            case SQLITE_BUSY:
-                run = 1;
-                sqlite3_reset(stmt);
-                continue;
+    switch (rc) {
+        case SQLITE_ROW:
+        case SQLITE_DONE:
+            break;
 
-            case SQLITE_ROW:
-            case SQLITE_DONE:
-                run = 0;
-                break;
-            default:
-                ce_log_a0->error("builddb", "SQL error '%s' (%d): %s",
-                                 sqlite3_sql(stmt), rc, sqlite3_errmsg(db));
-                run = 0;
-                break;
-        }
-    } while (run);
+        // Busy handler already waited BUSY_TIMEOUT_MS. Retry can not help,
+        // open read snapshot of connection stay stale.
+        default:
+            ce_log_a0->error("builddb", "SQL error '%s' (%d): %s",
+                             sqlite3_sql(stmt), rc, sqlite3_errmsg(db));
+            break;
+    }
 
     if ((rc != SQLITE_ROW)) {
         sqlite3_reset(stmt);
@@ -205,6 +261,16 @@ static int _step(sqlite3 *db,
     return rc;
 }
 
+// Pack mode open no database, only lookups served by pack work.
+static bool _no_db(const char *fce) {
+    if (!_G.pack) {
+        return false;
+    }
+
+    ce_log_a0->warning(LOG_WHERE, "%s need resource database, use pack", fce);
+    return true;
+}
+
 static struct sqls_s *_get_sqls() {
     uint32_t worker_idx = ce_task_a0->worker_id();
     struct sqls_s *sqls = &_G.sqls[worker_idx];
@@ -238,6 +304,47 @@ static int _do_sql(const char *sql) {
     return 0;
 }
 
+// Transactions are per worker connection and may nest, only outermost
+// begin/commit touch db.
+static void builddb_begin() {
+    if (_no_db(__func__)) {
+        return;
+    }
+
+    uint32_t worker_idx = ce_task_a0->worker_id();
+
+    if (!_G.transaction_depth[worker_idx]++) {
+        _do_sql("BEGIN TRANSACTION;");
+    }
+}
+
+static void builddb_commit() {
+    if (_no_db(__func__)) {
+        return;
+    }
+
+    uint32_t worker_idx = ce_task_a0->worker_id();
+
+    CE_ASSERT(LOG_WHERE, _G.transaction_depth[worker_idx]);
+
+    if (!--_G.transaction_depth[worker_idx]) {
+        _do_sql("COMMIT TRANSACTION;");
+    }
+}
+
+#include "resource_pack.inl"
+
+// Append (?1, ... ?LOAD_BATCH)
+static void _in_params(char *sql,
+                       size_t max_len) {
+    strcat(sql, "(");
+    for (int i = 0; i < LOAD_BATCH; ++i) {
+        size_t len = strlen(sql);
+        snprintf(sql + len, max_len - len, i ? ", ?%d" : "?%d", i + 1);
+    }
+    strcat(sql, ")");
+}
+
 static int builddb_init_db() {
     const ce_cdb_obj_o0 *reader = ce_cdb_a0->read(ce_cdb_a0->db(),
                                                   ce_config_a0->obj());
@@ -257,8 +364,23 @@ static int builddb_init_db() {
                         build_dir_full,
                         "resource.db");
 
+    ce_os_path_a0->join(&_G._pack_path, ce_memory_a0->system, 2,
+                        build_dir_full,
+                        "resource.pack");
+
     ce_buffer_free(build_dir_full, ce_memory_a0->system);
 
+    // Pack replace database, compile need database.
+    if (ce_cdb_a0->read_uint64(reader, CONFIG_PACK, 0)
+        && !ce_cdb_a0->read_uint64(reader, CONFIG_COMPILE, 0)) {
+        if (_pack_open(_G._pack_path)) {
+            return 1;
+        }
+
+        ce_log_a0->warning(LOG_WHERE, "Pack %s not found, use %s",
+                           _G._pack_path, _G._logdb_path);
+    }
+
     int worker_n = ce_task_a0->worker_count();
     for (int j = 0; j < worker_n; ++j) {
         sqlite3_open_v2(_G._logdb_path,
@@ -267,9 +389,13 @@ static int builddb_init_db() {
                         SQLITE_OPEN_NOMUTEX,
                         NULL);
 
-        sqlite3_exec(_G.db[j], "PRAGMA synchronous = OFF", NULL, NULL,
+        sqlite3_busy_timeout(_G.db[j], BUSY_TIMEOUT_MS);
+
+        // WAL let readers run while compile write, NORMAL sync only on
+        // checkpoint.
+        sqlite3_exec(_G.db[j], "PRAGMA journal_mode = WAL", NULL, NULL,
                      NULL);
-        sqlite3_exec(_G.db[j], "PRAGMA journal_mode = OFF", NULL, NULL,
+        sqlite3_exec(_G.db[j], "PRAGMA synchronous = NORMAL", NULL, NULL,
                      NULL);
     }
 
@@ -279,6 +405,32 @@ static int builddb_init_db() {
         }
     }
 
+    char load_blobs_sql[96 + LOAD_BATCH * 8] = "SELECT uid, data FROM resource_data WHERE uid IN ";
+    char load_depends_sql[96 + LOAD_BATCH * 8] = "SELECT uid, depend_on FROM resource_depend WHERE uid IN ";
+    _in_params(load_blobs_sql, CE_ARRAY_LEN(load_blobs_sql));
+    _in_params(load_depends_sql, CE_ARRAY_LEN(load_depends_sql));
+
+    for (int j = 0; j < worker_n; ++j) {
+        sqlite3_open_v2(_G._logdb_path,
+                        &_G.read_db[j],
+                        SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                        NULL);
+
+        sqlite3_busy_timeout(_G.read_db[j], BUSY_TIMEOUT_MS);
+
+        struct read_sqls_s *sqls = &_G.read_sqls[j];
+
+        sqlite3_prepare_v2(_G.read_db[j],
+                           "SELECT data FROM resource_data WHERE uid = ?1",
+                           -1, &sqls->load_blob, NULL);
+
+        sqlite3_prepare_v2(_G.read_db[j], load_blobs_sql,
+                           -1, &sqls->load_blobs, NULL);
+
+        sqlite3_prepare_v2(_G.read_db[j], load_depends_sql,
+                           -1, &sqls->load_depends, NULL);
+    }
+
 
     for (int j = 0; j < worker_n; ++j) {
         sqlite3 *_db = _G.db[j];
@@ -306,6 +458,9 @@ static int builddb_init_db() {
 
 static void builddb_put_file(const char *filename,
                              time_t mtime) {
+    if (_no_db(__func__)) {
+        return;
+    }
 
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
@@ -319,6 +474,10 @@ static void builddb_put_file(const char *filename,
 static void put_resource_blob(ct_resource_id_t0 rid,
                               const char *data,
                               uint64_t size) {
+    if (_no_db(__func__)) {
+        return;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
@@ -331,6 +490,10 @@ static void put_resource(ct_resource_id_t0 rid,
                          const char *type,
                          const char *filename,
                          const char *name) {
+    if (_no_db(__func__)) {
+        return;
+    }
+
     sqlite3 *_db = _opendb();
 
     struct sqls_s *sqls = _get_sqls();
@@ -343,37 +506,419 @@ static void put_resource(ct_resource_id_t0 rid,
     _step(_db, sqls->put_resource);
 }
 
-bool builddb_load_cdb_file(ct_resource_id_t0 resource,
-                           uint64_t object,
-                           uint64_t type,
-                           struct ce_alloc_t0 *allocator) {
+// Raw pack entry stay mapped, its strings and blobs are not copied.
+static void builddb_load_blob(ce_cdb_t0 db,
+                              const char *blob,
+                              uint64_t object,
+                              struct ce_alloc_t0 *allocator) {
+    if (_pack_is_mapped(blob)) {
+        ce_cdb_a0->load_mapped(db, blob, object);
+        return;
+    }
+
+    ce_cdb_a0->load(db, blob, object, allocator);
+}
+
+static void builddb_free_blob(const char *blob,
+                              struct ce_alloc_t0 *allocator) {
+    _pack_data_free(blob, allocator);
+}
+
+static bool builddb_load_cdb_file_to(ce_cdb_t0 db,
+                                     ct_resource_id_t0 resource,
+                                     uint64_t object,
+                                     struct ce_alloc_t0 *allocator) {
+    if (_G.pack) {
+        const pack_entry_t *entry = _pack_find(resource.uid);
+        const char *data = entry ? _pack_data(entry, _G.alloc) : NULL;
+
+        if (!data) {
+            return false;
+        }
+
+        builddb_load_blob(db, data, object, allocator);
+        _pack_data_free(data, _G.alloc);
+        return true;
+    }
+
+    uint32_t worker_idx = ce_task_a0->worker_id();
+    sqlite3 *_db = _G.read_db[worker_idx];
+    sqlite3_stmt *stmt = _G.read_sqls[worker_idx].load_blob;
+
+    sqlite3_bind_int64(stmt, 1, resource.uid);
+
+    int ok = _step(_db, stmt) == SQLITE_ROW;
+
+    if (ok) {
+        // load copy all data so blob is used directly, it is valid until next step.
+        const char *data = sqlite3_column_blob(stmt, 0);
+
+        ce_cdb_a0->load(db, data, object, allocator);
+
+        _step(_db, stmt);
+    }
+
+    return ok != 0;
+}
+
+typedef struct blob_read_t {
+    const uint64_t *uids;
+    uint32_t n;
+    const char **blobs;
+    uint32_t *sizes;
+    ce_alloc_t0 *alloc;
+} blob_read_t;
+
+// Read at most LOAD_BATCH blobs on worker read connection, missing stay NULL.
+static void _read_blobs(void *data) {
+    blob_read_t *r = data;
+
+    if (_G.pack) {
+        for (uint32_t i = 0; i < r->n; ++i) {
+            const pack_entry_t *entry = _pack_find(r->uids[i]);
+            r->blobs[i] = entry ? _pack_data(entry, r->alloc) : NULL;
+
+            if (!r->blobs[i]) {
+                continue;
+            }
+
+            if (r->sizes) {
+                r->sizes[i] = entry->raw_size;
+            }
+        }
+        return;
+    }
+
+    uint32_t worker_idx = ce_task_a0->worker_id();
+    sqlite3 *_db = _G.read_db[worker_idx];
+    sqlite3_stmt *stmt = _G.read_sqls[worker_idx].load_blobs;
+
+    // Uid 0 is never stored, it fill unused params.
+    for (uint32_t i = 0; i < LOAD_BATCH; ++i) {
+        sqlite3_bind_int64(stmt, i + 1, (i < r->n) ? r->uids[i] : 0);
+    }
+
+    while (_step(_db, stmt) == SQLITE_ROW) {
+        uint64_t uid = sqlite3_column_int64(stmt, 0);
+        const char *blob = sqlite3_column_blob(stmt, 1);
+        int size = sqlite3_column_bytes(stmt, 1);
+
+        for (uint32_t i = 0; i < r->n; ++i) {
+            if ((r->uids[i] != uid) || r->blobs[i]) {
+                continue;
+            }
+
+            char *copy = CE_ALLOC(r->alloc, char, size);
+            memcpy(copy, blob, size);
+            r->blobs[i] = copy;
+
+            if (r->sizes) {
+                r->sizes[i] = size;
+            }
+        }
+    }
+}
+
+static void builddb_read_blobs(const uint64_t *uids,
+                               uint32_t n,
+                               const char **blobs,
+                               uint32_t *sizes,
+                               struct ce_alloc_t0 *allocator) {
+    memset(blobs, 0, sizeof(char *) * n);
+
+    const uint32_t batch_n = (n + LOAD_BATCH - 1) / LOAD_BATCH;
+
+    blob_read_t *reads = CE_ALLOC(_G.alloc, blob_read_t,
+                                  sizeof(blob_read_t) * batch_n);
+
+    for (uint32_t i = 0; i < batch_n; ++i) {
+        uint32_t first = i * LOAD_BATCH;
+
+        reads[i] = (blob_read_t) {
+                .uids = uids + first,
+                .n = ((n - first) < LOAD_BATCH) ? (n - first) : LOAD_BATCH,
+                .blobs = blobs + first,
+                .sizes = sizes ? sizes + first : NULL,
+                .alloc = allocator,
+        };
+    }
+
+    if (batch_n == 1) {
+        _read_blobs(&reads[0]);
+    } else if (batch_n) {
+        ce_task_item_t0 *tasks = CE_ALLOC(_G.alloc, ce_task_item_t0,
+                                          sizeof(ce_task_item_t0) * batch_n);
+
+        for (uint32_t i = 0; i < batch_n; ++i) {
+            tasks[i] = (ce_task_item_t0) {
+                    .name = "resourcedb_read",
+                    .work = _read_blobs,
+                    .data = &reads[i],
+            };
+        }
+
+        ce_task_counter_t0 *counter = NULL;
+        ce_task_a0->add(tasks, batch_n, &counter);
+        ce_task_a0->wait_for_counter(counter, 0);
+
+        CE_FREE(_G.alloc, tasks);
+    }
+
+    CE_FREE(_G.alloc, reads);
+}
+
+static uint32_t builddb_load_cdb_files(const uint64_t *uids,
+                                       uint32_t n,
+                                       bool *loaded,
+                                       struct ce_alloc_t0 *allocator) {
+    const char **blobs = CE_ALLOC(_G.alloc, const char *, sizeof(char *) * n);
+
+    builddb_read_blobs(uids, n, blobs, NULL, _G.alloc);
+
+    // Objects are created in given order, on calling thread.
+    uint32_t loaded_n = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (loaded) {
+            loaded[i] = blobs[i] != NULL;
+        }
+
+        if (!blobs[i]) {
+            continue;
+        }
+
+        builddb_load_blob(ce_cdb_a0->db(), blobs[i], uids[i], allocator);
+        builddb_free_blob(blobs[i], _G.alloc);
+        ++loaded_n;
+    }
+
+    CE_FREE(_G.alloc, blobs);
+
+    return loaded_n;
+}
+
+static void builddb_set_resource_depends(uint64_t uid,
+                                         const uint64_t *depends,
+                                         uint32_t n) {
+    if (_no_db(__func__)) {
+        return;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
+    builddb_begin();
 
-    sqlite3_bind_int64(sqls->load_file_blob, 1, resource.uid);
+    sqlite3_bind_int64(sqls->clean_resource_depend, 1, uid);
+    _step(_db, sqls->clean_resource_depend);
 
-    int ok = _step(_db, sqls->load_file_blob) == SQLITE_ROW;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (!depends[i] || (depends[i] == uid)) {
+            continue;
+        }
 
-    char *buff = NULL;
+        sqlite3_bind_int64(sqls->put_resource_depend, 1, uid);
+        sqlite3_bind_int64(sqls->put_resource_depend, 2, depends[i]);
+        _step(_db, sqls->put_resource_depend);
+    }
 
-    if (ok) {
-        const char *data = sqlite3_column_blob(sqls->load_file_blob, 0);
-        int s = sqlite3_column_bytes(sqls->load_file_blob, 0);
-        ce_array_push_n(buff, data, s, allocator);
+    builddb_commit();
+}
 
-        _step(_db, sqls->load_file_blob);
+// Push (uid, depend_on) edges of uids, LOAD_BATCH uids per query.
+static void _read_depends(const uint64_t *uids,
+                          uint32_t n,
+                          uint64_t **edges) {
+    if (_G.pack) {
+        for (uint32_t i = 0; i < n; ++i) {
+            const pack_entry_t *entry = _pack_find(uids[i]);
+            if (!entry) {
+                continue;
+            }
 
-        ce_cdb_a0->load(ce_cdb_a0->db(), buff, object, allocator);
+            const uint64_t *depends = _pack_depends(entry);
+            for (uint32_t j = 0; j < entry->deps_n; ++j) {
+                uint64_t edge[2] = {uids[i], depends[j]};
+                ce_array_push_n(*edges, edge, 2, _G.alloc);
+            }
+        }
+        return;
+    }
 
-        ce_array_free(buff, allocator);
+    uint32_t worker_idx = ce_task_a0->worker_id();
+    sqlite3 *_db = _G.read_db[worker_idx];
+    sqlite3_stmt *stmt = _G.read_sqls[worker_idx].load_depends;
+
+    for (uint32_t first = 0; first < n; first += LOAD_BATCH) {
+        for (uint32_t i = 0; i < LOAD_BATCH; ++i) {
+            uint32_t idx = first + i;
+            sqlite3_bind_int64(stmt, i + 1, (idx < n) ? uids[idx] : 0);
+        }
+
+        while (_step(_db, stmt) == SQLITE_ROW) {
+            uint64_t edge[2] = {
+                    sqlite3_column_int64(stmt, 0),
+                    sqlite3_column_int64(stmt, 1),
+            };
+            ce_array_push_n(*edges, edge, 2, _G.alloc);
+        }
+    }
+}
+
+// Breadth first by levels, one batched read per level, then Kahn's
+// algorithm over read edges so dependencies are before resources that
+// need them.
+static uint32_t builddb_get_closure(const uint64_t *uids,
+                                    uint32_t n,
+                                    uint64_t **closure,
+                                    ce_alloc_t0 *alloc) {
+    // uid -> index in nodes
+    ce_hash_t node_map = {};
+    uint64_t *nodes = NULL;
+    uint64_t *edges = NULL;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        if (!ce_hash_contain(&node_map, uids[i])) {
+            ce_hash_add(&node_map, uids[i], ce_array_size(nodes), _G.alloc);
+            ce_array_push(nodes, uids[i], _G.alloc);
+        }
     }
 
-    return ok != 0;
+    uint32_t level_first = 0;
+    uint32_t edge_first = 0;
+    while (level_first < ce_array_size(nodes)) {
+        uint32_t level_end = ce_array_size(nodes);
+
+        _read_depends(nodes + level_first, level_end - level_first, &edges);
+
+        const uint32_t edges_n = ce_array_size(edges);
+        for (uint32_t i = edge_first; i < edges_n; i += 2) {
+            uint64_t depend_on = edges[i + 1];
+            if (!ce_hash_contain(&node_map, depend_on)) {
+                ce_hash_add(&node_map, depend_on, ce_array_size(nodes),
+                            _G.alloc);
+                ce_array_push(nodes, depend_on, _G.alloc);
+            }
+        }
+
+        edge_first = edges_n;
+        level_first = level_end;
+    }
+
+    const uint32_t nodes_n = ce_array_size(nodes);
+    const uint32_t edges_n = ce_array_size(edges) / 2;
+
+    // Unresolved depends count per node and dependents of node, packed.
+    uint32_t *pending = CE_ALLOC(_G.alloc, uint32_t,
+                                 sizeof(uint32_t) * nodes_n);
+    uint32_t *first = CE_ALLOC(_G.alloc, uint32_t,
+                               sizeof(uint32_t) * (nodes_n + 1));
+    uint32_t *dependents = CE_ALLOC(_G.alloc, uint32_t,
+                                    sizeof(uint32_t) * (edges_n + 1));
+
+    memset(pending, 0, sizeof(uint32_t) * nodes_n);
+    memset(first, 0, sizeof(uint32_t) * (nodes_n + 1));
+
+    for (uint32_t i = 0; i < edges_n; ++i) {
+        uint64_t from = ce_hash_lookup(&node_map, edges[i * 2], 0);
+        uint64_t to = ce_hash_lookup(&node_map, edges[i * 2 + 1], 0);
+
+        ++pending[from];
+        ++first[to + 1];
+    }
+
+    for (uint32_t i = 0; i < nodes_n; ++i) {
+        first[i + 1] += first[i];
+    }
+
+    for (uint32_t i = 0; i < edges_n; ++i) {
+        uint64_t from = ce_hash_lookup(&node_map, edges[i * 2], 0);
+        uint64_t to = ce_hash_lookup(&node_map, edges[i * 2 + 1], 0);
+
+        // Count down from end so fill need no cursor array.
+        dependents[--first[to + 1]] = from;
+    }
+
+    // After fill first[i + 1] is begin of node i, shift it back.
+    for (uint32_t i = 0; i < nodes_n; ++i) {
+        first[i] = first[i + 1];
+    }
+    first[nodes_n] = edges_n;
+
+    uint32_t *ready = NULL;
+    for (uint32_t i = 0; i < nodes_n; ++i) {
+        if (!pending[i]) {
+            ce_array_push(ready, i, _G.alloc);
+        }
+    }
+
+    uint32_t closure_n = 0;
+    for (uint32_t r = 0; r < ce_array_size(ready); ++r) {
+        uint32_t node = ready[r];
+
+        ce_array_push(*closure, nodes[node], alloc);
+        ++closure_n;
+
+        for (uint32_t i = first[node]; i < first[node + 1]; ++i) {
+            uint32_t dependent = dependents[i];
+            if (!--pending[dependent]) {
+                ce_array_push(ready, dependent, _G.alloc);
+            }
+        }
+    }
+
+    // Cycle has no valid order, keep its resources in breadth first order.
+    if (closure_n != nodes_n) {
+        ce_log_a0->warning(LOG_WHERE, "Resource depends have cycle");
+
+        for (uint32_t i = 0; i < nodes_n; ++i) {
+            if (pending[i]) {
+                ce_array_push(*closure, nodes[i], alloc);
+                ++closure_n;
+            }
+        }
+    }
+
+    ce_array_free(ready, _G.alloc);
+    CE_FREE(_G.alloc, dependents);
+    CE_FREE(_G.alloc, first);
+    CE_FREE(_G.alloc, pending);
+    ce_array_free(edges, _G.alloc);
+    ce_array_free(nodes, _G.alloc);
+    ce_hash_free(&node_map, _G.alloc);
+
+    return closure_n;
+}
+
+static void put_resources(const ct_resourcedb_resource_t0 *resources,
+                          uint32_t n) {
+    if (_no_db(__func__)) {
+        return;
+    }
+
+    builddb_begin();
+
+    for (uint32_t i = 0; i < n; ++i) {
+        const ct_resourcedb_resource_t0 *r = &resources[i];
+        put_resource((ct_resource_id_t0) {.uid=r->uid},
+                     r->type, r->filename, r->name);
+    }
+
+    builddb_commit();
+}
+
+bool builddb_load_cdb_file(ct_resource_id_t0 resource,
+                           uint64_t object,
+                           uint64_t type,
+                           struct ce_alloc_t0 *allocator) {
+    return builddb_load_cdb_file_to(ce_cdb_a0->db(), resource, object, allocator);
 }
 
 static void builddb_set_file_depend(const char *filename,
                                     const char *depend_on) {
+    if (_no_db(__func__)) {
+        return;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
@@ -385,6 +930,9 @@ static void builddb_set_file_depend(const char *filename,
 
 static int buildb_get_resource_dirs(char ***filename,
                                     struct ce_alloc_t0 *alloc) {
+    if (_no_db(__func__)) {
+        return 0;
+    }
 
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
@@ -424,6 +972,10 @@ static int buildb_get_resource_dirs(char ***filename,
 static int buildb_get_resource_from_dirs(const char *dir,
                                          char ***filename,
                                          struct ce_alloc_t0 *alloc) {
+    if (_no_db(__func__)) {
+        return 0;
+    }
+
 //    if (!strlen(dir)) {
 //        return 0;
 //    }
@@ -458,6 +1010,10 @@ static int buildb_get_resource_from_dirs(const char *dir,
 
 
 static bool builddb_obj_exist(ct_resource_id_t0 resource) {
+    if (_G.pack) {
+        return _pack_find(resource.uid) != NULL;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
@@ -472,8 +1028,154 @@ static bool builddb_obj_exist(ct_resource_id_t0 resource) {
     return false;
 }
 
+static uint64_t _hash_file(const char *filename) {
+    ce_vio_t0 *f = ce_fs_a0->open(SOURCE_ROOT, filename, FS_OPEN_READ);
+
+    if (!f) {
+        return 0;
+    }
+
+    int64_t size = f->vt->size(f->inst);
+    char *data = CE_ALLOC(_G.alloc, char, size + 1);
+    f->vt->read(f->inst, data, sizeof(char), size);
+    ce_fs_a0->close(f);
+
+    uint64_t hash = ce_hash_murmur2_64(data, size, 0);
+    CE_FREE(_G.alloc, data);
+
+    return hash;
+}
+
+static void builddb_put_file_hash(const char *filename,
+                                  int64_t mtime,
+                                  uint64_t hash) {
+    if (_no_db(__func__)) {
+        return;
+    }
+
+    sqlite3 *_db = _opendb();
+    struct sqls_s *sqls = _get_sqls();
+
+    sqlite3_bind_int64(sqls->put_file_hash, 1, ce_id_a0->id64(filename));
+    sqlite3_bind_int64(sqls->put_file_hash, 2, mtime);
+    sqlite3_bind_int64(sqls->put_file_hash, 3, hash);
+    _step(_db, sqls->put_file_hash);
+}
+
+// Mtime is only a hint, file is read when it differs from manifest.
+static bool builddb_file_changed(const char *filename,
+                                 int64_t *mtime,
+                                 uint64_t *hash) {
+    if (_no_db(__func__)) {
+        *mtime = 0;
+        *hash = 0;
+        return false;
+    }
+
+    sqlite3 *_db = _opendb();
+    struct sqls_s *sqls = _get_sqls();
+
+    int64_t actual_mtime = ce_fs_a0->file_mtime(SOURCE_ROOT, filename);
+
+    bool known = false;
+    int64_t last_mtime = 0;
+    uint64_t last_hash = 0;
+
+    sqlite3_bind_int64(sqls->get_file_hash, 1, ce_id_a0->id64(filename));
+
+    if (_step(_db, sqls->get_file_hash) == SQLITE_ROW) {
+        known = true;
+        last_mtime = sqlite3_column_int64(sqls->get_file_hash, 0);
+        last_hash = (uint64_t) sqlite3_column_int64(sqls->get_file_hash, 1);
+
+        _step(_db, sqls->get_file_hash);
+    }
+
+    *mtime = actual_mtime;
+
+    if (known && (actual_mtime == last_mtime)) {
+        *hash = last_hash;
+        return false;
+    }
+
+    *hash = _hash_file(filename);
+
+    if (!known || (*hash != last_hash)) {
+        return true;
+    }
+
+    // Touched only, remember new mtime so file is not read again. Check run
+    // on more connections at once, write it later by put_touched_files.
+    touched_file_t touched = {
+            .filename = ce_memory_a0->str_dup(filename, _G.alloc),
+            .mtime = actual_mtime,
+            .hash = last_hash,
+    };
+
+    ce_os_thread_a0->spin_lock(&_G.touched_lock);
+    ce_array_push(_G.touched, touched, _G.alloc);
+    ce_os_thread_a0->spin_unlock(&_G.touched_lock);
+
+    return false;
+}
+
+static void builddb_put_touched_files() {
+    ce_os_thread_a0->spin_lock(&_G.touched_lock);
+    touched_file_t *touched = _G.touched;
+    _G.touched = NULL;
+    ce_os_thread_a0->spin_unlock(&_G.touched_lock);
+
+    const uint32_t n = ce_array_size(touched);
+    for (uint32_t i = 0; i < n; ++i) {
+        builddb_put_file_hash(touched[i].filename, touched[i].mtime,
+                              touched[i].hash);
+        CE_FREE(_G.alloc, touched[i].filename);
+    }
+
+    ce_array_free(touched, _G.alloc);
+}
+
+static void builddb_clean_file_depend(const char *filename) {
+    if (_no_db(__func__)) {
+        return;
+    }
+
+    sqlite3 *_db = _opendb();
+    struct sqls_s *sqls = _get_sqls();
+
+    sqlite3_bind_int64(sqls->clean_file_depend, 1, ce_id_a0->id64(filename));
+    _step(_db, sqls->clean_file_depend);
+}
+
+static uint32_t builddb_get_file_depends(uint64_t **files,
+                                         uint64_t **depend_on,
+                                         ce_alloc_t0 *alloc) {
+    if (_no_db(__func__)) {
+        return 0;
+    }
+
+    sqlite3 *_db = _opendb();
+    struct sqls_s *sqls = _get_sqls();
+
+    uint32_t n = 0;
+    while (_step(_db, sqls->get_file_depends) == SQLITE_ROW) {
+        uint64_t file = sqlite3_column_int64(sqls->get_file_depends, 0);
+        uint64_t dep = sqlite3_column_int64(sqls->get_file_depends, 1);
+
+        ce_array_push(*files, file, alloc);
+        ce_array_push(*depend_on, dep, alloc);
+        ++n;
+    }
+
+    return n;
+}
+
 static int builddb_need_compile(const char *filename) {
-    int compile = 1;
+    if (_no_db(__func__)) {
+        return 0;
+    }
+
+    int compile = 0;
 
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
@@ -481,16 +1183,14 @@ static int builddb_need_compile(const char *filename) {
     sqlite3_bind_int64(sqls->need_compile, 1, ce_id_a0->id64(filename));
 
     while (_step(_db, sqls->need_compile) == SQLITE_ROW) {
-        compile = 0;
         const char *dep_file = (const char *) sqlite3_column_text(
                 sqls->need_compile, 0);
 
-        time_t actual_mtime = ce_fs_a0->file_mtime(SOURCE_ROOT, dep_file);
-
-        time_t last_mtime = sqlite3_column_int64(sqls->need_compile, 1);
-
-        if (actual_mtime != last_mtime) {
+        int64_t mtime;
+        uint64_t hash;
+        if (builddb_file_changed(dep_file, &mtime, &hash)) {
             compile = 1;
+            sqlite3_reset(sqls->need_compile);
             break;
         }
     }
@@ -500,10 +1200,18 @@ static int builddb_need_compile(const char *filename) {
 
 void _add_dependency(const char *who_filename,
                      const char *depend_on_filename) {
+    if (_no_db(__func__)) {
+        return;
+    }
 
     builddb_set_file_depend(who_filename, depend_on_filename);
-//    builddb_set_file(depend_on_filename,ce_fs_a0->file_mtime(SOURCE_ROOT,
-//                                                 depend_on_filename));
+
+    int64_t mtime;
+    uint64_t hash;
+    if (builddb_file_changed(depend_on_filename, &mtime, &hash)) {
+        builddb_put_file(depend_on_filename, mtime);
+        builddb_put_file_hash(depend_on_filename, mtime, hash);
+    }
 }
 
 
@@ -516,6 +1224,11 @@ uint64_t resource_type(ct_resource_id_t0 resource) {
         return type;
     }
 
+    if (_G.pack) {
+        const pack_entry_t *entry = _pack_find(resource.uid);
+        return entry ? entry->type : 0;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
@@ -539,6 +1252,10 @@ uint64_t resource_type(ct_resource_id_t0 resource) {
 bool resource_filename(ct_resource_id_t0 resource,
                        char *filename,
                        size_t max_len) {
+    if (_no_db(__func__)) {
+        return false;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
@@ -593,6 +1310,11 @@ void fullname_resource(const char *fullname,
         return;
     }
 
+    if (_no_db(__func__)) {
+        resource->uid = 0;
+        return;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
@@ -622,6 +1344,10 @@ int get_resource_by_type(const char *name,
                          const char *type,
                          char ***filename,
                          struct ce_alloc_t0 *alloc) {
+    if (_no_db(__func__)) {
+        return 0;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
@@ -659,6 +1385,10 @@ void get_resource_clean(char **filename,
 
 uint64_t get_uid(const char *name,
                  const char *type) {
+    if (_no_db(__func__)) {
+        return 0;
+    }
+
     sqlite3 *_db = _opendb();
     struct sqls_s *sqls = _get_sqls();
 
@@ -681,11 +1411,27 @@ static struct ct_resourcedb_a0 build_db_api = {
         .put_file = builddb_put_file,
         .put_resource_blob = put_resource_blob,
         .put_resource = put_resource,
+        .put_resources = put_resources,
+        .begin = builddb_begin,
+        .commit = builddb_commit,
         .load_cdb_file = builddb_load_cdb_file,
+        .load_cdb_file_to = builddb_load_cdb_file_to,
+        .load_cdb_files = builddb_load_cdb_files,
+        .read_blobs = builddb_read_blobs,
+        .load_blob = builddb_load_blob,
+        .free_blob = builddb_free_blob,
+        .set_resource_depends = builddb_set_resource_depends,
+        .get_closure = builddb_get_closure,
         .set_file_depend = builddb_set_file_depend,
         .need_compile = builddb_need_compile,
+        .cook = builddb_cook,
         .obj_exist = builddb_obj_exist,
         .add_dependency = _add_dependency,
+        .clean_file_depend = builddb_clean_file_depend,
+        .get_file_depends = builddb_get_file_depends,
+        .file_changed = builddb_file_changed,
+        .put_file_hash = builddb_put_file_hash,
+        .put_touched_files = builddb_put_touched_files,
         .get_resource_type = resource_type,
         .get_resource_filename = resource_filename,
         .get_resource_by_fullname = fullname_resource,
@@ -723,8 +1469,17 @@ void CE_MODULE_UNLOAD(builddb)(struct ce_api_a0 *api,
     CE_UNUSED(api);
 
     for (int i = 0; i < TASK_MAX_WORKERS; ++i) {
+        sqlite3_close_v2(_G.read_db[i]);
         sqlite3_close_v2(_G.db[i]);
     }
 
+    _pack_close();
+
+    const uint32_t touched_n = ce_array_size(_G.touched);
+    for (uint32_t i = 0; i < touched_n; ++i) {
+        CE_FREE(_G.alloc, _G.touched[i].filename);
+    }
+    ce_array_free(_G.touched, _G.alloc);
+
     _G = (struct _G) {};
 }
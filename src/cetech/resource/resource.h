@@ -27,9 +27,15 @@ extern "C" {
 #define CONFIG_BUILD \
      CE_ID64_0("build", 0x4429661936ece1eaULL)
 
+#define CONFIG_PACK \
+     CE_ID64_0("pack", 0x841557608bd228ffULL)
+
 #define RESOURCE_I \
     CE_ID64_0("ct_resource_i0", 0x3e0127963a0db5b9ULL)
 
+#define CT_RESOURCE_STREAM_TASK \
+    CE_ID64_0("resource_stream_task", 0xffe3bd1efb3aad65ULL)
+
 
 typedef struct ce_vio_t0 ce_vio_t0;
 typedef struct ce_alloc_t0 ce_alloc_t0;
@@ -43,6 +49,24 @@ typedef struct ct_resource_id_t0 {
 typedef bool (*ct_resource_compilator_t)(ce_cdb_t0 db,
                                          uint64_t obj);
 
+enum ct_resource_load_status_e0 {
+    CT_RESOURCE_LOAD_NONE = 0,
+    CT_RESOURCE_LOAD_READING,
+    CT_RESOURCE_LOAD_DECODING,
+    CT_RESOURCE_LOAD_DONE,
+    CT_RESOURCE_LOAD_FAILED,
+};
+
+enum ct_resource_load_priority_e0 {
+    CT_RESOURCE_PRIORITY_LOW = 0,
+    CT_RESOURCE_PRIORITY_NORMAL,
+    CT_RESOURCE_PRIORITY_HIGH,
+};
+
+typedef void (*ct_resource_loaded_t)(uint64_t handle,
+                                     bool ok,
+                                     void *data);
+
 //! Resource interface
 typedef struct ct_resource_i0 {
     uint64_t (*cdb_type)();
@@ -67,6 +91,28 @@ struct ct_resource_a0 {
 
     bool (*cdb_loader)(uint64_t uid);
 
+    // Blobs are read and objects created on workers, online and loaded run on
+    // main thread in resource_stream_task. Higher priority is created first.
+    uint64_t (*load_async)(const uint64_t *uids,
+                           uint32_t n,
+                           enum ct_resource_load_priority_e0 priority,
+                           ct_resource_loaded_t loaded,
+                           void *data);
+
+    // Finished request report DONE or FAILED for some frames, then NONE as
+    // unknown handle.
+    enum ct_resource_load_status_e0 (*load_status)(uint64_t handle);
+
+    // Referenced resource is never unloaded. Loaded resource retain resources
+    // it reference. Released resource stay cached and is unloaded least
+    // recently used first when resident size exceed resource.budget_mb.
+    void (*retain)(uint64_t uid);
+
+    void (*release)(uint64_t uid);
+
+    // Resident size of loaded resources of type, 0 => all types.
+    uint64_t (*resident_bytes)(uint64_t type);
+
     bool (*save)(uint64_t uid);
 
     bool (*save_to_db)(uint64_t uid);
@@ -24,11 +24,27 @@ extern "C" {
 #define CONFIG_EXTERNAL \
      CE_ID64_0("external", 0x9fb8bb487a62dc4fULL)
 
+#define CONFIG_CDB_BENCH \
+     CE_ID64_0("cdb_bench", 0xfafdbdf9365b13b2ULL)
+
+#define CONFIG_COOK \
+     CE_ID64_0("cook", 0xbfb6b9b80ac639e1ULL)
+
+#define CONFIG_COOK_COMPRESS \
+     CE_ID64_0("cook_compress", 0x610cbc6d2c4dcadeULL)
+
+#define CONFIG_EXTERNAL_JOBS \
+     CE_ID64_0("external_jobs", 0x9a2927245a7e69acULL)
+
 
 typedef struct ce_vio_t0 ce_vio_t0;
 typedef struct ce_alloc_t0 ce_alloc_t0;
 typedef struct ct_resource_id_t0 ct_resource_id_t0;
 
+// Write tool output to output path, return 0 on success.
+typedef int (*ct_resource_compiler_run_t)(const char *output,
+                                          void *data);
+
 struct ct_resource_compiler_a0 {
     void (*compile_all)();
 
@@ -37,6 +53,35 @@ struct ct_resource_compiler_a0 {
 
     char *(*external_join)(ce_alloc_t0 *a,
                            const char *name);
+
+    // Called by compilator on compile thread, source file of compiled
+    // resource is rebuilt when content of filename change.
+    void (*add_dependency)(const char *filename);
+
+    // Run external tool, at most CONFIG_EXTERNAL_JOBS at once. Waiting worker
+    // run other tasks meanwhile.
+    int (*external_exec)(const char *cmd);
+
+    // Path of cached tool output for content key, directory is created.
+    char *(*get_cache_path)(ce_alloc_t0 *a,
+                            const char *platform,
+                            uint64_t key,
+                            const char *ext);
+
+    // Read whole file, data is NUL terminated. NULL if file does not exist.
+    char *(*read_file)(ce_alloc_t0 *a,
+                       const char *path,
+                       uint64_t *size);
+
+    // Cached tool output for content key, run tool when it is not cached.
+    // NULL if tool fail.
+    char *(*cached_exec)(ce_alloc_t0 *a,
+                         const char *platform,
+                         uint64_t key,
+                         const char *ext,
+                         ct_resource_compiler_run_t run,
+                         void *data,
+                         uint64_t *size);
 };
 
 CE_MODULE(ct_resource_compiler_a0);
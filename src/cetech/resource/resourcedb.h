@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
 
 #define CT_BUILDDB_API \
@@ -13,6 +14,14 @@ extern "C" {
 
 typedef struct ct_resource_id_t0 ct_resource_id_t0;
 typedef struct ce_alloc_t0 ce_alloc_t0;
+typedef struct ce_cdb_t0 ce_cdb_t0;
+
+typedef struct ct_resourcedb_resource_t0 {
+    uint64_t uid;
+    const char *type;
+    const char *filename;
+    const char *name;
+} ct_resourcedb_resource_t0;
 
 struct ct_resourcedb_a0 {
     void (*put_file)(const char *filename,
@@ -23,6 +32,16 @@ struct ct_resourcedb_a0 {
                          const char *filename,
                          const char *name);
 
+    // Put all in one transaction.
+    void (*put_resources)(const ct_resourcedb_resource_t0 *resources,
+                          uint32_t n);
+
+    // Transaction of calling worker, can nest. Do not wait for other worker
+    // that write inside transaction, writer is blocked until commit.
+    void (*begin)();
+
+    void (*commit)();
+
     void (*put_resource_blob)(ct_resource_id_t0 rid,
                               const char *data,
                               uint64_t size);
@@ -35,11 +54,79 @@ struct ct_resourcedb_a0 {
                           uint64_t type,
                           ce_alloc_t0 *allocator);
 
+    bool (*load_cdb_file_to)(ce_cdb_t0 db,
+                             ct_resource_id_t0 resource,
+                             uint64_t object,
+                             ce_alloc_t0 *allocator);
+
+    // Blobs are read by workers in batches, objects are created in given
+    // order on calling thread. loaded[i] (optional) is set for found uids.
+    uint32_t (*load_cdb_files)(const uint64_t *uids,
+                               uint32_t n,
+                               bool *loaded,
+                               ce_alloc_t0 *allocator);
+
+    // Read compiled objects without creating them, blobs[i] is NULL for
+    // missing uid. Blobs are allocated from allocator or point into mapped
+    // pack, create objects with load_blob and release with free_blob.
+    // sizes is optional. Safe to call from task.
+    void (*read_blobs)(const uint64_t *uids,
+                       uint32_t n,
+                       const char **blobs,
+                       uint32_t *sizes,
+                       ce_alloc_t0 *allocator);
+
+    void (*load_blob)(ce_cdb_t0 db,
+                      const char *blob,
+                      uint64_t obj,
+                      ce_alloc_t0 *allocator);
+
+    void (*free_blob)(const char *blob,
+                      ce_alloc_t0 *allocator);
+
+    // Replace direct dependencies of compiled object.
+    void (*set_resource_depends)(uint64_t uid,
+                                 const uint64_t *depends,
+                                 uint32_t n);
+
+    // Push uids and all their transitive dependencies to closure array,
+    // dependencies first. Safe to call from task.
+    uint32_t (*get_closure)(const uint64_t *uids,
+                            uint32_t n,
+                            uint64_t **closure,
+                            ce_alloc_t0 *alloc);
+
+    // Add dependency and remember its content hash.
     void (*add_dependency)(const char *who_filename,
                            const char *depend_on_filename);
 
+    void (*clean_file_depend)(const char *filename);
+
+    // All (file, depend_on) pairs, file is id64 of filename.
+    uint32_t (*get_file_depends)(uint64_t **files,
+                                 uint64_t **depend_on,
+                                 ce_alloc_t0 *alloc);
+
+    // Return 1 if any dependency of filename changed since last build.
     int (*need_compile)(const char *filename);
 
+    // Compare file content with build manifest, return current mtime and hash.
+    // Nothing is written, check can run on more threads.
+    bool (*file_changed)(const char *filename,
+                         int64_t *mtime,
+                         uint64_t *hash);
+
+    void (*put_file_hash)(const char *filename,
+                          int64_t mtime,
+                          uint64_t hash);
+
+    // Write new mtime of files file_changed found touched only. Call on one
+    // thread inside begin/commit after check tasks.
+    void (*put_touched_files)();
+
+
+    // Write all compiled objects to platform resource.pack.
+    bool (*cook)(bool compress);
 
     bool (*obj_exist)(ct_resource_id_t0 resource);
 
@@ -36,12 +36,18 @@
 #include <celib/os/path.h>
 #include <celib/os/process.h>
 #include <celib/os/vio.h>
+#include <celib/containers/hash.h>
+#include <celib/task.h>
+#include <celib/murmur.h>
+#include <string.h>
 
 //==============================================================================
 // GLobals
 //==============================================================================
 
 #define _G ShaderResourceGlobals
+#define LOG_WHERE "shader"
+
 struct _G {
     ce_alloc_t0 *allocator;
 } _G;
@@ -57,7 +63,8 @@ static int _shaderc(const char *input,
                     const char *include_path,
                     const char *type,
                     const char *platform,
-                    const char *profile) {
+                    const char *profile,
+                    const char *defines) {
     ce_alloc_t0 *a = ce_memory_a0->system;
 
     char *buffer = NULL;
@@ -75,38 +82,151 @@ static int _shaderc(const char *input,
                      " -i %s"
                      " --type %s"
                      " --platform %s"
-                     " --profile %s"
-
-                     " 2>&1",  // TODO: move to exec
+                     " --profile %s",
                      input, output, include_path, type, platform, profile);
 
-    int status = ce_os_process_a0->exec(buffer);
+    if (defines[0]) {
+        ce_buffer_printf(&buffer, a, " --define \"%s\"", defines);
+    }
+
+    ce_buffer_printf(&buffer, a, " 2>&1"); // TODO: move to exec
+
+    int status = ct_resource_compiler_a0->external_exec(buffer);
 
     ce_log_a0->debug("shaderc", "STATUS %d", status);
 
+    ce_buffer_free(buffer, a);
+
     return status;
 }
 
-static int _gen_tmp_name(char *tmp_filename,
-                         const char *tmp_dir,
-                         size_t max_len,
-                         const char *filename) {
+// Hash file and files it includes, relative to it or include dir. Read
+// files are pushed to files.
+static uint64_t _hash_source(const char *path,
+                             const char *include_dir,
+                             ce_hash_t *visited,
+                             char ***files,
+                             uint64_t hash) {
+    ce_alloc_t0 *a = ce_memory_a0->system;
+
+    uint64_t path_id = ce_hash_murmur2_64(path, strlen(path), 0);
+    if (ce_hash_contain(visited, path_id)) {
+        return hash;
+    }
+    ce_hash_add(visited, path_id, path_id, a);
+
+    uint64_t size = 0;
+    char *data = ct_resource_compiler_a0->read_file(a, path, &size);
+
+    if (!data) {
+        return hash;
+    }
+
+    ce_array_push(*files, ce_memory_a0->str_dup(path, a), a);
+
+    hash = ce_hash_murmur2_64(data, size, hash);
+
+    char dir[1024] = {};
+    ce_os_path_a0->dir(dir, path);
+
+    for (const char *it = strstr(data, "#include"); it;
+         it = strstr(it + 1, "#include")) {
+        const char *begin = it + strlen("#include");
+        while ((*begin == ' ') || (*begin == '\t')) {
+            ++begin;
+        }
+
+        if ((*begin != '"') && (*begin != '<')) {
+            continue;
+        }
+
+        const char end_ch = (*begin == '"') ? '"' : '>';
+        const char *end = strchr(++begin, end_ch);
+
+        if (!end || ((end - begin) >= 1024) || memchr(begin, '\n', end - begin)) {
+            continue;
+        }
+
+        char name[1024] = {};
+        memcpy(name, begin, end - begin);
+
+        char *include_path = NULL;
+        ce_os_path_a0->join(&include_path, a, 2, dir, name);
+
+        ce_vio_t0 *include_file = ce_os_vio_a0->from_file(include_path,
+                                                          VIO_OPEN_READ);
+        if (include_file) {
+            ce_os_vio_a0->close(include_file);
+        } else {
+            ce_buffer_clear(include_path);
+            ce_os_path_a0->join(&include_path, a, 2, include_dir, name);
+        }
+
+        hash = _hash_source(include_path, include_dir, visited, files, hash);
+
+        ce_buffer_free(include_path, a);
+    }
+
+    CE_FREE(a, data);
+
+    return hash;
+}
+
+typedef struct shader_stage_t {
+    const char *input_path;
+    const char *include_dir;
+    const char *type;
+    const char *platform;
+    const char *profile;
+    const char *defines;
+
+    // Source, include closure and varying def.
+    char **files;
+
+    char *data;
+    uint64_t size;
+} shader_stage_t;
+
+static int _run_shaderc(const char *output,
+                        void *data) {
+    shader_stage_t *stage = data;
+    return _shaderc(stage->input_path, output, stage->include_dir,
+                    stage->type, stage->platform, stage->profile,
+                    stage->defines);
+}
 
+// Output is cached by hash of source, include closure, varying def, stage
+// options and defines. Platform is part of cache path.
+static void _compile_stage(void *data) {
+    shader_stage_t *stage = data;
     ce_alloc_t0 *a = ce_memory_a0->system;
 
+    ce_hash_t visited = {};
+
+    uint64_t key = _hash_source(stage->input_path, stage->include_dir,
+                                &visited, &stage->files, 0);
+
+    // shaderc use varying.def.sc next to input.
     char dir[1024] = {};
-    ce_os_path_a0->dir(dir, filename);
+    ce_os_path_a0->dir(dir, stage->input_path);
 
-    char *tmp_dirname = NULL;
-    ce_os_path_a0->join(&tmp_dirname, a, 2, tmp_dir, dir);
+    char *varying_path = NULL;
+    ce_os_path_a0->join(&varying_path, a, 2, dir, "varying.def.sc");
+    key = _hash_source(varying_path, stage->include_dir, &visited,
+                       &stage->files, key);
+    ce_buffer_free(varying_path, a);
 
-    ce_os_path_a0->make_path(tmp_dirname);
+    ce_hash_free(&visited, a);
 
-    int ret = snprintf(tmp_filename, max_len, "%s/%s.shaderc", tmp_dirname,
-                       ce_os_path_a0->filename(filename));
-    ce_buffer_free(tmp_dirname, a);
+    const char *options[] = {stage->type, stage->profile, stage->defines};
+    for (uint32_t i = 0; i < CE_ARRAY_LEN(options); ++i) {
+        key = ce_hash_murmur2_64(options[i], strlen(options[i]) + 1, key);
+    }
 
-    return ret;
+    stage->data = ct_resource_compiler_a0->cached_exec(a, stage->platform,
+                                                       key, "shaderc",
+                                                       _run_shaderc, stage,
+                                                       &stage->size);
 }
 
 
@@ -132,6 +252,7 @@ static bool _compile(ce_cdb_t0 db,
 
     const char *vs_input = ce_cdb_a0->read_str(reader, SHADER_VS_INPUT, "");
     const char *fs_input = ce_cdb_a0->read_str(reader, SHADER_FS_INPUT, "");
+    const char *defines = ce_cdb_a0->read_str(reader, SHADER_DEFINES, "");
 
     ce_alloc_t0 *a = ce_memory_a0->system;
 
@@ -142,95 +263,115 @@ static bool _compile(ce_cdb_t0 db,
     const char *core_dir = ce_cdb_a0->read_str(c_reader, CONFIG_CORE,
                                                "");
 
-    ce_cdb_obj_o0 *w = ce_cdb_a0->write_begin(db, obj);
-
-    char *include_dir = NULL;
-    ce_os_path_a0->join(&include_dir, a, 2, core_dir, "bgfxshaders");
-
-    // TODO: temp ce_alloc_t0?
-    char output_path[1024] = {};
-    char tmp_filename[1024] = {};
-
-
     const char *platform;
     platform = ce_cdb_a0->read_str(c_reader, CONFIG_PLATFORM, "");
 
-    char *tmp_dir = ct_resource_compiler_a0->get_tmp_dir(a, platform);
-
-    //////// VS
-//    compilator_api->add_dependency(filename, vs_input);
-
-    char *input_path = NULL;
-    ce_os_path_a0->join(&input_path, a, 2, source_dir, vs_input);
-
-    _gen_tmp_name(output_path, tmp_dir,
-                  CE_ARRAY_LEN(tmp_filename), vs_input);
-
-    int result = _shaderc(input_path, output_path, include_dir, "vertex",
-                          platform, vs_profile);
-
-    ce_buffer_free(input_path, a);
+    char *include_dir = NULL;
+    ce_os_path_a0->join(&include_dir, a, 2, core_dir, "bgfxshaders");
 
-    if (result != 0) {
-        ce_buffer_free(include_dir, a);
-        return false;
+    ct_resource_compiler_a0->add_dependency(vs_input);
+    ct_resource_compiler_a0->add_dependency(fs_input);
+
+    char *vs_path = NULL;
+    ce_os_path_a0->join(&vs_path, a, 2, source_dir, vs_input);
+
+    char *fs_path = NULL;
+    ce_os_path_a0->join(&fs_path, a, 2, source_dir, fs_input);
+
+    shader_stage_t stages[] = {
+            {
+                    .input_path = vs_path,
+                    .include_dir = include_dir,
+                    .type = "vertex",
+                    .platform = platform,
+                    .profile = vs_profile,
+                    .defines = defines,
+            },
+            {
+                    .input_path = fs_path,
+                    .include_dir = include_dir,
+                    .type = "fragment",
+                    .platform = platform,
+                    .profile = fs_profile,
+                    .defines = defines,
+            },
+    };
+
+    // Stages compile at once, shaders and permutations are already
+    // compiled in parallel by resource compiler.
+    ce_task_item_t0 tasks[CE_ARRAY_LEN(stages)];
+    for (uint32_t i = 0; i < CE_ARRAY_LEN(stages); ++i) {
+        tasks[i] = (ce_task_item_t0) {
+                .name = "shader_stage",
+                .work = _compile_stage,
+                .data = &stages[i],
+        };
     }
 
+    ce_task_counter_t0 *counter = NULL;
+    ce_task_a0->add(tasks, CE_ARRAY_LEN(tasks), &counter);
+    ce_task_a0->wait_for_counter(counter, 0);
 
-    ce_vio_t0 *tmp_file;
-
-    do {
-        tmp_file = ce_os_vio_a0->from_file(output_path, VIO_OPEN_READ);
-    } while (tmp_file == NULL);
+    // Report includes on compile thread, they are under source dir or
+    // external like core shaders.
+    const uint32_t source_dir_len = strlen(source_dir);
 
+    ce_hash_t reported = {};
+    ce_hash_add(&reported, ce_id_a0->id64(vs_input), 1, a);
+    ce_hash_add(&reported, ce_id_a0->id64(fs_input), 1, a);
 
-    char *vs_data = CE_ALLOC(ce_memory_a0->system, char,
-                             tmp_file->vt->size(tmp_file->inst) + 1);
+    for (uint32_t i = 0; i < CE_ARRAY_LEN(stages); ++i) {
+        const uint32_t files_n = ce_array_size(stages[i].files);
+        for (uint32_t j = 0; j < files_n; ++j) {
+            char *file = stages[i].files[j];
+            const char *filename = file;
 
-    uint64_t vs_data_size = tmp_file->vt->size(tmp_file->inst);
-    tmp_file->vt->read(tmp_file->inst, vs_data, sizeof(char), vs_data_size);
-    ce_os_vio_a0->close(tmp_file);
+            if (source_dir_len
+                && !strncmp(file, source_dir, source_dir_len)
+                && (file[source_dir_len] == '/')) {
+                filename = file + source_dir_len + 1;
+            }
 
-    ce_cdb_a0->set_blob(w, SHADER_VS_DATA, vs_data, vs_data_size);
+            uint64_t id = ce_id_a0->id64(filename);
+            if (!ce_hash_contain(&reported, id)) {
+                ce_hash_add(&reported, id, 1, a);
+                ct_resource_compiler_a0->add_dependency(filename);
+            }
 
-    ///////
+            CE_FREE(a, file);
+        }
 
-    //////// FS
-//    compilator_api->add_dependency(filename, fs_input);
-    ce_buffer_clear(input_path);
+        ce_array_free(stages[i].files, a);
+    }
 
-    ce_os_path_a0->join(&input_path, a, 2, source_dir, fs_input);
+    ce_hash_free(&reported, a);
 
-    _gen_tmp_name(output_path, tmp_dir, CE_ARRAY_LEN(tmp_filename),
-                  fs_input);
+    ce_buffer_free(fs_path, a);
+    ce_buffer_free(vs_path, a);
+    ce_buffer_free(include_dir, a);
 
-    result = _shaderc(input_path, output_path,
-                      include_dir, "fragment",
-                      platform, fs_profile);
+    shader_stage_t *vs = &stages[0];
+    shader_stage_t *fs = &stages[1];
 
-    ce_buffer_free(input_path, a);
+    bool ok = vs->data && fs->data;
 
-    if (result != 0) {
-        ce_buffer_free(include_dir, a);
-        return false;
+    if (ok) {
+        ce_cdb_obj_o0 *w = ce_cdb_a0->write_begin(db, obj);
+        ce_cdb_a0->set_blob(w, SHADER_VS_DATA, vs->data, vs->size);
+        ce_cdb_a0->set_blob(w, SHADER_FS_DATA, fs->data, fs->size);
+        ce_cdb_a0->write_commit(w);
+    } else {
+        ce_log_a0->error(LOG_WHERE, "Could not compile shader %s %s",
+                         vs_input, fs_input);
     }
 
-    tmp_file = ce_os_vio_a0->from_file(output_path, VIO_OPEN_READ);
-    char *fs_data = CE_ALLOC(ce_memory_a0->system, char,
-                             tmp_file->vt->size(tmp_file->inst) + 1);
-
-    uint64_t fs_data_size = tmp_file->vt->size(tmp_file->inst);
-    tmp_file->vt->read(tmp_file->inst, fs_data, sizeof(char), fs_data_size);
-    ce_os_vio_a0->close(tmp_file);
-
-    ce_cdb_a0->set_blob(w, SHADER_FS_DATA, fs_data, fs_data_size);
-    ce_cdb_a0->write_commit(w);
-
-    CE_FREE(a, vs_data);
-    CE_FREE(a, fs_data);
-    ce_buffer_free(include_dir, a);
+    for (uint32_t i = 0; i < CE_ARRAY_LEN(stages); ++i) {
+        if (stages[i].data) {
+            CE_FREE(a, stages[i].data);
+        }
+    }
 
-    return true;
+    return ok;
 }
 
 bool shader_compiler(ce_cdb_t0 db,
@@ -323,6 +464,7 @@ void CE_MODULE_LOAD(shader)(struct ce_api_a0 *api,
     CE_INIT_API(api, ce_id_a0);
     CE_INIT_API(api, ce_cdb_a0);
     CE_INIT_API(api, ct_renderer_a0);
+    CE_INIT_API(api, ce_task_a0);
 
     _G = (struct _G) {.allocator = ce_memory_a0->system};
 
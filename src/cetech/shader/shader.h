@@ -23,6 +23,10 @@ extern "C" {
 #define SHADER_FS_INPUT \
     CE_ID64_0("fs_input", 0x7ed33aaa3bf6f312ULL)
 
+// Permutation, semicolon separated shaderc defines.
+#define SHADER_DEFINES \
+    CE_ID64_0("defines", 0xe7420a90176aad43ULL)
+
 #define SHADER_VS_DATA \
     CE_ID64_0("vs_data", 0xb2eef410e8bf776aULL)
 
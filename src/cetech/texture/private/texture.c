@@ -39,6 +39,9 @@
 #include <celib/os/process.h>
 #include <celib/os/vio.h>
 #include <celib/containers/hash.h>
+#include <celib/task.h>
+#include <celib/murmur.h>
+#include <stdatomic.h>
 
 
 //==============================================================================
@@ -46,10 +49,34 @@
 //==============================================================================
 
 #define _G TextureResourceGlobals
+#define LOG_WHERE "texture"
+
+// Editor recompile running on worker, result is swapped on main thread.
+typedef struct texture_job_t {
+    uint64_t obj;
+    char input[1024];
+    bool gen_mipmaps;
+    bool is_normalmap;
+
+    char *data;
+    uint64_t size;
+    bool ok;
+
+    atomic_bool done;
+    ce_task_counter_t0 *counter;
+} texture_job_t;
+
 struct _G {
     ce_alloc_t0 *allocator;
     ct_cdb_ev_queue_o0 *changed_obj_queue;
     ce_hash_t online_texture;
+
+    // obj -> job
+    ce_hash_t running;
+    texture_job_t **jobs;
+
+    uint64_t *pending;
+    ce_hash_t pending_set;
 } _G;
 
 typedef struct ct_texture_obj_t {
@@ -137,83 +164,102 @@ static int _texturec(const char *input,
 
     ce_buffer_printf(&buffer, alloc, " %s", "2>&1");
 
-    int status = ce_os_process_a0->exec(buffer);
+    int status = ct_resource_compiler_a0->external_exec(buffer);
+
+    ce_log_a0->info(LOG_WHERE, "STATUS %d", status);
 
-    ce_log_a0->info("application", "STATUS %d", status);
+    ce_buffer_free(buffer, alloc);
 
     return status;
 }
 
-static int _gen_tmp_name(char *tmp_filename,
-                         const char *tmp_dir,
-                         size_t max_len,
-                         const char *filename) {
+typedef struct texturec_args_t {
+    const char *input_path;
+    bool gen_mipmaps;
+    bool is_normalmap;
+} texturec_args_t;
+
+static int _run_texturec(const char *output,
+                         void *data) {
+    texturec_args_t *args = data;
+    return _texturec(args->input_path, output,
+                     args->gen_mipmaps, args->is_normalmap);
+}
+
+// Output is cached by source content and options, same texture is not
+// compiled again after rename, branch switch or undo.
+static char *_compile_data(const char *input,
+                           bool gen_mipmaps,
+                           bool is_normalmap,
+                           uint64_t *size) {
+    const ce_cdb_obj_o0 *c_reader = ce_cdb_a0->read(ce_cdb_a0->db(),
+                                                    ce_config_a0->obj());
 
     ce_alloc_t0 *a = ce_memory_a0->system;
 
-    char dir[1024] = {};
-    ce_os_path_a0->dir(dir, filename);
+    const char *platform = ce_cdb_a0->read_str(c_reader,
+                                               CONFIG_PLATFORM,
+                                               "");
+
+    const char *source_dir = ce_cdb_a0->read_str(c_reader,
+                                                 CONFIG_SRC, "");
+
+    char *input_path = NULL;
+    ce_os_path_a0->join(&input_path, a, 2, source_dir, input);
+
+    uint64_t source_size = 0;
+    char *source = ct_resource_compiler_a0->read_file(a, input_path,
+                                                      &source_size);
+
+    if (!source) {
+        ce_log_a0->error(LOG_WHERE, "Could not read %s", input_path);
+        ce_buffer_free(input_path, a);
+        return NULL;
+    }
 
-    char *tmp_dirname = NULL;
-    ce_os_path_a0->join(&tmp_dirname, a, 2, tmp_dir, dir);
+    uint64_t options = (gen_mipmaps ? 1 : 0) | (is_normalmap ? 2 : 0);
+    uint64_t key = ce_hash_murmur2_64(source, source_size, options);
+    CE_FREE(a, source);
 
-    ce_os_path_a0->make_path(tmp_dirname);
+    texturec_args_t args = {
+            .input_path = input_path,
+            .gen_mipmaps = gen_mipmaps,
+            .is_normalmap = is_normalmap,
+    };
 
-    int ret = snprintf(tmp_filename, max_len, "%s/%s.ktx",
-                       tmp_dirname, ce_os_path_a0->filename(filename));
+    char *data = ct_resource_compiler_a0->cached_exec(a, platform, key, "ktx",
+                                                      _run_texturec, &args,
+                                                      size);
 
-    ce_buffer_free(tmp_dirname, a);
+    ce_buffer_free(input_path, a);
 
-    return ret;
+    return data;
 }
 
 static bool _compile(ce_cdb_t0 db,
                      uint64_t obj) {
     const ce_cdb_obj_o0 *reader = ce_cdb_a0->read(db, obj);
-    const ce_cdb_obj_o0 *c_reader = ce_cdb_a0->read(ce_cdb_a0->db(),
-                                                    ce_config_a0->obj());
 
     const char *input = ce_cdb_a0->read_str(reader, TEXTURE_INPUT, "");
     bool gen_mipmaps = ce_cdb_a0->read_bool(reader, TEXTURE_GEN_MIPMAPS, false);
     bool is_normalmap = ce_cdb_a0->read_bool(reader, TEXTURE_IS_NORMALMAP,
                                              false);
 
-    ce_alloc_t0 *a = ce_memory_a0->system;
-
-    const char *platform = ce_cdb_a0->read_str(c_reader,
-                                               CONFIG_PLATFORM,
-                                               "");
-
-    char output_path[1024] = {};
-    char tmp_filename[1024] = {};
-
-    const char *source_dir = ce_cdb_a0->read_str(c_reader,
-                                                 CONFIG_SRC, "");
-
-    char *tmp_dir = ct_resource_compiler_a0->get_tmp_dir(a, platform);
-    char *input_path = NULL;
-    ce_os_path_a0->join(&input_path, a, 2, source_dir, input);
+    ct_resource_compiler_a0->add_dependency(input);
 
-    _gen_tmp_name(output_path, tmp_dir, CE_ARRAY_LEN(tmp_filename),
-                  input);
+    uint64_t size = 0;
+    char *data = _compile_data(input, gen_mipmaps, is_normalmap, &size);
 
-    int result = _texturec(input_path, output_path, gen_mipmaps, is_normalmap);
-    if (result != 0) {
+    if (!data) {
         return false;
     }
 
-    ce_vio_t0 *tmp_file = NULL;
-    tmp_file = ce_os_vio_a0->from_file(output_path, VIO_OPEN_READ);
-
-    const uint64_t size = tmp_file->vt->size(tmp_file->inst);
-    char *tmp_data = CE_ALLOC(ce_memory_a0->system, char, size + 1);
-    tmp_file->vt->read(tmp_file->inst, tmp_data, sizeof(char), size);
-    ce_os_vio_a0->close(tmp_file);
-
     ce_cdb_obj_o0 *w = ce_cdb_a0->write_begin(db, obj);
-    ce_cdb_a0->set_blob(w, TEXTURE_DATA, tmp_data, size);
+    ce_cdb_a0->set_blob(w, TEXTURE_DATA, data, size);
     ce_cdb_a0->write_commit(w);
 
+    CE_FREE(ce_memory_a0->system, data);
+
     return true;
 }
 
@@ -338,6 +384,133 @@ static uint64_t *update_after(uint64_t *n) {
     return a;
 }
 
+static void _add_pending(uint64_t obj) {
+    if (ce_hash_contain(&_G.pending_set, obj)) {
+        return;
+    }
+
+    ce_array_push(_G.pending, obj, _G.allocator);
+    ce_hash_add(&_G.pending_set, obj, obj, _G.allocator);
+}
+
+static void _job_task(void *data) {
+    texture_job_t *job = data;
+
+    // Job can run over frame end, keep config object alive over gc.
+    ce_cdb_a0->read_pin();
+
+    job->data = _compile_data(job->input, job->gen_mipmaps, job->is_normalmap,
+                              &job->size);
+    job->ok = job->data != NULL;
+
+    ce_cdb_a0->read_unpin();
+
+    atomic_store(&job->done, true);
+}
+
+static void _free_job(texture_job_t *job) {
+    if (job->data) {
+        CE_FREE(ce_memory_a0->system, job->data);
+    }
+
+    CE_FREE(_G.allocator, job);
+}
+
+// Swap textures that are ready, old one is used until then.
+static void _finish_jobs() {
+    uint32_t alive_n = 0;
+
+    const uint32_t jobs_n = ce_array_size(_G.jobs);
+    for (uint32_t i = 0; i < jobs_n; ++i) {
+        texture_job_t *job = _G.jobs[i];
+
+        if (!atomic_load(&job->done)) {
+            _G.jobs[alive_n++] = job;
+            continue;
+        }
+
+        ce_task_a0->wait_for_counter_no_work(job->counter, 0);
+        ce_hash_remove(&_G.running, job->obj);
+
+        if (!job->ok) {
+            ce_log_a0->error(LOG_WHERE, "Could not compile texture %s",
+                             job->input);
+        } else if (ce_hash_contain(&_G.online_texture, job->obj)) {
+            texture_offline(job->obj);
+
+            ce_cdb_obj_o0 *w = ce_cdb_a0->write_begin(ce_cdb_a0->db(), job->obj);
+            ce_cdb_a0->set_blob(w, TEXTURE_DATA, job->data, job->size);
+            ce_cdb_a0->write_commit(w);
+
+            texture_online(job->obj);
+        }
+
+        _free_job(job);
+    }
+
+    ce_array_resize(_G.jobs, alive_n, _G.allocator);
+}
+
+static void _dispatch_jobs() {
+    const ce_cdb_obj_o0 *c_reader = ce_cdb_a0->read(ce_cdb_a0->db(),
+                                                    ce_config_a0->obj());
+    uint32_t max_jobs = ce_cdb_a0->read_uint64(c_reader, CONFIG_EXTERNAL_JOBS, 4);
+    if (!max_jobs) {
+        max_jobs = 1;
+    }
+
+    uint32_t left_n = 0;
+
+    const uint32_t pending_n = ce_array_size(_G.pending);
+    for (uint32_t i = 0; i < pending_n; ++i) {
+        uint64_t obj = _G.pending[i];
+
+        // Changed while compiling, compile again when it is done.
+        if ((ce_array_size(_G.jobs) >= max_jobs)
+            || ce_hash_contain(&_G.running, obj)) {
+            _G.pending[left_n++] = obj;
+            continue;
+        }
+
+        ce_hash_remove(&_G.pending_set, obj);
+
+        if (!ce_hash_contain(&_G.online_texture, obj)) {
+            continue;
+        }
+
+        const ce_cdb_obj_o0 *reader = ce_cdb_a0->read(ce_cdb_a0->db(), obj);
+
+        texture_job_t *job = CE_ALLOC(_G.allocator, texture_job_t,
+                                      sizeof(texture_job_t));
+
+        *job = (texture_job_t) {
+                .obj = obj,
+                .gen_mipmaps = ce_cdb_a0->read_bool(reader, TEXTURE_GEN_MIPMAPS,
+                                                    false),
+                .is_normalmap = ce_cdb_a0->read_bool(reader,
+                                                     TEXTURE_IS_NORMALMAP,
+                                                     false),
+        };
+
+        snprintf(job->input, CE_ARRAY_LEN(job->input), "%s",
+                 ce_cdb_a0->read_str(reader, TEXTURE_INPUT, ""));
+        atomic_init(&job->done, false);
+
+        ce_array_push(_G.jobs, job, _G.allocator);
+        ce_hash_add(&_G.running, obj, (uint64_t) job, _G.allocator);
+
+        ce_task_item_t0 task = {
+                .name = "texture_compile",
+                .work = _job_task,
+                .data = job,
+        };
+
+        ce_task_a0->add(&task, 1, &job->counter);
+    }
+
+    ce_array_resize(_G.pending, left_n, _G.allocator);
+}
+
 static void _update(float dt) {
     ce_cdb_prop_ev_t0 ev = {};
 
@@ -345,15 +518,23 @@ static void _update(float dt) {
     ce_hash_t obj_set = {};
 
     while (ce_cdb_a0->pop_objs_events(_G.changed_obj_queue, &ev)) {
-        if (!ce_hash_contain(&_G.online_texture, ev.obj)) {
+        if (ev.ev_type == CE_CDB_RESYNC_EVENT) {
+            for (uint32_t i = 0; i < _G.online_texture.n; ++i) {
+                uint64_t obj = _G.online_texture.keys[i];
+
+                if ((obj == EMPTY_SLOT) || (obj == DELETE_SLOT)) {
+                    continue;
+                }
+
+                if (!ce_hash_contain(&obj_set, obj)) {
+                    ce_array_push(to_compile_obj, obj, _G.allocator);
+                    ce_hash_add(&obj_set, obj, obj, _G.allocator);
+                }
+            }
             continue;
         }
 
-        if (ev.prop == TEXTURE_DATA) {
-            continue;
-        }
-
-        if (ev.prop == TEXTURE_HANDLER_PROP) {
+        if (!ce_hash_contain(&_G.online_texture, ev.obj)) {
             continue;
         }
 
@@ -367,14 +548,14 @@ static void _update(float dt) {
 
     uint32_t n = ce_array_size(to_compile_obj);
     for (int i = 0; i < n; ++i) {
-        uint64_t obj = to_compile_obj[i];
-        texture_offline(obj);
-        _compile(ce_cdb_a0->db(), obj);
-        texture_online(obj);
+        _add_pending(to_compile_obj[i]);
     }
 
     ce_hash_free(&obj_set, _G.allocator);
     ce_array_free(to_compile_obj, _G.allocator);
+
+    _finish_jobs();
+    _dispatch_jobs();
 }
 
 static struct ct_kernel_task_i0 texture_task = {
@@ -384,6 +565,22 @@ static struct ct_kernel_task_i0 texture_task = {
 };
 
 
+static const uint64_t _listen_types[] = {TEXTURE_TYPE};
+
+// compiled data and handler are written by texture itself
+static const uint64_t _listen_props[] = {
+        TEXTURE_INPUT,
+        TEXTURE_GEN_MIPMAPS,
+        TEXTURE_IS_NORMALMAP,
+};
+
+static const ce_cdb_listener_filter_t0 _listen_filter = {
+        .types = _listen_types,
+        .types_n = CE_ARRAY_LEN(_listen_types),
+        .props = _listen_props,
+        .props_n = CE_ARRAY_LEN(_listen_props),
+};
+
 static const ce_cdb_prop_def_t0 texture_prop[] = {
         {.name = "asset_name", .type = CDB_TYPE_STR},
         {.name = "input", .type = CDB_TYPE_STR},
@@ -398,7 +595,8 @@ void CE_MODULE_LOAD(texture)(struct ce_api_a0 *api,
 
     _G = (struct _G) {
             .allocator = ce_memory_a0->system,
-            .changed_obj_queue = ce_cdb_a0->new_objs_listener(ce_cdb_a0->db()),
+            .changed_obj_queue = ce_cdb_a0->new_objs_listener_filter(ce_cdb_a0->db(),
+                                                                     &_listen_filter),
     };
 
     CE_UNUSED(reload);
@@ -408,6 +606,7 @@ void CE_MODULE_LOAD(texture)(struct ce_api_a0 *api,
     CE_INIT_API(api, ce_id_a0);
     CE_INIT_API(api, ce_cdb_a0);
     CE_INIT_API(api, ct_renderer_a0);
+    CE_INIT_API(api, ce_task_a0);
 
     api->register_api(CT_TEXTURE_API, &texture_api, sizeof(texture_api));
 
@@ -426,6 +625,18 @@ void CE_MODULE_UNLOAD(texture)(struct ce_api_a0 *api,
     CE_UNUSED(reload);
     CE_UNUSED(api);
 
+    const uint32_t jobs_n = ce_array_size(_G.jobs);
+    for (uint32_t i = 0; i < jobs_n; ++i) {
+        ce_task_a0->wait_for_counter(_G.jobs[i]->counter, 0);
+        _free_job(_G.jobs[i]);
+    }
+
+    ce_array_free(_G.jobs, _G.allocator);
+    ce_array_free(_G.pending, _G.allocator);
+    ce_hash_free(&_G.running, _G.allocator);
+    ce_hash_free(&_G.pending_set, _G.allocator);
+    ce_hash_free(&_G.online_texture, _G.allocator);
+
     _G = (struct _G) {
             .allocator = ce_memory_a0->system,
     };